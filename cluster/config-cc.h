@@ -67,6 +67,7 @@
 #define INCLUDE_CONFIG_CC_H
 
 #include "stats.h"
+#include "fs_emitter.h"
 
 configEntry configKeysRestartCC[] = {
     {"DISABLE_TUNNELING", "N"}
@@ -83,6 +84,8 @@ configEntry configKeysRestartCC[] = {
     ,
     {"SCHEDPOLICY", "ROUNDROBIN"}
     ,
+    {"SCHED_ANTI_AFFINITY", "N"}
+    ,
     {"VNET_ADDRSPERNET", NULL}
     ,
     {"VNET_BRIDGE", NULL}
@@ -127,6 +130,8 @@ configEntry configKeysRestartCC[] = {
     ,
     {"CC_IMAGE_PROXY_CACHE_SIZE", "32768"}
     ,
+    {"CC_IMAGE_PROXY_MAX_DOWNLOADS", "4"}
+    ,
     {"CC_IMAGE_PROXY_PATH", NULL}
     ,
     {"MAX_INSTANCES_PER_CC", NULL}
@@ -154,8 +159,14 @@ configEntry configKeysNoRestartCC[] = {
     ,
     {"LOGFACILITY", ""}
     ,
+    {"LOGASYNC", "N"}
+    ,
     {SENSOR_LIST_CONF_PARAM_NAME, SENSOR_LIST_CONF_PARAM_DEFAULT}
     ,
+    {OUTPUT_MODE_CONFIG_NAME, OUTPUT_MODE_CONFIG_DEFAULT}
+    ,
+    {OUTPUT_MAX_BYTES_CONFIG_NAME, OUTPUT_MAX_BYTES_CONFIG_DEFAULT}
+    ,
     {NULL, NULL}
     ,
 };
@@ -87,6 +87,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <signal.h>
+#include <errno.h>
 #include <math.h>
 #include <assert.h>
 #include <json/json.h>
@@ -120,6 +121,7 @@
 #include <message_stats.h>
 #include <message_sensor.h>
 #include <service_sensor.h>
+#include <counter_sensor.h>
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -131,6 +133,23 @@
 #define POLL_INTERVAL_MINIMUM_SEC                6
 #define STATS_INTERVAL_SEC                       60
 
+//! @{
+//! @name capacity dimensions used by the BINPACK scheduler
+#define SCHED_DIM_MEMORY                          0
+#define SCHED_DIM_DISK                            1
+#define SCHED_DIM_CORES                           2
+#define SCHED_DIMS                                3
+//! @}
+
+//! @{
+//! @name states of an instance being run by doRunInstances()
+#define RUNSLOT_FAILED                            0 //!< could not be set up or scheduled, given up on
+#define RUNSLOT_PENDING                           1 //!< waiting to be scheduled on a node
+#define RUNSLOT_DISPATCHED                        2 //!< scheduled, being sent to its node
+#define RUNSLOT_RUNNING                           3 //!< accepted by its node
+#define RUNSLOT_DONE                              4 //!< accepted and recorded in the instance cache
+//! @}
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  TYPEDEFS                                  |
@@ -149,6 +168,39 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! Rank of a resource in the capacity index, the lowest one gets the next VM
+typedef struct ccCapacityEntry_t {
+    int resid;                         //!< resource cache index of the resource
+    int asleep;                        //!< set if the resource must be woken up first
+    int placed;                        //!< instances of the reservation already placed there (0 without SCHED_ANTI_AFFINITY)
+    double score;                      //!< capacity left over, relative to the total, once the VM is placed
+} ccCapacityEntry;
+
+//! Capacity index over the resource cache used by the BINPACK scheduler. It is built for the VM
+//! type of one reservation and holds the resources that can take one more such VM in a binary
+//! min-heap ordered by rank. Placing a VM only changes the rank of the resource it goes to, so
+//! each placement is a pop and, if the resource still has room, a push: O(log n).
+typedef struct ccCapacityIndex_t {
+    virtualMachine vm;                 //!< the VM type being placed
+    boolean antiAffinity;              //!< SCHED_ANTI_AFFINITY at the time the index was built
+    int numResources;                  //!< number of schedulable resources when the index was built
+    int heapLen;                       //!< number of resources in the heap
+    ccCapacityEntry heap[MAXNODES];    //!< resources able to fit the VM
+    int avail[MAXNODES][SCHED_DIMS];   //!< remaining capacity of each resource (indexed by resource cache index)
+    int max[MAXNODES][SCHED_DIMS];     //!< total capacity of each resource (indexed by resource cache index)
+    int asleep[MAXNODES];              //!< set if the resource must be woken up first
+    int placed[MAXNODES];              //!< number of instances of the reservation placed on each resource
+} ccCapacityIndex;
+
+//! Progress of one instance of a reservation being run by doRunInstances()
+typedef struct ccRunSlot_t {
+    char instId[16];                   //!< instance identifier
+    char uuid[48];                     //!< instance UUID
+    netConfig ncnet;                   //!< primary network interface of the instance
+    int resid;                         //!< resource cache index of the node it is sent to, -1 if not scheduled
+    int state;                         //!< one of the RUNSLOT_* states
+} ccRunSlot;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXTERNAL VARIABLES                             |
@@ -184,9 +236,8 @@ globalNetworkInfo *globalnetworkinfo = NULL;
 ccResourceCache *resourceCache = NULL; // canonical source for latest information about resources
 ccResourceCache *resourceCacheStage = NULL; // clone of resourceCache used for aggregating replies from NCs (via child procs)
 sensorResourceCache *ccSensorResourceCache = NULL;  // canonical source for latest sensor data, both local and from NCs
-char *message_stats_shared_mem = NULL; //Reference to the shared memory region
-char message_stats_cache[MESSAGE_STATS_MEMORY_REGION_SIZE]; //The proc local holder for cached copies of message_stats_shared_mem to avoid realloc for each cache copy.
-json_object *stats_cache_json = NULL;  //! Pointer to parsed stats from the cache
+ccImageCache *imageCache = NULL;       // index of the images in the CC image proxy cache
+message_stats_table *message_stats_shared_mem = NULL; //Reference to the shared memory region holding the message counters
 
 //! @}
 
@@ -206,6 +257,7 @@ char *SCHEDPOLICIES[SCHEDLAST] = {
     "ROUNDROBIN",
     "POWERSAVE",
     "USER",
+    "BINPACK",
 };
 
 /*----------------------------------------------------------------------------*\
@@ -225,11 +277,26 @@ static void refresh_resourceCache(ccResourceCache * updatedResourceCache, boolea
 
 static int schedule_instance_migration(ncInstance * instance, char **includeNodes, char **excludeNodes, int includeNodeCount, int excludeNodeCount, int inresid, int *outresid,
                                        ccResourceCache * resourceCacheLocal, char **replyString);
+static int capacity_entry_compare(const void *a, const void *b);
+static boolean capacity_index_rank(ccCapacityIndex * index, int resid, ccCapacityEntry * entry);
+static void capacity_index_push(ccCapacityIndex * index, ccCapacityEntry * entry);
+static void capacity_index_pop(ccCapacityIndex * index);
+static ccCapacityIndex *capacity_index_build(virtualMachine * vm);
+static int capacity_index_place(ccCapacityIndex * index);
+static int resource_fits(ccResource * res, virtualMachine * vm);
+static int image_cache_fetch(char *id, char *url, long long *bytes);
+static void image_cache_remove(ccImage * image);
+static int image_cache_scan(void);
+static json_object *image_cache_counters(void);
+static int build_image_peer_hints(ccResourceCache * cache, int resid, char ***outHints, int *outHintsLen);
+static void dispatch_run_instances(ncMetadata * pMeta, ccRunSlot * runSlots, int numSlots, char *reservationId, virtualMachine * ncvm, char *amiId,
+                                   char *amiURL, char *kernelId, char *kernelURL, char *ramdiskId, char *ramdiskURL, char *ownerId, char *accountId,
+                                   char *keyName, char *userData, char *credential, char *launchIndex, char *platform, int expiryTime, char **netNames,
+                                   int netNamesLen, char *rootDirective, char **netIds, int netIdsLen, netConfig * secNetCfgs, int secNetCfgsLen);
 static int migration_handler(ccInstance * myInstance, char *host, char *src, char *dst, migration_states migration_state, char **node, char **instance, char **action);
 static int populateOutboundMeta(ncMetadata * pMeta);
 static int initialize_stats_system(int interval_sec);
-static json_object **message_stats_getter();
-static void message_stats_setter();
+static message_stats_table *message_stats_getter();
 static char *stats_service_check_call();
 static char *stats_service_state_call();
 static void lock_stats();
@@ -311,19 +378,20 @@ static int initialize_stats_system(int interval_sec)
 
     lock_stats();
     {
-        //Zero the cache location
-        bzero(message_stats_cache, MESSAGE_STATS_MEMORY_REGION_SIZE);
-
         //Init the message sensor with component-specific data
-        ret = initialize_message_sensor(euca_this_component_name, interval_sec, stats_ttl, message_stats_getter, message_stats_setter);
+        ret = initialize_message_sensor(euca_this_component_name, interval_sec, stats_ttl, message_stats_getter);
         if (ret != EUCA_OK) {
             LOGERROR("Error initializing internal message sensor: %d\n", ret);
             goto cleanup;
         } else {
-            json_object **tmp = message_stats_getter();
-            const char *tmp_out = json_object_to_json_string(*tmp);
-            LOGINFO("Initialized internal message stats: %s\n", tmp_out);
+            LOGINFO("Initialized internal message stats\n");
+        }
 
+        //Init the counter sensor with the image proxy cache counters
+        ret = initialize_counter_sensor(euca_this_component_name, interval_sec, stats_ttl, image_cache_counters);
+        if (ret != EUCA_OK) {
+            LOGERROR("Error initializing internal counter sensor: %d\n", ret);
+            goto cleanup;
         }
 
         //Init the service state sensor with component-specific data
@@ -928,11 +996,14 @@ int ncClientCall(ncMetadata * pMeta, int timeout, int ncLock, char *ncURL, char
             }
         } else if (!strcmp(ncOp, "ncDescribeResource")) {
             char *resourceType = va_arg(al, char *);
+            char **imagePeers = va_arg(al, char **);
+            int imagePeersLen = va_arg(al, int);
             ncResource **outRes = va_arg(al, ncResource **);
             char **errMsg = va_arg(al, char **);
 
-            LOGTRACE("\tcalling ncDescribeResourceStub with resourceType=%s outRes=%lx errMsg=%lx\n", resourceType, (unsigned long)outRes, (unsigned long)errMsg);
-            rc = ncDescribeResourceStub(ncs, localmeta, resourceType, outRes);
+            LOGTRACE("\tcalling ncDescribeResourceStub with resourceType=%s imagePeersLen=%d outRes=%lx errMsg=%lx\n", resourceType, imagePeersLen, (unsigned long)outRes,
+                     (unsigned long)errMsg);
+            rc = ncDescribeResourceStub(ncs, localmeta, resourceType, imagePeers, imagePeersLen, outRes);
             LOGTRACE("\tcalled  ncDescribeResourceStub, rc = %d, timeout = %d\n", rc, timeout);
             if (timeout && outRes) {
                 if (!rc && *outRes) {
@@ -1016,6 +1087,27 @@ int ncClientCall(ncMetadata * pMeta, int timeout, int ncLock, char *ncURL, char
         } else if (!strcmp(ncOp, "ncModifyNode")) {
             char *stateName = va_arg(al, char *);
             rc = ncModifyNodeStub(ncs, localmeta, stateName);
+        } else if (!strcmp(ncOp, "ncPrewarmImages")) {
+            virtualBootRecord *images = va_arg(al, virtualBootRecord *);
+            int imagesLen = va_arg(al, int);
+            ncImageResidency **outResidency = va_arg(al, ncImageResidency **);
+
+            rc = ncPrewarmImagesStub(ncs, localmeta, images, imagesLen, outResidency);
+            if (timeout && outResidency) {
+                if (!rc && *outResidency) {
+                    len = sizeof(ncImageResidency);
+                    rc = write(filedes[1], &len, sizeof(int));
+                    rc = write(filedes[1], *outResidency, sizeof(ncImageResidency));
+                    rc = 0;
+                } else {
+                    len = 0;
+                    rc = write(filedes[1], &len, sizeof(int));
+                    rc = 1;
+                }
+            }
+
+            if (outResidency)
+                EUCA_FREE(*outResidency);
         } else if (!strcmp(ncOp, "ncMigrateInstances")) {
             ncInstance **instances = va_arg(al, ncInstance **);
             int instancesLen = va_arg(al, int);
@@ -1279,6 +1371,8 @@ int ncClientCall(ncMetadata * pMeta, int timeout, int ncLock, char *ncURL, char
             ncResource **outRes = NULL;
 
             resourceType = va_arg(al, char *);
+            va_arg(al, char **);       // imagePeers and imagePeersLen, only used by the child
+            va_arg(al, int);
             outRes = va_arg(al, ncResource **);
             errMsg = va_arg(al, char **);
             if (outRes) {
@@ -1361,6 +1455,33 @@ int ncClientCall(ncMetadata * pMeta, int timeout, int ncLock, char *ncURL, char
                     }
                 }
             }
+        } else if (!strcmp(ncOp, "ncPrewarmImages")) {
+            ncImageResidency **outResidency = NULL;
+
+            va_arg(al, virtualBootRecord *);    // images and imagesLen, only used by the child
+            va_arg(al, int);
+            outResidency = va_arg(al, ncImageResidency **);
+            if (outResidency) {
+                *outResidency = NULL;
+            }
+            if (timeout && outResidency) {
+                rbytes = timeread(filedes[0], &len, sizeof(int), timeout);
+                if (rbytes <= 0) {
+                    killwait(pid);
+                    opFail = 1;
+                } else if (len == sizeof(ncImageResidency)) {
+                    if ((*outResidency = EUCA_ZALLOC(1, sizeof(ncImageResidency))) == NULL) {
+                        LOGFATAL("out of memory! ncOps=%s\n", ncOp);
+                        unlock_exit(1);
+                    }
+                    rbytes = timeread(filedes[0], *outResidency, sizeof(ncImageResidency), timeout);
+                    if (rbytes <= 0) {
+                        killwait(pid);
+                        EUCA_FREE(*outResidency);
+                        opFail = 1;
+                    }
+                }
+            }
         } else if (!strcmp(ncOp, "ncMigrateInstances")) {
             READ_REPLY_STRING;
         } else if (!strcmp(ncOp, "ncStartInstance")) {
@@ -2271,8 +2392,11 @@ int refresh_resources(ncMetadata * pMeta, int timeout, int dolock)
 {
     int i, rc, nctimeout, pid, *pids = NULL;
     int status;
+    int imagePeersLen = 0;
+    char **imagePeers = NULL;
     time_t op_start;
     ncResource *ncResDst = NULL;
+    ccResourceCache *peerView = NULL;
 
     if (timeout <= 0)
         timeout = 1;
@@ -2283,6 +2407,10 @@ int refresh_resources(ncMetadata * pMeta, int timeout, int dolock)
     // critical NC call section
     sem_mywait(RESCACHE);
     memcpy(resourceCacheStage, resourceCache, sizeof(ccResourceCache));
+    // private snapshot to derive image peer hints from, the stage is rewritten by the children as they go
+    if ((peerView = EUCA_ALLOC(1, sizeof(ccResourceCache))) != NULL) {
+        memcpy(peerView, resourceCache, sizeof(ccResourceCache));
+    }
     sem_mypost(RESCACHE);
 
     sem_close(locks[REFRESHLOCK]);
@@ -2303,8 +2431,11 @@ int refresh_resources(ncMetadata * pMeta, int timeout, int dolock)
             if (resourceCacheStage->resources[i].state != RESASLEEP && resourceCacheStage->resources[i].running == 0) {
                 nctimeout = ncGetTimeout(op_start, timeout, 1, 1);
                 char *errMsg = NULL;
+                if (peerView) {
+                    build_image_peer_hints(peerView, i, &imagePeers, &imagePeersLen);
+                }
                 rc = ncClientCall(pMeta, nctimeout, resourceCacheStage->resources[i].lockidx, resourceCacheStage->resources[i].ncURL,
-                                  "ncDescribeResource", NULL, &ncResDst, &errMsg);
+                                  "ncDescribeResource", NULL, imagePeers, imagePeersLen, &ncResDst, &errMsg);
                 if (rc != 0) {
                     powerUp(&(resourceCacheStage->resources[i]));
 
@@ -2322,6 +2453,8 @@ int refresh_resources(ncMetadata * pMeta, int timeout, int dolock)
                         changeState(&(resourceCacheStage->resources[i]), RESDOWN);
                         resourceCacheStage->resources[i].ncState = NOTREADY;
                         resourceCacheStage->resources[i].migrationCapable = FALSE;
+                        resourceCacheStage->resources[i].imagePeerPort = 0;
+                        resourceCacheStage->resources[i].cachedImagesLen = 0;
                         euca_strncpy(resourceCacheStage->resources[i].nodeMessage, SP(errMsg), 1024);
                         LOGERROR("error message from ncDescribeResource: %s\n", resourceCacheStage->resources[i].nodeMessage);
                     }
@@ -2354,6 +2487,9 @@ int refresh_resources(ncMetadata * pMeta, int timeout, int dolock)
                     if (strlen(ncResDst->hypervisor)) {
                         euca_strncpy(resourceCacheStage->resources[i].hypervisor, ncResDst->hypervisor, 16);
                     }
+                    resourceCacheStage->resources[i].imagePeerPort = ncResDst->imagePeerPort;
+                    resourceCacheStage->resources[i].cachedImagesLen = MIN(ncResDst->cachedImagesLen, MAX_CACHED_IMAGES_ADVERTISED);
+                    memcpy(resourceCacheStage->resources[i].cachedImages, ncResDst->cachedImages, sizeof(ncResDst->cachedImages));
                     changeState(&(resourceCacheStage->resources[i]), RESUP);
                 }
                 if (errMsg != NULL) {
@@ -2376,6 +2512,11 @@ int refresh_resources(ncMetadata * pMeta, int timeout, int dolock)
             }
 
             EUCA_FREE(ncResDst);
+            for (int j = 0; j < imagePeersLen; j++) {
+                EUCA_FREE(imagePeers[j]);
+            }
+            EUCA_FREE(imagePeers);
+            EUCA_FREE(peerView);
             sem_mypost(REFRESHLOCK);
             exit(0);
         } else {
@@ -2412,11 +2553,84 @@ int refresh_resources(ncMetadata * pMeta, int timeout, int dolock)
     // does not change as part of the update)
     refresh_resourceCache(resourceCacheStage, FALSE);
 
+    EUCA_FREE(peerView);
     EUCA_FREE(pids);
     LOGTRACE("done\n");
     return (0);
 }
 
+//!
+//! Builds the "who has image X" hints for one node out of the images its
+//! peers reported in their last ncDescribeResource reply. Each hint reads
+//! "<artifact-id> <host>:<port>". Peers are visited starting right after
+//! the node itself so that different nodes are pointed at different holders
+//! of the same image first, and images the node already has are left out.
+//! The list starts with a "* <ip>" hint for every other node that is up:
+//! those are the only nodes the node will serve its own cache to.
+//!
+//! @param[in]  cache the resource cache snapshot to derive the hints from
+//! @param[in]  resid the index of the node the hints are for
+//! @param[out] outHints the list of hints (to be freed by the caller, each entry and the list)
+//! @param[out] outHintsLen the number of hints in the list
+//!
+//! @return EUCA_OK on success or EUCA_MEMORY_ERROR on failure
+//!
+static int build_image_peer_hints(ccResourceCache * cache, int resid, char ***outHints, int *outHintsLen)
+{
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    int imageHints = 0;
+    boolean have_it = FALSE;
+    char hint[CACHED_IMAGE_ID_SIZE + 300] = "";
+    ccResource *self = &(cache->resources[resid]);
+    ccResource *peer = NULL;
+
+    *outHints = NULL;
+    *outHintsLen = 0;
+
+    if ((*outHints = EUCA_ZALLOC(MAXNODES + MAX_IMAGE_PEER_HINTS, sizeof(char *))) == NULL) {
+        LOGERROR("out of memory\n");
+        return (EUCA_MEMORY_ERROR);
+    }
+
+    for (i = 1; i < cache->numResources; i++) {
+        peer = &(cache->resources[(resid + i) % cache->numResources]);
+        if ((peer->state != RESUP) || (peer->ip[0] == '\0'))
+            continue;
+
+        snprintf(hint, sizeof(hint), "* %s", peer->ip);
+        if (((*outHints)[*outHintsLen] = strdup(hint)) == NULL) {
+            LOGERROR("out of memory\n");
+            return (EUCA_MEMORY_ERROR);
+        }
+        (*outHintsLen)++;
+    }
+
+    for (i = 1; (i < cache->numResources) && (imageHints < MAX_IMAGE_PEER_HINTS); i++) {
+        peer = &(cache->resources[(resid + i) % cache->numResources]);
+        if ((peer->state != RESUP) || (peer->imagePeerPort <= 0))
+            continue;
+
+        for (j = 0; (j < peer->cachedImagesLen) && (imageHints < MAX_IMAGE_PEER_HINTS); j++) {
+            for (k = 0, have_it = FALSE; (k < self->cachedImagesLen) && !have_it; k++) {
+                have_it = (strcmp(self->cachedImages[k], peer->cachedImages[j]) == 0);
+            }
+            if (have_it)
+                continue;
+
+            snprintf(hint, sizeof(hint), "%s %s:%d", peer->cachedImages[j], ((peer->ip[0] != '\0') ? peer->ip : peer->hostname), peer->imagePeerPort);
+            if (((*outHints)[*outHintsLen] = strdup(hint)) == NULL) {
+                LOGERROR("out of memory\n");
+                return (EUCA_MEMORY_ERROR);
+            }
+            (*outHintsLen)++;
+            imageHints++;
+        }
+    }
+    return (EUCA_OK);
+}
+
 //!
 //! @param[in] myInstance instance to check for migration
 //! @param[in] host reported hostname
@@ -3136,6 +3350,8 @@ int schedule_instance(virtualMachine * vm, char *amiId, char *kernelId, char *ra
         ret = schedule_instance_greedy(vm, outresid);
     } else if (config->schedPolicy == SCHEDUSER) {
         ret = schedule_instance_user(vm, amiId, kernelId, ramdiskId, instId, userData, platform, outresid);
+    } else if (config->schedPolicy == SCHEDBINPACK) {
+        ret = schedule_instance_binpack(vm, outresid);
     } else {
         ret = schedule_instance_greedy(vm, outresid);
     }
@@ -3255,10 +3471,10 @@ static int schedule_instance_migration(ncInstance * instance, char **includeNode
     } else {
         if (config->schedPolicy == SCHEDROUNDROBIN) {
             LOGDEBUG("[%s] scheduling migration using ROUNDROBIN scheduler\n", instance->instanceId);
-        } else if (config->schedPolicy == SCHEDGREEDY || config->schedPolicy == SCHEDPOWERSAVE) {
+        } else if (config->schedPolicy == SCHEDGREEDY || config->schedPolicy == SCHEDPOWERSAVE || config->schedPolicy == SCHEDBINPACK) {
             LOGINFO
-                ("[%s] scheduling migration using ROUNDROBIN scheduler, despite GREEDY or POWERSAVE scheduler specification in Eucalyptus configuration file; GREEDY scheduling can be emulated by selecting specific destination nodes for migrations\n",
-                 instance->instanceId);
+                ("[%s] scheduling migration using ROUNDROBIN scheduler, despite %s scheduler specification in Eucalyptus configuration file; GREEDY scheduling can be emulated by selecting specific destination nodes for migrations\n",
+                 instance->instanceId, SCHEDPOLICIES[config->schedPolicy]);
         } else {
             LOGWARN("[%s] unsupported scheduler configuration--scheduling migration using ROUNDROBIN scheduler\n", instance->instanceId);
         }
@@ -3471,6 +3687,257 @@ int schedule_instance_greedy(virtualMachine * vm, int *outresid)
     return (0);
 }
 
+//!
+//! Checks whether a resource is schedulable and has enough capacity left for a VM
+//!
+//! @param[in] res a pointer to the resource
+//! @param[in] vm a pointer to the VM parameters
+//!
+//! @return TRUE if the VM fits on the resource, FALSE otherwise
+//!
+static int resource_fits(ccResource * res, virtualMachine * vm)
+{
+    if ((res->state == RESDOWN) || (res->ncState != ENABLED))
+        return (FALSE);
+    return ((res->availMemory >= vm->mem) && (res->availDisk >= vm->disk) && (res->availCores >= vm->cores));
+}
+
+//!
+//! Orders capacity index entries: awake resources first, then (with SCHED_ANTI_AFFINITY) those
+//! hosting fewer instances of the reservation, then the one with the least capacity left over.
+//!
+//! @param[in] a a pointer to the first ccCapacityEntry
+//! @param[in] b a pointer to the second ccCapacityEntry
+//!
+//! @return a negative, zero or positive value as for qsort()
+//!
+static int capacity_entry_compare(const void *a, const void *b)
+{
+    const ccCapacityEntry *ea = (const ccCapacityEntry *)a;
+    const ccCapacityEntry *eb = (const ccCapacityEntry *)b;
+
+    if (ea->asleep != eb->asleep)
+        return (ea->asleep - eb->asleep);
+    if (ea->placed != eb->placed)
+        return (ea->placed - eb->placed);
+    if (ea->score != eb->score)
+        return ((ea->score < eb->score) ? -1 : 1);
+    return (ea->resid - eb->resid);
+}
+
+//!
+//! Computes the rank of a resource for the VM type of the index
+//!
+//! @param[in]  index a pointer to the capacity index
+//! @param[in]  resid the resource cache index of the resource
+//! @param[out] entry the rank of the resource
+//!
+//! @return TRUE if the resource has room for one more VM, FALSE otherwise
+//!
+static boolean capacity_index_rank(ccCapacityIndex * index, int resid, ccCapacityEntry * entry)
+{
+    int d = 0;
+    int need[SCHED_DIMS] = { 0 };
+
+    need[SCHED_DIM_MEMORY] = index->vm.mem;
+    need[SCHED_DIM_DISK] = index->vm.disk;
+    need[SCHED_DIM_CORES] = index->vm.cores;
+
+    entry->resid = resid;
+    entry->asleep = index->asleep[resid];
+    entry->placed = (index->antiAffinity ? index->placed[resid] : 0);
+    entry->score = 0;
+    for (d = 0; d < SCHED_DIMS; d++) {
+        if (index->avail[resid][d] < need[d])
+            return (FALSE);
+        entry->score += (double)(index->avail[resid][d] - need[d]) / ((index->max[resid][d] > 0) ? index->max[resid][d] : 1);
+    }
+    return (TRUE);
+}
+
+//!
+//! Adds a resource to the heap of the capacity index
+//!
+//! @param[in] index a pointer to the capacity index
+//! @param[in] entry the rank of the resource
+//!
+static void capacity_index_push(ccCapacityIndex * index, ccCapacityEntry * entry)
+{
+    int i = index->heapLen++;
+
+    for (; (i > 0) && (capacity_entry_compare(entry, &(index->heap[(i - 1) / 2])) < 0); i = (i - 1) / 2) {
+        index->heap[i] = index->heap[(i - 1) / 2];
+    }
+    index->heap[i] = *entry;
+}
+
+//!
+//! Removes the best ranked resource from the heap of the capacity index
+//!
+//! @param[in] index a pointer to the capacity index
+//!
+static void capacity_index_pop(ccCapacityIndex * index)
+{
+    int i = 0;
+    int child = 0;
+    ccCapacityEntry last = { 0 };
+
+    if (index->heapLen <= 0)
+        return;
+
+    last = index->heap[--index->heapLen];
+    while ((child = (2 * i) + 1) < index->heapLen) {
+        if (((child + 1) < index->heapLen) && (capacity_entry_compare(&(index->heap[child + 1]), &(index->heap[child])) < 0))
+            child++;
+        if (capacity_entry_compare(&(index->heap[child]), &last) >= 0)
+            break;
+        index->heap[i] = index->heap[child];
+        i = child;
+    }
+    index->heap[i] = last;
+}
+
+//!
+//! Builds the capacity index for a VM type from the current resource cache. The resources able
+//! to fit the VM are sorted by rank, which also makes them a valid heap.
+//!
+//! @param[in] vm a pointer to the VM parameters
+//!
+//! @return a pointer to the new capacity index (to be freed by the caller) or NULL if out of memory
+//!
+//! @pre The caller must hold the RESCACHE and CONFIG locks
+//!
+static ccCapacityIndex *capacity_index_build(virtualMachine * vm)
+{
+    int i = 0;
+    ccResource *res = NULL;
+    ccCapacityIndex *index = NULL;
+
+    if ((index = EUCA_ZALLOC(1, sizeof(ccCapacityIndex))) == NULL) {
+        LOGERROR("out of memory\n");
+        return (NULL);
+    }
+
+    memcpy(&(index->vm), vm, sizeof(virtualMachine));
+    index->antiAffinity = config->schedAntiAffinity;
+    for (i = 0; i < resourceCache->numResources; i++) {
+        res = &(resourceCache->resources[i]);
+        if ((res->state == RESDOWN) || (res->ncState != ENABLED))
+            continue;
+
+        index->avail[i][SCHED_DIM_MEMORY] = res->availMemory;
+        index->avail[i][SCHED_DIM_DISK] = res->availDisk;
+        index->avail[i][SCHED_DIM_CORES] = res->availCores;
+        index->max[i][SCHED_DIM_MEMORY] = res->maxMemory;
+        index->max[i][SCHED_DIM_DISK] = res->maxDisk;
+        index->max[i][SCHED_DIM_CORES] = res->maxCores;
+        index->asleep[i] = (res->state == RESASLEEP);
+        index->numResources++;
+
+        if (capacity_index_rank(index, i, &(index->heap[index->heapLen])))
+            index->heapLen++;
+    }
+    qsort(index->heap, index->heapLen, sizeof(ccCapacityEntry), capacity_entry_compare);
+    return (index);
+}
+
+//!
+//! Picks the resource the VM type of the index fits best on and takes one VM's capacity from
+//! it. Sleeping resources that get picked are powered up. Resources that went down or ran out
+//! of room in the resource cache since the index was built are dropped on the way.
+//!
+//! @param[in] index a pointer to the capacity index
+//!
+//! @return the resource cache index of the chosen resource or -1 if the VM does not fit anywhere
+//!
+//! @pre The caller must hold the RESCACHE lock
+//!
+static int capacity_index_place(ccCapacityIndex * index)
+{
+    int resid = -1;
+    ccCapacityEntry entry = { 0 };
+
+    while (index->heapLen > 0) {
+        resid = index->heap[0].resid;
+        capacity_index_pop(index);
+        if (resource_fits(&(resourceCache->resources[resid]), &(index->vm)))
+            break;
+        resid = -1;
+    }
+
+    if (resid < 0)
+        return (-1);
+
+    index->avail[resid][SCHED_DIM_MEMORY] -= index->vm.mem;
+    index->avail[resid][SCHED_DIM_DISK] -= index->vm.disk;
+    index->avail[resid][SCHED_DIM_CORES] -= index->vm.cores;
+    index->placed[resid]++;
+    if (index->asleep[resid]) {
+        powerUp(&(resourceCache->resources[resid]));
+        index->asleep[resid] = 0;
+    }
+
+    if (capacity_index_rank(index, resid, &entry))
+        capacity_index_push(index, &entry);
+    return (resid);
+}
+
+//!
+//! Schedules a VM using the BINPACK policy, which places it on the resource it fits best
+//!
+//! @param[in]  vm a pointer to the VM parameters
+//! @param[out] outresid the resource cache index of the chosen resource
+//!
+//! @return 0 on success or 1 if no resource can fit the VM
+//!
+//! @pre The caller must hold the RESCACHE lock
+//!
+int schedule_instance_binpack(virtualMachine * vm, int *outresid)
+{
+    int resid = 0;
+
+    LOGDEBUG("scheduler using BINPACK policy to find next resource\n");
+    if (schedule_reservation(vm, 1, &resid) != 1) {
+        *outresid = 0;
+        return (1);
+    }
+    *outresid = resid;
+    return (0);
+}
+
+//!
+//! Places up to 'count' identical VMs of a reservation with a capacity index built from the
+//! resource cache, using the BINPACK policy: O(n log n) to build, O(log n) per VM. The resource
+//! cache itself is not modified, except that sleeping resources that get picked are powered up.
+//!
+//! @param[in]  vm a pointer to the VM parameters
+//! @param[in]  count the number of VMs to place
+//! @param[out] outresids the resource cache index chosen for each placed VM (at least 'count' entries)
+//!
+//! @return the number of VMs placed, the first ones of the reservation
+//!
+//! @pre The caller must hold the RESCACHE and CONFIG locks
+//!
+int schedule_reservation(virtualMachine * vm, int count, int *outresids)
+{
+    int i = 0;
+    int resid = 0;
+    ccCapacityIndex *index = NULL;
+
+    if ((index = capacity_index_build(vm)) == NULL)
+        return (0);
+
+    for (i = 0; i < count; i++) {
+        if ((resid = capacity_index_place(index)) < 0)
+            break;
+        outresids[i] = resid;
+    }
+
+    LOGDEBUG("scheduler placed %d of %d instance(s) across %d schedulable resource(s)\n", i, count, index->numResources);
+    EUCA_FREE(index);
+    return (i);
+}
+
 //!
 //!
 //!
@@ -3594,6 +4061,186 @@ static void print_abbreviated_instances(const char *gerund, char **instIds, int
     LOGINFO("%s %d instance(s): %s\n", gerund, instIdsLen, list);
 }
 
+//!
+//! Sends the dispatched instances of a reservation to their nodes. One process is forked per node,
+//! which runs that node's instances back to back (calls to a node are serialized on its NCCALL lock
+//! anyway) and reports each result over a pipe, so all the nodes are being worked on concurrently.
+//! The whole dispatch is bounded by OP_TIMEOUT_RUNINSTANCES. On return, every RUNSLOT_DISPATCHED
+//! slot is either RUNSLOT_RUNNING or back to RUNSLOT_PENDING.
+//!
+//! @param[in]     pMeta a pointer to the node controller (NC) metadata structure
+//! @param[in,out] runSlots the instances of the reservation
+//! @param[in]     numSlots the number of entries in runSlots
+//! @param[in]     reservationId
+//! @param[in]     ncvm the VM parameters to send
+//! @param[in]     amiId
+//! @param[in]     amiURL
+//! @param[in]     kernelId the kernel image identifier (eki-XXXXXXXX)
+//! @param[in]     kernelURL the kernel image URL address
+//! @param[in]     ramdiskId the ramdisk image identifier (eri-XXXXXXXX)
+//! @param[in]     ramdiskURL the ramdisk image URL address
+//! @param[in]     ownerId
+//! @param[in]     accountId
+//! @param[in]     keyName
+//! @param[in]     userData
+//! @param[in]     credential
+//! @param[in]     launchIndex
+//! @param[in]     platform
+//! @param[in]     expiryTime
+//! @param[in]     netNames
+//! @param[in]     netNamesLen
+//! @param[in]     rootDirective
+//! @param[in]     netIds
+//! @param[in]     netIdsLen
+//! @param[in]     secNetCfgs
+//! @param[in]     secNetCfgsLen
+//!
+//! @pre The caller must hold the RESCACHE lock
+//!
+static void dispatch_run_instances(ncMetadata * pMeta, ccRunSlot * runSlots, int numSlots, char *reservationId, virtualMachine * ncvm, char *amiId,
+                                   char *amiURL, char *kernelId, char *kernelURL, char *ramdiskId, char *ramdiskURL, char *ownerId, char *accountId,
+                                   char *keyName, char *userData, char *credential, char *launchIndex, char *platform, int expiryTime, char **netNames,
+                                   int netNamesLen, char *rootDirective, char **netIds, int netIdsLen, netConfig * secNetCfgs, int secNetCfgsLen)
+{
+    int i = 0;
+    int j = 0;
+    int rc = 0;
+    int status = 0;
+    int numNodes = 0;
+    int result[2] = { 0 };
+    int nodeResid[MAXNODES] = { 0 };
+    int nodeCount[MAXNODES] = { 0 };
+    int nodeFd[MAXNODES] = { 0 };
+    int filedes[2] = { 0 };
+    pid_t nodePid[MAXNODES] = { 0 };
+    time_t startRun = 0;
+    time_t startDispatch = 0;
+    time_t ncRunTimeout = 0;
+    time_t deadline = 0;
+    time_t runDeadline = 0;
+    ccResource *res = NULL;
+    ncInstance *outInst = NULL;
+
+    // one process per node that got instances in this round
+    startDispatch = time(NULL);
+    runDeadline = startDispatch + OP_TIMEOUT_RUNINSTANCES;
+    for (i = 0; i < numSlots; i++) {
+        if (runSlots[i].state != RUNSLOT_DISPATCHED)
+            continue;
+        for (j = 0; (j < numNodes) && (nodeResid[j] != runSlots[i].resid); j++) ;
+        if (j < numNodes)
+            continue;
+
+        res = &(resourceCache->resources[runSlots[i].resid]);
+        nodeResid[numNodes] = runSlots[i].resid;
+        for (j = i; j < numSlots; j++) {
+            if ((runSlots[j].state == RUNSLOT_DISPATCHED) && (runSlots[j].resid == nodeResid[numNodes]))
+                nodeCount[numNodes]++;
+        }
+        nodePid[numNodes] = -1;
+        nodeFd[numNodes] = -1;
+        if (pipe(filedes) != 0) {
+            LOGERROR("cannot create pipe to run instances on resource '%s'\n", res->ncURL);
+            numNodes++;
+            continue;
+        }
+
+        if ((nodePid[numNodes] = fork()) == 0) {
+            close(filedes[0]);
+            if (config->schedPolicy == SCHEDPOWERSAVE) {
+                ncRunTimeout = config->wakeThresh;
+            } else {
+                ncRunTimeout = 15;
+            }
+
+            for (j = i; j < numSlots; j++) {
+                if ((runSlots[j].state != RUNSLOT_DISPATCHED) || (runSlots[j].resid != nodeResid[numNodes]))
+                    continue;
+
+                LOGTRACE("sending run instance: node=%s instanceId=%s emiId=%s mac=%s privIp=%s pubIp=%s vlan=%d networkIdx=%d key=%.32s... "
+                         "mem=%d disk=%d cores=%d\n", res->ncURL, runSlots[j].instId, SP(amiId), runSlots[j].ncnet.privateMac, runSlots[j].ncnet.privateIp,
+                         runSlots[j].ncnet.publicIp, runSlots[j].ncnet.vlan, runSlots[j].ncnet.networkIndex, SP(keyName), ncvm->mem, ncvm->disk, ncvm->cores);
+
+                // every instance gets its own OP_TIMEOUT - 5 budget within that of the request, no new attempt is started past either
+                rc = 1;
+                startRun = time(NULL);
+                while (rc && ((time(NULL) - startRun) < ncRunTimeout) && ((time(NULL) - startRun + OP_TIMEOUT_PERNODE) <= (OP_TIMEOUT - 5))
+                       && ((time(NULL) + OP_TIMEOUT_PERNODE) <= runDeadline)) {
+                    rc = ncClientCall(pMeta, OP_TIMEOUT_PERNODE, res->lockidx, res->ncURL, "ncRunInstance", runSlots[j].uuid, runSlots[j].instId, reservationId, ncvm,
+                                      amiId, amiURL, kernelId, kernelURL, ramdiskId, ramdiskURL, ownerId, accountId, keyName, &(runSlots[j].ncnet), userData,
+                                      credential, launchIndex, platform, expiryTime, netNames, netNamesLen, rootDirective, netIds, netIdsLen, secNetCfgs,
+                                      secNetCfgsLen, &outInst);
+                    LOGDEBUG("sent run request for instance '%s' on resource '%s': result '%s' uuis '%s'\n", runSlots[j].instId, res->ncURL,
+                             runSlots[j].uuid, rc ? "FAIL" : "SUCCESS");
+                    if (rc) {
+                        // make sure we get the latest topology information before trying again
+                        sem_mywait(CONFIG);
+                        memcpy(pMeta->services, config->services, sizeof(serviceInfoType) * 16);
+                        memcpy(pMeta->disabledServices, config->disabledServices, sizeof(serviceInfoType) * 16);
+                        memcpy(pMeta->notreadyServices, config->notreadyServices, sizeof(serviceInfoType) * 16);
+                        sem_mypost(CONFIG);
+                        sleep(1);
+                    }
+                }
+
+                // a node that fails an instance is marked down by the caller, do not bother it with the rest
+                result[0] = j;
+                result[1] = rc;
+                if ((write(filedes[1], result, sizeof(result)) != sizeof(result)) || rc)
+                    break;
+            }
+            close(filedes[1]);
+            exit(0);
+        }
+
+        close(filedes[1]);
+        if (nodePid[numNodes] < 0) {
+            LOGERROR("cannot fork to run instances on resource '%s'\n", res->ncURL);
+            close(filedes[0]);
+        } else {
+            nodeFd[numNodes] = filedes[0];
+        }
+        numNodes++;
+    }
+
+    // collect the per-instance results; anything not reported as accepted goes back to pending. A node
+    // sends its instances one after the other, so its deadline scales with how many it was given, up
+    // to the budget of the whole request.
+    for (i = 0; i < numNodes; i++) {
+        res = &(resourceCache->resources[nodeResid[i]]);
+        if (nodePid[i] > 0) {
+            deadline = startDispatch + (nodeCount[i] * (OP_TIMEOUT - 5));
+            if (deadline > runDeadline)
+                deadline = runDeadline;
+
+            if (res->running > 0) {
+                res->running++;
+            }
+            if (timewait(nodePid[i], &status, (int)(deadline - time(NULL))) == 0) {
+                LOGERROR("timed out running instances on resource '%s'\n", res->ncURL);
+                killwait(nodePid[i]);
+            }
+            if (res->running > 0) {
+                res->running--;
+            }
+            LOGDEBUG("call complete (pid/resource): %d/%s\n", nodePid[i], res->ncURL);
+        }
+
+        if (nodeFd[i] >= 0) {
+            while (read(nodeFd[i], result, sizeof(result)) == sizeof(result)) {
+                if ((result[0] >= 0) && (result[0] < numSlots) && (runSlots[result[0]].resid == nodeResid[i]) && !result[1])
+                    runSlots[result[0]].state = RUNSLOT_RUNNING;
+            }
+            close(nodeFd[i]);
+        }
+    }
+
+    for (i = 0; i < numSlots; i++) {
+        if (runSlots[i].state == RUNSLOT_DISPATCHED)
+            runSlots[i].state = RUNSLOT_PENDING;
+    }
+}
+
 //!
 //!
 //!
@@ -3643,17 +4290,16 @@ int doRunInstances(ncMetadata * pMeta, char *amiId, char *kernelId, char *ramdis
                    char *platform, int expiryTime, char *targetNode, char *rootDirective, char *eniAttachmentId, netConfig * secNetCfgs, int secNetCfgsLen,
                    ccInstance ** outInsts, int *outInstsLen)
 {
-    int rc = 0, i = 0, done = 0, runCount = 0, resid = 0, foundnet = 0, error = 0, nidx = 0, thenidx = 0, pid = 0;
+    int rc = 0, i = 0, done = 0, runCount = 0, resid = 0, foundnet = 0, error = 0, nidx = 0, thenidx = 0, pending = 0;
+    ccCapacityIndex *capacity = NULL;
     ccInstance *myInstance = NULL, *retInsts = NULL;
-    char instId[16], uuid[48];
+    ccRunSlot *runSlots = NULL, *slot = NULL;
     ccResource *res = NULL;
     char *mac = NULL;
     char privip[32] = "";
     char pubip[32] = "";
 
-    ncInstance *outInst = NULL;
     virtualMachine ncvm;
-    netConfig ncnet;
 
     rc = initialize(pMeta, FALSE);
     if (rc || ccIsEnabled()) {
@@ -3694,7 +4340,7 @@ int doRunInstances(ncMetadata * pMeta, char *amiId, char *kernelId, char *ramdis
                         if (!rc) {
                             snprintf(ccvm->virtualBootRecord[i].resourceLocation, CHAR_BUFFER_SIZE, "http://%s:8776/%s", config->proxyIp, ccvm->virtualBootRecord[i].id);
                         } else {
-                            LOGWARN("could not cache image %s/%s\n", ccvm->virtualBootRecord[i].id, newURL);
+                            LOGDEBUG("not serving image %s/%s from the proxy cache\n", ccvm->virtualBootRecord[i].id, newURL);
                         }
                     }
                 }
@@ -3726,20 +4372,37 @@ int doRunInstances(ncMetadata * pMeta, char *amiId, char *kernelId, char *ramdis
 
     runCount = 0;
 
-    // get updated resource information
+    // with BINPACK, index the resources once for the whole reservation so every instance is placed in O(log n)
+    if ((config->schedPolicy == SCHEDBINPACK) && !(targetNode && strlen(targetNode))) {
+        sem_mywait(RESCACHE);
+        sem_mywait(CONFIG);
+        capacity = capacity_index_build(ccvm);
+        sem_mypost(CONFIG);
+        sem_mypost(RESCACHE);
+    }
 
-    done = 0;
-    for (i = 0; i < maxCount && !done; i++) {
-        mac = EUCA_ZALLOC(32, sizeof(char)); 
+    runSlots = EUCA_ZALLOC(maxCount, sizeof(ccRunSlot));
+    if (!runSlots) {
+        LOGFATAL("out of memory!\n");
+        unlock_exit(1);
+    }
 
-        snprintf(instId, 16, "%s", instIds[i]);
+    // set up the networking of every instance of the reservation
+    for (i = 0; i < maxCount; i++) {
+        slot = &(runSlots[i]);
+        slot->resid = -1;
+        slot->state = RUNSLOT_FAILED;
+
+        mac = EUCA_ZALLOC(32, sizeof(char));
+
+        snprintf(slot->instId, 16, "%s", instIds[i]);
         if (uuidsLen > i) {
-            snprintf(uuid, 48, "%s", uuids[i]);
+            snprintf(slot->uuid, 48, "%s", uuids[i]);
         } else {
-            snprintf(uuid, 48, "UNSET");
+            snprintf(slot->uuid, 48, "UNSET");
         }
 
-        LOGDEBUG("running instance %s\n", instId);
+        LOGDEBUG("running instance %s\n", slot->instId);
 
         foundnet = 0;
 
@@ -3765,9 +4428,9 @@ int doRunInstances(ncMetadata * pMeta, char *amiId, char *kernelId, char *ramdis
                 foundnet = 1;
                 thenidx = -1;
                 snprintf(mac, 32, "%s", macAddrs[i]);
-                LOGDEBUG("setting instance '%s' macAddr to CLC input value '%s'\n", instId, mac);
+                LOGDEBUG("setting instance '%s' macAddr to CLC input value '%s'\n", slot->instId, mac);
             } else {
-                if ((rc = euca_inst2mac(gpEucaNet->sMacPrefix, instId, &mac)) == 0) {
+                if ((rc = euca_inst2mac(gpEucaNet->sMacPrefix, slot->instId, &mac)) == 0) {
                     foundnet = 1;
                     if (nidx == -1) {
                         thenidx = -1;
@@ -3776,7 +4439,7 @@ int doRunInstances(ncMetadata * pMeta, char *amiId, char *kernelId, char *ramdis
                         nidx++;
                     }
                 } else {
-                    LOGDEBUG("Failed to compute MAC address for instance '%s' - MAC Prefix '%s'\n", instId, gpEucaNet->sMacPrefix);
+                    LOGDEBUG("Failed to compute MAC address for instance '%s' - MAC Prefix '%s'\n", slot->instId, gpEucaNet->sMacPrefix);
                     foundnet = 0;
                 }
             }
@@ -3792,155 +4455,134 @@ int doRunInstances(ncMetadata * pMeta, char *amiId, char *kernelId, char *ramdis
         if (mac[0] == '\0' || !foundnet) {
             LOGERROR("could not find/initialize any free network address, failing doRunInstances()\n");
         } else {
-            // "run" the instance
-            memcpy(&ncvm, ccvm, sizeof(virtualMachine));
-
-            snprintf(ncnet.interfaceId, ENI_ID_LEN, "%s", instId);
-            ncnet.device = 0; // primary network interface is always device 0
-            ncnet.vlan = vlan;
+            snprintf(slot->ncnet.interfaceId, ENI_ID_LEN, "%s", slot->instId);
+            slot->ncnet.device = 0; // primary network interface is always device 0
+            slot->ncnet.vlan = vlan;
             if (thenidx >= 0) {
-                ncnet.networkIndex = networkIndexList[thenidx];
+                slot->ncnet.networkIndex = networkIndexList[thenidx];
             } else {
-                ncnet.networkIndex = -1;
+                slot->ncnet.networkIndex = -1;
             }
-            snprintf(ncnet.privateMac, ENET_ADDR_LEN, "%s", mac);
-            snprintf(ncnet.privateIp, INET_ADDR_LEN, "%s", privip);
-            snprintf(ncnet.publicIp, INET_ADDR_LEN, "%s", pubip);
+            snprintf(slot->ncnet.privateMac, ENET_ADDR_LEN, "%s", mac);
+            snprintf(slot->ncnet.privateIp, INET_ADDR_LEN, "%s", privip);
+            snprintf(slot->ncnet.publicIp, INET_ADDR_LEN, "%s", pubip);
             if (eniAttachmentId != NULL)
-                snprintf(ncnet.attachmentId, ENI_ATTACHMENT_ID_LEN, "%s", eniAttachmentId);
+                snprintf(slot->ncnet.attachmentId, ENI_ATTACHMENT_ID_LEN, "%s", eniAttachmentId);
             else
-                ncnet.attachmentId[0] = '\0';
+                slot->ncnet.attachmentId[0] = '\0';
+            slot->state = RUNSLOT_PENDING;
+        }
+        EUCA_FREE(mac);
+    }
 
-            sem_mywait(RESCACHE);
+    // "run" the instances: every round schedules the pending instances, then sends them to all their
+    // nodes concurrently. Instances that failed on a node (now marked down) are retried on another one.
+    memcpy(&ncvm, ccvm, sizeof(virtualMachine));
+    do {
+        sem_mywait(RESCACHE);
 
-            resid = 0;
+        pending = 0;
+        for (i = 0; i < maxCount; i++) {
+            slot = &(runSlots[i]);
+            if (slot->state != RUNSLOT_PENDING)
+                continue;
 
-            sem_mywait(CONFIG);
-            rc = schedule_instance(ccvm, amiId, kernelId, ramdiskId, instId, userData, platform, targetNode, &resid);
-            sem_mypost(CONFIG);
+            resid = 0;
+            if (capacity) {
+                // resources that went down since (e.g. after a failed send) are dropped from the index
+                LOGDEBUG("scheduler using BINPACK policy to find next resource\n");
+                if ((resid = capacity_index_place(capacity)) < 0) {
+                    resid = 0;
+                    rc = 1;
+                } else {
+                    rc = 0;
+                }
+            } else {
+                sem_mywait(CONFIG);
+                rc = schedule_instance(ccvm, amiId, kernelId, ramdiskId, slot->instId, userData, platform, targetNode, &resid);
+                sem_mypost(CONFIG);
+            }
 
-            res = &(resourceCache->resources[resid]);
             if (rc) {
                 // could not find resource
                 LOGERROR("scheduler could not find resource to run the instance on\n");
-                // couldn't run this VM, remove networking information from system
-                //                free_instanceNetwork(mac, vlan, 1, 1);
-            } else {
-                int ret;
-
-                // try to run the instance on the chosen resource
-                LOGINFO("scheduler decided to run instance %s on resource %s, running count %d\n", instId, res->ncURL, res->running);
-
-                outInst = NULL;
-
-                pid = fork();
-                if (pid == 0) {
-                    time_t startRun, ncRunTimeout;
-
-                    ret = 0;
-                    LOGTRACE("sending run instance: node=%s instanceId=%s emiId=%s mac=%s privIp=%s pubIp=%s vlan=%d networkIdx=%d key=%.32s... "
-                             "mem=%d disk=%d cores=%d\n", res->ncURL, instId, SP(amiId), ncnet.privateMac, ncnet.privateIp, ncnet.publicIp,
-                             ncnet.vlan, ncnet.networkIndex, SP(keyName), ncvm.mem, ncvm.disk, ncvm.cores);
-
-                    rc = 1;
-                    startRun = time(NULL);
-                    if (config->schedPolicy == SCHEDPOWERSAVE) {
-                        ncRunTimeout = config->wakeThresh;
-                    } else {
-                        ncRunTimeout = 15;
-                    }
+                slot->state = RUNSLOT_FAILED;
+                continue;
+            }
 
-                    while (rc && ((time(NULL) - startRun) < ncRunTimeout)) {
+            // hold the capacity while the instance is being sent, so the next ones are scheduled around it
+            res = &(resourceCache->resources[resid]);
+            res->availMemory -= ccvm->mem;
+            res->availDisk -= ccvm->disk;
+            res->availCores -= ccvm->cores;
 
-                        rc = ncClientCall(pMeta, OP_TIMEOUT_PERNODE, res->lockidx, res->ncURL, "ncRunInstance", uuid, instId, reservationId, &ncvm,
-                                          amiId, amiURL, kernelId, kernelURL, ramdiskId, ramdiskURL, ownerId, accountId, keyName, &ncnet, userData, credential,
-                                          launchIndex, platform, expiryTime, netNames, netNamesLen, rootDirective, netIds, netIdsLen, secNetCfgs, secNetCfgsLen, &outInst);
-                        LOGDEBUG("sent run request for instance '%s' on resource '%s': result '%s' uuis '%s'\n", instId, res->ncURL, uuid, rc ? "FAIL" : "SUCCESS");
-                        if (rc) {
-                            // make sure we get the latest topology information before trying again
-                            sem_mywait(CONFIG);
-                            memcpy(pMeta->services, config->services, sizeof(serviceInfoType) * 16);
-                            memcpy(pMeta->disabledServices, config->disabledServices, sizeof(serviceInfoType) * 16);
-                            memcpy(pMeta->notreadyServices, config->notreadyServices, sizeof(serviceInfoType) * 16);
-                            sem_mypost(CONFIG);
-                            sleep(1);
-                        }
-                    }
-                    if (!rc) {
-                        ret = 0;
-                    } else {
-                        ret = 1;
-                    }
+            LOGINFO("scheduler decided to run instance %s on resource %s, running count %d\n", slot->instId, res->ncURL, res->running);
+            slot->resid = resid;
+            slot->state = RUNSLOT_DISPATCHED;
+            pending++;
+        }
 
-                    exit(ret);
-                } else {
-                    rc = 0;
-                    {
-                        int status;
+        if (pending) {
+            dispatch_run_instances(pMeta, runSlots, maxCount, reservationId, &ncvm, amiId, amiURL, kernelId, kernelURL, ramdiskId, ramdiskURL, ownerId,
+                                   accountId, keyName, userData, credential, launchIndex, platform, expiryTime, netNames, netNamesLen, rootDirective, netIds,
+                                   netIdsLen, secNetCfgs, secNetCfgsLen);
 
-                        if (res->running > 0) {
-                            res->running++;
-                        }
-                        pid_t p = timewait(pid, &status, OP_TIMEOUT - 5);
-                        if (res->running > 0) {
-                            res->running--;
-                        }
+            pending = 0;
+            for (i = 0; i < maxCount; i++) {
+                slot = &(runSlots[i]);
+                if ((slot->state != RUNSLOT_RUNNING) && (slot->state != RUNSLOT_PENDING))
+                    continue;
+                if (slot->resid < 0)
+                    continue;
 
-                        if (p > 0) {
-                            if (WIFEXITED(status)) {
-                                rc = WEXITSTATUS(status);
-                            } else {
-                                rc = 1; // child crashed
-                            }
-                        } else {
-                            rc = 1;    // timeout or error
-                        }
-                    }
-                    LOGDEBUG("call complete (pid/rc): %d/%d\n", pid, rc);
-                }
-                if (rc != 0) {
+                res = &(resourceCache->resources[slot->resid]);
+                if (slot->state == RUNSLOT_PENDING) {
                     // problem
                     LOGERROR("tried to run the VM, but runInstance() failed; marking resource '%s' as down\n", res->ncURL);
                     res->state = RESDOWN;
-                    i--;
-                    // couldn't run this VM, remove networking information from system
-                    //                    free_instanceNetwork(mac, vlan, 1, 1);
-                } else {
-                    res->availMemory -= ccvm->mem;
-                    res->availDisk -= ccvm->disk;
-                    res->availCores -= ccvm->cores;
+                    res->availMemory += ccvm->mem;
+                    res->availDisk += ccvm->disk;
+                    res->availCores += ccvm->cores;
+                    slot->resid = -1;
+                    pending++;
+                    continue;
+                }
 
-                    LOGDEBUG("resource information after schedule/run: %d/%d, %d/%d, %d/%d\n", res->availMemory, res->maxMemory,
-                             res->availCores, res->maxCores, res->availDisk, res->maxDisk);
+                LOGDEBUG("resource information after schedule/run: %d/%d, %d/%d, %d/%d\n", res->availMemory, res->maxMemory,
+                         res->availCores, res->maxCores, res->availDisk, res->maxDisk);
 
-                    myInstance = &(retInsts[runCount]);
-                    bzero(myInstance, sizeof(ccInstance));
+                myInstance = &(retInsts[runCount]);
+                bzero(myInstance, sizeof(ccInstance));
 
-                    allocate_ccInstance(myInstance, instId, amiId, kernelId, ramdiskId, amiURL, kernelURL, ramdiskURL, ownerId, accountId, "Pending",
-                                        "", time(NULL), reservationId, &ncnet, &ncnet, ccvm, resid, keyName, resourceCache->resources[resid].ncURL,
-                                        userData, launchIndex, platform, myInstance->guestStateName, myInstance->bundleTaskStateName, myInstance->groupNames, myInstance->groupIds,
-                                        myInstance->volumes, myInstance->volumesSize, myInstance->bundleTaskProgress, secNetCfgs, secNetCfgsLen);
-                    sensor_add_resource(myInstance->instanceId, "instance", uuid);
-                    sensor_set_resource_alias(myInstance->instanceId, myInstance->ncnet.privateIp);
+                allocate_ccInstance(myInstance, slot->instId, amiId, kernelId, ramdiskId, amiURL, kernelURL, ramdiskURL, ownerId, accountId, "Pending",
+                                    "", time(NULL), reservationId, &(slot->ncnet), &(slot->ncnet), ccvm, slot->resid, keyName, res->ncURL,
+                                    userData, launchIndex, platform, myInstance->guestStateName, myInstance->bundleTaskStateName, myInstance->groupNames, myInstance->groupIds,
+                                    myInstance->volumes, myInstance->volumesSize, myInstance->bundleTaskProgress, secNetCfgs, secNetCfgsLen);
+                sensor_add_resource(myInstance->instanceId, "instance", slot->uuid);
+                sensor_set_resource_alias(myInstance->instanceId, myInstance->ncnet.privateIp);
 
-                    // start up DHCP
-                    sem_mywait(CONFIG);
-                    config->kick_dhcp = 1;
-                    sem_mypost(CONFIG);
+                // add the instance to the cache, and continue on
+                refresh_instanceCache(myInstance->instanceId, myInstance);
+                print_ccInstance("", myInstance);
 
-                    // add the instance to the cache, and continue on
-                    refresh_instanceCache(myInstance->instanceId, myInstance);
-                    print_ccInstance("", myInstance);
+                slot->state = RUNSLOT_DONE;
+                runCount++;
+            }
 
-                    runCount++;
-                }
+            if (runCount) {
+                // start up DHCP
+                sem_mywait(CONFIG);
+                config->kick_dhcp = 1;
+                sem_mypost(CONFIG);
             }
+        }
 
-            sem_mypost(RESCACHE);
+        sem_mypost(RESCACHE);
+    } while (pending);
+
+    EUCA_FREE(runSlots);
+    EUCA_FREE(capacity);
 
-        }
-        EUCA_FREE(mac);
-    }
     *outInstsLen = runCount;
     *outInsts = retInsts;
 
@@ -4475,6 +5117,142 @@ out:
     return (ret);
 }
 
+//!
+//! Implements the CC logic of pre-warming images: asks the nodes, all in parallel, to bring
+//! the given images into their caches in the background and reports the images that each
+//! node has in its cache or on the way there. With no images, only the report is produced.
+//!
+//! @param[in]  pMeta a pointer to the node controller (NC) metadata structure
+//! @param[in]  images VBRs of the images (emi|eki|eri) to pre-warm
+//! @param[in]  imagesLen number of VBRs in the list
+//! @param[in]  nodeNames the names (hostname or IP) of the nodes to pre-warm, all nodes when empty
+//! @param[in]  nodeNamesLen number of names in the list
+//! @param[out] outNodes the per-node residency report (caller frees)
+//! @param[out] outNodesLen number of nodes in the report
+//!
+//! @return 0 on success or 1 on failure
+//!
+int doPrewarmImages(ncMetadata * pMeta, virtualBootRecord * images, int imagesLen, char **nodeNames, int nodeNamesLen, ccImageResidency ** outNodes, int *outNodesLen)
+{
+    int i = 0;
+    int j = 0;
+    int rc = 0;
+    int status = 0;
+    int numNodes = 0;
+    int len = 0;
+    int filedes[2] = { 0 };
+    int nodeFd[MAXNODES] = { 0 };
+    pid_t nodePid[MAXNODES] = { 0 };
+    time_t deadline = 0;
+    ccResource *res = NULL;
+    ccImageResidency *nodes = NULL;
+    ncImageResidency *outResidency = NULL;
+    ccResourceCache resourceCacheLocal;
+
+    LOGINFO("pre-warming %d image(s) on %d node(s)\n", imagesLen, nodeNamesLen);
+
+    rc = initialize(pMeta, FALSE);
+    if (rc || ccIsEnabled()) {
+        return (1);
+    }
+
+    if (!outNodes || !outNodesLen || ((imagesLen > 0) && !images)) {
+        LOGERROR("bad input params\n");
+        return (1);
+    }
+    *outNodes = NULL;
+    *outNodesLen = 0;
+
+    sem_mywait(RESCACHE);
+    memcpy(&resourceCacheLocal, resourceCache, sizeof(ccResourceCache));
+    sem_mypost(RESCACHE);
+
+    if (resourceCacheLocal.numResources <= 0)
+        return (0);
+
+    if ((nodes = EUCA_ZALLOC(resourceCacheLocal.numResources, sizeof(ccImageResidency))) == NULL) {
+        LOGERROR("out of memory\n");
+        return (1);
+    }
+    // one process per node, so that a slow node does not hold up the others
+    for (i = 0; i < resourceCacheLocal.numResources; i++) {
+        res = &(resourceCacheLocal.resources[i]);
+        if (nodeNamesLen > 0) {
+            for (j = 0; (j < nodeNamesLen) && (!nodeNames[j] || (strcmp(nodeNames[j], res->hostname) && strcmp(nodeNames[j], res->ip))); j++) ;
+            if (j == nodeNamesLen)
+                continue;
+        }
+
+        euca_strncpy(nodes[numNodes].nodeName, res->hostname, sizeof(nodes[numNodes].nodeName));
+        nodePid[numNodes] = -1;
+        nodeFd[numNodes] = -1;
+        if (res->state != RESUP) {
+            // an asleep or down node is reported as unreachable rather than woken up for this
+            numNodes++;
+            continue;
+        }
+
+        if (pipe(filedes) != 0) {
+            LOGERROR("cannot create pipe to pre-warm images on resource '%s'\n", res->ncURL);
+            numNodes++;
+            continue;
+        }
+
+        if ((nodePid[numNodes] = fork()) == 0) {
+            close(filedes[0]);
+            rc = ncClientCall(pMeta, OP_TIMEOUT_PERNODE, res->lockidx, res->ncURL, "ncPrewarmImages", images, imagesLen, &outResidency);
+            if (!rc && outResidency) {
+                len = sizeof(ncImageResidency);
+                rc = write(filedes[1], outResidency, len);
+            }
+            EUCA_FREE(outResidency);
+            close(filedes[1]);
+            exit(0);
+        }
+
+        close(filedes[1]);
+        if (nodePid[numNodes] < 0) {
+            LOGERROR("cannot fork to pre-warm images on resource '%s'\n", res->ncURL);
+            close(filedes[0]);
+        } else {
+            nodeFd[numNodes] = filedes[0];
+        }
+        numNodes++;
+    }
+
+    // collect the per-node reports
+    deadline = time(NULL) + OP_TIMEOUT_PERNODE + OP_TIMEOUT_MIN;
+    for (i = 0; i < numNodes; i++) {
+        if (nodePid[i] > 0) {
+            if (timewait(nodePid[i], &status, (int)(deadline - time(NULL))) == 0) {
+                LOGERROR("timed out pre-warming images on node '%s'\n", nodes[i].nodeName);
+                killwait(nodePid[i]);
+            }
+        }
+
+        if (nodeFd[i] >= 0) {
+            if (timeread(nodeFd[i], &(nodes[i].images), sizeof(ncImageResidency), 1) == sizeof(ncImageResidency)) {
+                nodes[i].reachable = TRUE;
+                LOGDEBUG("node '%s' has %d image(s) in its cache and %d pending\n", nodes[i].nodeName, nodes[i].images.residentImagesLen,
+                         nodes[i].images.pendingImagesLen);
+            } else {
+                bzero(&(nodes[i].images), sizeof(ncImageResidency));
+                LOGWARN("failed to pre-warm images on node '%s'\n", nodes[i].nodeName);
+            }
+            close(nodeFd[i]);
+        }
+    }
+
+    *outNodes = nodes;
+    *outNodesLen = numNodes;
+
+    LOGTRACE("done\n");
+
+    shawn();
+
+    return (0);
+}
+
 //!
 //! Implements the CC logic of migrating instances from a node controller
 //!
@@ -5782,6 +6560,11 @@ int init_log(void)
             }
             EUCA_FREE(log_facility);
         }
+
+        char *log_async = configFileValue("LOGASYNC");
+        config->log_async = ((log_async != NULL) && !strcmp(log_async, "Y"));
+        EUCA_FREE(log_async);
+
         // set the log file path (levels and size limits are set below)
         log_file_set(logFile, logFileReqTrack);
 
@@ -5792,6 +6575,7 @@ int init_log(void)
     log_params_set(config->log_level, (int)config->log_roll_number, config->log_max_size_bytes);
     log_prefix_set(config->log_prefix);
     log_facility_set(config->log_facility, "cc");
+    log_async_set(config->log_async ? TRUE : FALSE);
 
     return (0);
 }
@@ -5888,9 +6672,19 @@ int init_thread(void)
                 exit(1);
             }
         }
+        if (imageCache == NULL) {
+            rc = setup_shared_buffer((void **)&imageCache, "/eucalyptusCCImageCache", sizeof(ccImageCache), &(locks[IMAGECACHE]), "/eucalyptusCCImageCacheLock",
+                                     SHARED_FILE);
+            if (rc != 0) {
+                fprintf(stderr, "Cannot set up shared memory region for ccImageCache, exiting...\n");
+                sem_mypost(INIT);
+                exit(1);
+            }
+        }
+
         //setup message stats shared buffer
         if (message_stats_shared_mem == NULL) {
-            rc = setup_shared_buffer((void **)&message_stats_shared_mem, "/eucalyptusCCmessageStats", MESSAGE_STATS_MEMORY_REGION_SIZE, &(locks[STATSCACHE]),
+            rc = setup_shared_buffer((void **)&message_stats_shared_mem, "/eucalyptusCCmessageStats", sizeof(message_stats_table), &(locks[STATSCACHE]),
                                      "/eucalyptusCCmessageStatsLock", SHARED_FILE);
             if (rc != 0) {
                 fprintf(stderr, "Cannot setup shared memory region for message statistics, exiting...\n");
@@ -5956,63 +6750,18 @@ int init_dynamicCaches(void) {
     return (0);
 }
 
-//! Update the message stat structure
-//! Wraps the message stats update with the necessary caching copies.
-//! Caller must handle necessary locks
-static json_object **message_stats_getter()
+//! Returns the message stats table living in the shared memory region
+static message_stats_table *message_stats_getter()
 {
-    LOGTRACE("Fetching latest message stats from shared memory\n");
-
-    //copy the memory region into the proc-local buffer from the shared-memory region
-    euca_strncpy(message_stats_cache, message_stats_shared_mem, MESSAGE_STATS_MEMORY_REGION_SIZE);
-
-    //A process-local json cache to avoid repeated parsing
-    stats_cache_json = json_tokener_parse(message_stats_cache);
-
-    LOGTRACE("Message stats fetch complete\n");
-    return &stats_cache_json;
-}
-
-//! Write the cached value back to the shared memory region
-//! Must be called from within a lock for the memory region
-static void message_stats_setter()
-{
-    LOGTRACE("Updating latest message stats from shared memory\n");
-
-    if (stats_cache_json != NULL) {
-        //Write the memory back
-        const char *output = json_object_to_json_string(stats_cache_json);
-        LOGTRACE("Setting stats state to: %s\n", output);
-
-        if (strlen(output) + 1 > MESSAGE_STATS_MEMORY_REGION_SIZE) {
-            LOGERROR("Pre-allocated size for internal message stats exceeded. Stats updates will not be reflected.\n");
-        } else {
-            euca_strncpy(message_stats_shared_mem, output, strlen(output) + 1);
-        }
-
-        json_object_put(stats_cache_json);  //Free it
-    }
-
-    LOGTRACE("Message stats fetch complete\n");
-    return;
+    return (message_stats_shared_mem);
 }
 
 //! Update the message stat structure
-//! Wraps the message stats update with the necessary caching copies and locking
+//! The counters live in shared memory and are updated with atomic operations: no lock required
 int cached_message_stats_update(const char *message_name, long call_time, int msg_failed)
 {
     LOGTRACE("Updating message stats for message %s\n", message_name);
-    lock_stats();
-
-    json_object **stats_state = message_stats_getter();
-
-    //Update the counters
-    update_message_stats(*stats_state, message_name, call_time, msg_failed);
-
-    message_stats_setter();
-
-    unlock_stats();
-    LOGTRACE("Message stats update complete\n");
+    update_message_stats(message_stats_shared_mem, message_name, call_time, msg_failed);
     return EUCA_OK;
 }
 
@@ -6058,10 +6807,16 @@ int update_config(void)
                 }
                 EUCA_FREE(log_facility);
             }
+
+            char *log_async = configFileValue("LOGASYNC");
+            config->log_async = ((log_async != NULL) && !strcmp(log_async, "Y"));
+            EUCA_FREE(log_async);
+
             // reconfigure the logging subsystem to use the new values, if any
             log_params_set(config->log_level, (int)config->log_roll_number, config->log_max_size_bytes);
             log_prefix_set(config->log_prefix);
             log_facility_set(config->log_facility, "cc");
+            log_async_set(config->log_async ? TRUE : FALSE);
 
             // NODES
             LOGINFO("refreshing node list\n");
@@ -6143,7 +6898,9 @@ int init_config(void)
     int use_tunnels = 0;
     int use_proxy = 0;
     int proxy_max_cache_size = 0;
+    int proxy_max_downloads = 0;
     int schedPolicy = 0;
+    int schedAntiAffinity = 0;
     int idleThresh = 0;
     int wakeThresh = 0;
     int ccMaxInstances = DEFAULT_MAX_INSTANCES_PER_CC;
@@ -6261,6 +7018,8 @@ int init_config(void)
             schedPolicy = SCHEDROUNDROBIN;
         else if (!strcmp(tmpstr, "POWERSAVE"))
             schedPolicy = SCHEDPOWERSAVE;
+        else if (!strcmp(tmpstr, "BINPACK"))
+            schedPolicy = SCHEDBINPACK;
         else if (access(tmpstr, X_OK) == 0) {   // scheduler is an executable path, assumed to be user scheduler
             LOGWARN("will use user-defined scheduler at '%s'\n", tmpstr);
             euca_strncpy(schedPath, tmpstr, sizeof(schedPath));
@@ -6270,6 +7029,16 @@ int init_config(void)
     }
     EUCA_FREE(tmpstr);
 
+    // spread the instances of a reservation across nodes when possible (BINPACK only)
+    schedAntiAffinity = 0;
+    tmpstr = configFileValue("SCHED_ANTI_AFFINITY");
+    if (tmpstr) {
+        if (!strcmp(tmpstr, "Y")) {
+            schedAntiAffinity = 1;
+        }
+    }
+    EUCA_FREE(tmpstr);
+
     // powersave options
     tmpstr = configFileValue("POWER_IDLETHRESH");
     if (!tmpstr) {
@@ -6423,8 +7192,17 @@ int init_config(void)
     }
     EUCA_FREE(tmpstr);
 
+    proxy_max_downloads = 4;
+    tmpstr = configFileValue("CC_IMAGE_PROXY_MAX_DOWNLOADS");
+    if (tmpstr) {
+        proxy_max_downloads = atoi(tmpstr);
+        if (proxy_max_downloads <= 0) {
+            LOGWARN("bad value for CC_IMAGE_PROXY_MAX_DOWNLOADS (%s), defaulting to 4\n", tmpstr);
+            proxy_max_downloads = 4;
+        }
+    }
+    EUCA_FREE(tmpstr);
 
-    
     tmpstr = configFileValue("CC_IMAGE_PROXY_PATH");
     if (tmpstr) {
         snprintf(proxyPath, EUCA_MAX_PATH, "%s", tmpstr);
@@ -6434,7 +7212,7 @@ int init_config(void)
     }
 
     if (use_proxy)
-        LOGINFO("enabling CC image proxy cache with size %d, path %s\n", proxy_max_cache_size, proxyPath);
+        LOGINFO("enabling CC image proxy cache with size %d, path %s, %d concurrent download(s)\n", proxy_max_cache_size, proxyPath, proxy_max_downloads);
 
     sem_mywait(CONFIG);
     // set up the current config
@@ -6444,6 +7222,7 @@ int init_config(void)
     snprintf(config->proxyPath, EUCA_MAX_PATH, "%s", proxyPath);
     config->use_proxy = use_proxy;
     config->proxy_max_cache_size = proxy_max_cache_size;
+    config->proxy_max_downloads = proxy_max_downloads;
     if (use_proxy) {
         snprintf(config->proxyIp, 32, "%s", proxyIp);
     }
@@ -6452,6 +7231,7 @@ int init_config(void)
     config->use_wssec = use_wssec;
     config->use_tunnels = use_tunnels;
     config->schedPolicy = schedPolicy;
+    config->schedAntiAffinity = schedAntiAffinity;
     euca_strncpy(config->schedPath, schedPath, sizeof(config->schedPath));
     config->idleThresh = idleThresh;
     config->wakeThresh = wakeThresh;
@@ -6493,6 +7273,8 @@ int init_config(void)
     LOGINFO("                     policyfile=%s\n", SP(config->policyFile));
     LOGINFO("                     ws-security=%s\n", use_wssec ? "ENABLED" : "DISABLED");
     LOGINFO("                     schedulerPolicy=%s\n", SP(SCHEDPOLICIES[config->schedPolicy]));
+    if (config->schedPolicy == SCHEDBINPACK)
+        LOGINFO("                     antiAffinity=%s\n", config->schedAntiAffinity ? "ENABLED" : "DISABLED");
     LOGINFO("                     idleThreshold=%d\n", config->idleThresh);
     LOGINFO("                     wakeThreshold=%d\n", config->wakeThresh);
     LOGINFO("                     maxInstances=%d\n", config->ccMaxInstances);
@@ -7883,120 +8665,332 @@ int sem_mypost(int lockno)
 }
 
 //!
+//! Downloads an image and its manifest into the CC image proxy path, unless already there
 //!
+//! @param[in]  id the image identifier
+//! @param[in]  url the object storage URL of the image manifest
+//! @param[out] bytes the size of the cached image file
 //!
-//! @param[in] id
-//! @param[in] url
+//! @return EUCA_OK on success or EUCA_ERROR on failure
 //!
-//! @return
+static int image_cache_fetch(char *id, char *url, long long *bytes)
+{
+    char path[EUCA_MAX_PATH] = "";
+    char finalpath[EUCA_MAX_PATH] = "";
+    struct stat mystat = { 0 };
+
+    snprintf(finalpath, EUCA_MAX_PATH, "%s/data/%s.manifest.xml", config->proxyPath, id);
+    snprintf(path, EUCA_MAX_PATH, "%s/data/%s.manifest.xml.staging", config->proxyPath, id);
+    if (check_file(path) && check_file(finalpath)) {
+        if (objectstorage_object_by_url(url, path, 0)) {
+            LOGERROR("could not cache image manifest (%s/%s)\n", id, url);
+            unlink(path);
+            return (EUCA_ERROR);
+        }
+        rename(path, finalpath);
+        chmod(finalpath, 0600);
+    }
+
+    snprintf(path, EUCA_MAX_PATH, "%s/data/%s.staging", config->proxyPath, id);
+    snprintf(finalpath, EUCA_MAX_PATH, "%s/data/%s", config->proxyPath, id);
+    if (check_file(path) && check_file(finalpath)) {
+        if (objectstorage_image_by_manifest_url(url, path, 1)) {
+            LOGERROR("could not cache image (%s/%s)\n", id, url);
+            unlink(path);
+            return (EUCA_ERROR);
+        }
+        rename(path, finalpath);
+        chmod(finalpath, 0600);
+    }
+
+    if (stat(finalpath, &mystat)) {
+        LOGERROR("cached image '%s' disappeared\n", finalpath);
+        return (EUCA_ERROR);
+    }
+    *bytes = mystat.st_size;
+    return (EUCA_OK);
+}
+
 //!
-//! @pre
+//! Removes an image and its manifest from the CC image proxy path and frees its cache entry
 //!
-//! @note
+//! @param[in] image a pointer to the cache entry
 //!
-int image_cache(char *id, char *url)
+//! @pre The caller must hold the IMAGECACHE lock
+//!
+static void image_cache_remove(ccImage * image)
 {
-    int rc;
-    int pid;
-    char path[EUCA_MAX_PATH], finalpath[EUCA_MAX_PATH];
+    char path[EUCA_MAX_PATH] = "";
+
+    snprintf(path, EUCA_MAX_PATH, "%s/data/%s", config->proxyPath, image->id);
+    unlink(path);
+    snprintf(path, EUCA_MAX_PATH, "%s/data/%s.manifest.xml", config->proxyPath, image->id);
+    unlink(path);
+    if (image->state == IMGCACHE_READY)
+        imageCache->cachedBytes -= image->bytes;
+    bzero(image, sizeof(ccImage));
+}
 
-    if (url && id) {
-        pid = fork();
-        if (!pid) {
-            snprintf(finalpath, EUCA_MAX_PATH, "%s/data/%s.manifest.xml", config->proxyPath, id);
-            snprintf(path, EUCA_MAX_PATH, "%s/data/%s.manifest.xml.staging", config->proxyPath, id);
-            if (check_file(path) && check_file(finalpath)) {
-                rc = objectstorage_object_by_url(url, path, 0);
-                if (rc) {
-                    LOGERROR("could not cache image manifest (%s/%s)\n", id, url);
-                    unlink(path);
-                    exit(1);
-                }
-                rename(path, finalpath);
-                chmod(finalpath, 0600);
-            }
-            snprintf(path, EUCA_MAX_PATH, "%s/data/%s.staging", config->proxyPath, id);
-            snprintf(finalpath, EUCA_MAX_PATH, "%s/data/%s", config->proxyPath, id);
-            if (check_file(path) && check_file(finalpath)) {
-                rc = objectstorage_image_by_manifest_url(url, path, 1);
-                if (rc) {
-                    LOGERROR("could not cache image (%s/%s)\n", id, url);
-                    unlink(path);
-                    exit(1);
-                }
-                rename(path, finalpath);
-                chmod(finalpath, 0600);
+//!
+//! Indexes the images already present in the CC image proxy path, e.g. from before a restart
+//!
+//! @return EUCA_OK on success or EUCA_ERROR if the proxy path cannot be read
+//!
+//! @pre The caller must hold the IMAGECACHE lock
+//!
+static int image_cache_scan(void)
+{
+    int i = 0;
+    int rc = 0;
+    char proxyPath[EUCA_MAX_PATH] = "";
+    char path[EUCA_MAX_PATH] = "";
+    DIR *DH = NULL;
+    struct dirent dent, *result = NULL;
+    struct stat mystat = { 0 };
+    ccImage *image = NULL;
+
+    snprintf(proxyPath, EUCA_MAX_PATH, "%s/data", config->proxyPath);
+    if ((DH = opendir(proxyPath)) == NULL) {
+        LOGERROR("could not open dir '%s'\n", proxyPath);
+        return (EUCA_ERROR);
+    }
+
+    rc = readdir_r(DH, &dent, &result);
+    while (!rc && result) {
+        if (strcmp(dent.d_name, ".") && strcmp(dent.d_name, "..") && !strstr(dent.d_name, "manifest.xml") && !strstr(dent.d_name, ".staging")
+            && strcmp(dent.d_name, "network-topology") && strcmp(dent.d_name, "config-cc") && (strlen(dent.d_name) < sizeof(image->id))) {
+            for (i = 0; (i < imageCache->numImages) && strcmp(imageCache->images[i].id, dent.d_name); i++) ;
+            snprintf(path, EUCA_MAX_PATH, "%s/%s", proxyPath, dent.d_name);
+            if ((i == imageCache->numImages) && (i < MAX_CACHED_IMAGES) && !stat(path, &mystat)) {
+                image = &(imageCache->images[imageCache->numImages++]);
+                euca_strncpy(image->id, dent.d_name, sizeof(image->id));
+                image->state = IMGCACHE_READY;
+                image->lastAccess = mystat.st_atime;
+                image->bytes = mystat.st_size;
+                imageCache->cachedBytes += image->bytes;
+                LOGDEBUG("indexed cached image: name=%s size=%lld atime=%ld\n", image->id, image->bytes / 1048576, image->lastAccess);
             }
-            exit(0);
         }
+        rc = readdir_r(DH, &dent, &result);
     }
-
-    return (0);
+    closedir(DH);
+    return (EUCA_OK);
 }
 
 //!
+//! Builds the image proxy cache counters reported by the stats subsystem
 //!
+//! @return a new json object mapping the counter names to their values
 //!
-//! @return
+static json_object *image_cache_counters(void)
+{
+    int i = 0;
+    int inflight = 0;
+    int cached = 0;
+    json_object *counters = json_object_new_object();
+
+    sem_mywait(IMAGECACHE);
+    for (i = 0; i < imageCache->numImages; i++) {
+        if (imageCache->images[i].state == IMGCACHE_DOWNLOADING)
+            inflight++;
+        else if (imageCache->images[i].state == IMGCACHE_READY)
+            cached++;
+    }
+    json_object_object_add(counters, "image_cache_hits", json_object_new_int64(imageCache->hits + imageCache->joins));
+    json_object_object_add(counters, "image_cache_misses", json_object_new_int64(imageCache->misses));
+    json_object_object_add(counters, "image_cache_deduplicated", json_object_new_int64(imageCache->joins));
+    json_object_object_add(counters, "image_cache_throttled", json_object_new_int64(imageCache->throttled));
+    json_object_object_add(counters, "image_cache_downloads", json_object_new_int64(imageCache->downloads));
+    json_object_object_add(counters, "image_cache_failures", json_object_new_int64(imageCache->failures));
+    json_object_object_add(counters, "image_cache_evictions", json_object_new_int64(imageCache->evictions));
+    json_object_object_add(counters, "image_cache_bytes_downloaded", json_object_new_int64(imageCache->bytesDownloaded));
+    json_object_object_add(counters, "image_cache_bytes", json_object_new_int64(imageCache->cachedBytes));
+    json_object_object_add(counters, "image_cache_images", json_object_new_int(cached));
+    json_object_object_add(counters, "image_cache_inflight", json_object_new_int(inflight));
+    sem_mypost(IMAGECACHE);
+
+    return (counters);
+}
+
 //!
-//! @pre
+//! Makes sure an image gets into the CC image proxy cache. Only one download per image is ever
+//! in flight across the CC processes and at most CC_IMAGE_PROXY_MAX_DOWNLOADS run at once. The
+//! download runs in a detached process and does not hold up the caller.
 //!
-//! @note
+//! @param[in] id the image identifier
+//! @param[in] url the object storage URL of the image manifest
 //!
-int image_cache_invalidate(void)
+//! @return 0 if the image is or will be served by the proxy, 1 if it should be fetched from object storage
+//!
+int image_cache(char *id, char *url)
 {
-    time_t oldest;
-    char proxyPath[EUCA_MAX_PATH], path[EUCA_MAX_PATH], oldestpath[EUCA_MAX_PATH], oldestmanifestpath[EUCA_MAX_PATH];
-    DIR *DH = NULL;
-    struct dirent dent, *result = NULL;
-    struct stat mystat;
-    int rc, total_megs = 0;
+    int i = 0;
+    int rc = 0;
+    int status = 0;
+    int slot = -1;
+    int downloading = 0;
+    pid_t pid = 0;
+    long long bytes = 0;
+    ccImage *image = NULL;
 
-    if (config->use_proxy) {
-        proxyPath[0] = '\0';
-        path[0] = '\0';
-        oldestpath[0] = '\0';
-        oldestmanifestpath[0] = '\0';
-
-        oldest = time(NULL);
-        snprintf(proxyPath, EUCA_MAX_PATH, "%s/data", config->proxyPath);
-        DH = opendir(proxyPath);
-        if (!DH) {
-            LOGERROR("could not open dir '%s'\n", proxyPath);
-            return (1);
+    if (!id || !url || (strlen(id) >= sizeof(image->id)))
+        return (1);
+
+    sem_mywait(IMAGECACHE);
+    for (i = 0; i < imageCache->numImages; i++) {
+        if (imageCache->images[i].state == IMGCACHE_FREE) {
+            if (slot < 0)
+                slot = i;
+            continue;
         }
+        if (imageCache->images[i].state == IMGCACHE_DOWNLOADING)
+            downloading++;
+        if (!strcmp(imageCache->images[i].id, id))
+            image = &(imageCache->images[i]);
+    }
 
-        rc = readdir_r(DH, &dent, &result);
-        while (!rc && result) {
-            if (strcmp(dent.d_name, ".") && strcmp(dent.d_name, "..") && !strstr(dent.d_name, "manifest.xml") && strcmp(dent.d_name, "network-topology")
-                && strcmp(dent.d_name, "config-cc")) {
-                snprintf(path, EUCA_MAX_PATH, "%s/%s", proxyPath, dent.d_name);
-                rc = stat(path, &mystat);
-                if (!rc) {
-                    LOGDEBUG("evaluating file: name=%s size=%ld atime=%ld'\n", dent.d_name, mystat.st_size / 1048576, mystat.st_atime);
-                    if (mystat.st_atime < oldest) {
-                        oldest = mystat.st_atime;
-                        snprintf(oldestpath, EUCA_MAX_PATH, "%s", path);
-                        snprintf(oldestmanifestpath, EUCA_MAX_PATH, "%s.manifest.xml", path);
-                    }
-                    total_megs += mystat.st_size / 1048576;
+    if (image) {
+        if (image->state == IMGCACHE_READY) {
+            imageCache->hits++;
+            image->lastAccess = time(NULL);
+        } else {
+            imageCache->joins++;
+        }
+        sem_mypost(IMAGECACHE);
+        LOGDEBUG("image %s is %s the proxy cache\n", id, (image->state == IMGCACHE_READY) ? "in" : "being downloaded into");
+        return (0);
+    }
+
+    if ((slot < 0) && (imageCache->numImages < MAX_CACHED_IMAGES))
+        slot = imageCache->numImages++;
+    if ((slot < 0) || (downloading >= config->proxy_max_downloads)) {
+        imageCache->throttled++;
+        sem_mypost(IMAGECACHE);
+        LOGDEBUG("not caching image %s: %d download(s) in progress, %d image(s) indexed\n", id, downloading, imageCache->numImages);
+        return (1);
+    }
+
+    image = &(imageCache->images[slot]);
+    bzero(image, sizeof(ccImage));
+    euca_strncpy(image->id, id, sizeof(image->id));
+    image->state = IMGCACHE_DOWNLOADING;
+    image->started = image->lastAccess = time(NULL);
+    imageCache->misses++;
+    sem_mypost(IMAGECACHE);
+
+    if ((pid = fork()) == 0) {
+        // the download is detached from this process, so nobody has to reap it
+        if (fork() == 0) {
+            sem_mywait(IMAGECACHE);
+            image->pid = getpid();
+            sem_mypost(IMAGECACHE);
+
+            rc = image_cache_fetch(id, url, &bytes);
+
+            sem_mywait(IMAGECACHE);
+            if ((image->state == IMGCACHE_DOWNLOADING) && (image->pid == getpid())) {
+                if (rc == EUCA_OK) {
+                    image->state = IMGCACHE_READY;
+                    image->bytes = bytes;
+                    imageCache->cachedBytes += bytes;
+                    imageCache->bytesDownloaded += bytes;
+                    imageCache->downloads++;
+                } else {
+                    bzero(image, sizeof(ccImage));
+                    imageCache->failures++;
                 }
             }
-            rc = readdir_r(DH, &dent, &result);
-        }
-        closedir(DH);
-        LOGDEBUG("summary: totalMBs=%d oldestAtime=%ld oldestFile=%s\n", total_megs, oldest, oldestpath);
-        if (total_megs > config->proxy_max_cache_size) {
-            // start slowly deleting
-            LOGINFO("invalidating cached image %s\n", oldestpath);
-            unlink(oldestpath);
-            unlink(oldestmanifestpath);
+            sem_mypost(IMAGECACHE);
+            exit((rc == EUCA_OK) ? 0 : 1);
         }
+        exit(0);
+    } else if (pid < 0) {
+        LOGERROR("cannot fork to cache image %s\n", id);
+        sem_mywait(IMAGECACHE);
+        bzero(image, sizeof(ccImage));
+        imageCache->failures++;
+        sem_mypost(IMAGECACHE);
+        return (1);
     }
 
+    waitpid(pid, &status, 0);
     return (0);
 }
 
+//!
+//! Maintains the CC image proxy cache: forgets downloads that died or took too long and images
+//! removed from the proxy path, then evicts the least recently used images until the cache fits
+//! within CC_IMAGE_PROXY_CACHE_SIZE.
+//!
+//! @return 0 on success or 1 if the proxy path cannot be read
+//!
+int image_cache_invalidate(void)
+{
+    int i = 0;
+    int oldest = 0;
+    int ret = 0;
+    time_t now = 0;
+    char path[EUCA_MAX_PATH] = "";
+    struct stat mystat = { 0 };
+    ccImage *image = NULL;
+
+    if (!config->use_proxy)
+        return (0);
+
+    sem_mywait(IMAGECACHE);
+    if (!imageCache->scanned) {
+        if (image_cache_scan() == EUCA_OK)
+            imageCache->scanned = TRUE;
+        else
+            ret = 1;
+    }
+
+    now = time(NULL);
+    for (i = 0; i < imageCache->numImages; i++) {
+        image = &(imageCache->images[i]);
+        if (image->state == IMGCACHE_DOWNLOADING) {
+            if (((image->pid > 0) && (kill(image->pid, 0) != 0) && (errno == ESRCH)) || ((now - image->started) > IMAGE_CACHE_DOWNLOAD_TIMEOUT_SEC)) {
+                LOGWARN("abandoning download of image %s into the proxy cache\n", image->id);
+                if (image->pid > 0)
+                    kill(image->pid, SIGKILL);
+                snprintf(path, EUCA_MAX_PATH, "%s/data/%s.staging", config->proxyPath, image->id);
+                unlink(path);
+                snprintf(path, EUCA_MAX_PATH, "%s/data/%s.manifest.xml.staging", config->proxyPath, image->id);
+                unlink(path);
+                image_cache_remove(image);
+                imageCache->failures++;
+            }
+        } else if (image->state == IMGCACHE_READY) {
+            snprintf(path, EUCA_MAX_PATH, "%s/data/%s", config->proxyPath, image->id);
+            if (stat(path, &mystat)) {
+                LOGDEBUG("cached image %s is gone from the proxy path\n", image->id);
+                image_cache_remove(image);
+            }
+        }
+    }
+
+    while ((imageCache->cachedBytes / 1048576) > config->proxy_max_cache_size) {
+        for (i = 0, oldest = -1; i < imageCache->numImages; i++) {
+            if ((imageCache->images[i].state == IMGCACHE_READY) && ((oldest < 0) || (imageCache->images[i].lastAccess < imageCache->images[oldest].lastAccess)))
+                oldest = i;
+        }
+        if (oldest < 0)
+            break;
+
+        LOGINFO("invalidating cached image %s/data/%s\n", config->proxyPath, imageCache->images[oldest].id);
+        image_cache_remove(&(imageCache->images[oldest]));
+        imageCache->evictions++;
+    }
+
+    while ((imageCache->numImages > 0) && (imageCache->images[imageCache->numImages - 1].state == IMGCACHE_FREE))
+        imageCache->numImages--;
+
+    LOGDEBUG("summary: totalMBs=%lld images=%d hits=%lld misses=%lld evictions=%lld\n", imageCache->cachedBytes / 1048576, imageCache->numImages,
+             imageCache->hits + imageCache->joins, imageCache->misses, imageCache->evictions);
+    sem_mypost(IMAGECACHE);
+    return (ret);
+}
+
 //!
 //!
 //!
@@ -93,9 +93,12 @@
 #define OP_TIMEOUT                               60
 #define OP_TIMEOUT_PERNODE                       20
 #define OP_TIMEOUT_MIN                            5
+#define OP_TIMEOUT_RUNINSTANCES                 180 //!< overall budget of a RunInstances request, however many instances a node gets
 #define LOG_INTERVAL_SUMMARY_SEC                 60
 #define SCHED_TIMEOUT_SEC                         8 //! timeout for user scheduler
-#define MESSAGE_STATS_MEMORY_REGION_SIZE         10485760   //! 10 MB
+#define MAX_CACHED_IMAGES                      1024 //!< number of images the CC image proxy cache keeps track of
+#define IMAGE_CACHE_DOWNLOAD_TIMEOUT_SEC       3600 //!< an image download taking longer than this is given up on
+#define MAX_IMAGE_PEER_HINTS                    256 //!< most "who has image X" hints sent to a node per resource refresh
 
 /*
 {
@@ -133,6 +136,7 @@ enum {
     SENSORCACHE,
     STATSCACHE,
     GLOBALNETWORKINFO,
+    IMAGECACHE,
     NCCALL0,
     NCCALL1,
     NCCALL2,
@@ -186,6 +190,13 @@ enum {
     RESWAKING,
 };
 
+//! States of an image in the CC image proxy cache
+enum {
+    IMGCACHE_FREE,                     //!< unused entry
+    IMGCACHE_DOWNLOADING,              //!< being downloaded into the proxy path
+    IMGCACHE_READY,                    //!< in the proxy path, ready to be served
+};
+
 enum {
     INSTINVALID,
     INSTVALID,
@@ -216,6 +227,7 @@ enum {
     SCHEDROUNDROBIN,
     SCHEDPOWERSAVE,
     SCHEDUSER,
+    SCHEDBINPACK,
     SCHEDLAST,
 };
 
@@ -305,8 +317,18 @@ typedef struct resource_t {
     char nodeStatus[24];
     boolean migrationCapable;
     char hypervisor[16];
+    int imagePeerPort;
+    char cachedImages[MAX_CACHED_IMAGES_ADVERTISED][CACHED_IMAGE_ID_SIZE];
+    int cachedImagesLen;
 } ccResource;
 
+//! Images in the cache of a node, as reported to a pre-warm request
+typedef struct ccImageResidency_t {
+    char nodeName[256];
+    boolean reachable;                 //!< FALSE when the node did not answer the request, in which case images is empty
+    ncImageResidency images;
+} ccImageResidency;
+
 typedef struct ccResourceCache_t {
     ccResource resources[MAXNODES];
     int cacheState[MAXNODES];
@@ -332,6 +354,32 @@ typedef struct ccInstanceCacheMetadata_t {
     int dirty;
 } ccInstanceCacheMetadata;
 
+//! An image in the CC image proxy cache
+typedef struct ccImage_t {
+    char id[64];                       //!< image identifier, also the name of the cached file
+    int state;                         //!< one of the IMGCACHE_* states
+    pid_t pid;                         //!< process downloading the image (IMGCACHE_DOWNLOADING)
+    time_t started;                    //!< when the download started
+    time_t lastAccess;                 //!< last time an instance was launched from it, for LRU eviction
+    long long bytes;                   //!< size of the cached image file
+} ccImage;
+
+//! Index of the CC image proxy cache, shared between CC processes
+typedef struct ccImageCache_t {
+    ccImage images[MAX_CACHED_IMAGES];
+    int numImages;                     //!< number of entries in use at the beginning of images[]
+    boolean scanned;                   //!< set once the images already in the proxy path are indexed
+    long long cachedBytes;             //!< total size of the IMGCACHE_READY images
+    long long hits;                    //!< requests served from a cached image
+    long long joins;                   //!< requests for an image already being downloaded
+    long long misses;                  //!< requests that started a download
+    long long throttled;               //!< requests not cached because of the download limit
+    long long downloads;               //!< completed downloads
+    long long failures;                //!< failed or abandoned downloads
+    long long bytesDownloaded;         //!< bytes brought into the cache
+    long long evictions;               //!< images evicted to stay within the cache size
+} ccImageCache;
+
 typedef struct ccConfig_t {
     char eucahome[EUCA_MAX_PATH];
     char log_file_path[EUCA_MAX_PATH];
@@ -340,10 +388,12 @@ typedef struct ccConfig_t {
     int log_level;
     char log_prefix[64];
     char log_facility[32];
+    int log_async;
     char proxyPath[EUCA_MAX_PATH];
     char proxyIp[32];
     int use_proxy;
     int proxy_max_cache_size;
+    int proxy_max_downloads;
     char configFiles[2][EUCA_MAX_PATH];
     int use_wssec;
     int use_tunnels;
@@ -353,6 +403,7 @@ typedef struct ccConfig_t {
     int schedPolicy;
     char schedPath[EUCA_MAX_PATH];
     int schedState;
+    int schedAntiAffinity;
     int idleThresh;
     int wakeThresh;
     time_t instanceTimeout;
@@ -429,6 +480,8 @@ int schedule_instance_roundrobin(virtualMachine * vm, int *outresid);
 int schedule_instance_explicit(virtualMachine * vm, char *targetNode, int *outresid, boolean is_migration);
 int schedule_instance_user(virtualMachine * vm, char *amiId, char *kernelId, char *ramdiskId, char *instId, char *userData, char *platform, int *outresid);
 int schedule_instance_greedy(virtualMachine * vm, int *outresid);
+int schedule_instance_binpack(virtualMachine * vm, int *outresid);
+int schedule_reservation(virtualMachine * vm, int count, int *outresids);
 int doRunInstances(ncMetadata * pMeta, char *amiId, char *kernelId, char *ramdiskId, char *amiURL, char *kernelURL, char *ramdiskURL, char **instIds,
                    int instIdsLen, char **netNames, int netNamesLen, char **netIds, int netIdsLen, char **macAddrs, int macAddrsLen, int *networkIndexList,
                    int networkIndexListLen, char **uuids, int uuidsLen, char **privateIps, int privateIpsLen, int minCount, int maxCount, char *accountId,
@@ -442,6 +495,7 @@ int doCreateImage(ncMetadata * pMeta, char *instanceId, char *volumeId, char *re
 int doDescribeSensors(ncMetadata * pMeta, int historySize, long long collectionIntervalTimeMs, char **instIds, int instIdsLen, char **sensorIds,
                       int sensorIdsLen, sensorResource *** outResources, int *outResourcesLen);
 int doModifyNode(ncMetadata * pMeta, char *nodeName, char *nodeState);
+int doPrewarmImages(ncMetadata * pMeta, virtualBootRecord * images, int imagesLen, char **nodeNames, int nodeNamesLen, ccImageResidency ** outNodes, int *outNodesLen);
 int doMigrateInstances(ncMetadata * pMeta, char *sourceNode, char *instanceId, char **destinationNodes, int destinationNodeCount, int allowHosts, char *nodeAction, char **resourceLocations, int resourceLocationCount);
 int doStartInstance(ncMetadata * pMeta, char *instanceId);
 int doStopInstance(ncMetadata * pMeta, char *instanceId);
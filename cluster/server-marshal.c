@@ -2033,6 +2033,111 @@ adb_ModifyNodeResponse_t *ModifyNodeMarshal(adb_ModifyNode_t * modifyNode, const
     return (ret);
 }
 
+//!
+//! Unmarshalls request to pre-warm images on the node controllers, executes, responds.
+//!
+//! @param[in] prewarmImages a pointer to the request message structure
+//! @param[in] env pointer to the AXIS2 environment structure
+//!
+//! @return a pointer to the response message structure
+//!
+adb_PrewarmImagesResponse_t *PrewarmImagesMarshal(adb_PrewarmImages_t * prewarmImages, const axutil_env_t * env)
+{
+    adb_PrewarmImagesResponse_t *ret = NULL;
+    adb_prewarmImagesResponseType_t *pirt = NULL;
+    adb_prewarmImagesType_t *pit = NULL;
+    adb_imageResidencyType_t *irt = NULL;
+    adb_virtualBootRecordType_t *vbr_type = NULL;
+    int i = 0;
+    int j = 0;
+    int rc = 0;
+    int imagesLen = 0;
+    int nodeNamesLen = 0;
+    int outNodesLen = 0;
+    axis2_bool_t status = AXIS2_TRUE;
+    char statusMessage[256] = { 0 };
+    char **nodeNames = NULL;
+    virtualBootRecord *images = NULL;
+    ccImageResidency *outNodes = NULL;
+    ncMetadata ccMeta = { 0 };
+    long long call_time = time_ms();
+
+    pit = adb_PrewarmImages_get_PrewarmImages(prewarmImages, env);
+
+    EUCA_MESSAGE_UNMARSHAL(prewarmImagesType, pit, (&ccMeta));
+
+    if ((imagesLen = adb_prewarmImagesType_sizeof_images(pit, env)) > MAX_PREWARM_IMAGES) {
+        LOGWARN("pre-warming only the first %d of %d images\n", MAX_PREWARM_IMAGES, imagesLen);
+        imagesLen = MAX_PREWARM_IMAGES;
+    }
+    if (imagesLen > 0) {
+        images = EUCA_ZALLOC(imagesLen, sizeof(virtualBootRecord));
+    }
+    nodeNamesLen = adb_prewarmImagesType_sizeof_nodeNames(pit, env);
+    if (nodeNamesLen > 0) {
+        nodeNames = EUCA_ZALLOC(nodeNamesLen, sizeof(char *));
+    }
+
+    if (((imagesLen > 0) && !images) || ((nodeNamesLen > 0) && !nodeNames)) {
+        LOGERROR("out of memory\n");
+        status = AXIS2_FALSE;
+        snprintf(statusMessage, 255, "ERROR");
+    } else {
+        for (i = 0; i < imagesLen; i++) {
+            if ((vbr_type = adb_prewarmImagesType_get_images_at(pit, env, i)) != NULL)
+                copy_vbr_type_from_adb(&images[i], vbr_type, env);
+        }
+        for (i = 0; i < nodeNamesLen; i++) {
+            nodeNames[i] = adb_prewarmImagesType_get_nodeNames_at(pit, env, i);
+        }
+
+        if (!DONOTHING) {
+            threadCorrelationId *corr_id = set_corrid(ccMeta.correlationId);
+            rc = doPrewarmImages(&ccMeta, images, imagesLen, nodeNames, nodeNamesLen, &outNodes, &outNodesLen);
+            unset_corrid(corr_id);
+            if (rc) {
+                LOGERROR("doPrewarmImages() failed: %d\n", rc);
+                status = AXIS2_FALSE;
+                snprintf(statusMessage, 255, "ERROR");
+            }
+        }
+    }
+
+    pirt = adb_prewarmImagesResponseType_create(env);
+    adb_prewarmImagesResponseType_set_return(pirt, env, status);
+    if (status == AXIS2_FALSE) {
+        adb_prewarmImagesResponseType_set_statusMessage(pirt, env, statusMessage);
+    } else {
+        for (i = 0; i < outNodesLen; i++) {
+            irt = adb_imageResidencyType_create(env);
+            adb_imageResidencyType_set_nodeName(irt, env, outNodes[i].nodeName);
+            adb_imageResidencyType_set_reachable(irt, env, (outNodes[i].reachable ? AXIS2_TRUE : AXIS2_FALSE));
+            for (j = 0; j < outNodes[i].images.residentImagesLen; j++) {
+                adb_imageResidencyType_add_residentImages(irt, env, outNodes[i].images.residentImages[j]);
+            }
+            for (j = 0; j < outNodes[i].images.pendingImagesLen; j++) {
+                adb_imageResidencyType_add_pendingImages(irt, env, outNodes[i].images.pendingImages[j]);
+            }
+            adb_prewarmImagesResponseType_add_nodes(pirt, env, irt);
+        }
+    }
+    EUCA_FREE(outNodes);
+    EUCA_FREE(nodeNames);
+    EUCA_FREE(images);
+
+    adb_prewarmImagesResponseType_set_correlationId(pirt, env, ccMeta.correlationId);
+    adb_prewarmImagesResponseType_set_userId(pirt, env, ccMeta.userId);
+
+    ret = adb_PrewarmImagesResponse_create(env);
+    adb_PrewarmImagesResponse_set_PrewarmImagesResponse(ret, env, pirt);
+
+    //update stats and return
+    call_time = time_ms() - call_time;
+    cached_message_stats_update("PrewarmImages", (long)call_time, rc);
+
+    return (ret);
+}
+
 //!
 //! Unmarshalls request to modify a node controller, executes, responds.
 //!
@@ -0,0 +1,377 @@
+// -*- mode: C; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+// vim: set softtabstop=4 shiftwidth=4 tabstop=4 expandtab:
+
+/*************************************************************************
+ * Copyright 2009-2012 Eucalyptus Systems, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ *
+ * Please contact Eucalyptus Systems, Inc., 6755 Hollister Ave., Goleta
+ * CA 93117, USA or visit http://www.eucalyptus.com/licenses/ if you need
+ * additional information or have any questions.
+ *
+ * This file may incorporate work covered under the following copyright
+ * and permission notice:
+ *
+ *   Software License Agreement (BSD License)
+ *
+ *   Copyright (c) 2008, Regents of the University of California
+ *   All rights reserved.
+ *
+ *   Redistribution and use of this software in source and binary forms,
+ *   with or without modification, are permitted provided that the
+ *   following conditions are met:
+ *
+ *     Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *     Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE. USERS OF THIS SOFTWARE ACKNOWLEDGE
+ *   THE POSSIBLE PRESENCE OF OTHER OPEN SOURCE LICENSED MATERIAL,
+ *   COPYRIGHTED MATERIAL OR PATENTED MATERIAL IN THIS SOFTWARE,
+ *   AND IF ANY SUCH MATERIAL IS DISCOVERED THE PARTY DISCOVERING
+ *   IT MAY INFORM DR. RICH WOLSKI AT THE UNIVERSITY OF CALIFORNIA,
+ *   SANTA BARBARA WHO WILL THEN ASCERTAIN THE MOST APPROPRIATE REMEDY,
+ *   WHICH IN THE REGENTS' DISCRETION MAY INCLUDE, WITHOUT LIMITATION,
+ *   REPLACEMENT OF THE CODE SO IDENTIFIED, LICENSING OF THE CODE SO
+ *   IDENTIFIED, OR WITHDRAWAL OF THE CODE CAPABILITY TO THE EXTENT
+ *   NEEDED TO COMPLY WITH ANY SUCH LICENSES OR RIGHTS.
+ ************************************************************************/
+
+//!
+//! @file net/arp_handler.c
+//! Implements the in-process gratuitous ARP announcer. Announcements are queued
+//! while the network configuration is applied and then sent in a few rounds,
+//! all from a single raw socket and at a bounded packet rate, instead of forking
+//! one arping or announce-arp process per address.
+//!
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  INCLUDES                                  |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <net/if_arp.h>
+#include <netinet/if_ether.h>
+#include <linux/if_packet.h>
+
+#include <eucalyptus.h>
+#include <misc.h>
+#include <log.h>
+#include <euca_string.h>
+
+#include "arp_handler.h"
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  DEFINES                                   |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  TYPEDEFS                                  |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                ENUMERATIONS                                |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                 STRUCTURES                                 |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+//! A gratuitous ARP frame
+typedef struct arp_frame_t {
+    struct ether_header eth;           //!< Ethernet header
+    struct ether_arp arp;              //!< ARP payload
+} __attribute__ ((packed)) arp_frame;
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                             EXTERNAL VARIABLES                             |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/* Should preferably be handled in header file */
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                              GLOBAL VARIABLES                              |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                              STATIC VARIABLES                              |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                              STATIC PROTOTYPES                             |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+static int arp_handler_send_one(arp_handler * pArph, arp_announcement * pAnnounce);
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                   MACROS                                   |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                               IMPLEMENTATION                               |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+//!
+//! Initialize the given ARP announcer. Opening a raw packet socket requires
+//! CAP_NET_RAW but sending on it does not, so this must be called before
+//! eucanetd switches to its unprivileged user.
+//!
+//! @param[in] pArph pointer to the ARP announcer structure
+//! @param[in] rate the maximum number of packets to send per second (0 for ARP_ANNOUNCE_RATE)
+//!
+//! @return 0 on success or 1 on failure
+//!
+//! @pre The pArph parameter MUST not be NULL
+//!
+//! @post On success ONLY, the 'initialized' field is set to TRUE. On failure, callers
+//!       should fall back on the external announce tools.
+//!
+int arp_handler_init(arp_handler * pArph, u32 rate)
+{
+    if (!pArph) {
+        LOGERROR("Invalid argument: cannot initialize NULL ARP announcer\n");
+        return (1);
+    }
+
+    bzero(pArph, sizeof(arp_handler));
+    pArph->rate = ((rate > 0) ? rate : ARP_ANNOUNCE_RATE);
+
+    // protocol 0: we only transmit, never receive anything on this socket
+    if ((pArph->sock = socket(AF_PACKET, SOCK_RAW, 0)) < 0) {
+        LOGWARN("cannot open raw packet socket (%s): gratuitous ARPs will be sent with external tools\n", strerror(errno));
+        return (1);
+    }
+
+    pArph->initialized = TRUE;
+    return (0);
+}
+
+//!
+//! Queues a gratuitous ARP announcement. Announcing the same address twice on
+//! the same interface before arp_handler_send() is a no-op.
+//!
+//! @param[in] pArph pointer to an initialized ARP announcer
+//! @param[in] psDevice the interface to announce on
+//! @param[in] psIp the dotted IP address to announce
+//! @param[in] psMac the MAC address the IP resolves to (NULL for the interface MAC)
+//!
+//! @return 0 on success or 1 on failure
+//!
+int arp_handler_queue(arp_handler * pArph, const char *psDevice, const char *psIp, const char *psMac)
+{
+    u32 i = 0;
+    arp_announcement announce = { 0 };
+    arp_announcement *pQueue = NULL;
+    struct ifreq ifr = { {{0}} };
+
+    if (!pArph || !pArph->initialized || !psDevice || !psIp) {
+        LOGERROR("Invalid argument: cannot queue ARP announcement for %s on %s\n", SP(psIp), SP(psDevice));
+        return (1);
+    }
+
+    if ((announce.ifIndex = if_nametoindex(psDevice)) == 0) {
+        LOGERROR("Cannot find interface %s to announce %s\n", psDevice, psIp);
+        return (1);
+    }
+
+    if (psMac) {
+        if (!euca_mac2hex(psMac, announce.aMac)) {
+            LOGERROR("Invalid MAC address %s to announce %s\n", psMac, psIp);
+            return (1);
+        }
+    } else {
+        euca_strncpy(ifr.ifr_name, psDevice, IFNAMSIZ);
+        if (ioctl(pArph->sock, SIOCGIFHWADDR, &ifr) < 0) {
+            LOGERROR("Cannot retrieve MAC address of %s to announce %s: %s\n", psDevice, psIp, strerror(errno));
+            return (1);
+        }
+        memcpy(announce.aMac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+    }
+    announce.ip = htonl(euca_dot2hex(psIp));
+
+    for (i = 0; i < pArph->nbQueued; i++) {
+        if (!memcmp(&pArph->pQueue[i], &announce, sizeof(announce))) {
+            return (0);
+        }
+    }
+
+    if ((pQueue = EUCA_REALLOC(pArph->pQueue, (pArph->nbQueued + 1), sizeof(arp_announcement))) == NULL) {
+        LOGFATAL("out of memory!\n");
+        return (1);
+    }
+    pArph->pQueue = pQueue;
+    pArph->pQueue[pArph->nbQueued++] = announce;
+    return (0);
+}
+
+//!
+//! Sends every queued announcement 'rounds' times and empties the queue. Packets
+//! are paced to stay under the configured rate and rounds are at least 'intervalMs'
+//! apart, so a mass reassignment turns into a short, bounded burst.
+//!
+//! @param[in] pArph pointer to an initialized ARP announcer
+//! @param[in] rounds number of times each announcement is sent
+//! @param[in] intervalMs minimum delay between the start of two rounds
+//!
+//! @return 0 on success or 1 if any packet could not be sent
+//!
+int arp_handler_send(arp_handler * pArph, u32 rounds, u32 intervalMs)
+{
+    int ret = 0;
+    u32 i = 0;
+    u32 round = 0;
+    long elapsedMs = 0;
+    unsigned long long spacing = 0;
+    struct timeval start = { 0 };
+    struct timeval now = { 0 };
+
+    if (!pArph || !pArph->initialized) {
+        return (1);
+    }
+
+    if (pArph->nbQueued == 0) {
+        return (0);
+    }
+
+    LOGDEBUG("sending %u gratuitous ARP announcement(s) x%u\n", pArph->nbQueued, rounds);
+    spacing = NANOSECONDS_IN_SECOND / pArph->rate;
+    for (round = 0; round < rounds; round++) {
+        gettimeofday(&start, NULL);
+        for (i = 0; i < pArph->nbQueued; i++) {
+            if (arp_handler_send_one(pArph, &pArph->pQueue[i])) {
+                ret = 1;
+            }
+            euca_nanosleep(spacing);
+        }
+
+        if ((round + 1) < rounds) {
+            gettimeofday(&now, NULL);
+            elapsedMs = ((now.tv_sec - start.tv_sec) * 1000) + ((now.tv_usec - start.tv_usec) / 1000);
+            if (elapsedMs < (long)intervalMs) {
+                euca_nanosleep((unsigned long long)(intervalMs - elapsedMs) * 1000000ULL);
+            }
+        }
+    }
+
+    EUCA_FREE(pArph->pQueue);
+    pArph->nbQueued = 0;
+    return (ret);
+}
+
+//!
+//! Releases the resources of an ARP announcer.
+//!
+//! @param[in] pArph pointer to the ARP announcer structure
+//!
+//! @return 0 on success or 1 if pArph is NULL
+//!
+int arp_handler_free(arp_handler * pArph)
+{
+    if (!pArph) {
+        return (1);
+    }
+
+    if (pArph->initialized) {
+        close(pArph->sock);
+    }
+    EUCA_FREE(pArph->pQueue);
+    bzero(pArph, sizeof(arp_handler));
+    return (0);
+}
+
+//!
+//! Sends one gratuitous ARP request (sender and target protocol addresses are both
+//! the announced IP) to the broadcast address.
+//!
+//! @param[in] pArph pointer to an initialized ARP announcer
+//! @param[in] pAnnounce the announcement to send
+//!
+//! @return 0 on success or 1 on failure
+//!
+static int arp_handler_send_one(arp_handler * pArph, arp_announcement * pAnnounce)
+{
+    arp_frame frame = { {{0}} };
+    struct sockaddr_ll sll = { 0 };
+
+    memset(frame.eth.ether_dhost, 0xFF, ETH_ALEN);
+    memcpy(frame.eth.ether_shost, pAnnounce->aMac, ETH_ALEN);
+    frame.eth.ether_type = htons(ETHERTYPE_ARP);
+
+    frame.arp.ea_hdr.ar_hrd = htons(ARPHRD_ETHER);
+    frame.arp.ea_hdr.ar_pro = htons(ETHERTYPE_IP);
+    frame.arp.ea_hdr.ar_hln = ETH_ALEN;
+    frame.arp.ea_hdr.ar_pln = sizeof(pAnnounce->ip);
+    frame.arp.ea_hdr.ar_op = htons(ARPOP_REQUEST);
+    memcpy(frame.arp.arp_sha, pAnnounce->aMac, ETH_ALEN);
+    memcpy(frame.arp.arp_spa, &pAnnounce->ip, sizeof(pAnnounce->ip));
+    memcpy(frame.arp.arp_tpa, &pAnnounce->ip, sizeof(pAnnounce->ip));
+
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ARP);
+    sll.sll_ifindex = pAnnounce->ifIndex;
+    sll.sll_halen = ETH_ALEN;
+    memset(sll.sll_addr, 0xFF, ETH_ALEN);
+
+    if (sendto(pArph->sock, &frame, sizeof(frame), MSG_DONTWAIT, (struct sockaddr *)&sll, sizeof(sll)) != sizeof(frame)) {
+        LOGWARN("failed to send gratuitous ARP on interface index %d: %s\n", pAnnounce->ifIndex, strerror(errno));
+        return (1);
+    }
+    return (0);
+}
@@ -84,6 +84,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <ctype.h>
+#include <pthread.h>
 #include <curl/curl.h>
 #include <json/json.h>
 
@@ -161,6 +162,10 @@ int midocache_invalid = 0;
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+static int mido_task_cmp(const void *p1, const void *p2);
+static int mido_task_queue_next(mido_task_queue *queue, int *start, int *end);
+static void *mido_task_worker(void *arg);
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                   MACROS                                   |
@@ -1823,6 +1828,268 @@ int do_midonet_update_pass3_vpcs(globalNetworkInfo *gni, mido_config *mido) {
     return (ret);
 }
 
+/**
+ * Orders mido_task entries by serialization key, preserving the original order
+ * of tasks that share the same key. Tasks without a key keep their position
+ * relative to each other.
+ * @param p1 [in] pointer to the first mido_task pointer
+ * @param p2 [in] pointer to the second mido_task pointer
+ * @return -1, 0, or 1 as required by qsort()
+ */
+static int mido_task_cmp(const void *p1, const void *p2) {
+    mido_task *t1 = *((mido_task **) p1);
+    mido_task *t2 = *((mido_task **) p2);
+
+    if (t1->key != t2->key) {
+        return (((uintptr_t) t1->key < (uintptr_t) t2->key) ? -1 : 1);
+    }
+    if (t1 != t2) {
+        return ((t1 < t2) ? -1 : 1);
+    }
+    return (0);
+}
+
+/**
+ * Retrieves the next batch of tasks to be executed. A batch is either a single
+ * task without serialization key, or all tasks sharing the same key.
+ * Caller must hold the MidoNet model lock.
+ * @param queue [in] the task queue of interest
+ * @param start [out] index (in queue->order) of the first task of the batch
+ * @param end [out] index (in queue->order) past the last task of the batch
+ * @return 1 if a batch was retrieved. 0 if the queue is exhausted.
+ */
+static int mido_task_queue_next(mido_task_queue *queue, int *start, int *end) {
+    int i = 0;
+
+    if (queue->next >= queue->max_tasks) {
+        return (0);
+    }
+    i = queue->next;
+    *start = i;
+    i++;
+    if (queue->order[*start]->key) {
+        while ((i < queue->max_tasks) && (queue->order[i]->key == queue->order[*start]->key)) {
+            i++;
+        }
+    }
+    *end = i;
+    queue->next = i;
+    return (1);
+}
+
+/**
+ * MidoNet reconciliation worker. Executes batches of tasks until the queue is
+ * exhausted. The MidoNet model lock is held while tasks are executed, and is
+ * released by midonet-api while HTTP requests are in flight.
+ * @param arg [in] pointer to the mido_task_queue of interest
+ * @return always NULL
+ */
+static void *mido_task_worker(void *arg) {
+    int start = 0, end = 0;
+    mido_task *task = NULL;
+    mido_task_queue *queue = (mido_task_queue *) arg;
+
+    midonet_api_model_lock();
+    while (mido_task_queue_next(queue, &start, &end)) {
+        for (int i = start; i < end; i++) {
+            task = queue->order[i];
+            task->rc = task->fn(queue->gni, queue->mido, task->arg);
+        }
+    }
+    midonet_api_model_unlock();
+    return (NULL);
+}
+
+/**
+ * Executes a set of MidoNet reconciliation tasks using up to max_threads threads
+ * (including the caller). Tasks that share the same non-NULL key are executed
+ * one at a time, in the order they appear in the tasks array. Small sets are
+ * executed sequentially by the caller.
+ * @param gni [in] Global Network Information to be applied.
+ * @param mido [in] data structure that holds MidoNet configuration
+ * @param tasks [in] array of tasks to execute
+ * @param max_tasks [in] number of tasks in the array
+ * @param max_threads [in] maximum number of threads to use
+ * @return sum of the return codes of all tasks (0 on success).
+ */
+int mido_run_tasks(globalNetworkInfo *gni, mido_config *mido, mido_task *tasks, int max_tasks, int max_threads) {
+    int i = 0, ret = 0, nthreads = 0, rc = 0;
+    pthread_t *threads = NULL;
+    boolean *started = NULL;
+    mido_task_queue queue = { 0 };
+    struct timeval tv;
+
+    if (!tasks || (max_tasks <= 0)) {
+        return (0);
+    }
+
+    eucanetd_timer_usec(&tv);
+    nthreads = (max_threads < max_tasks) ? max_threads : max_tasks;
+    if ((max_tasks < MIDO_UPDATE_USE_THREADS_THRESHOLD) || (nthreads < 2)) {
+        for (i = 0; i < max_tasks; i++) {
+            tasks[i].rc = tasks[i].fn(gni, mido, tasks[i].arg);
+            ret += tasks[i].rc;
+        }
+        return (ret);
+    }
+
+    queue.gni = gni;
+    queue.mido = mido;
+    queue.max_tasks = max_tasks;
+    queue.order = EUCA_ZALLOC_C(max_tasks, sizeof (mido_task *));
+    for (i = 0; i < max_tasks; i++) {
+        queue.order[i] = &(tasks[i]);
+    }
+    qsort(queue.order, max_tasks, sizeof (mido_task *), mido_task_cmp);
+
+    threads = EUCA_ZALLOC_C(nthreads, sizeof (pthread_t));
+    started = EUCA_ZALLOC_C(nthreads, sizeof (boolean));
+    // The calling thread is the last worker
+    for (i = 0; i < nthreads - 1; i++) {
+        rc = pthread_create(&(threads[i]), NULL, mido_task_worker, &queue);
+        if (rc) {
+            LOGWARN("failed to create mido worker thread %d: %s\n", i, strerror(rc));
+        } else {
+            started[i] = TRUE;
+        }
+    }
+    mido_task_worker(&queue);
+    for (i = 0; i < nthreads - 1; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    for (i = 0; i < max_tasks; i++) {
+        ret += tasks[i].rc;
+    }
+    LOGDEBUG("\t%d tasks executed by %d threads in %.2f ms\n", max_tasks, nthreads, eucanetd_timer_usec(&tv) / 1000.0);
+
+    EUCA_FREE(started);
+    EUCA_FREE(threads);
+    EUCA_FREE(queue.order);
+    return (ret);
+}
+
+/**
+ * Implements the rules and member IP addresses of a security group as described
+ * in GNI. Executed as a mido_task by do_midonet_update_pass3_sgs(), possibly
+ * from a worker thread holding the MidoNet model lock.
+ * @param gni [in] Global Network Information to be applied.
+ * @param mido [in] data structure that holds MidoNet configuration
+ * @param arg [in] pointer to the mido_vpc_secgroup of interest
+ * @return 0 on success. Positive integer otherwise.
+ */
+static int do_midonet_update_pass3_sg(globalNetworkInfo *gni, mido_config *mido, void *arg) {
+    int rc = 0, ret = 0, j = 0;
+
+    mido_vpc_secgroup *vpcsecgroup = (mido_vpc_secgroup *) arg;
+    gni_secgroup *gnisecgroup = vpcsecgroup->gniSecgroup;
+    mido_parsed_chain_rule sgrule;
+    int ecnt = ret;
+
+    // Process egress rules
+    if (!vpcsecgroup->population_failed && !vpcsecgroup->egress_changed) {
+        LOGTRACE("\t\tskipping pass3 for %s egress\n", gnisecgroup->name);
+    } else {
+        // clear egress rules
+        rc = mido_clear_rules(vpcsecgroup->egress);
+        for (j = 0; j < gnisecgroup->max_egress_rules; j++) {
+            rc = parse_mido_secgroup_rule(mido, &(gnisecgroup->egress_rules[j]), &sgrule);
+            if (rc == 0) {
+                rc = create_mido_vpc_secgroup_rule(vpcsecgroup->egress, NULL, -1,
+                        MIDO_RULE_SG_EGRESS, &sgrule);
+                if (rc) {
+                    LOGWARN("failed to create %s egress rule at idx %d\n", gnisecgroup->name, j);
+                    ret++;
+                }
+            } else {
+                LOGWARN("failed to parse %s egress rule at idx %d\n", gnisecgroup->name, j);
+            }
+        }
+    }
+    
+    // Process ingress rules
+    if (!vpcsecgroup->population_failed && !vpcsecgroup->ingress_changed) {
+        LOGTRACE("\t\tskipping pass3 for %s ingress\n", gnisecgroup->name);
+    } else {
+        // clear ingress rules
+        rc = mido_clear_rules(vpcsecgroup->ingress);
+        for (j = 0; j < gnisecgroup->max_ingress_rules; j++) {
+            rc = parse_mido_secgroup_rule(mido, &(gnisecgroup->ingress_rules[j]), &sgrule);
+            if (rc == 0) {
+                rc = create_mido_vpc_secgroup_rule(vpcsecgroup->ingress, NULL, -1,
+                        MIDO_RULE_SG_INGRESS, &sgrule);
+                if (rc) {
+                    LOGWARN("failed to create %s ingress rule at idx %d\n", gnisecgroup->name, j);
+                    ret++;
+                }
+            } else {
+                LOGWARN("failed to parse %s ingress rule at idx %d\n", gnisecgroup->name, j);
+            }
+        }
+    }
+
+    // Process SG member IP addresses
+    for (j = 0; j < gnisecgroup->max_interfaces; j++) {
+        char *pubipstr = NULL;
+        char *privipstr = NULL;
+        gni_instance *gniif = gnisecgroup->interfaces[j];
+        pubipstr = hex2dot(gniif->publicIp);
+        privipstr = hex2dot(gniif->privateIp);
+        if (vpcsecgroup->midopresent_pubips[j] == 1) {
+            LOGTRACE("\t\t%s already in mido %s\n", pubipstr, gnisecgroup->name);
+        } else {
+            if (gniif->publicIp != 0) {
+                rc = mido_create_ipaddrgroup_ip(vpcsecgroup->iag_pub, NULL, pubipstr, NULL);
+                if (rc) {
+                    LOGWARN("failed to add %s to %s\n", pubipstr, vpcsecgroup->midos[VPCSG_IAGPUB]->name);
+                    ret++;
+                }
+            }
+        }
+        if (vpcsecgroup->midopresent_privips[j] == 1) {
+            LOGTRACE("\t\t%s already in mido %s\n", privipstr, gnisecgroup->name);
+        } else {
+            rc = mido_create_ipaddrgroup_ip(vpcsecgroup->iag_priv, NULL, privipstr, NULL);
+            if (rc) {
+                LOGWARN("failed to add %s to %s\n", privipstr, vpcsecgroup->midos[VPCSG_IAGPRIV]->name);
+                ret++;
+            }
+        }
+        if (vpcsecgroup->midopresent_allips_pub[j] == 1) {
+            LOGTRACE("\t\t%s already in mido %s\n", pubipstr, gnisecgroup->name);
+        } else {
+            if (gniif->publicIp != 0) {
+                rc = mido_create_ipaddrgroup_ip(vpcsecgroup->iag_all, NULL, pubipstr, NULL);
+                if (rc) {
+                    LOGWARN("failed to add %s to %s\n", pubipstr, vpcsecgroup->midos[VPCSG_IAGALL]->name);
+                    ret++;
+                }
+            }
+        }
+        if (vpcsecgroup->midopresent_allips_priv[j] == 1) {
+            LOGTRACE("\t\t%s already in mido %s\n", privipstr, gnisecgroup->name);
+        } else {
+            rc = mido_create_ipaddrgroup_ip(vpcsecgroup->iag_all, NULL, privipstr, NULL);
+            if (rc) {
+                LOGWARN("failed to add %s to %s\n", privipstr, vpcsecgroup->midos[VPCSG_IAGALL]->name);
+                ret++;
+            }
+        }
+        EUCA_FREE(pubipstr);
+        EUCA_FREE(privipstr);
+
+        if (ecnt != ret) {
+            vpcsecgroup->population_failed = 1;
+        } else {
+            vpcsecgroup->population_failed = 0;
+        }
+    }
+
+    return (ret);
+}
+
 /**
  * Implements security groups (create mido objects) as described in GNI.
  * @param gni [in] Global Network Information to be applied.
@@ -1830,10 +2097,12 @@ int do_midonet_update_pass3_vpcs(globalNetworkInfo *gni, mido_config *mido) {
  * @return 0 on success. 1 otherwise.
  */
 int do_midonet_update_pass3_sgs(globalNetworkInfo *gni, mido_config *mido) {
-    int rc = 0, ret = 0, i = 0, j = 0;
+    int rc = 0, ret = 0, i = 0;
+    int max_tasks = 0;
 
     mido_vpc_secgroup *vpcsecgroup = NULL;
     gni_secgroup *gnisecgroup = NULL;
+    mido_task *tasks = NULL;
 
     // Process security groups
     for (i = 0; i < gni->max_secgroups; i++) {
@@ -1883,11 +2152,12 @@ int do_midonet_update_pass3_sgs(globalNetworkInfo *gni, mido_config *mido) {
     }
 
     // Process security group rules
+    if (mido->max_vpcsecgroups > 0) {
+        tasks = EUCA_ZALLOC_C(mido->max_vpcsecgroups, sizeof (mido_task));
+    }
     for (i = 0; i < mido->max_vpcsecgroups; i++) {
-        int ecnt = ret;
         vpcsecgroup = &(mido->vpcsecgroups[i]);
         gnisecgroup = vpcsecgroup->gniSecgroup;
-        mido_parsed_chain_rule sgrule;
 
         if (strlen(vpcsecgroup->name) == 0) {
             continue;
@@ -1896,125 +2166,36 @@ int do_midonet_update_pass3_sgs(globalNetworkInfo *gni, mido_config *mido) {
             LOGWARN("unknown security group %s\n", vpcsecgroup->name);
             continue;
         }
-        // Process egress rules
-        if (!vpcsecgroup->population_failed && !vpcsecgroup->egress_changed) {
-            LOGTRACE("\t\tskipping pass3 for %s egress\n", gnisecgroup->name);
-        } else {
-            // clear egress rules
-            rc = mido_clear_rules(vpcsecgroup->egress);
-            for (j = 0; j < gnisecgroup->max_egress_rules; j++) {
-                rc = parse_mido_secgroup_rule(mido, &(gnisecgroup->egress_rules[j]), &sgrule);
-                if (rc == 0) {
-                    rc = create_mido_vpc_secgroup_rule(vpcsecgroup->egress, NULL, -1,
-                            MIDO_RULE_SG_EGRESS, &sgrule);
-                    if (rc) {
-                        LOGWARN("failed to create %s egress rule at idx %d\n", gnisecgroup->name, j);
-                        ret++;
-                    }
-                } else {
-                    LOGWARN("failed to parse %s egress rule at idx %d\n", gnisecgroup->name, j);
-                }
-            }
-        }
-        
-        // Process ingress rules
-        if (!vpcsecgroup->population_failed && !vpcsecgroup->ingress_changed) {
-            LOGTRACE("\t\tskipping pass3 for %s ingress\n", gnisecgroup->name);
-        } else {
-            // clear ingress rules
-            rc = mido_clear_rules(vpcsecgroup->ingress);
-            for (j = 0; j < gnisecgroup->max_ingress_rules; j++) {
-                rc = parse_mido_secgroup_rule(mido, &(gnisecgroup->ingress_rules[j]), &sgrule);
-                if (rc == 0) {
-                    rc = create_mido_vpc_secgroup_rule(vpcsecgroup->ingress, NULL, -1,
-                            MIDO_RULE_SG_INGRESS, &sgrule);
-                    if (rc) {
-                        LOGWARN("failed to create %s ingress rule at idx %d\n", gnisecgroup->name, j);
-                        ret++;
-                    }
-                } else {
-                    LOGWARN("failed to parse %s ingress rule at idx %d\n", gnisecgroup->name, j);
-                }
-            }
-        }
-
-        // Process SG member IP addresses
-        for (j = 0; j < gnisecgroup->max_interfaces; j++) {
-            char *pubipstr = NULL;
-            char *privipstr = NULL;
-            gni_instance *gniif = gnisecgroup->interfaces[j];
-            pubipstr = hex2dot(gniif->publicIp);
-            privipstr = hex2dot(gniif->privateIp);
-            if (vpcsecgroup->midopresent_pubips[j] == 1) {
-                LOGTRACE("\t\t%s already in mido %s\n", pubipstr, gnisecgroup->name);
-            } else {
-                if (gniif->publicIp != 0) {
-                    rc = mido_create_ipaddrgroup_ip(vpcsecgroup->iag_pub, NULL, pubipstr, NULL);
-                    if (rc) {
-                        LOGWARN("failed to add %s to %s\n", pubipstr, vpcsecgroup->midos[VPCSG_IAGPUB]->name);
-                        ret++;
-                    }
-                }
-            }
-            if (vpcsecgroup->midopresent_privips[j] == 1) {
-                LOGTRACE("\t\t%s already in mido %s\n", privipstr, gnisecgroup->name);
-            } else {
-                rc = mido_create_ipaddrgroup_ip(vpcsecgroup->iag_priv, NULL, privipstr, NULL);
-                if (rc) {
-                    LOGWARN("failed to add %s to %s\n", privipstr, vpcsecgroup->midos[VPCSG_IAGPRIV]->name);
-                    ret++;
-                }
-            }
-            if (vpcsecgroup->midopresent_allips_pub[j] == 1) {
-                LOGTRACE("\t\t%s already in mido %s\n", pubipstr, gnisecgroup->name);
-            } else {
-                if (gniif->publicIp != 0) {
-                    rc = mido_create_ipaddrgroup_ip(vpcsecgroup->iag_all, NULL, pubipstr, NULL);
-                    if (rc) {
-                        LOGWARN("failed to add %s to %s\n", pubipstr, vpcsecgroup->midos[VPCSG_IAGALL]->name);
-                        ret++;
-                    }
-                }
-            }
-            if (vpcsecgroup->midopresent_allips_priv[j] == 1) {
-                LOGTRACE("\t\t%s already in mido %s\n", privipstr, gnisecgroup->name);
-            } else {
-                rc = mido_create_ipaddrgroup_ip(vpcsecgroup->iag_all, NULL, privipstr, NULL);
-                if (rc) {
-                    LOGWARN("failed to add %s to %s\n", privipstr, vpcsecgroup->midos[VPCSG_IAGALL]->name);
-                    ret++;
-                }
-            }
-            EUCA_FREE(pubipstr);
-            EUCA_FREE(privipstr);
-
-            if (ecnt != ret) {
-                vpcsecgroup->population_failed = 1;
-            } else {
-                vpcsecgroup->population_failed = 0;
-            }
-        }
+        tasks[max_tasks].fn = do_midonet_update_pass3_sg;
+        tasks[max_tasks].arg = vpcsecgroup;
+        max_tasks++;
     }
 
+    ret += mido_run_tasks(gni, mido, tasks, max_tasks, MIDO_UPDATE_THREADS);
+    EUCA_FREE(tasks);
+
     return (ret);
 }
 
 /**
- * Implements instances/interfaces (create mido objects) as described in GNI.
+ * Implements a single instance/interface (create mido objects) as described in GNI.
+ * Executed as a mido_task by do_midonet_update_pass3_insts(), possibly from a
+ * worker thread holding the MidoNet model lock.
  * @param gni [in] Global Network Information to be applied.
  * @param mido [in] data structure that holds MidoNet configuration
- * @return 0 on success. 1 otherwise.
+ * @param arg [in] pointer to the gni_instance of interest
+ * @return 0 on success. Positive integer otherwise.
  */
-int do_midonet_update_pass3_insts(globalNetworkInfo *gni, mido_config *mido) {
-    int rc = 0, ret = 0, i = 0, j = 0, k = 0;
+static int do_midonet_update_pass3_inst(globalNetworkInfo *gni, mido_config *mido, void *arg) {
+    int rc = 0, ret = 0, j = 0, k = 0;
     char subnet_buf[24], slashnet_buf[8], gw_buf[24], pt_buf[24];
 
     mido_vpc_secgroup *vpcsecgroup = NULL;
-    mido_vpc_instance *vpcif = NULL;
-    mido_vpc_subnet *vpcsubnet = NULL;
-    mido_vpc *vpc = NULL;
+    gni_instance *gniif = (gni_instance *) arg;
+    mido_vpc_instance *vpcif = (mido_vpc_instance *) gniif->mido_present;
+    mido_vpc_subnet *vpcsubnet = (mido_vpc_subnet *) gniif->mido_vpcsubnet;
+    mido_vpc *vpc = (mido_vpc *) gniif->mido_vpc;
     
-    gni_instance *gniif = NULL;
     midonet_api_host *gni_instance_node = NULL;
 
     midoname **jprules_egress = NULL;
@@ -2029,579 +2210,613 @@ int do_midonet_update_pass3_insts(globalNetworkInfo *gni, mido_config *mido) {
 
     struct timeval tv;
 
-    // Process instances/interfaces
-    for (i = 0; i < gni->max_ifs; i++) {
-        eucanetd_timer_usec(&tv);
-        gniif = gni->ifs[i];
-        if (strlen(gniif->name) == 0) {
-            LOGWARN("Empty interface detected in GNI.\n");
-            ret++;
-            continue;
-        }
-        vpc = (mido_vpc *) gniif->mido_vpc;
-        vpcsubnet = (mido_vpc_subnet *) gniif->mido_vpcsubnet;
-        vpcif = (mido_vpc_instance *) gniif->mido_present;
-        if (!vpc || !vpcsubnet) {
-            LOGWARN("Unable to find %s and/or %s\n", gniif->vpc, gniif->subnet);
-            ret++;
-            continue;
-        }
-
-        if (vpcif) {
-            LOGTRACE("found instance %s in vpc %s subnet %s\n", vpcif->name, vpc->name, vpcsubnet->name);
-            vpcif->gniInst = gniif;
-        } else {
-            // create the instance model
-            // necessary memory should have been allocated in pass1
-            vpcif = &(vpcsubnet->instances[vpcsubnet->max_instances]);
-            bzero(vpcif, sizeof (mido_vpc_instance));
-            vpcsubnet->max_instances++;
-            snprintf(vpcif->name, INTERFACE_ID_LEN, "%s", gniif->name);
-            vpcif->gniInst = gniif;
-            gniif->mido_present = vpcif;
-            vpcif->host_changed = 1;
-            vpcif->srcdst_changed = 1;
-            vpcif->pubip_changed = 1;
-            vpcif->sg_changed = 1;
-            LOGINFO("\tcreating %s\n", gniif->name);
+    eucanetd_timer_usec(&tv);
+    rc = create_mido_vpc_instance(vpcif);
+    if (rc) {
+        LOGERROR("failed to create VPC instance %s: check midonet health\n", gniif->name);
+        rc = delete_mido_vpc_instance(mido, vpc, vpcsubnet, vpcif);
+        if (rc) {
+            LOGERROR("failed to cleanup %s\n", gniif->name);
         }
+        return (1);
+    }
 
-        if (vpcif->midopresent) {
-            LOGTRACE("\t\tskipping pass3 for %s\n", gniif->name);
-            continue;
-        } else {
-            rc = create_mido_vpc_instance(vpcif);
-            if (rc) {
-                LOGERROR("failed to create VPC instance %s: check midonet health\n", gniif->name);
-                rc = delete_mido_vpc_instance(mido, vpc, vpcsubnet, vpcif);
-                if (rc) {
-                    LOGERROR("failed to cleanup %s\n", gniif->name);
-                }
-                ret++;
-                continue;
-            }
-        }
-        vpcif->gnipresent = 1;
+    vpcif->gnipresent = 1;
 
-        int ecnt = ret;
-        // check for potential VMHOST change
-        if (!vpcif->population_failed && !vpcif->host_changed) {
-            LOGTRACE("\t\t%s host did not change\n", gniif->name);
+    int ecnt = ret;
+    // check for potential VMHOST change
+    if (!vpcif->population_failed && !vpcif->host_changed) {
+        LOGTRACE("\t\t%s host did not change\n", gniif->name);
+    } else {
+        gni_instance_node = mido_get_host_byip(gniif->node);
+        if (!gni_instance_node) {
+            LOGERROR("\thost %s for %s not found: check midonet and/or midolman health\n", gniif->node, gniif->name);
+            return (ret);
         } else {
-            gni_instance_node = mido_get_host_byip(gniif->node);
-            if (!gni_instance_node) {
-                LOGERROR("\thost %s for %s not found: check midonet and/or midolman health\n", gniif->node, gniif->name);
-                continue;
-            } else {
-                if (vpcif->midos[INST_VMHOST] && vpcif->midos[INST_VMHOST]->init) {
-                    if ((gni_instance_node->obj == vpcif->midos[INST_VMHOST]) ||
-                            (!strcmp(gni_instance_node->obj->uuid, vpcif->midos[INST_VMHOST]->uuid))) {
-                        LOGTRACE("\t\t%s host did not change.\n", gniif->name);
-                        vpcif->host_changed = 0;
-                    } else {
-                        LOGINFO("\t%s vmhost change detected.\n", gniif->name);
-                        disconnect_mido_vpc_instance(vpcsubnet, vpcif);
-                    }
+            if (vpcif->midos[INST_VMHOST] && vpcif->midos[INST_VMHOST]->init) {
+                if ((gni_instance_node->obj == vpcif->midos[INST_VMHOST]) ||
+                        (!strcmp(gni_instance_node->obj->uuid, vpcif->midos[INST_VMHOST]->uuid))) {
+                    LOGTRACE("\t\t%s host did not change.\n", gniif->name);
+                    vpcif->host_changed = 0;
+                } else {
+                    LOGINFO("\t%s vmhost change detected.\n", gniif->name);
+                    disconnect_mido_vpc_instance(vpcsubnet, vpcif);
                 }
-                vpcif->midos[INST_VMHOST] = gni_instance_node->obj;
             }
+            vpcif->midos[INST_VMHOST] = gni_instance_node->obj;
         }
+    }
 
-        // do instance/interface-host connection
-        if (vpcif->host_changed) {
-            LOGTRACE("\tconnecting mido host %s with interface %s\n",
-                    vpcif->midos[INST_VMHOST]->name, gniif->name);
-            rc = connect_mido_vpc_instance(vpcsubnet, vpcif, gni->instanceDNSDomain);
-            if (rc) {
-                LOGERROR("failed to connect %s to %s: check midolman\n", gniif->name, vpcif->midos[INST_VMHOST]->name);
-            }
+    // do instance/interface-host connection
+    if (vpcif->host_changed) {
+        LOGTRACE("\tconnecting mido host %s with interface %s\n",
+                vpcif->midos[INST_VMHOST]->name, gniif->name);
+        rc = connect_mido_vpc_instance(vpcsubnet, vpcif, gni->instanceDNSDomain);
+        if (rc) {
+            LOGERROR("failed to connect %s to %s: check midolman\n", gniif->name, vpcif->midos[INST_VMHOST]->name);
         }
+    }
 
-        // check public/elastic IP changes
-        if (!vpcif->population_failed && !vpcif->pubip_changed) {
-            LOGTRACE("\t\t%s pubip did not change\n", gniif->name);
+    // check public/elastic IP changes
+    if (!vpcif->population_failed && !vpcif->pubip_changed) {
+        LOGTRACE("\t\t%s pubip did not change\n", gniif->name);
+    } else {
+        if (gniif->publicIp == vpcif->pubip) {
+            LOGTRACE("\t\t%s pubip did not change.\n", gniif->name);
+            vpcif->pubip_changed = 0;
         } else {
-            if (gniif->publicIp == vpcif->pubip) {
-                LOGTRACE("\t\t%s pubip did not change.\n", gniif->name);
-                vpcif->pubip_changed = 0;
-            } else {
-                if (vpcif->population_failed || (vpcif->pubip != 0)) {
-                    // disconnect public/elastic IP
-                    rc = disconnect_mido_vpc_instance_elip(mido, vpc, vpcif);
-                    if (rc) {
-                        LOGERROR("failed to disconnect %s elip\n", gniif->name);
-                        ret++;
-                    } else {
-                        vpcif->pubip = 0;
-                    }
-                } 
-            }
-        }
-
-        // do instance/interface public/elastic IP connection
-        if (vpcif->population_failed || vpcif->pubip_changed) {
-            // Do not run connect for private interfaces
-            if (gniif->publicIp != 0) {
-                rc = connect_mido_vpc_instance_elip(mido, vpc, vpcsubnet, vpcif);
+            if (vpcif->population_failed || (vpcif->pubip != 0)) {
+                // disconnect public/elastic IP
+                rc = disconnect_mido_vpc_instance_elip(mido, vpc, vpcif);
                 if (rc) {
-                    LOGERROR("failed to setup public/elastic IP for %s\n", gniif->name);
+                    LOGERROR("failed to disconnect %s elip\n", gniif->name);
                     ret++;
+                } else {
+                    vpcif->pubip = 0;
                 }
+            } 
+        }
+    }
+
+    // do instance/interface public/elastic IP connection
+    if (vpcif->population_failed || vpcif->pubip_changed) {
+        // Do not run connect for private interfaces
+        if (gniif->publicIp != 0) {
+            rc = connect_mido_vpc_instance_elip(mido, vpc, vpcsubnet, vpcif);
+            if (rc) {
+                LOGERROR("failed to setup public/elastic IP for %s\n", gniif->name);
+                ret++;
             }
         }
-            
-        char pos_str[32];
-        char *instMac = NULL;
-        char *instIp = NULL;
-        int rulepos = 0;
-
-        midoname *ptmpmn;
-
-        subnet_buf[0] = '\0'; 
-        slashnet_buf[0] = '\0';
-        gw_buf[0] = '\0';
-        cidr_split(vpcsubnet->gniSubnet->cidr, subnet_buf, slashnet_buf, gw_buf, pt_buf);
-
-        hex2mac(gniif->macAddress, &instMac);
-        instIp = hex2dot(gniif->privateIp);
-        for (int i = 0; i < strlen(instMac); i++) {
-            instMac[i] = tolower(instMac[i]);
-        }
-
-        // anti-spoof
-        // block any source mac that isn't the registered instance mac
-        rulepos = 1;
-        snprintf(pos_str, 32, "%d", rulepos);
-        // Check if the rule is already in place
-        rc = mido_find_rule_from_list(vpcif->prechain->rules, vpcif->prechain->max_rules, &ptmpmn,
-                "type", "drop", "dlSrc", instMac, "invDlSrc", "true", NULL);
-
-        if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
-            if (mido->disable_l2_isolation) {
-                LOGTRACE("\tdeleting L2 rule for %s\n", gniif->name);
-                rc = mido_delete_rule(vpcif->prechain, ptmpmn);
-                if (rc) {
-                    LOGWARN("Failed to delete src mac check rule for %s\n", gniif->name);
-                    ret++;
-                }
+    }
+        
+    char pos_str[32];
+    char *instMac = NULL;
+    char *instIp = NULL;
+    int rulepos = 0;
+
+    midoname *ptmpmn;
+
+    subnet_buf[0] = '\0'; 
+    slashnet_buf[0] = '\0';
+    gw_buf[0] = '\0';
+    cidr_split(vpcsubnet->gniSubnet->cidr, subnet_buf, slashnet_buf, gw_buf, pt_buf);
+
+    hex2mac(gniif->macAddress, &instMac);
+    instIp = hex2dot(gniif->privateIp);
+    for (int i = 0; i < strlen(instMac); i++) {
+        instMac[i] = tolower(instMac[i]);
+    }
+
+    // anti-spoof
+    // block any source mac that isn't the registered instance mac
+    rulepos = 1;
+    snprintf(pos_str, 32, "%d", rulepos);
+    // Check if the rule is already in place
+    rc = mido_find_rule_from_list(vpcif->prechain->rules, vpcif->prechain->max_rules, &ptmpmn,
+            "type", "drop", "dlSrc", instMac, "invDlSrc", "true", NULL);
+
+    if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
+        if (mido->disable_l2_isolation) {
+            LOGTRACE("\tdeleting L2 rule for %s\n", gniif->name);
+            rc = mido_delete_rule(vpcif->prechain, ptmpmn);
+            if (rc) {
+                LOGWARN("Failed to delete src mac check rule for %s\n", gniif->name);
+                ret++;
             }
-        } else {
-            if (!mido->disable_l2_isolation) {
-                LOGTRACE("\tcreating L2 rule for %s\n", gniif->name);
-                rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
-                        NULL, &rulepos, "position", pos_str, "type", "drop", "dlSrc", instMac,
-                        "invDlSrc", "true", NULL);
-                if (rc) {
-                    LOGWARN("Failed to create src mac check rule for %s\n", gniif->name);
-                    ret++;
-                }
+        }
+    } else {
+        if (!mido->disable_l2_isolation) {
+            LOGTRACE("\tcreating L2 rule for %s\n", gniif->name);
+            rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
+                    NULL, &rulepos, "position", pos_str, "type", "drop", "dlSrc", instMac,
+                    "invDlSrc", "true", NULL);
+            if (rc) {
+                LOGWARN("Failed to create src mac check rule for %s\n", gniif->name);
+                ret++;
             }
         }
+    }
 
-        // block any incoming IP traffic that isn't to the VM private IP
-        // Check if the rule is already in place
-        rc = mido_find_rule_from_list(vpcif->prechain->rules, vpcif->prechain->max_rules, &ptmpmn,
-                "type", "drop", "dlType", "2048", "nwSrcAddress", instIp, "nwSrcLength", "32", "invNwSrc", "true", NULL);
-        if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
-            if ((mido->disable_l2_isolation) || (!gniif->srcdstcheck)) {
-                LOGTRACE("\tdeleting L3 rule src for %s\n", gniif->name);
-                rc = mido_delete_rule(vpcif->prechain, ptmpmn);
-                if (rc) {
-                    LOGWARN("Failed to delete src IP check rule for %s\n", gniif->name);
-                    ret++;
-                }
+    // block any incoming IP traffic that isn't to the VM private IP
+    // Check if the rule is already in place
+    rc = mido_find_rule_from_list(vpcif->prechain->rules, vpcif->prechain->max_rules, &ptmpmn,
+            "type", "drop", "dlType", "2048", "nwSrcAddress", instIp, "nwSrcLength", "32", "invNwSrc", "true", NULL);
+    if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
+        if ((mido->disable_l2_isolation) || (!gniif->srcdstcheck)) {
+            LOGTRACE("\tdeleting L3 rule src for %s\n", gniif->name);
+            rc = mido_delete_rule(vpcif->prechain, ptmpmn);
+            if (rc) {
+                LOGWARN("Failed to delete src IP check rule for %s\n", gniif->name);
+                ret++;
             }
-        } else {
-            if ((!mido->disable_l2_isolation) && (gniif->srcdstcheck)) {
-                LOGTRACE("\tcreating L3 rule src for %s\n", gniif->name);
-                rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
-                        NULL, &rulepos, "position", pos_str, "type", "drop", "dlType", "2048",
-                        "nwSrcAddress", instIp, "nwSrcLength", "32", "invNwSrc", "true", NULL);
-                if (rc) {
-                    LOGWARN("Failed to create src IP check rule for %s\n", gniif->name);
-                    ret++;
-                }
+        }
+    } else {
+        if ((!mido->disable_l2_isolation) && (gniif->srcdstcheck)) {
+            LOGTRACE("\tcreating L3 rule src for %s\n", gniif->name);
+            rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
+                    NULL, &rulepos, "position", pos_str, "type", "drop", "dlType", "2048",
+                    "nwSrcAddress", instIp, "nwSrcLength", "32", "invNwSrc", "true", NULL);
+            if (rc) {
+                LOGWARN("Failed to create src IP check rule for %s\n", gniif->name);
+                ret++;
             }
         }
+    }
 
-        // block any outgoing IP traffic that isn't from the VM private IP
-        // Check if the rule is already in place
-        rc = mido_find_rule_from_list(vpcif->postchain->rules, vpcif->postchain->max_rules, &ptmpmn,
-                "type", "drop", "dlType", "2048", "nwDstAddress", instIp, "nwDstLength", "32", "invNwDst", "true", NULL);
-        if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
-            if ((mido->disable_l2_isolation) || (!gniif->srcdstcheck)) {
-                LOGTRACE("\tdeleting L3 rule dst for %s\n", gniif->name);
-                rc = mido_delete_rule(vpcif->postchain, ptmpmn);
-                if (rc) {
-                    LOGWARN("Failed to delete dst IP check rule for %s\n", gniif->name);
-                    ret++;
-                }
+    // block any outgoing IP traffic that isn't from the VM private IP
+    // Check if the rule is already in place
+    rc = mido_find_rule_from_list(vpcif->postchain->rules, vpcif->postchain->max_rules, &ptmpmn,
+            "type", "drop", "dlType", "2048", "nwDstAddress", instIp, "nwDstLength", "32", "invNwDst", "true", NULL);
+    if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
+        if ((mido->disable_l2_isolation) || (!gniif->srcdstcheck)) {
+            LOGTRACE("\tdeleting L3 rule dst for %s\n", gniif->name);
+            rc = mido_delete_rule(vpcif->postchain, ptmpmn);
+            if (rc) {
+                LOGWARN("Failed to delete dst IP check rule for %s\n", gniif->name);
+                ret++;
             }
-        } else {
-            if ((!mido->disable_l2_isolation) && (gniif->srcdstcheck)) {
-                LOGTRACE("\tcreating L3 rule dst for %s\n", gniif->name);
-                rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
-                        NULL, &rulepos, "position", pos_str, "type", "drop", "dlType", "2048",
-                        "nwDstAddress", instIp, "nwDstLength", "32", "invNwDst", "true", NULL);
-                if (rc) {
-                    LOGWARN("Failed to create dst IP check rule for %s\n", gniif->name);
-                    ret++;
-                }
+        }
+    } else {
+        if ((!mido->disable_l2_isolation) && (gniif->srcdstcheck)) {
+            LOGTRACE("\tcreating L3 rule dst for %s\n", gniif->name);
+            rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
+                    NULL, &rulepos, "position", pos_str, "type", "drop", "dlType", "2048",
+                    "nwDstAddress", instIp, "nwDstLength", "32", "invNwDst", "true", NULL);
+            if (rc) {
+                LOGWARN("Failed to create dst IP check rule for %s\n", gniif->name);
+                ret++;
             }
         }
+    }
 
-        // Allow DHCP requests (this rule needs to be placed before dst check rule)
-        // Check if the rule is already in place
-        rc = mido_find_rule_from_list(vpcif->postchain->rules, vpcif->postchain->max_rules, &ptmpmn,
-                "type", "accept", "nwProto", "17", "tpDst", "jsonjson", "tpDst:start", "67", "tpDst:end", "68",
-                "tpDst:END", "END", NULL);
-        if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
-            if ((mido->disable_l2_isolation) || (!gniif->srcdstcheck)) {
-                LOGTRACE("\tdeleting DHCP rule for %s\n", gniif->name);
-                rc = mido_delete_rule(vpcif->postchain, ptmpmn);
-                if (rc) {
-                    LOGWARN("Failed to delete DHCP rule for %s\n", gniif->name);
-                    ret++;
-                }
+    // Allow DHCP requests (this rule needs to be placed before dst check rule)
+    // Check if the rule is already in place
+    rc = mido_find_rule_from_list(vpcif->postchain->rules, vpcif->postchain->max_rules, &ptmpmn,
+            "type", "accept", "nwProto", "17", "tpDst", "jsonjson", "tpDst:start", "67", "tpDst:end", "68",
+            "tpDst:END", "END", NULL);
+    if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
+        if ((mido->disable_l2_isolation) || (!gniif->srcdstcheck)) {
+            LOGTRACE("\tdeleting DHCP rule for %s\n", gniif->name);
+            rc = mido_delete_rule(vpcif->postchain, ptmpmn);
+            if (rc) {
+                LOGWARN("Failed to delete DHCP rule for %s\n", gniif->name);
+                ret++;
             }
-        } else {
-            if ((!mido->disable_l2_isolation) && (gniif->srcdstcheck)) {
-                LOGTRACE("\tcreating DHCP rule for %s\n", gniif->name);
-                rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
-                        NULL, &rulepos, "position", pos_str, "type", "accept", "nwProto", "17",
-                        "tpDst", "jsonjson", "tpDst:start", "67", "tpDst:end", "68",
-                        "tpDst:END", "END", NULL);
-                if (rc) {
-                    LOGWARN("Failed to create DHCP rule for %s\n", gniif->name);
-                    ret++;
-                }
+        }
+    } else {
+        if ((!mido->disable_l2_isolation) && (gniif->srcdstcheck)) {
+            LOGTRACE("\tcreating DHCP rule for %s\n", gniif->name);
+            rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
+                    NULL, &rulepos, "position", pos_str, "type", "accept", "nwProto", "17",
+                    "tpDst", "jsonjson", "tpDst:start", "67", "tpDst:end", "68",
+                    "tpDst:END", "END", NULL);
+            if (rc) {
+                LOGWARN("Failed to create DHCP rule for %s\n", gniif->name);
+                ret++;
             }
         }
+    }
 
-        // anti arp poisoning
-        // block any outgoing ARP that does not have sender hardware address set to the registered MAC
-        // Check if the rule is already in place
-        rc = mido_find_rule_from_list(vpcif->prechain->rules, vpcif->prechain->max_rules, &ptmpmn,
-                "type", "drop", "dlSrc", instMac, "invDlSrc", "true",
-                "dlType", "2054", "invDlType", "false", NULL);
-        if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
-            if (mido->disable_l2_isolation) {
-                LOGTRACE("\tdeleting ARP_SHA rule for %s\n", gniif->name);
-                rc = mido_delete_rule(vpcif->prechain, ptmpmn);
-                if (rc) {
-                    LOGWARN("Failed to delete ARP_SHA rule for %s\n", gniif->name);
-                    ret++;
-                }
+    // anti arp poisoning
+    // block any outgoing ARP that does not have sender hardware address set to the registered MAC
+    // Check if the rule is already in place
+    rc = mido_find_rule_from_list(vpcif->prechain->rules, vpcif->prechain->max_rules, &ptmpmn,
+            "type", "drop", "dlSrc", instMac, "invDlSrc", "true",
+            "dlType", "2054", "invDlType", "false", NULL);
+    if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
+        if (mido->disable_l2_isolation) {
+            LOGTRACE("\tdeleting ARP_SHA rule for %s\n", gniif->name);
+            rc = mido_delete_rule(vpcif->prechain, ptmpmn);
+            if (rc) {
+                LOGWARN("Failed to delete ARP_SHA rule for %s\n", gniif->name);
+                ret++;
             }
-        } else {
-            if (!mido->disable_l2_isolation) {
-                LOGTRACE("\tcreating ARP_SHA rule for %s\n", gniif->name);
-                rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
-                        NULL, &rulepos, "position", pos_str, "type", "drop", "dlSrc", instMac,
-                        "invDlSrc", "true", "dlType", "2054", "invDlType", "false", NULL);
-                if (rc) {
-                    LOGWARN("Failed to create ARP_SHA rule for %s\n", gniif->name);
-                    ret++;
-                }
+        }
+    } else {
+        if (!mido->disable_l2_isolation) {
+            LOGTRACE("\tcreating ARP_SHA rule for %s\n", gniif->name);
+            rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
+                    NULL, &rulepos, "position", pos_str, "type", "drop", "dlSrc", instMac,
+                    "invDlSrc", "true", "dlType", "2054", "invDlType", "false", NULL);
+            if (rc) {
+                LOGWARN("Failed to create ARP_SHA rule for %s\n", gniif->name);
+                ret++;
             }
         }
+    }
 
-        // block any outgoing ARP that does not have sender protocol address set to the VM private IP
-        // Check if the rule is already in place
-        rc = mido_find_rule_from_list(vpcif->prechain->rules, vpcif->prechain->max_rules, &ptmpmn,
-                "type", "drop", "dlType", "2054", "nwSrcAddress",
-                instIp, "nwSrcLength", "32", "invNwSrc", "true",
-                "invDlType", "false", NULL);
-        if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
-            if (mido->disable_l2_isolation) {
-                LOGTRACE("\tdeleting ARP_SPA rule for %s\n", gniif->name);
-                rc = mido_delete_rule(vpcif->prechain, ptmpmn);
-                if (rc) {
-                    LOGWARN("Failed to delete ARP_SPA rule for %s\n", gniif->name);
-                    ret++;
-                }
+    // block any outgoing ARP that does not have sender protocol address set to the VM private IP
+    // Check if the rule is already in place
+    rc = mido_find_rule_from_list(vpcif->prechain->rules, vpcif->prechain->max_rules, &ptmpmn,
+            "type", "drop", "dlType", "2054", "nwSrcAddress",
+            instIp, "nwSrcLength", "32", "invNwSrc", "true",
+            "invDlType", "false", NULL);
+    if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
+        if (mido->disable_l2_isolation) {
+            LOGTRACE("\tdeleting ARP_SPA rule for %s\n", gniif->name);
+            rc = mido_delete_rule(vpcif->prechain, ptmpmn);
+            if (rc) {
+                LOGWARN("Failed to delete ARP_SPA rule for %s\n", gniif->name);
+                ret++;
             }
-        } else {
-            if (!mido->disable_l2_isolation) {
-                LOGTRACE("\tcreating ARP_SPA rule for %s\n", gniif->name);
-                rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
-                        NULL, &rulepos, "position", pos_str, "type", "drop", "dlType", "2054",
-                        "nwSrcAddress", instIp, "nwSrcLength", "32", "invNwSrc", "true",
-                        "invDlType", "false", NULL);
-                if (rc) {
-                    LOGWARN("Failed to create src IP check rule for %s\n", gniif->name);
-                    ret++;
-                }
+        }
+    } else {
+        if (!mido->disable_l2_isolation) {
+            LOGTRACE("\tcreating ARP_SPA rule for %s\n", gniif->name);
+            rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
+                    NULL, &rulepos, "position", pos_str, "type", "drop", "dlType", "2054",
+                    "nwSrcAddress", instIp, "nwSrcLength", "32", "invNwSrc", "true",
+                    "invDlType", "false", NULL);
+            if (rc) {
+                LOGWARN("Failed to create src IP check rule for %s\n", gniif->name);
+                ret++;
             }
         }
+    }
 
-        // block any incoming ARP replies that does not have target hardware address set to the registered MAC
-        // Check if the rule is already in place
-        rc = mido_find_rule_from_list(vpcif->postchain->rules, vpcif->postchain->max_rules, &ptmpmn,
-                "type", "drop", "dlDst", instMac, "invDlDst", "true",
-                "dlType", "2054", "invDlType", "false", "nwProto", "2",
-                "invNwProto", "false", NULL);
-        if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
-            if (mido->disable_l2_isolation) {
-                LOGTRACE("\tdeleting ARP_THA rule for %s\n", gniif->name);
-                rc = mido_delete_rule(vpcif->postchain, ptmpmn);
-                if (rc) {
-                    LOGWARN("Failed to delete ARP_THA rule for %s\n", gniif->name);
-                    ret++;
-                }
+    // block any incoming ARP replies that does not have target hardware address set to the registered MAC
+    // Check if the rule is already in place
+    rc = mido_find_rule_from_list(vpcif->postchain->rules, vpcif->postchain->max_rules, &ptmpmn,
+            "type", "drop", "dlDst", instMac, "invDlDst", "true",
+            "dlType", "2054", "invDlType", "false", "nwProto", "2",
+            "invNwProto", "false", NULL);
+    if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
+        if (mido->disable_l2_isolation) {
+            LOGTRACE("\tdeleting ARP_THA rule for %s\n", gniif->name);
+            rc = mido_delete_rule(vpcif->postchain, ptmpmn);
+            if (rc) {
+                LOGWARN("Failed to delete ARP_THA rule for %s\n", gniif->name);
+                ret++;
             }
-        } else {
-            if (!mido->disable_l2_isolation) {
-                LOGTRACE("\tcreating ARP_SHA rule for %s\n", gniif->name);
-                rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
-                        NULL, &rulepos, "position", pos_str, "type", "drop", "dlDst", instMac,
-                        "invDlDst", "true", "dlType", "2054", "invDlType", "false", "nwProto", "2",
-                        "invNwProto", "false", NULL);
-                if (rc) {
-                    LOGWARN("Failed to create ARP_THA rule for %s\n", gniif->name);
-                    ret++;
-                }
+        }
+    } else {
+        if (!mido->disable_l2_isolation) {
+            LOGTRACE("\tcreating ARP_SHA rule for %s\n", gniif->name);
+            rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
+                    NULL, &rulepos, "position", pos_str, "type", "drop", "dlDst", instMac,
+                    "invDlDst", "true", "dlType", "2054", "invDlType", "false", "nwProto", "2",
+                    "invNwProto", "false", NULL);
+            if (rc) {
+                LOGWARN("Failed to create ARP_THA rule for %s\n", gniif->name);
+                ret++;
             }
         }
+    }
 
-        // block any incoming ARP that does not have target protocol address set to the VM private IP
-        // Check if the rule is already in place
-        rc = mido_find_rule_from_list(vpcif->postchain->rules, vpcif->postchain->max_rules, &ptmpmn,
-                "type", "drop", "dlType", "2054", "nwDstAddress",
-                instIp, "nwDstLength", "32", "invNwDst", "true",
-                "invDlType", "false", NULL);
-        if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
-            if (mido->disable_l2_isolation) {
-                LOGTRACE("\tdeleting ARP_TPA rule for %s\n", gniif->name);
-                rc = mido_delete_rule(vpcif->postchain, ptmpmn);
-                if (rc) {
-                    LOGWARN("Failed to delete ARP_TPA rule for %s\n", gniif->name);
-                    ret++;
-                }
+    // block any incoming ARP that does not have target protocol address set to the VM private IP
+    // Check if the rule is already in place
+    rc = mido_find_rule_from_list(vpcif->postchain->rules, vpcif->postchain->max_rules, &ptmpmn,
+            "type", "drop", "dlType", "2054", "nwDstAddress",
+            instIp, "nwDstLength", "32", "invNwDst", "true",
+            "invDlType", "false", NULL);
+    if ((rc == 0) && ptmpmn && (ptmpmn->init == 1)) {
+        if (mido->disable_l2_isolation) {
+            LOGTRACE("\tdeleting ARP_TPA rule for %s\n", gniif->name);
+            rc = mido_delete_rule(vpcif->postchain, ptmpmn);
+            if (rc) {
+                LOGWARN("Failed to delete ARP_TPA rule for %s\n", gniif->name);
+                ret++;
             }
-        } else {
-            if (!mido->disable_l2_isolation) {
-                LOGTRACE("\tcreating ARP_TPA rule for %s\n", gniif->name);
-                rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
-                        NULL, &rulepos, "position", pos_str, "type", "drop", "dlType", "2054",
-                        "nwDstAddress", instIp, "nwDstLength", "32", "invNwDst", "true",
-                        "invDlType", "false", NULL);
-                if (rc) {
-                    LOGWARN("Failed to create ARP_TPA rule for %s\n", gniif->name);
-                    ret++;
-                }
+        }
+    } else {
+        if (!mido->disable_l2_isolation) {
+            LOGTRACE("\tcreating ARP_TPA rule for %s\n", gniif->name);
+            rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
+                    NULL, &rulepos, "position", pos_str, "type", "drop", "dlType", "2054",
+                    "nwDstAddress", instIp, "nwDstLength", "32", "invNwDst", "true",
+                    "invDlType", "false", NULL);
+            if (rc) {
+                LOGWARN("Failed to create ARP_TPA rule for %s\n", gniif->name);
+                ret++;
             }
         }
+    }
 
-        EUCA_FREE(instMac);
-        EUCA_FREE(instIp);
+    EUCA_FREE(instMac);
+    EUCA_FREE(instIp);
 
-        // metadata
-        // metadata redirect egress
-        rulepos = vpcif->prechain->rules_count + 1;
-        snprintf(pos_str, 32, "%d", rulepos);
-        rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
-                NULL, &rulepos,
-                "position", pos_str, "type", "dnat", "flowAction", "continue",
-                "ipAddrGroupDst", mido->midocore->midos[CORE_METADATA_IPADDRGROUP]->uuid,
-                "nwProto", "6", "tpDst", "jsonjson", "tpDst:start", "80", "tpDst:end", "80",
-                "tpDst:END", "END", "natTargets", "jsonlist", "natTargets:addressTo", pt_buf,
-                "natTargets:addressFrom", pt_buf, "natTargets:portFrom",
-                "8008", "natTargets:portTo", "8008", "natTargets:END", "END", NULL);
-        if (rc) {
-            LOGWARN("Failed to create MD dnat rule for %s\n", gniif->name);
-            ret++;
-        }
+    // metadata
+    // metadata redirect egress
+    rulepos = vpcif->prechain->rules_count + 1;
+    snprintf(pos_str, 32, "%d", rulepos);
+    rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
+            NULL, &rulepos,
+            "position", pos_str, "type", "dnat", "flowAction", "continue",
+            "ipAddrGroupDst", mido->midocore->midos[CORE_METADATA_IPADDRGROUP]->uuid,
+            "nwProto", "6", "tpDst", "jsonjson", "tpDst:start", "80", "tpDst:end", "80",
+            "tpDst:END", "END", "natTargets", "jsonlist", "natTargets:addressTo", pt_buf,
+            "natTargets:addressFrom", pt_buf, "natTargets:portFrom",
+            "8008", "natTargets:portTo", "8008", "natTargets:END", "END", NULL);
+    if (rc) {
+        LOGWARN("Failed to create MD dnat rule for %s\n", gniif->name);
+        ret++;
+    }
 
-        // metadata redirect ingress
-        rulepos = vpcif->postchain->rules_count + 1;
-        snprintf(pos_str, 32, "%d", rulepos);
-        rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
-                NULL, &rulepos,
-                "position", pos_str, "type", "snat", "flowAction", "continue",
-                "nwSrcAddress", pt_buf, "nwSrcLength", "32", "nwProto", "6",
-                "tpSrc", "jsonjson", "tpSrc:start", "8008", "tpSrc:end", "8008", "tpSrc:END", "END",
-                "natTargets", "jsonlist", "natTargets:addressTo", "169.254.169.254",
-                "natTargets:addressFrom", "169.254.169.254", "natTargets:portFrom", "80",
-                "natTargets:portTo", "80", "natTargets:END", "END", NULL);
-        if (rc) {
-            LOGWARN("Failed to create MD snat rule for %s\n", gniif->name);
-            ret++;
-        }
+    // metadata redirect ingress
+    rulepos = vpcif->postchain->rules_count + 1;
+    snprintf(pos_str, 32, "%d", rulepos);
+    rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
+            NULL, &rulepos,
+            "position", pos_str, "type", "snat", "flowAction", "continue",
+            "nwSrcAddress", pt_buf, "nwSrcLength", "32", "nwProto", "6",
+            "tpSrc", "jsonjson", "tpSrc:start", "8008", "tpSrc:end", "8008", "tpSrc:END", "END",
+            "natTargets", "jsonlist", "natTargets:addressTo", "169.254.169.254",
+            "natTargets:addressFrom", "169.254.169.254", "natTargets:portFrom", "80",
+            "natTargets:portTo", "80", "natTargets:END", "END", NULL);
+    if (rc) {
+        LOGWARN("Failed to create MD snat rule for %s\n", gniif->name);
+        ret++;
+    }
 
-        // contrack
-        // conntrack egress
-        rulepos = vpcif->prechain->rules_count + 1;
-        snprintf(pos_str, 32, "%d", rulepos);
-        rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
-                NULL, &rulepos,
-                "position", pos_str, "type", "accept", "matchReturnFlow", "true", NULL);
-        if (rc) {
-            LOGWARN("Failed to create egress conntrack for %s\n", gniif->name);
-            ret++;
-        }
+    // contrack
+    // conntrack egress
+    rulepos = vpcif->prechain->rules_count + 1;
+    snprintf(pos_str, 32, "%d", rulepos);
+    rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
+            NULL, &rulepos,
+            "position", pos_str, "type", "accept", "matchReturnFlow", "true", NULL);
+    if (rc) {
+        LOGWARN("Failed to create egress conntrack for %s\n", gniif->name);
+        ret++;
+    }
 
-        // conn track ingress
-        rulepos = vpcif->postchain->rules_count + 1;
-        snprintf(pos_str, 32, "%d", rulepos);
-        rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
-                NULL, &rulepos,
-                "position", pos_str, "type", "accept", "matchReturnFlow", "true", NULL);
-        if (rc) {
-            LOGWARN("Failed to create ingress conntrack for %s\n", gniif->name);
-            ret++;
-        }
+    // conn track ingress
+    rulepos = vpcif->postchain->rules_count + 1;
+    snprintf(pos_str, 32, "%d", rulepos);
+    rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
+            NULL, &rulepos,
+            "position", pos_str, "type", "accept", "matchReturnFlow", "true", NULL);
+    if (rc) {
+        LOGWARN("Failed to create ingress conntrack for %s\n", gniif->name);
+        ret++;
+    }
 
-        // plus two accept for metadata egress
-        rulepos = vpcif->prechain->rules_count + 1;
-        snprintf(pos_str, 32, "%d", rulepos);
-        rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
-                NULL, &rulepos,
-                "position", pos_str, "type", "accept", "nwDstAddress", pt_buf, "nwDstLength", "32", NULL);
-        if (rc) {
-            LOGWARN("Failed to create egress +2 rule for %s\n", gniif->name);
-            ret++;
-        }
+    // plus two accept for metadata egress
+    rulepos = vpcif->prechain->rules_count + 1;
+    snprintf(pos_str, 32, "%d", rulepos);
+    rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
+            NULL, &rulepos,
+            "position", pos_str, "type", "accept", "nwDstAddress", pt_buf, "nwDstLength", "32", NULL);
+    if (rc) {
+        LOGWARN("Failed to create egress +2 rule for %s\n", gniif->name);
+        ret++;
+    }
 
-        // drops
-        // default drop all else egress
-        rulepos = vpcif->prechain->rules_count + 1;
-        snprintf(pos_str, 32, "%d", rulepos);
-        rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
-                NULL, &rulepos,
-                "position", pos_str, "type", "drop", "invDlType",
-                "true", "dlType", "2054", NULL);
-        if (rc) {
-            LOGWARN("Failed to create egress drop rule for %s\n", gniif->name);
-            ret++;
-        }
+    // drops
+    // default drop all else egress
+    rulepos = vpcif->prechain->rules_count + 1;
+    snprintf(pos_str, 32, "%d", rulepos);
+    rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
+            NULL, &rulepos,
+            "position", pos_str, "type", "drop", "invDlType",
+            "true", "dlType", "2054", NULL);
+    if (rc) {
+        LOGWARN("Failed to create egress drop rule for %s\n", gniif->name);
+        ret++;
+    }
 
-        // default drop all else ingress
-        rulepos = vpcif->postchain->rules_count + 1;
-        snprintf(pos_str, 32, "%d", rulepos);
-        rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
-                NULL, &rulepos,
-                "type", "drop", "invDlType", "true", "position", pos_str,
-                "dlType", "2054", NULL);
-        if (rc) {
-            LOGWARN("Failed to create ingress drop rule for %s\n", gniif->name);
-            ret++;
-        }
+    // default drop all else ingress
+    rulepos = vpcif->postchain->rules_count + 1;
+    snprintf(pos_str, 32, "%d", rulepos);
+    rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
+            NULL, &rulepos,
+            "type", "drop", "invDlType", "true", "position", pos_str,
+            "dlType", "2054", NULL);
+    if (rc) {
+        LOGWARN("Failed to create ingress drop rule for %s\n", gniif->name);
+        ret++;
+    }
 
-        // now set up the jumps to SG chains
-        if (!vpcif->population_failed && !vpcif->sg_changed) {
-            LOGTRACE("\t\t%s sec groups did not change\n", gniif->name);
-        } else {
-            // Get all SG jump rules from interface chains
-            rc = mido_get_jump_rules(vpcif->prechain, &jprules_egress, &max_jprules_egress,
-                    &jprules_tgt_egress, &max_jprules_egress);
-            rc = mido_get_jump_rules(vpcif->postchain, &jprules_ingress, &max_jprules_ingress,
-                    &jprules_tgt_ingress, &max_jprules_ingress);
-            jpe_gni_present = EUCA_ZALLOC_C(max_jprules_egress, sizeof (int));
-            jpi_gni_present = EUCA_ZALLOC_C(max_jprules_ingress, sizeof (int));
-
-            for (j = 0; j < gniif->max_secgroup_names; j++) {
-                // go through the interface SGs in GNI
-                if (gniif->gnisgs[j] && gniif->gnisgs[j]->mido_present) {
-                    vpcsecgroup = (mido_vpc_secgroup *) gniif->gnisgs[j]->mido_present;
-                    if (vpcsecgroup) {
-                        found = 0;
-                        for (k = 0; k < max_jprules_egress && !found; k++) {
-                            if (!strcmp(vpcsecgroup->midos[VPCSG_EGRESS]->uuid, jprules_tgt_egress[k])) {
-                                LOGTRACE("\t\tegress jump to %s found.\n", vpcsecgroup->name);
-                                jpe_gni_present[k] = 1;
-                                found = 1;
-                            }
+    // now set up the jumps to SG chains
+    if (!vpcif->population_failed && !vpcif->sg_changed) {
+        LOGTRACE("\t\t%s sec groups did not change\n", gniif->name);
+    } else {
+        // Get all SG jump rules from interface chains
+        rc = mido_get_jump_rules(vpcif->prechain, &jprules_egress, &max_jprules_egress,
+                &jprules_tgt_egress, &max_jprules_egress);
+        rc = mido_get_jump_rules(vpcif->postchain, &jprules_ingress, &max_jprules_ingress,
+                &jprules_tgt_ingress, &max_jprules_ingress);
+        jpe_gni_present = EUCA_ZALLOC_C(max_jprules_egress, sizeof (int));
+        jpi_gni_present = EUCA_ZALLOC_C(max_jprules_ingress, sizeof (int));
+
+        for (j = 0; j < gniif->max_secgroup_names; j++) {
+            // go through the interface SGs in GNI
+            if (gniif->gnisgs[j] && gniif->gnisgs[j]->mido_present) {
+                vpcsecgroup = (mido_vpc_secgroup *) gniif->gnisgs[j]->mido_present;
+                if (vpcsecgroup) {
+                    found = 0;
+                    for (k = 0; k < max_jprules_egress && !found; k++) {
+                        if (!strcmp(vpcsecgroup->midos[VPCSG_EGRESS]->uuid, jprules_tgt_egress[k])) {
+                            LOGTRACE("\t\tegress jump to %s found.\n", vpcsecgroup->name);
+                            jpe_gni_present[k] = 1;
+                            found = 1;
                         }
-                        if (!found) {
-                            // add the SG chain jump egress - right before the drop rule
-                            rulepos = vpcif->prechain->rules_count;
-                            snprintf(pos_str, 32, "%d", rulepos);
-                            rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
-                                    NULL, &rulepos,
-                                    "position", pos_str, "type", "jump", "jumpChainId",
-                                    vpcsecgroup->midos[VPCSG_EGRESS]->uuid, NULL);
-                            if (rc) {
-                                LOGWARN("Failed to create egress jump rule %s %s\n", vpcsecgroup->name, gniif->name);
-                                ret++;
-                            }
+                    }
+                    if (!found) {
+                        // add the SG chain jump egress - right before the drop rule
+                        rulepos = vpcif->prechain->rules_count;
+                        snprintf(pos_str, 32, "%d", rulepos);
+                        rc = mido_create_rule(vpcif->prechain, vpcif->midos[INST_PRECHAIN],
+                                NULL, &rulepos,
+                                "position", pos_str, "type", "jump", "jumpChainId",
+                                vpcsecgroup->midos[VPCSG_EGRESS]->uuid, NULL);
+                        if (rc) {
+                            LOGWARN("Failed to create egress jump rule %s %s\n", vpcsecgroup->name, gniif->name);
+                            ret++;
                         }
+                    }
 
-                        found = 0;
-                        for (k = 0; k < max_jprules_ingress && !found; k++) {
-                            if (!strcmp(vpcsecgroup->midos[VPCSG_INGRESS]->uuid, jprules_tgt_ingress[k])) {
-                                LOGTRACE("\t\tingress jump to %s found.\n", vpcsecgroup->name);
-                                jpi_gni_present[k] = 1;
-                                found = 1;
-                            }
+                    found = 0;
+                    for (k = 0; k < max_jprules_ingress && !found; k++) {
+                        if (!strcmp(vpcsecgroup->midos[VPCSG_INGRESS]->uuid, jprules_tgt_ingress[k])) {
+                            LOGTRACE("\t\tingress jump to %s found.\n", vpcsecgroup->name);
+                            jpi_gni_present[k] = 1;
+                            found = 1;
                         }
-                        if (!found) {
-                            // add the SG chain jump ingress - right before the drop rule
-                            rulepos = vpcif->postchain->rules_count;
-                            snprintf(pos_str, 32, "%d", rulepos);
-                            rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
-                                    NULL, &rulepos,
-                                    "position", pos_str, "type", "jump", "jumpChainId",
-                                    vpcsecgroup->midos[VPCSG_INGRESS]->uuid, NULL);
-                            if (rc) {
-                                LOGWARN("Failed to create ingress jump rule %s %s\n", vpcsecgroup->name, gniif->name);
-                                ret++;
-                            }
+                    }
+                    if (!found) {
+                        // add the SG chain jump ingress - right before the drop rule
+                        rulepos = vpcif->postchain->rules_count;
+                        snprintf(pos_str, 32, "%d", rulepos);
+                        rc = mido_create_rule(vpcif->postchain, vpcif->midos[INST_POSTCHAIN],
+                                NULL, &rulepos,
+                                "position", pos_str, "type", "jump", "jumpChainId",
+                                vpcsecgroup->midos[VPCSG_INGRESS]->uuid, NULL);
+                        if (rc) {
+                            LOGWARN("Failed to create ingress jump rule %s %s\n", vpcsecgroup->name, gniif->name);
+                            ret++;
                         }
-                    } else {
-                        LOGWARN("cannot locate %s\n", gniif->secgroup_names[j].name);
-                        ret++;
                     }
                 } else {
-                    LOGWARN("Inconsistent GNI detected while processing %s\n", gniif->name);
+                    LOGWARN("cannot locate %s\n", gniif->secgroup_names[j].name);
                     ret++;
                 }
+            } else {
+                LOGWARN("Inconsistent GNI detected while processing %s\n", gniif->name);
+                ret++;
             }
-            
-            // Delete jump rules not in GNI
-            for (j = 0; j < max_jprules_egress; j++) {
-                if (jpe_gni_present[j] == 0) {
-                    rc = mido_delete_rule(vpcif->prechain, jprules_egress[j]);
-                    if (rc != 0) {
-                        LOGWARN("failed to delete egress jump rule\n");
-                    }
+        }
+        
+        // Delete jump rules not in GNI
+        for (j = 0; j < max_jprules_egress; j++) {
+            if (jpe_gni_present[j] == 0) {
+                rc = mido_delete_rule(vpcif->prechain, jprules_egress[j]);
+                if (rc != 0) {
+                    LOGWARN("failed to delete egress jump rule\n");
                 }
             }
-            for (j = 0; j < max_jprules_ingress; j++) {
-                if (jpi_gni_present[j] == 0) {
-                    rc = mido_delete_rule(vpcif->postchain, jprules_ingress[j]);
-                    if (rc != 0) {
-                        LOGWARN("failed to delete ingress jump rule\n");
-                    }
+        }
+        for (j = 0; j < max_jprules_ingress; j++) {
+            if (jpi_gni_present[j] == 0) {
+                rc = mido_delete_rule(vpcif->postchain, jprules_ingress[j]);
+                if (rc != 0) {
+                    LOGWARN("failed to delete ingress jump rule\n");
                 }
             }
+        }
 
-            // release memory
+        // release memory
 /*
-            for (k = 0; k < max_jprules_egress; k++) {
-                EUCA_FREE(jprules_tgt_egress[k]);
-            }
-            for (k = 0; k < max_jprules_ingress; k++) {
-                EUCA_FREE(jprules_tgt_ingress[k]);
-            }
+        for (k = 0; k < max_jprules_egress; k++) {
+            EUCA_FREE(jprules_tgt_egress[k]);
+        }
+        for (k = 0; k < max_jprules_ingress; k++) {
+            EUCA_FREE(jprules_tgt_ingress[k]);
+        }
 */
-            EUCA_FREE(jprules_egress);
-            EUCA_FREE(jprules_tgt_egress);
-            EUCA_FREE(jpe_gni_present);
-            EUCA_FREE(jprules_ingress);
-            EUCA_FREE(jprules_tgt_ingress);
-            EUCA_FREE(jpi_gni_present);
-            
-            if (ecnt != ret) {
-                vpcif->population_failed = 1;
-            } else {
-                vpcif->population_failed = 0;
-            }
+        EUCA_FREE(jprules_egress);
+        EUCA_FREE(jprules_tgt_egress);
+        EUCA_FREE(jpe_gni_present);
+        EUCA_FREE(jprules_ingress);
+        EUCA_FREE(jprules_tgt_ingress);
+        EUCA_FREE(jpi_gni_present);
+        
+        if (ecnt != ret) {
+            vpcif->population_failed = 1;
+        } else {
+            vpcif->population_failed = 0;
         }
-
-        LOGDEBUG("\t%s implemented in %.2f ms\n", vpcif->name, eucanetd_timer_usec(&tv) / 1000.0);
     }
+
+    LOGDEBUG("\t%s implemented in %.2f ms\n", vpcif->name, eucanetd_timer_usec(&tv) / 1000.0);
+
+    return (ret);
+}
+
+/**
+ * Implements instances/interfaces (create mido objects) as described in GNI.
+ * Instance models are set up sequentially; the MidoNet objects of instances
+ * that are not yet in place are then reconciled concurrently. Instances of the
+ * same VPC subnet are serialized, as they share the subnet bridge DHCP entries.
+ * @param gni [in] Global Network Information to be applied.
+ * @param mido [in] data structure that holds MidoNet configuration
+ * @return 0 on success. 1 otherwise.
+ */
+int do_midonet_update_pass3_insts(globalNetworkInfo *gni, mido_config *mido) {
+    int ret = 0, i = 0;
+    int max_tasks = 0;
+
+    mido_vpc_instance *vpcif = NULL;
+    mido_vpc_subnet *vpcsubnet = NULL;
+    mido_vpc *vpc = NULL;
+    mido_task *tasks = NULL;
     
+    gni_instance *gniif = NULL;
+
+    if (gni->max_ifs > 0) {
+        tasks = EUCA_ZALLOC_C(gni->max_ifs, sizeof (mido_task));
+    }
+
+    // Process instances/interfaces
+    for (i = 0; i < gni->max_ifs; i++) {
+        gniif = gni->ifs[i];
+        if (strlen(gniif->name) == 0) {
+            LOGWARN("Empty interface detected in GNI.\n");
+            ret++;
+            continue;
+        }
+        vpc = (mido_vpc *) gniif->mido_vpc;
+        vpcsubnet = (mido_vpc_subnet *) gniif->mido_vpcsubnet;
+        vpcif = (mido_vpc_instance *) gniif->mido_present;
+        if (!vpc || !vpcsubnet) {
+            LOGWARN("Unable to find %s and/or %s\n", gniif->vpc, gniif->subnet);
+            ret++;
+            continue;
+        }
+
+        if (vpcif) {
+            LOGTRACE("found instance %s in vpc %s subnet %s\n", vpcif->name, vpc->name, vpcsubnet->name);
+            vpcif->gniInst = gniif;
+        } else {
+            // create the instance model
+            // necessary memory should have been allocated in pass1
+            vpcif = &(vpcsubnet->instances[vpcsubnet->max_instances]);
+            bzero(vpcif, sizeof (mido_vpc_instance));
+            vpcsubnet->max_instances++;
+            snprintf(vpcif->name, INTERFACE_ID_LEN, "%s", gniif->name);
+            vpcif->gniInst = gniif;
+            gniif->mido_present = vpcif;
+            vpcif->host_changed = 1;
+            vpcif->srcdst_changed = 1;
+            vpcif->pubip_changed = 1;
+            vpcif->sg_changed = 1;
+            LOGINFO("\tcreating %s\n", gniif->name);
+        }
+
+        if (vpcif->midopresent) {
+            LOGTRACE("\t\tskipping pass3 for %s\n", gniif->name);
+            continue;
+        }
+        tasks[max_tasks].fn = do_midonet_update_pass3_inst;
+        tasks[max_tasks].arg = gniif;
+        tasks[max_tasks].key = vpcsubnet;
+        max_tasks++;
+    }
+
+    ret += mido_run_tasks(gni, mido, tasks, max_tasks, MIDO_UPDATE_THREADS);
+    EUCA_FREE(tasks);
+
     return (ret);
 }
 
@@ -89,6 +89,9 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+#define MIDO_UPDATE_THREADS                    8
+#define MIDO_UPDATE_USE_THREADS_THRESHOLD      16
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  TYPEDEFS                                  |
@@ -334,6 +337,24 @@ typedef struct mido_config_t {
     int router_ids[MAX_RTID];
 } mido_config;
 
+//! MidoNet reconciliation task callback
+typedef int (*mido_task_fn) (globalNetworkInfo *gni, mido_config *mido, void *arg);
+
+typedef struct mido_task_t {
+    mido_task_fn fn;                   //!< function that implements the task
+    void *arg;                         //!< argument passed to fn
+    void *key;                         //!< tasks sharing a non-NULL key are never executed concurrently
+    int rc;                            //!< return code of fn
+} mido_task;
+
+typedef struct mido_task_queue_t {
+    globalNetworkInfo *gni;
+    mido_config *mido;
+    mido_task **order;                 //!< tasks sorted by key
+    int max_tasks;
+    int next;                          //!< next entry of order to be picked up by a worker
+} mido_task_queue;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXPORTED VARIABLES                             |
@@ -467,6 +488,7 @@ int do_midonet_update_pass2(globalNetworkInfo *gni, mido_config *mido);
 int do_midonet_update_pass3_vpcs(globalNetworkInfo *gni, mido_config *mido);
 int do_midonet_update_pass3_sgs(globalNetworkInfo *gni, mido_config *mido);
 int do_midonet_update_pass3_insts(globalNetworkInfo *gni, mido_config *mido);
+int mido_run_tasks(globalNetworkInfo *gni, mido_config *mido, mido_task *tasks, int max_tasks, int max_threads);
 
 int do_midonet_teardown(mido_config *mido);
 int do_midonet_delete_all(mido_config *mido);
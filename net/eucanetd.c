@@ -341,6 +341,7 @@ int main(int argc, char **argv)
     int epoch_failed_updates = 0;
     int epoch_checks = 0;
     time_t epoch_timer = 0;
+    time_t epoch_start = 0;
     struct timeval tv = { 0 };
     struct timeval ttv = { 0 };
     
@@ -474,6 +475,12 @@ int main(int argc, char **argv)
         }
     }
 
+    // the ARP announcer raw socket has to be opened while we are still privileged
+    config->arph = EUCA_ZALLOC_C(1, sizeof(arp_handler));
+    if (arp_handler_init(config->arph, ARP_ANNOUNCE_RATE)) {
+        EUCA_FREE(config->arph);
+    }
+
     // daemonize this process!
     rc = eucanetd_daemonize();
     if (rc) {
@@ -588,7 +595,11 @@ int main(int argc, char **argv)
         }
     }
 
+    // wake up on GNI changes rather than on the polling period (falls back on polling if the source cannot be watched)
+    atomic_file_watch(&(config->global_network_info_file));
+
     // got all config, enter main loop
+    epoch_start = time(NULL);
     while (gIsRunning) {
         eucanetd_timer(&ttv);
         counter++;
@@ -782,6 +793,7 @@ int main(int argc, char **argv)
             LOGINFO("eucanetd report: tot_checks=%d tot_update_attempts=%d\n\tsuccess_update_attempts=%d fail_update_attempts=%d duty_cycle_minutes=%f\n", epoch_checks,
                     epoch_updates + epoch_failed_updates, epoch_updates, epoch_failed_updates, (float)epoch_timer / 60.0);
             epoch_checks = epoch_updates = epoch_failed_updates = epoch_timer = 0;
+            epoch_start = time(NULL);
         }
 
         if ((update_globalnet_failed == FALSE) && (update_globalnet == FALSE) && (gIsRunning == TRUE)) {
@@ -799,8 +811,8 @@ int main(int argc, char **argv)
             sleep(config->polling_frequency);
         } else {
             if (update_globalnet == FALSE) {
-                LOGTRACE("main loop complete (%ld ms): sleeping %d seconds before next poll\n", eucanetd_timer(&ttv), config->polling_frequency);
-                sleep(config->polling_frequency);
+                LOGTRACE("main loop complete (%ld ms): waiting up to %d seconds for a GNI change\n", eucanetd_timer(&ttv), config->polling_frequency);
+                atomic_file_wait(&(config->global_network_info_file), config->polling_frequency * 1000);
             } else {
                 pGniApplied = pGni;
                 if (pGni == gni_a) {
@@ -812,7 +824,7 @@ int main(int argc, char **argv)
             }
         }
 
-        epoch_timer += config->polling_frequency;
+        epoch_timer = time(NULL) - epoch_start;
         
     }
 
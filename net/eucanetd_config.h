@@ -84,6 +84,7 @@
 #include <ipt_handler.h>
 #include <ips_handler.h>
 #include <ebt_handler.h>
+#include <arp_handler.h>
 #include <atomic_file.h>
 
 /*----------------------------------------------------------------------------*\
@@ -168,6 +169,7 @@ typedef struct eucanetdConfig_t {
     ipt_handler *ipt;                  //!< Pointer to the IP Tables Handler
     ips_handler *ips;                  //!< Pointer to the IP Sets Handler
     ebt_handler *ebt;                  //!< Pointer to the EB Tables Handler
+    arp_handler *arph;                 //!< Pointer to the gratuitous ARP announcer (NULL if it could not be set up)
 
     char netMode[NETMODE_LEN];         //!< Network mode name string
     euca_netmode nmCode;               //!< Network mode integer code
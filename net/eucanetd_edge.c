@@ -106,11 +106,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <pwd.h>
 #include <dirent.h>
 #include <errno.h>
+#include <openssl/rand.h>
 
 #include <eucalyptus.h>
 #include <misc.h>
@@ -121,6 +123,7 @@
 #include <http.h>
 #include <config.h>
 #include <atomic_file.h>
+#include <euca_auth.h>
 
 #include "ipt_handler.h"
 #include "ips_handler.h"
@@ -131,6 +134,7 @@
 #include "euca_lni.h"
 #include "eucanetd.h"
 #include "eucanetd_util.h"
+#include "omapi_handler.h"
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -138,6 +142,8 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+#define DHCPD_OMAPI_KEY_NAME              "euca_omapi"  //!< Name of the OMAPI key shared with our dhcpd
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  TYPEDEFS                                  |
@@ -156,6 +162,13 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! A host declaration of the DHCP server configuration
+typedef struct dhcp_host_t {
+    char name[32];                     //!< The host declaration name (node-<ip>)
+    char mac[ENET_ADDR_LEN];           //!< The instance MAC address
+    char ip[INET_ADDR_LEN];            //!< The instance private IP address
+} dhcp_host;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXTERNAL VARIABLES                             |
@@ -179,6 +192,14 @@
 //! Set to TRUE when driver is initialized
 static boolean gInitialized = FALSE;
 
+//! @{
+//! @name What the running dhcpd was last configured with, so host changes can be applied through OMAPI
+static char *psDhcpdAppliedPreamble = NULL;    //!< Everything in the configuration but the host declarations
+static dhcp_host *pDhcpdAppliedHosts = NULL;   //!< The host declarations
+static int nbDhcpdAppliedHosts = 0;    //!< Number of host declarations
+static char sDhcpdOmapiSecret[64] = "";    //!< Base64 secret of the OMAPI key (generated once per eucanetd run)
+//! @}
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXPORTED PROTOTYPES                            |
@@ -202,7 +223,9 @@ static int network_driver_implement_sg(globalNetworkInfo * pGni, lni_t * pLni);
 static int network_driver_implement_addressing(globalNetworkInfo * pGni, lni_t * pLni);
 //! @}
 
-static int generate_dhcpd_config(globalNetworkInfo * pGni);
+static int generate_dhcpd_config(globalNetworkInfo * pGni, char **ppsPreamble, dhcp_host ** ppHosts, int *pNbHosts);
+static int update_dhcpd_hosts(const char *psPreamble, dhcp_host * pHosts, int nbHosts);
+static dhcp_host *find_dhcp_host(dhcp_host * pHosts, int nbHosts, dhcp_host * pHost);
 
 static int update_private_ips(globalNetworkInfo * pGni);
 static int update_elastic_ips(globalNetworkInfo * pGni);
@@ -906,24 +929,30 @@ static int network_driver_implement_addressing(globalNetworkInfo * pGni, lni_t *
 
 //!
 //! Generates the DHCP server configuration so the instances can get their
-//! networking configuration information.
+//! networking configuration information. The configuration preamble (OMAPI key,
+//! subnet and options) and the host declarations are also handed back separately
+//! so that update_dhcpd_hosts() can tell whether a restart is needed.
 //!
-//! @param[in] pGni a pointer to the Global Network Information structure
+//! @param[in]  pGni a pointer to the Global Network Information structure
+//! @param[out] ppsPreamble the configuration without its host declarations (caller frees)
+//! @param[out] ppHosts the host declarations (caller frees)
+//! @param[out] pNbHosts the number of host declarations
 //!
 //! @return 0 on success or 1 if any failure occurred
 //!
-//! @see
+//! @see update_dhcpd_hosts()
 //!
-//! @pre The pGni parameter MUST not be NULL
+//! @pre The pGni, ppsPreamble, ppHosts and pNbHosts parameters MUST not be NULL
 //!
 //! @post On success the DHCP server configuration is created. On failure, the
 //!       DHCP configuration file should not exists.
 //!
 //! @note
 //!
-static int generate_dhcpd_config(globalNetworkInfo * pGni)
+static int generate_dhcpd_config(globalNetworkInfo * pGni, char **ppsPreamble, dhcp_host ** ppHosts, int *pNbHosts)
 {
     int i = 0;
+    int fd = -1;
     int rc = 0;
     int ret = 0;
     int max_instances = 0;
@@ -936,17 +965,26 @@ static int generate_dhcpd_config(globalNetworkInfo * pGni)
     char *broadcast = NULL;
     char *router = NULL;
     char *strptra = NULL;
+    char *psPreamble = NULL;
     char dhcpd_config_path[EUCA_MAX_PATH] = "";
+    u8 aSecret[16] = { 0 };
+    size_t preambleLen = 0;
     FILE *OFH = NULL;
+    FILE *PFH = NULL;
+    dhcp_host *pHosts = NULL;
     gni_node *myself = NULL;
     gni_cluster *mycluster = NULL;
     gni_instance *instances = NULL;
 
     // Make sure the given pointer is valid
-    if (!pGni) {
+    if (!pGni || !ppsPreamble || !ppHosts || !pNbHosts) {
         LOGERROR("Cannot configure DHCP server. Invalid parameter provided.\n");
         return (1);
     }
+
+    *ppsPreamble = NULL;
+    *ppHosts = NULL;
+    *pNbHosts = 0;
     // Find our associated cluster
     rc = gni_find_self_cluster(pGni, &mycluster);
     if (rc) {
@@ -970,56 +1008,98 @@ static int generate_dhcpd_config(globalNetworkInfo * pGni)
     nm = mycluster->private_subnet.netmask;
     //    rt = mycluster->private_subnet.gateway;
 
-    // Open the DHCP configuration file
+    // The OMAPI key only has to be unguessable, dhcpd is restarted with it whenever eucanetd starts
+    if (sDhcpdOmapiSecret[0] == '\0') {
+        if ((RAND_bytes(aSecret, sizeof(aSecret)) == 1) && ((strptra = base64_enc(aSecret, sizeof(aSecret))) != NULL)) {
+            euca_strncpy(sDhcpdOmapiSecret, strptra, sizeof(sDhcpdOmapiSecret));
+        }
+        EUCA_FREE(strptra);
+    }
+
+    // Open the DHCP configuration file. Everything but the hosts is first written to memory so it can be compared.
+    // The file holds the OMAPI secret, so only its owner may read it, even if an older version created it world-readable.
     snprintf(dhcpd_config_path, EUCA_MAX_PATH, NC_NET_PATH_DEFAULT "/euca-dhcp.conf", config->eucahome);
-    OFH = fopen(dhcpd_config_path, "w");
-    if (!OFH) {
+    if ((fd = open(dhcpd_config_path, O_CREAT | O_TRUNC | O_WRONLY, 0600)) >= 0) {
+        if ((fchmod(fd, 0600) != 0) || ((OFH = fdopen(fd, "w")) == NULL)) {
+            close(fd);
+        }
+    }
+    PFH = open_memstream(&psPreamble, &preambleLen);
+    if (!OFH || !PFH) {
         LOGERROR("cannot open dhcpd server config file for write '%s': check permissions\n", dhcpd_config_path);
         ret = 1;
     } else {
-        fprintf(OFH, "# automatically generated config file for DHCP server\ndefault-lease-time 86400;\nmax-lease-time 86400;\nddns-update-style none;\n\n");
-        fprintf(OFH, "shared-network euca {\n");
+        fprintf(PFH, "# automatically generated config file for DHCP server\ndefault-lease-time 86400;\nmax-lease-time 86400;\nddns-update-style none;\n\n");
+        if (sDhcpdOmapiSecret[0] != '\0') {
+            // lets eucanetd add and remove hosts without restarting dhcpd
+            fprintf(PFH, "key %s {\n  algorithm hmac-md5;\n  secret \"%s\";\n};\nomapi-key %s;\nomapi-port %d;\n\n", DHCPD_OMAPI_KEY_NAME, sDhcpdOmapiSecret,
+                    DHCPD_OMAPI_KEY_NAME, OMAPI_DEFAULT_PORT);
+        }
+        fprintf(PFH, "shared-network euca {\n");
 
         network = hex2dot(nw);
         netmask = hex2dot(nm);
         broadcast = hex2dot(nw | ~nm);
         router = hex2dot(config->vmGatewayIP);  // this is set by configuration
 
-        fprintf(OFH, "subnet %s netmask %s {\n  option subnet-mask %s;\n  option broadcast-address %s;\n", network, netmask, netmask, broadcast);
+        fprintf(PFH, "subnet %s netmask %s {\n  option subnet-mask %s;\n  option broadcast-address %s;\n", network, netmask, netmask, broadcast);
         if (strlen(pGni->instanceDNSDomain)) {
-            fprintf(OFH, "  option domain-name \"%s\";\n", pGni->instanceDNSDomain);
+            fprintf(PFH, "  option domain-name \"%s\";\n", pGni->instanceDNSDomain);
         }
 
         if (pGni->max_instanceDNSServers) {
             strptra = hex2dot(pGni->instanceDNSServers[0]);
-            fprintf(OFH, "  option domain-name-servers %s", SP(strptra));
+            fprintf(PFH, "  option domain-name-servers %s", SP(strptra));
             EUCA_FREE(strptra);
             for (i = 1; i < pGni->max_instanceDNSServers; i++) {
                 strptra = hex2dot(pGni->instanceDNSServers[i]);
-                fprintf(OFH, ", %s", SP(strptra));
+                fprintf(PFH, ", %s", SP(strptra));
                 EUCA_FREE(strptra);
             }
-            fprintf(OFH, ";\n");
+            fprintf(PFH, ";\n");
         } else {
-            fprintf(OFH, "  option domain-name-servers 8.8.8.8;\n");
+            fprintf(PFH, "  option domain-name-servers 8.8.8.8;\n");
         }
-        fprintf(OFH, "  option routers %s;\n}\n", router);
+        fprintf(PFH, "  option routers %s;\n}\n", router);
 
         EUCA_FREE(network);
         EUCA_FREE(netmask);
         EUCA_FREE(broadcast);
         EUCA_FREE(router);
 
+        fclose(PFH);
+        PFH = NULL;
+        fprintf(OFH, "%s", psPreamble);
+
+        pHosts = EUCA_ZALLOC(((max_instances > 0) ? max_instances : 1), sizeof(dhcp_host));
         for (i = 0; i < max_instances; i++) {
             hex2mac(instances[i].macAddress, &mac);
             ip = hex2dot(instances[i].privateIp);
             fprintf(OFH, "\nhost node-%s {\n  hardware ethernet %s;\n  fixed-address %s;\n}\n", ip, mac, ip);
+            if (pHosts) {
+                snprintf(pHosts[i].name, sizeof(pHosts[i].name), "node-%s", ip);
+                euca_strncpy(pHosts[i].mac, mac, ENET_ADDR_LEN);
+                euca_strncpy(pHosts[i].ip, ip, INET_ADDR_LEN);
+            }
             EUCA_FREE(mac);
             EUCA_FREE(ip);
         }
 
         fprintf(OFH, "}\n");
+    }
+
+    if (OFH)
         fclose(OFH);
+    if (PFH)
+        fclose(PFH);
+
+    if (!ret && pHosts) {
+        *ppsPreamble = psPreamble;
+        *ppHosts = pHosts;
+        *pNbHosts = max_instances;
+    } else {
+        EUCA_FREE(psPreamble);
+        EUCA_FREE(pHosts);
     }
 
     // Free our instance list
@@ -1027,6 +1107,95 @@ static int generate_dhcpd_config(globalNetworkInfo * pGni)
     return (ret);
 }
 
+//!
+//! Looks up a host declaration with the same name, MAC and IP in a list.
+//!
+//! @param[in] pHosts the list of host declarations
+//! @param[in] nbHosts the number of host declarations in the list
+//! @param[in] pHost the host declaration to look for
+//!
+//! @return a pointer to the matching entry or NULL if not found
+//!
+static dhcp_host *find_dhcp_host(dhcp_host * pHosts, int nbHosts, dhcp_host * pHost)
+{
+    int i = 0;
+
+    for (i = 0; i < nbHosts; i++) {
+        if (!strcmp(pHosts[i].name, pHost->name) && !strcasecmp(pHosts[i].mac, pHost->mac) && !strcmp(pHosts[i].ip, pHost->ip)) {
+            return (&pHosts[i]);
+        }
+    }
+    return (NULL);
+}
+
+//!
+//! Applies host declaration changes to the running dhcpd through OMAPI so that an
+//! instance launch or termination only touches its own host entry. This is only
+//! possible if dhcpd is running with the same preamble (key, subnet, options) as
+//! the new configuration; anything else requires a restart.
+//!
+//! @param[in] psPreamble the new configuration without its host declarations
+//! @param[in] pHosts the new host declarations
+//! @param[in] nbHosts the number of new host declarations
+//!
+//! @return 0 if dhcpd is now serving the new host declarations or 1 if it must be restarted
+//!
+//! @see generate_dhcpd_config(), eucanetd_kick_dhcpd_server()
+//!
+static int update_dhcpd_hosts(const char *psPreamble, dhcp_host * pHosts, int nbHosts)
+{
+    int i = 0;
+    int pid = 0;
+    int added = 0;
+    int removed = 0;
+    char *psPid = NULL;
+    char sPidFileName[EUCA_MAX_PATH] = "";
+    omapi_handler omapi = { 0 };
+
+    if (!psPreamble || !psDhcpdAppliedPreamble || strcmp(psDhcpdAppliedPreamble, psPreamble) || (sDhcpdOmapiSecret[0] == '\0')) {
+        return (1);
+    }
+    // Make sure the dhcpd we configured is still around
+    snprintf(sPidFileName, EUCA_MAX_PATH, NC_NET_PATH_DEFAULT "/euca-dhcp.pid", config->eucahome);
+    if ((psPid = file2str(sPidFileName)) != NULL) {
+        pid = atoi(psPid);
+        EUCA_FREE(psPid);
+    }
+    if ((pid <= 1) || check_process(pid, "euca-dhcp.conf")) {
+        // no instance on this node means dhcpd was not started, see eucanetd_kick_dhcpd_server()
+        return ((nbHosts == 0) ? 0 : 1);
+    }
+
+    if (omapi_handler_connect(&omapi, "127.0.0.1", OMAPI_DEFAULT_PORT, DHCPD_OMAPI_KEY_NAME, sDhcpdOmapiSecret)) {
+        LOGDEBUG("cannot reach dhcpd through OMAPI: restarting it instead\n");
+        return (1);
+    }
+
+    for (i = 0; i < nbDhcpdAppliedHosts; i++) {
+        if (!find_dhcp_host(pHosts, nbHosts, &pDhcpdAppliedHosts[i])) {
+            if (omapi_handler_del_host(&omapi, pDhcpdAppliedHosts[i].name)) {
+                omapi_handler_close(&omapi);
+                return (1);
+            }
+            removed++;
+        }
+    }
+
+    for (i = 0; i < nbHosts; i++) {
+        if (!find_dhcp_host(pDhcpdAppliedHosts, nbDhcpdAppliedHosts, &pHosts[i])) {
+            if (omapi_handler_add_host(&omapi, pHosts[i].name, pHosts[i].mac, pHosts[i].ip)) {
+                omapi_handler_close(&omapi);
+                return (1);
+            }
+            added++;
+        }
+    }
+
+    omapi_handler_close(&omapi);
+    LOGDEBUG("dhcpd updated in place: %d host(s) added, %d host(s) removed\n", added, removed);
+    return (0);
+}
+
 //!
 //! Update the private IP addressing. This will ensure a DHCP configuration file
 //! is generated and the server restarted upon success.
@@ -1047,6 +1216,10 @@ static int generate_dhcpd_config(globalNetworkInfo * pGni)
 static int update_private_ips(globalNetworkInfo * pGni)
 {
     int rc = 0;
+    int nbHosts = 0;
+    char *psPreamble = NULL;
+    char sLeaseFileName[EUCA_MAX_PATH] = "";
+    dhcp_host *pHosts = NULL;
     struct timeval tv = { 0 };
 
     eucanetd_timer_usec(&tv);
@@ -1072,15 +1245,31 @@ static int update_private_ips(globalNetworkInfo * pGni)
     }
 #endif /* USE_IP_ROUTE_HANDLER */
     // Generate the DHCP configuration so instances can get their network config
-    if ((rc = generate_dhcpd_config(pGni)) != 0) {
+    if ((rc = generate_dhcpd_config(pGni, &psPreamble, &pHosts, &nbHosts)) != 0) {
         LOGERROR("unable to generate new dhcp configuration file: check above log errors for details\n");
         return (1);
     }
-    // Restart the DHCP server so it can pick up the new configuration
-    if ((rc = eucanetd_kick_dhcpd_server(config)) != 0) {
-        LOGERROR("unable to (re)configure local dhcpd server: check above log errors for details\n");
-        return (1);
+    // Only restart the DHCP server if the host changes cannot be pushed to it
+    if (update_dhcpd_hosts(psPreamble, pHosts, nbHosts) != 0) {
+        // all our hosts have fixed addresses so the lease file only holds OMAPI host records, which the new configuration supersedes
+        snprintf(sLeaseFileName, EUCA_MAX_PATH, NC_NET_PATH_DEFAULT "/euca-dhcp.leases", config->eucahome);
+        unlink(sLeaseFileName);
+
+        if ((rc = eucanetd_kick_dhcpd_server(config)) != 0) {
+            LOGERROR("unable to (re)configure local dhcpd server: check above log errors for details\n");
+            EUCA_FREE(psDhcpdAppliedPreamble);
+            EUCA_FREE(psPreamble);
+            EUCA_FREE(pHosts);
+            return (1);
+        }
     }
+    // Remember what dhcpd is now serving
+    EUCA_FREE(psDhcpdAppliedPreamble);
+    EUCA_FREE(pDhcpdAppliedHosts);
+    psDhcpdAppliedPreamble = psPreamble;
+    pDhcpdAppliedHosts = pHosts;
+    nbDhcpdAppliedHosts = nbHosts;
+
     LOGINFO("update_private_ips executed in %.2f ms.\n", eucanetd_timer_usec(&tv) / 1000.0);
     return (0);
 }
@@ -1222,7 +1411,10 @@ static int update_elastic_ips(globalNetworkInfo * pGni)
                 LOGERROR("could not execute: adding ips\n");
                 ret = 1;
             }
-            euca_exec_no_wait(config->cmdprefix, "arping", "-c", "5", "-w", "1", "-U", "-I", config->pubInterface, strptra, NULL);
+            // announced in one batch once the NAT rules are in place
+            if (!config->arph || arp_handler_queue(config->arph, config->pubInterface, strptra, NULL)) {
+                euca_exec_no_wait(config->cmdprefix, "arping", "-c", "5", "-w", "1", "-U", "-I", config->pubInterface, strptra, NULL);
+            }
 
             snprintf(rule, MAX_RULE_LEN, "-A EUCA_NAT_PRE -d %s/32 -j DNAT --to-destination %s", strptra, strptrb);
             rc = ipt_chain_add_rule(config->ipt, "nat", "EUCA_NAT_PRE", rule);
@@ -1274,6 +1466,10 @@ static int update_elastic_ips(globalNetworkInfo * pGni)
         ret = 1;
     }
 
+    if (config->arph && arp_handler_send(config->arph, ARP_ANNOUNCE_ROUNDS, ARP_ANNOUNCE_INTERVAL_MS)) {
+        LOGWARN("could not send all elastic IP gratuitous ARPs\n");
+    }
+
     // if all has gone well, now clear any public IPs that have not been mapped to private IPs
     if (!ret) {
         u32 *ips=NULL, *nms=NULL;
@@ -2041,17 +2237,23 @@ static int update_host_arp(void)
                                 snprintf(sRule, EUCA_MAX_PATH, "-p ARP --arp-ip-dst %s -j arpreply --arpreply-mac %s", psPrivateIp, psTrimMac);
                                 if (ebt_chain_find_rule(config->ebt, "nat", "EUCA_EBT_NAT_PRE", sRule) == NULL) {
                                     LOGDEBUG("Sending gratuitous ARP for instance %s IP %s using MAC %s on %s\n", pInstances[i].name, psPrivateIp, psBridgeMac, config->bridgeDev);
-                                    snprintf(sCommand, EUCA_MAX_PATH, "/usr/libexec/eucalyptus/announce-arp %s %s %s", config->bridgeDev, psPrivateIp, psBridgeMac);
-                                    euca_execlp(&rc, config->cmdprefix, "/usr/libexec/eucalyptus/announce-arp", config->bridgeDev, psPrivateIp, psBridgeMac, NULL);
-                                    rc = rc >> 8;
-                                    if(!(rc == 0 || rc == 2)){
-                                        LOGWARN("Failed to run %s", sCommand);
-                                        ret = 1;
+                                    if (!config->arph || arp_handler_queue(config->arph, config->bridgeDev, psPrivateIp, psBridgeMac)) {
+                                        snprintf(sCommand, EUCA_MAX_PATH, "/usr/libexec/eucalyptus/announce-arp %s %s %s", config->bridgeDev, psPrivateIp, psBridgeMac);
+                                        euca_execlp(&rc, config->cmdprefix, "/usr/libexec/eucalyptus/announce-arp", config->bridgeDev, psPrivateIp, psBridgeMac, NULL);
+                                        rc = rc >> 8;
+                                        if(!(rc == 0 || rc == 2)){
+                                            LOGWARN("Failed to run %s", sCommand);
+                                            ret = 1;
+                                        }
                                     }
                                 }
                                 EUCA_FREE(psPrivateIp);
                             }
                         }
+                        // announce-arp sends a single packet per address
+                        if (config->arph && arp_handler_send(config->arph, 1, 0)) {
+                            ret = 1;
+                        }
                         // Done with the MAC
                         EUCA_FREE(psTrimMac);
                     }
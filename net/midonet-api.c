@@ -179,9 +179,15 @@ static pthread_mutex_t libcurl_handles_mutex;
 static pthread_mutex_t mido_buffer_mutex;
 static pthread_mutex_t mido_cache_ports_mutex;
 
+//! Serializes access to the in-memory MidoNet model (cache, midonames, GNI
+//! derived state) across reconciliation worker threads. Released around HTTP I/O.
+static pthread_mutex_t mido_model_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread int mido_model_locked = 0;
+
 static size_t header_find_location(char *content, size_t size, size_t nmemb, void *params);
 static size_t mem_writer(void *contents, size_t size, size_t nmemb, void *in_params);
 static size_t mem_reader(void *contents, size_t size, size_t nmemb, void *in_params);
+static CURLcode mido_curl_perform(CURL *curl);
 
 /**
  * Prepares an array of mido_cache_thread_params structures: divides ntasks to
@@ -4439,6 +4445,45 @@ static size_t mem_reader(void *contents, size_t size, size_t nmemb, void *in_par
     return (bytes_to_copy);
 }
 
+/**
+ * Acquires the MidoNet model lock. Reconciliation worker threads hold this lock
+ * while they inspect or modify the cache and midoname structures; it is
+ * dropped automatically while a midonet-api HTTP request is in flight so that
+ * requests issued by different workers overlap.
+ */
+void midonet_api_model_lock(void) {
+    pthread_mutex_lock(&mido_model_mutex);
+    mido_model_locked = 1;
+}
+
+/**
+ * Releases the MidoNet model lock acquired with midonet_api_model_lock().
+ */
+void midonet_api_model_unlock(void) {
+    mido_model_locked = 0;
+    pthread_mutex_unlock(&mido_model_mutex);
+}
+
+/**
+ * Performs a libcurl request. If the calling thread holds the model lock, the
+ * lock is released for the duration of the transfer.
+ * @param curl [in] libcurl easy_handle ready to be performed
+ * @return the libcurl result code
+ */
+static CURLcode mido_curl_perform(CURL *curl) {
+    CURLcode res = CURLE_OK;
+    int locked = mido_model_locked;
+
+    if (locked) {
+        midonet_api_model_unlock();
+    }
+    res = curl_easy_perform(curl);
+    if (locked) {
+        midonet_api_model_lock();
+    }
+    return (res);
+}
+
 /**
  * Initializes resources to be used in midonet-api calls
  */
@@ -4656,7 +4701,7 @@ int midonet_http_get(char *url, char *apistr, char **out_payload) {
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
     }
 
-    curlret = curl_easy_perform(curl);
+    curlret = mido_curl_perform(curl);
     if (curlret != CURLE_OK) {
         LOGERROR("ERROR: curl_easy_perform(): %s\n", curl_easy_strerror(curlret));
         ret = 1;
@@ -4738,7 +4783,7 @@ int midonet_http_put(char *url, char *resource_type, char *vers, char *payload)
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
     LOGTRACE("PUT PAYLOAD: %s\n", SP(payload));
-    curlret = curl_easy_perform(curl);
+    curlret = mido_curl_perform(curl);
     if (curlret != CURLE_OK) {
         LOGERROR("ERROR: curl_easy_perform(): %s\n", curl_easy_strerror(curlret));
         ret = 1;
@@ -4851,7 +4896,7 @@ int midonet_http_post(char *url, char *resource_type, char *vers, char *payload,
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
     LOGTRACE("POST PAYLOAD: %s\n", SP(payload));
-    curlret = curl_easy_perform(curl);
+    curlret = mido_curl_perform(curl);
     if (curlret != CURLE_OK) {
         LOGERROR("ERROR: curl_easy_perform(): %s\n", curl_easy_strerror(curlret));
         ret = 1;
@@ -4906,7 +4951,7 @@ int midonet_http_delete(char *url) {
     curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
 
     LOGTRACE("DELETE PAYLOAD: %s\n", SP(url));
-    curlret = curl_easy_perform(curl);
+    curlret = mido_curl_perform(curl);
     if (curlret != CURLE_OK) {
         LOGERROR("ERROR: curl_easy_perform(): %s\n", curl_easy_strerror(curlret));
         ret = 1;
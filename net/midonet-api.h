@@ -535,6 +535,8 @@ char *mido_jsonize(char *tenant, va_list * al);
 
 void midonet_api_init(void);
 void midonet_api_cleanup(void);
+void midonet_api_model_lock(void);
+void midonet_api_model_unlock(void);
 int mido_libcurl_cleanup_handles(mido_libcurl_handles *handles);
 int mido_libcurl_init(mido_libcurl_handles *handles);
 int mido_libcurl_cleanup(mido_libcurl_handles *handles);
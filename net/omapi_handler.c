@@ -0,0 +1,808 @@
+// -*- mode: C; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+// vim: set softtabstop=4 shiftwidth=4 tabstop=4 expandtab:
+
+/*************************************************************************
+ * Copyright 2009-2012 Eucalyptus Systems, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ *
+ * Please contact Eucalyptus Systems, Inc., 6755 Hollister Ave., Goleta
+ * CA 93117, USA or visit http://www.eucalyptus.com/licenses/ if you need
+ * additional information or have any questions.
+ *
+ * This file may incorporate work covered under the following copyright
+ * and permission notice:
+ *
+ *   Software License Agreement (BSD License)
+ *
+ *   Copyright (c) 2008, Regents of the University of California
+ *   All rights reserved.
+ *
+ *   Redistribution and use of this software in source and binary forms,
+ *   with or without modification, are permitted provided that the
+ *   following conditions are met:
+ *
+ *     Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *     Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE. USERS OF THIS SOFTWARE ACKNOWLEDGE
+ *   THE POSSIBLE PRESENCE OF OTHER OPEN SOURCE LICENSED MATERIAL,
+ *   COPYRIGHTED MATERIAL OR PATENTED MATERIAL IN THIS SOFTWARE,
+ *   AND IF ANY SUCH MATERIAL IS DISCOVERED THE PARTY DISCOVERING
+ *   IT MAY INFORM DR. RICH WOLSKI AT THE UNIVERSITY OF CALIFORNIA,
+ *   SANTA BARBARA WHO WILL THEN ASCERTAIN THE MOST APPROPRIATE REMEDY,
+ *   WHICH IN THE REGENTS' DISCRETION MAY INCLUDE, WITHOUT LIMITATION,
+ *   REPLACEMENT OF THE CODE SO IDENTIFIED, LICENSING OF THE CODE SO
+ *   IDENTIFIED, OR WITHDRAWAL OF THE CODE CAPABILITY TO THE EXTENT
+ *   NEEDED TO COMPLY WITH ANY SUCH LICENSES OR RIGHTS.
+ ************************************************************************/
+
+//!
+//! @file net/omapi_handler.c
+//! Implements a minimal ISC DHCP OMAPI client. Only what is needed to create
+//! and delete host objects is supported: the connection handshake, HMAC-MD5
+//! message signing and the OPEN/DELETE operations.
+//!
+//! Every OMAPI message starts with a 24 bytes header (authid, authlen, opcode,
+//! handle, id, rid) followed by two lists of name/value pairs (message values
+//! then object values), each terminated by a zero length name, and ends with
+//! the signature when an authenticator is in use. Like dhcpd, which starts its
+//! output authenticator right after writing the authid, the signature covers
+//! every byte following the authid field, authlen included.
+//!
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  INCLUDES                                  |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+
+#include <eucalyptus.h>
+#include <log.h>
+#include <euca_string.h>
+#include <euca_auth.h>
+
+#include "omapi_handler.h"
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  DEFINES                                   |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+#define OMAPI_PROTOCOL_VERSION                    100   //!< Protocol version exchanged on connection
+#define OMAPI_HEADER_SIZE                          24   //!< Size of the message header we speak
+#define OMAPI_SIGNATURE_LEN                        16   //!< Size of an HMAC-MD5 signature
+#define OMAPI_IO_TIMEOUT                            5   //!< Seconds we wait on dhcpd before giving up
+
+//! @{
+//! @name OMAPI operation codes
+
+#define OMAPI_OP_OPEN                               1
+#define OMAPI_OP_REFRESH                            2
+#define OMAPI_OP_UPDATE                             3
+#define OMAPI_OP_NOTIFY                             4
+#define OMAPI_OP_STATUS                             5
+#define OMAPI_OP_DELETE                             6
+
+//! @}
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  TYPEDEFS                                  |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                ENUMERATIONS                                |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                 STRUCTURES                                 |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+//! An outgoing message being built
+typedef struct omapi_msg_t {
+    u8 buf[OMAPI_MAX_MSG_LEN];         //!< Wire representation of the message
+    u32 len;                           //!< Number of bytes used in buf
+    u32 id;                            //!< Transaction ID of this message
+    boolean overflow;                  //!< Set if a value did not fit in buf
+} omapi_msg;
+
+//! The parts of a reply we care about
+typedef struct omapi_reply_t {
+    u32 op;                            //!< Operation code of the reply
+    u32 handle;                        //!< Object handle (valid on UPDATE)
+    u32 rid;                           //!< ID of the message this replies to
+    u32 result;                        //!< "result" message value (valid on STATUS)
+    char message[256];                 //!< "message" message value (valid on STATUS)
+} omapi_reply;
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                             EXTERNAL VARIABLES                             |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/* Should preferably be handled in header file */
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                              GLOBAL VARIABLES                              |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                              STATIC VARIABLES                              |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                              STATIC PROTOTYPES                             |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+static void omapi_msg_init(omapi_handler * pOmapi, omapi_msg * pMsg, u32 op, u32 handle);
+static void omapi_msg_put(omapi_msg * pMsg, const void *pData, u32 len);
+static void omapi_msg_put_u16(omapi_msg * pMsg, u16 value);
+static void omapi_msg_put_u32(omapi_msg * pMsg, u32 value);
+static void omapi_msg_put_value(omapi_msg * pMsg, const char *psName, const void *pValue, u32 len);
+static void omapi_msg_put_string(omapi_msg * pMsg, const char *psName, const char *psValue);
+static void omapi_msg_put_int(omapi_msg * pMsg, const char *psName, u32 value);
+static void omapi_msg_put_end(omapi_msg * pMsg);
+static int omapi_msg_add_host(omapi_handler * pOmapi, omapi_msg * pMsg, const char *psName, const char *psMac, const char *psIp);
+static void omapi_msg_sign(omapi_handler * pOmapi, omapi_msg * pMsg);
+
+static int omapi_write_full(int sock, const void *pBuf, size_t len);
+static int omapi_read_full(int sock, void *pBuf, size_t len);
+static int omapi_read_values(int sock, omapi_reply * pReply, boolean isMessage);
+static int omapi_transact(omapi_handler * pOmapi, omapi_msg * pMsg, omapi_reply * pReply);
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                   MACROS                                   |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                               IMPLEMENTATION                               |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+//!
+//! Connects to a dhcpd OMAPI listener and, if a key is given, opens an authenticator
+//! so that all subsequent messages are signed.
+//!
+//! @param[in] pOmapi pointer to the OMAPI handler structure to initialize
+//! @param[in] psServer dotted address of the dhcpd server (usually 127.0.0.1)
+//! @param[in] port the OMAPI port of the server
+//! @param[in] psKeyName name of the key declared in the dhcpd configuration (NULL for none)
+//! @param[in] psSecret base64 encoded secret of that key (NULL for none)
+//!
+//! @return 0 on success or 1 on failure
+//!
+//! @pre The pOmapi and psServer parameters must not be NULL
+//!
+//! @post On success the handler is initialized and must be released with omapi_handler_close()
+//!
+int omapi_handler_connect(omapi_handler * pOmapi, const char *psServer, u16 port, const char *psKeyName, const char *psSecret)
+{
+    int decodedLen = 0;
+    u32 intro[2] = { 0 };
+    char *psKey = NULL;
+    omapi_msg msg = { {0} };
+    omapi_reply reply = { 0 };
+    struct timeval tv = { OMAPI_IO_TIMEOUT, 0 };
+    struct sockaddr_in addr = { 0 };
+
+    if (!pOmapi || !psServer) {
+        LOGERROR("Invalid argument: cannot connect to OMAPI server with NULL parameters\n");
+        return (1);
+    }
+
+    bzero(pOmapi, sizeof(omapi_handler));
+    pOmapi->nextId = 1;
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, psServer, &addr.sin_addr) != 1) {
+        LOGERROR("Invalid OMAPI server address '%s'\n", psServer);
+        return (1);
+    }
+
+    if ((pOmapi->sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        LOGERROR("Cannot create OMAPI socket: %s\n", strerror(errno));
+        return (1);
+    }
+    setsockopt(pOmapi->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(pOmapi->sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (connect(pOmapi->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        LOGDEBUG("Cannot connect to OMAPI server %s:%u: %s\n", psServer, port, strerror(errno));
+        close(pOmapi->sock);
+        return (1);
+    }
+    // Both ends introduce themselves with their protocol version and header size
+    intro[0] = htonl(OMAPI_PROTOCOL_VERSION);
+    intro[1] = htonl(OMAPI_HEADER_SIZE);
+    if (omapi_write_full(pOmapi->sock, intro, sizeof(intro)) || omapi_read_full(pOmapi->sock, intro, sizeof(intro))) {
+        LOGERROR("OMAPI handshake with %s:%u failed\n", psServer, port);
+        close(pOmapi->sock);
+        return (1);
+    }
+
+    if ((ntohl(intro[0]) != OMAPI_PROTOCOL_VERSION) || (ntohl(intro[1]) != OMAPI_HEADER_SIZE)) {
+        LOGERROR("Unsupported OMAPI server (version=%u header=%u)\n", ntohl(intro[0]), ntohl(intro[1]));
+        close(pOmapi->sock);
+        return (1);
+    }
+
+    if (psKeyName && psSecret) {
+        if (((psKey = base64_dec2((u8 *) psSecret, strlen(psSecret), &decodedLen)) == NULL) || (decodedLen > OMAPI_MAX_KEY_LEN)) {
+            LOGERROR("Invalid OMAPI key secret for key '%s'\n", psKeyName);
+            EUCA_FREE(psKey);
+            close(pOmapi->sock);
+            return (1);
+        }
+        memcpy(pOmapi->key, psKey, decodedLen);
+        pOmapi->keyLen = decodedLen;
+        EUCA_FREE(psKey);
+
+        // The authenticator itself is opened with an unsigned message
+        omapi_msg_init(pOmapi, &msg, OMAPI_OP_OPEN, 0);
+        omapi_msg_put_string(&msg, "type", "authenticator");
+        omapi_msg_put_end(&msg);
+        omapi_msg_put_string(&msg, "name", psKeyName);
+        omapi_msg_put_string(&msg, "algorithm", OMAPI_KEY_ALGORITHM);
+        omapi_msg_put_end(&msg);
+        if (omapi_transact(pOmapi, &msg, &reply) || (reply.op != OMAPI_OP_UPDATE)) {
+            LOGERROR("OMAPI server refused authenticator '%s': %s\n", psKeyName, reply.message);
+            close(pOmapi->sock);
+            return (1);
+        }
+        pOmapi->authId = reply.handle;
+    }
+
+    pOmapi->initialized = TRUE;
+    return (0);
+}
+
+//!
+//! Creates a host object on the dhcpd server handing out a fixed address.
+//!
+//! @param[in] pOmapi pointer to a connected OMAPI handler
+//! @param[in] psName the host declaration name
+//! @param[in] psMac the hardware address of the host (aa:bb:cc:dd:ee:ff)
+//! @param[in] psIp the dotted fixed address of the host
+//!
+//! @return 0 on success or 1 on failure (including if the host already exists)
+//!
+int omapi_handler_add_host(omapi_handler * pOmapi, const char *psName, const char *psMac, const char *psIp)
+{
+    omapi_msg msg = { {0} };
+    omapi_reply reply = { 0 };
+
+    if (!pOmapi || !pOmapi->initialized || !psName || !psMac || !psIp) {
+        LOGERROR("Invalid argument: cannot add OMAPI host with NULL parameters\n");
+        return (1);
+    }
+
+    if (omapi_msg_add_host(pOmapi, &msg, psName, psMac, psIp)) {
+        return (1);
+    }
+
+    if (omapi_transact(pOmapi, &msg, &reply)) {
+        return (1);
+    }
+
+    if (reply.op != OMAPI_OP_UPDATE) {
+        LOGWARN("OMAPI server refused to create host '%s' (result=%u): %s\n", psName, reply.result, reply.message);
+        return (1);
+    }
+    LOGTRACE("OMAPI host '%s' (%s -> %s) created\n", psName, psMac, psIp);
+    return (0);
+}
+
+//!
+//! Deletes a host object from the dhcpd server. A host that does not exist is not an error.
+//!
+//! @param[in] pOmapi pointer to a connected OMAPI handler
+//! @param[in] psName the host declaration name
+//!
+//! @return 0 on success or 1 on failure
+//!
+int omapi_handler_del_host(omapi_handler * pOmapi, const char *psName)
+{
+    omapi_msg msg = { {0} };
+    omapi_reply reply = { 0 };
+
+    if (!pOmapi || !pOmapi->initialized || !psName) {
+        LOGERROR("Invalid argument: cannot delete OMAPI host with NULL parameters\n");
+        return (1);
+    }
+    // Look the host up to get its handle
+    omapi_msg_init(pOmapi, &msg, OMAPI_OP_OPEN, 0);
+    omapi_msg_put_string(&msg, "type", "host");
+    omapi_msg_put_end(&msg);
+    omapi_msg_put_string(&msg, "name", psName);
+    omapi_msg_put_end(&msg);
+
+    if (omapi_transact(pOmapi, &msg, &reply)) {
+        return (1);
+    }
+
+    if (reply.op != OMAPI_OP_UPDATE) {
+        LOGTRACE("OMAPI host '%s' not found (result=%u): nothing to delete\n", psName, reply.result);
+        return (0);
+    }
+
+    omapi_msg_init(pOmapi, &msg, OMAPI_OP_DELETE, reply.handle);
+    omapi_msg_put_end(&msg);
+    omapi_msg_put_end(&msg);
+
+    if (omapi_transact(pOmapi, &msg, &reply)) {
+        return (1);
+    }
+
+    if ((reply.op != OMAPI_OP_STATUS) || (reply.result != 0)) {
+        LOGWARN("OMAPI server refused to delete host '%s' (result=%u): %s\n", psName, reply.result, reply.message);
+        return (1);
+    }
+    LOGTRACE("OMAPI host '%s' deleted\n", psName);
+    return (0);
+}
+
+//!
+//! Closes an OMAPI connection.
+//!
+//! @param[in] pOmapi pointer to the OMAPI handler
+//!
+//! @return 0 on success or 1 if pOmapi is NULL
+//!
+int omapi_handler_close(omapi_handler * pOmapi)
+{
+    if (!pOmapi) {
+        return (1);
+    }
+
+    if (pOmapi->initialized) {
+        close(pOmapi->sock);
+    }
+    bzero(pOmapi, sizeof(omapi_handler));
+    return (0);
+}
+
+//!
+//! Builds the OPEN message creating a host object.
+//!
+//! @param[in] pOmapi pointer to the OMAPI handler
+//! @param[in] pMsg pointer to the message to build
+//! @param[in] psName the host declaration name
+//! @param[in] psMac the hardware address of the host (aa:bb:cc:dd:ee:ff)
+//! @param[in] psIp the dotted fixed address of the host
+//!
+//! @return 0 on success or 1 if the MAC address is invalid
+//!
+static int omapi_msg_add_host(omapi_handler * pOmapi, omapi_msg * pMsg, const char *psName, const char *psMac, const char *psIp)
+{
+    u8 aMac[6] = { 0 };
+    u32 ip = 0;
+
+    if (!mac2hex(psMac, aMac)) {
+        LOGERROR("Invalid MAC address '%s' for host '%s'\n", psMac, psName);
+        return (1);
+    }
+    ip = htonl(dot2hex(psIp));
+
+    omapi_msg_init(pOmapi, pMsg, OMAPI_OP_OPEN, 0);
+    omapi_msg_put_string(pMsg, "type", "host");
+    omapi_msg_put_int(pMsg, "create", 1);
+    omapi_msg_put_int(pMsg, "exclusive", 1);
+    omapi_msg_put_end(pMsg);
+    omapi_msg_put_string(pMsg, "name", psName);
+    omapi_msg_put_value(pMsg, "hardware-address", aMac, sizeof(aMac));
+    omapi_msg_put_int(pMsg, "hardware-type", 1);
+    omapi_msg_put_value(pMsg, "ip-address", &ip, sizeof(ip));
+    omapi_msg_put_end(pMsg);
+    return (0);
+}
+
+//!
+//! Starts a new message with its header. The authlen field announces a signature
+//! if the connection has an authenticator.
+//!
+//! @param[in] pOmapi pointer to the OMAPI handler
+//! @param[in] pMsg pointer to the message to initialize
+//! @param[in] op the operation code
+//! @param[in] handle the object handle the operation applies to (0 if none)
+//!
+static void omapi_msg_init(omapi_handler * pOmapi, omapi_msg * pMsg, u32 op, u32 handle)
+{
+    pMsg->len = 0;
+    pMsg->overflow = FALSE;
+    pMsg->id = pOmapi->nextId++;
+
+    omapi_msg_put_u32(pMsg, pOmapi->authId);
+    omapi_msg_put_u32(pMsg, (pOmapi->authId ? OMAPI_SIGNATURE_LEN : 0));
+    omapi_msg_put_u32(pMsg, op);
+    omapi_msg_put_u32(pMsg, handle);
+    omapi_msg_put_u32(pMsg, pMsg->id);
+    omapi_msg_put_u32(pMsg, 0);
+}
+
+//!
+//! Appends raw bytes to a message.
+//!
+//! @param[in] pMsg pointer to the message
+//! @param[in] pData the bytes to append
+//! @param[in] len number of bytes to append
+//!
+static void omapi_msg_put(omapi_msg * pMsg, const void *pData, u32 len)
+{
+    if (pMsg->overflow || ((pMsg->len + len + OMAPI_SIGNATURE_LEN) > OMAPI_MAX_MSG_LEN)) {
+        pMsg->overflow = TRUE;
+        return;
+    }
+    memcpy(pMsg->buf + pMsg->len, pData, len);
+    pMsg->len += len;
+}
+
+//!
+//! Appends a 16 bits integer in network byte order.
+//!
+//! @param[in] pMsg pointer to the message
+//! @param[in] value the value to append
+//!
+static void omapi_msg_put_u16(omapi_msg * pMsg, u16 value)
+{
+    u16 nvalue = htons(value);
+    omapi_msg_put(pMsg, &nvalue, sizeof(nvalue));
+}
+
+//!
+//! Appends a 32 bits integer in network byte order.
+//!
+//! @param[in] pMsg pointer to the message
+//! @param[in] value the value to append
+//!
+static void omapi_msg_put_u32(omapi_msg * pMsg, u32 value)
+{
+    u32 nvalue = htonl(value);
+    omapi_msg_put(pMsg, &nvalue, sizeof(nvalue));
+}
+
+//!
+//! Appends a name/value pair.
+//!
+//! @param[in] pMsg pointer to the message
+//! @param[in] psName the value name
+//! @param[in] pValue the raw value
+//! @param[in] len the length of the value
+//!
+static void omapi_msg_put_value(omapi_msg * pMsg, const char *psName, const void *pValue, u32 len)
+{
+    omapi_msg_put_u16(pMsg, strlen(psName));
+    omapi_msg_put(pMsg, psName, strlen(psName));
+    omapi_msg_put_u32(pMsg, len);
+    omapi_msg_put(pMsg, pValue, len);
+}
+
+//!
+//! Appends a string name/value pair (strings are not NUL terminated on the wire).
+//!
+//! @param[in] pMsg pointer to the message
+//! @param[in] psName the value name
+//! @param[in] psValue the string value
+//!
+static void omapi_msg_put_string(omapi_msg * pMsg, const char *psName, const char *psValue)
+{
+    omapi_msg_put_value(pMsg, psName, psValue, strlen(psValue));
+}
+
+//!
+//! Appends an integer (or boolean) name/value pair.
+//!
+//! @param[in] pMsg pointer to the message
+//! @param[in] psName the value name
+//! @param[in] value the integer value
+//!
+static void omapi_msg_put_int(omapi_msg * pMsg, const char *psName, u32 value)
+{
+    u32 nvalue = htonl(value);
+    omapi_msg_put_value(pMsg, psName, &nvalue, sizeof(nvalue));
+}
+
+//!
+//! Terminates a list of name/value pairs.
+//!
+//! @param[in] pMsg pointer to the message
+//!
+static void omapi_msg_put_end(omapi_msg * pMsg)
+{
+    omapi_msg_put_u16(pMsg, 0);
+}
+
+//!
+//! Appends the signature to a message if it announces one. The authid travels
+//! in the clear, the HMAC covers everything from the authlen field onward.
+//!
+//! @param[in] pOmapi pointer to the OMAPI handler holding the key
+//! @param[in] pMsg pointer to the complete message
+//!
+static void omapi_msg_sign(omapi_handler * pOmapi, omapi_msg * pMsg)
+{
+    unsigned int sigLen = 0;
+
+    if (ntohl(*((u32 *) pMsg->buf))) {
+        HMAC(EVP_md5(), pOmapi->key, pOmapi->keyLen, pMsg->buf + sizeof(u32), pMsg->len - sizeof(u32), pMsg->buf + pMsg->len, &sigLen);
+        pMsg->len += sigLen;
+    }
+}
+
+//!
+//! Writes a whole buffer to a socket.
+//!
+//! @param[in] sock the socket
+//! @param[in] pBuf the data to write
+//! @param[in] len number of bytes to write
+//!
+//! @return 0 on success or 1 on failure
+//!
+static int omapi_write_full(int sock, const void *pBuf, size_t len)
+{
+    ssize_t rc = 0;
+    const u8 *p = pBuf;
+
+    while (len > 0) {
+        if ((rc = write(sock, p, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return (1);
+        }
+        p += rc;
+        len -= rc;
+    }
+    return (0);
+}
+
+//!
+//! Reads exactly len bytes from a socket.
+//!
+//! @param[in]  sock the socket
+//! @param[out] pBuf where to store the data (may be NULL to discard it)
+//! @param[in]  len number of bytes to read
+//!
+//! @return 0 on success or 1 on failure, timeout or end of stream
+//!
+static int omapi_read_full(int sock, void *pBuf, size_t len)
+{
+    ssize_t rc = 0;
+    u8 discard[256] = { 0 };
+    u8 *p = pBuf;
+
+    while (len > 0) {
+        if (p) {
+            rc = read(sock, p, len);
+        } else {
+            rc = read(sock, discard, ((len < sizeof(discard)) ? len : sizeof(discard)));
+        }
+
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            return (1);
+        } else if (rc == 0) {
+            return (1);
+        }
+
+        if (p)
+            p += rc;
+        len -= rc;
+    }
+    return (0);
+}
+
+//!
+//! Reads one list of name/value pairs of a reply, keeping the "result" and
+//! "message" message values.
+//!
+//! @param[in]  sock the socket
+//! @param[out] pReply the reply being decoded
+//! @param[in]  isMessage TRUE when reading the message values, FALSE for object values
+//!
+//! @return 0 on success or 1 on failure
+//!
+static int omapi_read_values(int sock, omapi_reply * pReply, boolean isMessage)
+{
+    u16 nameLen = 0;
+    u32 valueLen = 0;
+    u32 result = 0;
+    char sName[256] = "";
+
+    for (;;) {
+        if (omapi_read_full(sock, &nameLen, sizeof(nameLen)))
+            return (1);
+        if ((nameLen = ntohs(nameLen)) == 0)
+            return (0);
+
+        if (nameLen >= sizeof(sName)) {
+            if (omapi_read_full(sock, NULL, nameLen))
+                return (1);
+            sName[0] = '\0';
+        } else {
+            if (omapi_read_full(sock, sName, nameLen))
+                return (1);
+            sName[nameLen] = '\0';
+        }
+
+        if (omapi_read_full(sock, &valueLen, sizeof(valueLen)))
+            return (1);
+        valueLen = ntohl(valueLen);
+
+        if (isMessage && !strcmp(sName, "result") && (valueLen == sizeof(result))) {
+            if (omapi_read_full(sock, &result, sizeof(result)))
+                return (1);
+            pReply->result = ntohl(result);
+        } else if (isMessage && !strcmp(sName, "message") && (valueLen < sizeof(pReply->message))) {
+            if (omapi_read_full(sock, pReply->message, valueLen))
+                return (1);
+            pReply->message[valueLen] = '\0';
+        } else if (omapi_read_full(sock, NULL, valueLen)) {
+            return (1);
+        }
+    }
+}
+
+//!
+//! Signs and sends a message then reads its reply. The signature of the reply
+//! is skipped, we trust the connection once our own messages are accepted.
+//!
+//! @param[in]  pOmapi pointer to the OMAPI handler
+//! @param[in]  pMsg the message to send
+//! @param[out] pReply the decoded reply
+//!
+//! @return 0 if a reply to this message was received or 1 on failure
+//!
+static int omapi_transact(omapi_handler * pOmapi, omapi_msg * pMsg, omapi_reply * pReply)
+{
+    u32 header[OMAPI_HEADER_SIZE / sizeof(u32)] = { 0 };
+
+    if (pMsg->overflow) {
+        LOGERROR("OMAPI message too large\n");
+        return (1);
+    }
+
+    omapi_msg_sign(pOmapi, pMsg);
+
+    if (omapi_write_full(pOmapi->sock, pMsg->buf, pMsg->len)) {
+        LOGERROR("Failed to send OMAPI message: %s\n", strerror(errno));
+        return (1);
+    }
+
+    bzero(pReply, sizeof(omapi_reply));
+    if (omapi_read_full(pOmapi->sock, header, sizeof(header)) || omapi_read_values(pOmapi->sock, pReply, TRUE) || omapi_read_values(pOmapi->sock, pReply, FALSE)
+        || omapi_read_full(pOmapi->sock, NULL, ntohl(header[1]))) {
+        LOGERROR("Failed to read OMAPI reply: %s\n", strerror(errno));
+        return (1);
+    }
+
+    pReply->op = ntohl(header[2]);
+    pReply->handle = ntohl(header[3]);
+    pReply->rid = ntohl(header[5]);
+    if (pReply->rid != pMsg->id) {
+        LOGERROR("Unexpected OMAPI reply (rid=%u expected=%u)\n", pReply->rid, pMsg->id);
+        return (1);
+    }
+    return (0);
+}
+
+#ifdef _UNIT_TEST
+//!
+//! Main entry point of the application. Checks the wire format and signature of
+//! a host creation message against a vector built independently from the ISC
+//! dhcpd OMAPI protocol (authid in the clear, HMAC-MD5 over the rest).
+//!
+//! @param[in] argc the number of parameter passed on the command line
+//! @param[in] argv the list of arguments
+//!
+//! @return EUCA_OK on success or EUCA_ERROR on failure.
+//!
+int main(int argc, char **argv)
+{
+    int i = 0;
+    int decodedLen = 0;
+    char *psKey = NULL;
+    char sHex[3] = "";
+    omapi_msg msg = { {0} };
+    omapi_handler omapi = { 0 };
+    // key "omapi_key" { algorithm hmac-md5; secret "c2VjcmV0LW9tYXBpLWtleQ=="; }, authenticator handle 7
+    const char *psSecret = "c2VjcmV0LW9tYXBpLWtleQ==";
+    const char *psExpected =
+        "00000007" "00000010" "00000001" "00000000" "00000001" "00000000"
+        "0004" "74797065" "00000004" "686f7374"
+        "0006" "637265617465" "00000004" "00000001"
+        "0009" "6578636c7573697665" "00000004" "00000001"
+        "0000"
+        "0004" "6e616d65" "0000000a" "692d3132333435363738"
+        "0010" "68617264776172652d61646472657373" "00000006" "d00d12345678"
+        "000d" "68617264776172652d74797065" "00000004" "00000001"
+        "000a" "69702d61646472657373" "00000004" "0a010203"
+        "0000"
+        "5330b65f9c57d6cfb1ca30e43cf2a123";
+
+    psKey = base64_dec2((u8 *) psSecret, strlen(psSecret), &decodedLen);
+    memcpy(omapi.key, psKey, decodedLen);
+    omapi.keyLen = decodedLen;
+    omapi.authId = 7;
+    omapi.nextId = 1;
+    EUCA_FREE(psKey);
+
+    if (omapi_msg_add_host(&omapi, &msg, "i-12345678", "d0:0d:12:34:56:78", "10.1.2.3")) {
+        printf("failed to build host creation message\n");
+        return (EUCA_ERROR);
+    }
+    omapi_msg_sign(&omapi, &msg);
+
+    if ((msg.len * 2) != strlen(psExpected)) {
+        printf("signed message is %u bytes, expected %u\n", msg.len, (u32) (strlen(psExpected) / 2));
+        return (EUCA_ERROR);
+    }
+
+    for (i = 0; i < msg.len; i++) {
+        snprintf(sHex, sizeof(sHex), "%02x", msg.buf[i]);
+        if (strncmp(sHex, psExpected + (i * 2), 2)) {
+            printf("signed message differs at byte %d: %s != %.2s\n", i, sHex, psExpected + (i * 2));
+            return (EUCA_ERROR);
+        }
+    }
+
+    printf("OMAPI host creation message and signature match\n");
+    return (EUCA_OK);
+}
+#endif /* _UNIT_TEST */
@@ -175,6 +175,7 @@ static int ncClientAttachNetworkInterface(ncStub * pStub, ncMetadata * pMeta, ch
 static int ncClientDetachNetworkInterface(ncStub * pStub, ncMetadata * pMeta, char *psInstanceId, char *psInterfaceId, boolean force);
 static int ncClientDescribeSensors(ncStub * pStub, ncMetadata * pMeta);
 static int ncClientModifyNode(ncStub * pStub, ncMetadata * pMeta, char *psStateName);
+static int ncClientPrewarmImages(ncStub * pStub, ncMetadata * pMeta, virtualMachine * pVirtMachine);
 static int ncClientMigrateInstance(ncStub * pStub, ncMetadata * pMeta, char *psInstanceId, char *psSrcNodeName, char *psDstNodeName, char *psStateName, char *psMigrationCreds);
 static int ncClientStartInstance(ncStub * pStub, ncMetadata * pMeta, char *psInstanceId);
 static int ncClientStopInstance(ncStub * pStub, ncMetadata * pMeta, char *psInstanceId);
@@ -223,6 +224,7 @@ static void usage(void)
             "\t\tbundleRestartInstance\t[-i]\n"
             "\t\tdescribeSensors\n"
             "\t\tmodifyNode\t\t[-s]\n"
+            "\t\tprewarmImages\t\tmultiple [-v] or none for the residency report\n"
             "\t\tmigrateInstances\t\t[-i -M]\n"
             "\t\tstartInstance\t\t[-i]\n"
             "\t\tstopInstance\t\t[-i]\n"
@@ -756,7 +758,7 @@ static int ncClientDescribeResources(ncStub * pStub, ncMetadata * pMeta)
     char *psType = strdup("TYPE");
     ncResource *pOutRes = NULL;
 
-    if ((rc = ncDescribeResourceStub(pStub, pMeta, psType, &pOutRes)) != EUCA_OK) {
+    if ((rc = ncDescribeResourceStub(pStub, pMeta, psType, NULL, 0, &pOutRes)) != EUCA_OK) {
         printf("ncDescribeResourceStub = %d\n", rc);
         exit(1);
     }
@@ -972,6 +974,39 @@ static int ncClientModifyNode(ncStub * pStub, ncMetadata * pMeta, char *psStateN
     return (rc);
 }
 
+//!
+//! Builds and execute the "PrewarmImages" request
+//!
+//! @param[in]  pStub a pointer to the NC stub structure
+//! @param[in]  pMeta a pointer to the node controller (NC) metadata structure
+//! @param[in]  pVirtMachine a pointer to the VBRs of the images to pre-warm (given with -v)
+//!
+//! @return EUCA_OK on success. On failure, the program will terminate
+//!
+//! @pre None of the provided pointers should be NULL
+//!
+//! @post The request is sent to the NC client and the residency report will be displayed.
+//!
+static int ncClientPrewarmImages(ncStub * pStub, ncMetadata * pMeta, virtualMachine * pVirtMachine)
+{
+    int i = 0;
+    int rc = EUCA_OK;
+    ncImageResidency *pOutResidency = NULL;
+
+    if ((rc = ncPrewarmImagesStub(pStub, pMeta, pVirtMachine->virtualBootRecord, pVirtMachine->virtualBootRecordLen, &pOutResidency)) != EUCA_OK) {
+        printf("ncPrewarmImagesStub = %d\n", rc);
+        exit(1);
+    }
+
+    printf("ncPrewarmImagesStub = %d : resident=%d pending=%d\n", rc, pOutResidency->residentImagesLen, pOutResidency->pendingImagesLen);
+    for (i = 0; i < pOutResidency->residentImagesLen; i++)
+        printf("\tresident %s\n", pOutResidency->residentImages[i]);
+    for (i = 0; i < pOutResidency->pendingImagesLen; i++)
+        printf("\tpending  %s\n", pOutResidency->pendingImages[i]);
+    EUCA_FREE(pOutResidency);
+    return (rc);
+}
+
 //!
 //! Builds and execute the "RunInstance" request
 //!
@@ -1440,6 +1475,8 @@ int main(int argc, char *argv[])
     } else if (!strcmp(psCommand, "modifyNode")) {
         CHECK_PARAM(psStateName, "state name");
         ncClientModifyNode(pStub, &meta, psStateName);
+    } else if (!strcmp(psCommand, "prewarmImages")) {
+        ncClientPrewarmImages(pStub, &meta, &virtMachine);
     } else if (!strcmp(psCommand, "migrateInstances")) {
         // migration creds can be NULL
         CHECK_PARAM(psInstanceId, "instance ID");
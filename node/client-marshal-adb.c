@@ -667,12 +667,15 @@ int ncDescribeInstancesStub(ncStub * pStub, ncMetadata * pMeta, char **instIds,
 //! @param[in]  pStub a pointer to the node controller (NC) stub structure
 //! @param[in]  pMeta a pointer to the node controller (NC) metadata structure
 //! @param[in]  resourceType UNUSED
+//! @param[in]  imagePeers "<artifact-id> <host>:<port>" hints telling which peers can serve which images
+//! @param[in]  imagePeersLen the number of hints in imagePeers
 //! @param[out] outRes a list of resources we retrieved data for
 //!
 //! @return EUCA_OK on success or EUCA_ERROR on failure.
 //!
-int ncDescribeResourceStub(ncStub * pStub, ncMetadata * pMeta, char *resourceType, ncResource ** outRes)
+int ncDescribeResourceStub(ncStub * pStub, ncMetadata * pMeta, char *resourceType, char **imagePeers, int imagePeersLen, ncResource ** outRes)
 {
+    int i = 0;
     int status = 0;
     ncResource *res = NULL;
     axutil_env_t *env = NULL;
@@ -701,6 +704,9 @@ int ncDescribeResourceStub(ncStub * pStub, ncMetadata * pMeta, char *resourceTyp
     if (resourceType) {
         adb_ncDescribeResourceType_set_resourceType(request, env, resourceType);
     }
+    for (i = 0; i < imagePeersLen; i++) {
+        adb_ncDescribeResourceType_add_imagePeers(request, env, imagePeers[i]);
+    }
     adb_ncDescribeResource_set_ncDescribeResource(input, env, request);
 
     if ((output = axis2_stub_op_EucalyptusNC_ncDescribeResource(stub, env, input)) == NULL) {
@@ -728,6 +734,14 @@ int ncDescribeResourceStub(ncStub * pStub, ncMetadata * pMeta, char *resourceTyp
         if (!res) {
             LOGERROR("out of memory\n");
             status = 2;
+        } else {
+            res->imagePeerPort = adb_ncDescribeResourceResponseType_get_imagePeerPort(response, env);
+            res->cachedImagesLen = adb_ncDescribeResourceResponseType_sizeof_cachedImages(response, env);
+            if (res->cachedImagesLen > MAX_CACHED_IMAGES_ADVERTISED)
+                res->cachedImagesLen = MAX_CACHED_IMAGES_ADVERTISED;
+            for (i = 0; i < res->cachedImagesLen; i++) {
+                euca_strncpy(res->cachedImages[i], adb_ncDescribeResourceResponseType_get_cachedImages_at(response, env, i), CACHED_IMAGE_ID_SIZE);
+            }
         }
         *outRes = res;
     }
@@ -1673,6 +1687,87 @@ int ncModifyNodeStub(ncStub * pStub, ncMetadata * pMeta, char *stateName)
     return (status);
 }
 
+//!
+//! Marshals the image pre-warm request.
+//!
+//! @param[in]  pStub a pointer to the node controller (NC) stub structure
+//! @param[in]  pMeta a pointer to the node controller (NC) metadata structure
+//! @param[in]  images VBRs of the images to bring into the cache (may be empty to only get the report)
+//! @param[in]  imagesLen number of VBRs in the list
+//! @param[out] outResidency the images present in and on their way to the cache of the node (caller frees)
+//!
+//! @return 0 for success, non-zero for error
+//!
+//! @see ncPrewarmImages()
+//!
+int ncPrewarmImagesStub(ncStub * pStub, ncMetadata * pMeta, virtualBootRecord * images, int imagesLen, ncImageResidency ** outResidency)
+{
+    int i = 0;
+    int status = 0;
+    axutil_env_t *env = NULL;
+    axis2_stub_t *stub = NULL;
+    adb_ncPrewarmImages_t *input = NULL;
+    adb_ncPrewarmImagesType_t *request = NULL;
+    adb_ncPrewarmImagesResponse_t *output = NULL;
+    adb_ncPrewarmImagesResponseType_t *response = NULL;
+    adb_virtualBootRecordType_t *vbr_type = NULL;
+    ncImageResidency *residency = NULL;
+    char *correlation_id = NULL;
+
+    env = pStub->env;
+    stub = pStub->stub;
+    input = adb_ncPrewarmImages_create(env);
+    request = adb_ncPrewarmImagesType_create(env);
+
+    // set standard input fields
+    adb_ncPrewarmImagesType_set_nodeName(request, env, pStub->node_name);
+    if (pMeta) {
+        correlation_id = create_corrid(pMeta->correlationId);
+        EUCA_FREE(pMeta->correlationId);
+        EUCA_MESSAGE_MARSHAL(ncPrewarmImagesType, request, pMeta);
+    }
+    if (correlation_id != NULL)
+        adb_ncPrewarmImagesType_set_correlationId(request, env, correlation_id);
+
+    // set op-specific input fields
+    for (i = 0; i < imagesLen; i++) {
+        if ((vbr_type = copy_vbr_type_to_adb(env, &images[i])) != NULL)
+            adb_ncPrewarmImagesType_add_images(request, env, vbr_type);
+    }
+    adb_ncPrewarmImages_set_ncPrewarmImages(input, env, request);
+
+    // do it
+    if ((output = axis2_stub_op_EucalyptusNC_ncPrewarmImages(stub, env, input)) == NULL) {
+        LOGERROR(NULL_ERROR_MSG);
+        status = -1;
+    } else {
+        response = adb_ncPrewarmImagesResponse_get_ncPrewarmImagesResponse(output, env);
+        if (adb_ncPrewarmImagesResponseType_get_return(response, env) == AXIS2_FALSE) {
+            LOGERROR("returned an error\n");
+            status = 1;
+        } else if ((residency = EUCA_ZALLOC(1, sizeof(ncImageResidency))) == NULL) {
+            LOGERROR("out of memory\n");
+            status = 2;
+        } else {
+            residency->residentImagesLen = adb_ncPrewarmImagesResponseType_sizeof_residentImages(response, env);
+            if (residency->residentImagesLen > MAX_PREWARM_IMAGES)
+                residency->residentImagesLen = MAX_PREWARM_IMAGES;
+            for (i = 0; i < residency->residentImagesLen; i++) {
+                euca_strncpy(residency->residentImages[i], adb_ncPrewarmImagesResponseType_get_residentImages_at(response, env, i), CACHED_IMAGE_ID_SIZE);
+            }
+            residency->pendingImagesLen = adb_ncPrewarmImagesResponseType_sizeof_pendingImages(response, env);
+            if (residency->pendingImagesLen > MAX_PREWARM_IMAGES)
+                residency->pendingImagesLen = MAX_PREWARM_IMAGES;
+            for (i = 0; i < residency->pendingImagesLen; i++) {
+                euca_strncpy(residency->pendingImages[i], adb_ncPrewarmImagesResponseType_get_pendingImages_at(response, env, i), CACHED_IMAGE_ID_SIZE);
+            }
+            *outResidency = residency;
+        }
+    }
+
+    return (status);
+}
+
 //!
 //! Marshals the instance migration request, with different behavior on source and destination.
 //!
@@ -806,11 +806,13 @@ int ncDescribeBundleTasksStub(ncStub * pStub, ncMetadata * pMeta, char **instIds
 //! @param[in]  pStub a pointer to the node controller (NC) stub structure
 //! @param[in]  pMeta a pointer to the node controller (NC) metadata structure
 //! @param[in]  resourceType UNUSED
+//! @param[in]  imagePeers UNUSED
+//! @param[in]  imagePeersLen UNUSED
 //! @param[out] outRes a list of resources we retrieved data for
 //!
 //! @return EUCA_OK on success or EUCA_ERROR on failure.
 //!
-int ncDescribeResourceStub(ncStub * pStub, ncMetadata * pMeta, char *resourceType, ncResource ** outRes)
+int ncDescribeResourceStub(ncStub * pStub, ncMetadata * pMeta, char *resourceType, char **imagePeers, int imagePeersLen, ncResource ** outRes)
 {
     int ret = EUCA_OK;
     ncResource *res = NULL;
@@ -1108,6 +1110,24 @@ int ncModifyNodeStub(ncStub * pStub, ncMetadata * pMeta, char *stateName)
     return (EUCA_OK);
 }
 
+//!
+//! Handles the image pre-warm request.
+//!
+//! @param[in]  pStub a pointer to the node controller (NC) stub structure
+//! @param[in]  pMeta a pointer to the node controller (NC) metadata structure
+//! @param[in]  images VBRs of the images to bring into the cache
+//! @param[in]  imagesLen number of VBRs in the list
+//! @param[out] outResidency an empty report, as the fake node has no cache
+//!
+//! @return EUCA_OK on success or EUCA_MEMORY_ERROR on failure
+//!
+int ncPrewarmImagesStub(ncStub * pStub, ncMetadata * pMeta, virtualBootRecord * images, int imagesLen, ncImageResidency ** outResidency)
+{
+    if ((*outResidency = EUCA_ZALLOC(1, sizeof(ncImageResidency))) == NULL)
+        return (EUCA_MEMORY_ERROR);
+    return (EUCA_OK);
+}
+
 //!
 //! Marshals the instance migration request, with different behavior on source and destination.
 //!
@@ -374,15 +374,17 @@ int ncDescribeBundleTasksStub(ncStub * pStub, ncMetadata * pMeta, char **instIds
 //! @param[in]  pStub a pointer to the node controller (NC) stub structure
 //! @param[in]  pMeta a pointer to the node controller (NC) metadata structure
 //! @param[in]  resourceType UNUSED
+//! @param[in]  imagePeers "<artifact-id> <host>:<port>" hints telling which peers can serve which images
+//! @param[in]  imagePeersLen the number of hints in imagePeers
 //! @param[out] outRes a list of resources we retrieved data for
 //!
 //! @return the result of doDescribeResource()
 //!
 //! @see doDescribeResource()
 //!
-int ncDescribeResourceStub(ncStub * pStub, ncMetadata * pMeta, char *resourceType, ncResource ** outRes)
+int ncDescribeResourceStub(ncStub * pStub, ncMetadata * pMeta, char *resourceType, char **imagePeers, int imagePeersLen, ncResource ** outRes)
 {
-    return doDescribeResource(pMeta, resourceType, outRes);
+    return doDescribeResource(pMeta, resourceType, imagePeers, imagePeersLen, outRes);
 }
 
 //!
@@ -513,6 +515,24 @@ int ncModifyNodeStub(ncStub * pStub, ncMetadata * pMeta, char *stateName)
     return doModifyNode(pMeta, stateName);
 }
 
+//!
+//! Handles the image pre-warm request.
+//!
+//! @param[in]  pStub a pointer to the node controller (NC) stub structure
+//! @param[in]  pMeta a pointer to the node controller (NC) metadata structure
+//! @param[in]  images VBRs of the images to bring into the cache
+//! @param[in]  imagesLen number of VBRs in the list
+//! @param[out] outResidency the images present in and on their way to the cache
+//!
+//! @return the result of doPrewarmImages()
+//!
+//! @see doPrewarmImages()
+//!
+int ncPrewarmImagesStub(ncStub * pStub, ncMetadata * pMeta, virtualBootRecord * images, int imagesLen, ncImageResidency ** outResidency)
+{
+    return doPrewarmImages(pMeta, images, imagesLen, outResidency);
+}
+
 //!
 //! Handles the instance migration request, with different behavior on source and destination.
 //!
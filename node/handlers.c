@@ -114,6 +114,7 @@
 #include <eucanetd_config.h>
 
 #include <vbr.h>
+#include <image_peers.h>
 #include <iscsi.h>
 #include <config.h>
 #include <fault.h>
@@ -126,11 +127,14 @@
 #include "xml.h"
 #include "hooks.h"
 #include <ebs_utils.h>
+#include <storage-controller.h>
 #include "objectstorage.h"
 #include "stats.h"
 #include "message_sensor.h"
 #include "message_stats.h"
 #include "service_sensor.h"
+#include "counter_sensor.h"
+#include "fs_emitter.h"
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -205,7 +209,7 @@ sem *service_state_sem = NULL;         //!< Used to guard service state updates
 sem *stats_sem = NULL;                 //!< Used to guard the internal message stats data on updates
 
 bunchOfInstances *global_instances = NULL;  //!< pointer to the instance list
-bunchOfInstances *global_instances_copy = NULL; //!< pointer to the copied instance list
+instanceSnapshot *global_instances_copy = NULL;  //!< pointer to the latest copy of the instance list (guarded by inst_copy_sem)
 
 const int default_staging_cleanup_threshold = 60 * 60 * 2;  //!< after this many seconds any STAGING domains will be cleaned up
 const int default_booting_cleanup_threshold = 60;   //!< after this many seconds any BOOTING domains will be cleaned up
@@ -231,10 +235,13 @@ configEntry configKeysNoRestartNC[] = {
     {"LOGMAXSIZE", "104857600"},
     {"LOGPREFIX", ""},
     {"LOGFACILITY", ""},
+    {"LOGASYNC", "N"},
     {CONFIG_NC_CEPH_USER, DEFAULT_CEPH_USER},
     {CONFIG_NC_CEPH_KEYS, DEFAULT_CEPH_KEYRING},
     {CONFIG_NC_CEPH_CONF, DEFAULT_CEPH_CONF},
     {SENSOR_LIST_CONF_PARAM_NAME, SENSOR_LIST_CONF_PARAM_DEFAULT},
+    {OUTPUT_MODE_CONFIG_NAME, OUTPUT_MODE_CONFIG_DEFAULT},
+    {OUTPUT_MAX_BYTES_CONFIG_NAME, OUTPUT_MAX_BYTES_CONFIG_DEFAULT},
     {NULL, NULL},
 };
 
@@ -261,7 +268,7 @@ static struct handlers *available_handlers[] = {
     NULL,
 };
 
-static json_object *stats_json = NULL; //!< The json object that holds all of the internal message counters
+static message_stats_table stats_table; //!< The table that holds all of the internal message counters
 static int stats_sensor_interval_sec;  //!< Keeps the current value for sensor interval. Set during init
 static int hypervisor_conn_errors = 0;
 
@@ -282,8 +289,8 @@ static void printNCServiceStateInfo(void);
 static void printMsgServiceStateInfo(ncMetadata * pMeta);
 
 //! Helpers for internal stats handling in the NC
-static json_object **message_stats_getter();
-static void message_stats_setter();
+static message_stats_table *message_stats_getter();
+static json_object *nc_counters(void);
 static int initialize_stats_system(int interval_sec);
 static void *nc_run_stats(void *ignored_arg);
 
@@ -345,19 +352,10 @@ static char *stats_service_state_call()
     }
 }
 
-//! Gets the reference to the stats json object, basically a no-op for the NC
-static json_object **message_stats_getter()
+//! Gets the reference to the stats table, kept in process memory for the NC
+static message_stats_table *message_stats_getter()
 {
-    LOGTRACE("Fetching latest message stats from shared memory\n");
-    return &stats_json;
-}
-
-//! Updates the stats json data, literally a No-op for the NC (as opposed to the CC)
-static void message_stats_setter()
-{
-    LOGTRACE("Updating latest message stats from shared memory\n");
-    //No-op
-    return;
+    return &stats_table;
 }
 
 void nc_lock_stats()
@@ -376,18 +374,46 @@ int nc_update_message_stats(const char *message_name, long call_time, int msg_fa
 {
     LOGTRACE("Updating message stats for message %s\n", message_name);
 
-    nc_lock_stats();
-    json_object **stats_state = message_stats_getter();
-
-    //Update the counters
-    update_message_stats(*stats_state, message_name, call_time, msg_failed);
-    message_stats_setter();
-
-    nc_unlock_stats();
-    LOGTRACE("Message stats update complete\n");
+    //Counters are updated with atomic operations, no need for the stats lock
+    update_message_stats(message_stats_getter(), message_name, call_time, msg_failed);
     return EUCA_OK;
 }
 
+//! Gets the rootwrap broker and SC client counters of this process for the counter sensor
+static json_object *nc_counters(void)
+{
+    int i = 0;
+    char name[64] = "";
+    const char *sc_ops[] = { "ExportVolume", "UnexportVolume", NULL };
+    rootwrap_broker_stats stats = { 0 };
+    sc_client_op_stats sc_stats = { 0 };
+    json_object *counters = json_object_new_object();
+
+    euca_rootwrap_broker_get_stats(&stats);
+    json_object_object_add(counters, "rootwrap_broker_requests", json_object_new_int64(stats.requests));
+    json_object_object_add(counters, "rootwrap_broker_fallbacks", json_object_new_int64(stats.fallbacks));
+    json_object_object_add(counters, "rootwrap_broker_failures", json_object_new_int64(stats.failures));
+    json_object_object_add(counters, "rootwrap_broker_spawn_failures", json_object_new_int64(stats.spawn_failures));
+    json_object_object_add(counters, "rootwrap_broker_total_usec", json_object_new_int64(stats.total_usec));
+    json_object_object_add(counters, "rootwrap_broker_max_usec", json_object_new_int64(stats.max_usec));
+    json_object_object_add(counters, "rootwrap_broker_running", json_object_new_int(stats.running));
+    json_object_object_add(counters, "rootwrap_broker_disabled", json_object_new_boolean(stats.disabled));
+
+    for (i = 0; sc_ops[i]; i++) {
+        if (scClientGetStats(sc_ops[i], &sc_stats) != EUCA_OK)
+            continue;
+        snprintf(name, sizeof(name), "sc_%s_calls", sc_ops[i]);
+        json_object_object_add(counters, name, json_object_new_int64(sc_stats.calls));
+        snprintf(name, sizeof(name), "sc_%s_failures", sc_ops[i]);
+        json_object_object_add(counters, name, json_object_new_int64(sc_stats.failures));
+        snprintf(name, sizeof(name), "sc_%s_total_ms", sc_ops[i]);
+        json_object_object_add(counters, name, json_object_new_int64(sc_stats.total_ms));
+        snprintf(name, sizeof(name), "sc_%s_max_ms", sc_ops[i]);
+        json_object_object_add(counters, name, json_object_new_int64(sc_stats.max_ms));
+    }
+    return (counters);
+}
+
 //! Provides NC-specific initializations for the stats system of
 //! internal service sensors (state sensors, message statistics, etc)
 //! @returns EUCA_OK on success, or error code on failure
@@ -400,15 +426,19 @@ static int initialize_stats_system(int interval_sec)
     nc_lock_stats();
     {
         //Init the message sensor with component-specific data
-        ret = initialize_message_sensor(euca_this_component_name, interval_sec, stats_ttl, message_stats_getter, message_stats_setter);
+        ret = initialize_message_sensor(euca_this_component_name, interval_sec, stats_ttl, message_stats_getter);
         if (ret != EUCA_OK) {
             LOGERROR("Error initializing internal message sensor: %d\n", ret);
             goto cleanup;
         } else {
-            json_object **tmp = message_stats_getter();
-            const char *tmp_out = json_object_to_json_string(*tmp);
-            LOGINFO("Initialized internal message stats: %s\n", tmp_out);
+            LOGINFO("Initialized internal message stats\n");
+        }
 
+        //Init the counter sensor with the rootwrap broker and SC client counters
+        ret = initialize_counter_sensor(euca_this_component_name, interval_sec, stats_ttl, nc_counters);
+        if (ret != EUCA_OK) {
+            LOGERROR("Error initializing internal counter sensor: %d\n", ret);
+            goto cleanup;
         }
 
         //Init the service state sensor with component-specific data
@@ -1331,38 +1361,81 @@ static void refresh_instance_info(struct nc_state_t *nc, ncInstance * instance)
 }
 
 //!
-//! copying the linked list for use by Describe* requests
+//! copying the linked list for use by Describe* requests. The copy is built outside of
+//! inst_copy_sem so readers are only held up for the time it takes to swap the pointer.
+//! This is safe because inst_copy_sem only guards the published pointer and the reference
+//! counts: the list being copied is guarded by inst_sem, which every caller holds, so two
+//! copies are never built at once, and a published copy is never modified again. Readers
+//! still holding the previous copy keep using it until they release it.
+//!
+//! @pre The caller must hold inst_sem
+//!
+//! @see acquire_instances_copy(), release_instances_copy()
 //!
 void copy_instances(void)
 {
-    ncInstance *instance = NULL;
-    ncInstance *src_instance = NULL;
-    ncInstance *dst_instance = NULL;
-    bunchOfInstances *head = NULL;
-    bunchOfInstances *container = NULL;
+    instanceSnapshot *snapshot = NULL;
+    instanceSnapshot *old_snapshot = NULL;
+
+    if ((snapshot = snapshot_instances(&global_instances)) == NULL) {
+        LOGERROR("out of memory while copying the instance list\n");
+        return;
+    }
 
     sem_p(inst_copy_sem);
     {
-        // free the old linked list copy
-        for (head = global_instances_copy; head;) {
-            container = head;
-            instance = head->instance;
-            head = head->next;
-            EUCA_FREE(instance);
-            EUCA_FREE(container);
+        old_snapshot = global_instances_copy;
+        global_instances_copy = snapshot;
+        if (old_snapshot && (--old_snapshot->refs > 0)) {
+            old_snapshot = NULL;       // still in use, the last reader will free it
         }
+    }
+    sem_v(inst_copy_sem);
 
-        global_instances_copy = NULL;
+    free_instance_snapshot(&old_snapshot);
+}
 
-        // make a fresh copy
-        for (head = global_instances; head; head = head->next) {
-            src_instance = head->instance;
-            dst_instance = (ncInstance *) EUCA_ALLOC(1, sizeof(ncInstance));
-            memcpy(dst_instance, src_instance, sizeof(ncInstance));
-            add_instance(&global_instances_copy, dst_instance);
-        }
+//!
+//! Retrieves a reference to the latest copy of the instance list. The copy must not be
+//! modified and must be released with release_instances_copy() once done with it.
+//!
+//! @return a pointer to the copy or NULL if no copy has been made yet
+//!
+instanceSnapshot *acquire_instances_copy(void)
+{
+    instanceSnapshot *snapshot = NULL;
+
+    sem_p(inst_copy_sem);
+    {
+        if ((snapshot = global_instances_copy) != NULL)
+            snapshot->refs++;
     }
     sem_v(inst_copy_sem);
+    return (snapshot);
+}
+
+//!
+//! Releases a reference obtained with acquire_instances_copy(). The copy is freed if it was
+//! superseded and this was the last reference to it.
+//!
+//! @param[in,out] pSnapshot a pointer to the copy pointer. Set to NULL on return.
+//!
+void release_instances_copy(instanceSnapshot ** pSnapshot)
+{
+    instanceSnapshot *snapshot = NULL;
+
+    if ((pSnapshot == NULL) || (*pSnapshot == NULL))
+        return;
+
+    sem_p(inst_copy_sem);
+    {
+        if (--(*pSnapshot)->refs == 0)
+            snapshot = *pSnapshot;
+    }
+    sem_v(inst_copy_sem);
+
+    free_instance_snapshot(&snapshot);
+    *pSnapshot = NULL;
 }
 
 //!
@@ -1375,6 +1448,7 @@ static void update_log_params(void)
     long log_max_size_bytes = 0;
     char *log_prefix = NULL;
     char *log_facility = NULL;
+    char *log_async = NULL;
 
     // read log params from config file and update in-memory configuration
     configReadLogParams(&log_level, &log_roll_number, &log_max_size_bytes, &log_prefix);
@@ -1390,6 +1464,10 @@ static void update_log_params(void)
         }
         EUCA_FREE(log_facility);
     }
+
+    log_async = configFileValue("LOGASYNC");
+    log_async_set(((log_async != NULL) && !strcmp(log_async, "Y")) ? TRUE : FALSE);
+    EUCA_FREE(log_async);
 }
 
 //!
@@ -1836,8 +1914,7 @@ void *startup_thread(void *arg)
     set_instance_params(instance);
 
     if ((error = create_instance_backing(instance, FALSE))  // do the heavy lifting on the disk
-        || (error = gen_instance_xml(instance)) // create euca-specific instance XML file
-        || (error = gen_libvirt_instance_xml(instance))) {  // transform euca-specific XML into libvirt XML
+        || (error = gen_instance_and_libvirt_xml(instance))) {  // create euca-specific instance XML file and transform it into libvirt XML
         LOGERROR("[%s] failed to prepare images for instance (error=%d)\n", instance->instanceId, error);
         goto shutoff;
     }
@@ -2190,10 +2267,9 @@ static int init(void)
 {
 #define GET_VAR_INT(_var, _name, _def)                   \
 {                                                        \
-	s = getConfString(nc_state.configFiles, 2, (_name)); \
-	if (s) {					                         \
-		(_var) = atoi(s);                                \
-		EUCA_FREE(s);                                    \
+	long _l = 0;                                         \
+	if (getConfLong(nc_state.configFiles, 2, (_name), &_l)) { \
+		(_var) = (int)_l;                                \
 	} else {                                             \
 		(_var) = (_def);                                 \
 	}                                                    \
@@ -2204,7 +2280,6 @@ static int init(void)
     char logFile[EUCA_MAX_PATH] = "";
     char logFileReqTrack[EUCA_MAX_PATH] = "";
     char *bridge = NULL;
-    char *s = NULL;
     char *tmp = NULL;
     char *pubinterface = NULL;
     struct stat mystat = { 0 };
@@ -2422,11 +2497,18 @@ static int init(void)
     GET_VAR_INT(nc_state.config_max_cores, CONFIG_MAX_CORES, 0);
     GET_VAR_INT(nc_state.save_instance_files, CONFIG_SAVE_INSTANCES, 0);
     GET_VAR_INT(nc_state.concurrent_disk_ops, CONFIG_CONCURRENT_DISK_OPS, 4);
+    GET_VAR_INT(nc_state.image_peer_port, CONFIG_NC_IMAGE_PEER_PORT, 0);
     GET_VAR_INT(nc_state.sc_request_timeout_sec, CONFIG_SC_REQUEST_TIMEOUT, 45);
     GET_VAR_INT(nc_state.concurrent_cleanup_ops, CONFIG_CONCURRENT_CLEANUP_OPS, 30);
     GET_VAR_INT(nc_state.disable_snapshots, CONFIG_DISABLE_SNAPSHOTS, 0);
     GET_VAR_INT(nc_state.shutdown_grace_period_sec, CONFIG_SHUTDOWN_GRACE_PERIOD_SEC, 60);
 
+    {                                  // privileged helpers go through persistent rootwrap brokers unless disabled
+        int rootwrap_brokers = 0;
+        GET_VAR_INT(rootwrap_brokers, CONFIG_NC_ROOTWRAP_BROKERS, 4);
+        euca_rootwrap_broker_init(nc_state.rootwrap_cmd_path, rootwrap_brokers);
+    }
+
     strcpy(nc_state.admin_user_id, EUCALYPTUS_ADMIN);
     GET_VAR_INT(nc_state.staging_cleanup_threshold, CONFIG_NC_STAGING_CLEANUP_THRESHOLD, default_staging_cleanup_threshold);
     GET_VAR_INT(nc_state.booting_cleanup_threshold, CONFIG_NC_BOOTING_CLEANUP_THRESHOLD, default_booting_cleanup_threshold);
@@ -2915,6 +2997,8 @@ static int init(void)
             LOGFATAL("Error initializing vbr localhost configuration\n");
             return (EUCA_FATAL_ERROR);
         }
+        // the cache is only served on the address the rest of the cluster knows us by
+        share_cached_images(nc_state.ip, nc_state.image_peer_port);
     }
 
     {
@@ -3444,11 +3528,13 @@ int doGetConsoleOutput(ncMetadata * pMeta, char *instanceId, char **consoleOutpu
 //!
 //! @param[in]  pMeta a pointer to the node controller (NC) metadata structure
 //! @param[in]  resourceType UNUSED
+//! @param[in]  imagePeers "<artifact-id> <host>:<port>" hints telling which peers can serve which images
+//! @param[in]  imagePeersLen the number of hints in imagePeers
 //! @param[out] outRes a list of resources we retrieved data for
 //!
 //! @return EUCA_ERROR on failure or the result of the proper doDescribeResource() handler call.
 //!
-int doDescribeResource(ncMetadata * pMeta, char *resourceType, ncResource ** outRes)
+int doDescribeResource(ncMetadata * pMeta, char *resourceType, char **imagePeers, int imagePeersLen, ncResource ** outRes)
 {
     int ret = EUCA_OK;
 
@@ -3457,6 +3543,9 @@ int doDescribeResource(ncMetadata * pMeta, char *resourceType, ncResource ** out
 
     updateServiceStateInfo(pMeta, TRUE);
 
+    if (nc_state.image_peer_port > 0)
+        image_peers_set_hints(imagePeers, imagePeersLen);
+
     if (nc_state.H->doDescribeResource)
         ret = nc_state.H->doDescribeResource(&nc_state, pMeta, resourceType, outRes);
     else
@@ -3816,6 +3905,34 @@ int doModifyNode(ncMetadata * pMeta, char *stateName)
     return ret;
 }
 
+//!
+//! Handles the image pre-warm request.
+//!
+//! @param[in]  pMeta a pointer to the node controller (NC) metadata structure
+//! @param[in]  images VBRs of the images to bring into the cache (may be empty to only get the report)
+//! @param[in]  imagesLen number of VBRs in the list
+//! @param[out] outResidency the images present in and on their way to the cache (caller frees)
+//!
+//! @return EUCA_OK on success or EUCA_ERROR on failure
+//!
+int doPrewarmImages(ncMetadata * pMeta, virtualBootRecord * images, int imagesLen, ncImageResidency ** outResidency)
+{
+    int ret = EUCA_OK;
+
+    if (init())
+        return (EUCA_ERROR);
+
+    LOGDEBUG("invoked (imagesLen=%d)\n", imagesLen);
+
+    if (nc_state.H->doPrewarmImages) {
+        ret = nc_state.H->doPrewarmImages(&nc_state, pMeta, images, imagesLen, outResidency);
+    } else {
+        ret = nc_state.D->doPrewarmImages(&nc_state, pMeta, images, imagesLen, outResidency);
+    }
+
+    return ret;
+}
+
 //!
 //! Handles the instance migration request.
 //!
@@ -3922,18 +4039,6 @@ int doStopInstance(ncMetadata * pMeta, char *instanceId)
     return ret;
 }
 
-//!
-//! Finds an instance in the global instance list
-//!
-//! @param[in] instanceId the instance identifier string (i-XXXXXXXX)
-//!
-//! @return a pointer to the instance structure if found. Otherwise NULL is returned.
-//!
-ncInstance *find_global_instance(const char *instanceId)
-{
-    return NULL;
-}
-
 //!
 //! Predicate determining whether the instance is a migration destination
 //!
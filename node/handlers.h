@@ -140,6 +140,7 @@ struct nc_state_t {
     boolean convert_to_disk;
     boolean do_inject_key;
     int concurrent_disk_ops, concurrent_cleanup_ops;
+    int image_peer_port;
     int sc_request_timeout_sec;
     int disable_snapshots;
     int staging_cleanup_threshold;
@@ -249,6 +250,7 @@ struct handlers {
     int (*doDescribeSensors) (struct nc_state_t * nc, ncMetadata * pMeta, int historySize, long long collectionIntervalTimeMs, char **instIds,
                               int instIdsLen, char **sensorIds, int sensorIdsLen, sensorResource *** outResources, int *outResourcesLen);
     int (*doModifyNode) (struct nc_state_t * nc, ncMetadata * pMeta, char *stateName);
+    int (*doPrewarmImages) (struct nc_state_t * nc, ncMetadata * pMeta, virtualBootRecord * images, int imagesLen, ncImageResidency ** outResidency);
     int (*doMigrateInstances) (struct nc_state_t * nc, ncMetadata * pMeta, ncInstance ** instances, int instancesLen, char *action, char *credentials, char **resourceLocations, int resourceLocationsLen);
     int (*doStartInstance) (struct nc_state_t * nc, ncMetadata * pMeta, char *instanceId);
     int (*doStopInstance) (struct nc_state_t * nc, ncMetadata * pMeta, char *instanceId);
@@ -322,7 +324,7 @@ int doRunInstance(ncMetadata * pMeta, char *uuid, char *instanceId, char *reserv
 int doTerminateInstance(ncMetadata * pMeta, char *instanceId, int force, int *shutdownState, int *previousState);
 int doRebootInstance(ncMetadata * pMeta, char *instanceId);
 int doGetConsoleOutput(ncMetadata * pMeta, char *instanceId, char **consoleOutput);
-int doDescribeResource(ncMetadata * pMeta, char *resourceType, ncResource ** outRes);
+int doDescribeResource(ncMetadata * pMeta, char *resourceType, char **imagePeers, int imagePeersLen, ncResource ** outRes);
 int doStartNetwork(ncMetadata * pMeta, char *uuid, char **remoteHosts, int remoteHostsLen, int port, int vlan);
 int doAttachVolume(ncMetadata * pMeta, char *instanceId, char *volumeId, char *attachmentToken, char *localDev);
 int doDetachVolume(ncMetadata * pMeta, char *instanceId, char *volumeId, char *attachmentToken, char *localDev, int force);
@@ -337,6 +339,7 @@ int doCreateImage(ncMetadata * pMeta, char *instanceId, char *volumeId, char *re
 int doDescribeSensors(ncMetadata * pMeta, int historySize, long long collectionIntervalTimeMs, char **instIds, int instIdsLen, char **sensorIds,
                       int sensorIdsLen, sensorResource *** outResources, int *outResourcesLen);
 int doModifyNode(ncMetadata * pMeta, char *stateName);
+int doPrewarmImages(ncMetadata * pMeta, virtualBootRecord * images, int imagesLen, ncImageResidency ** outResidency);
 int doMigrateInstances(ncMetadata * pMeta, ncInstance ** instances, int instancesLen, char *action, char *credentials, char **resourceLocations, int resourceLocationsLen);
 int doStartInstance(ncMetadata * pMeta, char *instanceId);
 int doStopInstance(ncMetadata * pMeta, char *instanceId);
@@ -362,12 +365,13 @@ void *startup_thread(void *arg);
 void *terminating_thread(void *arg);
 
 int get_instance_stats(virDomainPtr dom, ncInstance * instance);
-ncInstance *find_global_instance(const char *instanceId);
 int find_and_terminate_instance(char *instanceId);
 int find_and_stop_instance(char *psInstanceId);
 int find_and_start_instance(char *psInstanceId);
 int shutdown_then_destroy_domain(const char *instanceId, boolean do_destroy);
 void copy_instances(void);
+instanceSnapshot *acquire_instances_copy(void);
+void release_instances_copy(instanceSnapshot ** pSnapshot);
 int is_migration_dst(const ncInstance * instance);
 int is_migration_src(const ncInstance * instance);
 int migration_rollback(ncInstance * instance);
@@ -105,6 +105,7 @@
 #include <backing.h>
 #include <euca_auth.h>
 #include <vbr.h>
+#include <image_peers.h>
 #include <sensor.h>
 #include <euca_string.h>
 #include <euca_file.h>
@@ -161,9 +162,7 @@ typedef struct startstop_params_ {
 // coming from handlers.c
 extern sem *hyp_sem;
 extern sem *inst_sem;
-extern sem *inst_copy_sem;
 extern bunchOfInstances *global_instances;
-extern bunchOfInstances *global_instances_copy;
 extern struct nc_state_t nc_state;    //!< Global NC state structure
 
 /*----------------------------------------------------------------------------*\
@@ -205,6 +204,8 @@ static int doRunInstance(struct nc_state_t *nc, ncMetadata * pMeta, char *uuid,
 static int doRebootInstance(struct nc_state_t *nc, ncMetadata * pMeta, char *instanceId);
 static int doGetConsoleOutput(struct nc_state_t *nc, ncMetadata * pMeta, char *instanceId, char **consoleOutput);
 static int doTerminateInstance(struct nc_state_t *nc, ncMetadata * pMeta, char *instanceId, int force, int *shutdownState, int *previousState);
+static int compare_id_refs(const void *a, const void *b);
+static boolean *find_duplicate_ids(char **instIds, int instIdsLen);
 static int doDescribeInstances(struct nc_state_t *nc, ncMetadata * pMeta, char **instIds, int instIdsLen, ncInstance *** outInsts, int *outInstsLen);
 static int doDescribeResource(struct nc_state_t *nc, ncMetadata * pMeta, char *resourceType, ncResource ** outRes);
 static int doBroadcastNetworkInfo(struct nc_state_t *nc, ncMetadata * pMeta, char *networkInfo);
@@ -230,6 +231,7 @@ static int doDescribeBundleTasks(struct nc_state_t *nc, ncMetadata * pMeta, char
 static int doDescribeSensors(struct nc_state_t *nc, ncMetadata * pMeta, int historySize, long long collectionIntervalTimeMs, char **instIds,
                              int instIdsLen, char **sensorIds, int sensorIdsLen, sensorResource *** outResources, int *outResourcesLen);
 static int doModifyNode(struct nc_state_t *nc, ncMetadata * pMeta, char *stateName);
+static int doPrewarmImages(struct nc_state_t *nc, ncMetadata * pMeta, virtualBootRecord * images, int imagesLen, ncImageResidency ** outResidency);
 static int doMigrateInstances(struct nc_state_t *nc, ncMetadata * pMeta, ncInstance ** instances, int instancesLen, char *action, char *credentials, char **resourceLocations, int resourceLocationsLen);
 static void *startstop_thread(void *arg);
 static int doStartInstance(struct nc_state_t *nc, ncMetadata * pMeta, char *instanceId);
@@ -266,6 +268,7 @@ struct handlers default_libvirt_handlers = {
     .doDescribeBundleTasks = doDescribeBundleTasks,
     .doDescribeSensors = doDescribeSensors,
     .doModifyNode = doModifyNode,
+    .doPrewarmImages = doPrewarmImages,
     .doMigrateInstances = doMigrateInstances,
     .doStartInstance = doStartInstance,
     .doStopInstance = doStopInstance,
@@ -835,7 +838,64 @@ static int doTerminateInstance(struct nc_state_t *nc, ncMetadata * pMeta, char *
 }
 
 //!
-//! Finds and retrieves information in regards to instances
+//! Orders references to instance identifiers by identifier, then by position in their list
+//!
+//! @param[in] a a pointer to the first reference
+//! @param[in] b a pointer to the second reference
+//!
+//! @return a negative, zero or positive value as for qsort()
+//!
+static int compare_id_refs(const void *a, const void *b)
+{
+    char **const *ra = (char **const *)a;
+    char **const *rb = (char **const *)b;
+    int rc = strcmp(**ra, **rb);
+
+    if (rc == 0)
+        rc = ((*ra < *rb) ? -1 : ((*ra > *rb) ? 1 : 0));
+    return (rc);
+}
+
+//!
+//! Flags the instance identifiers that repeat one found earlier in the same list
+//!
+//! @param[in] instIds a list of instance identifiers
+//! @param[in] instIdsLen the number of instance identifiers in the instIds list
+//!
+//! @return an array of instIdsLen flags, set for the repeats, to be freed by the caller or NULL on failure
+//!
+static boolean *find_duplicate_ids(char **instIds, int instIdsLen)
+{
+    int i = 0;
+    char ***refs = NULL;
+    boolean *dups = NULL;
+
+    if ((dups = EUCA_ZALLOC(((instIdsLen > 0) ? instIdsLen : 1), sizeof(boolean))) == NULL)
+        return (NULL);
+
+    if (instIdsLen > 1) {
+        if ((refs = EUCA_ZALLOC(instIdsLen, sizeof(char **))) == NULL) {
+            EUCA_FREE(dups);
+            return (NULL);
+        }
+
+        for (i = 0; i < instIdsLen; i++)
+            refs[i] = &instIds[i];
+        qsort(refs, instIdsLen, sizeof(char **), compare_id_refs);
+        for (i = 1; i < instIdsLen; i++) {
+            if (!strcmp(*refs[i], *refs[i - 1]))
+                dups[refs[i] - instIds] = TRUE;
+        }
+        EUCA_FREE(refs);
+    }
+    return (dups);
+}
+
+//!
+//! Finds and retrieves information in regards to instances. The instances come from
+//! the published copy of the instance list, which is read without holding inst_copy_sem:
+//! it is never modified once published and the reference taken on it keeps it from
+//! being freed until it is released. Instances requested more than once are reported once.
 //!
 //! @param[in]  nc a pointer to the NC state structure
 //! @param[in]  pMeta a pointer to the node controller (NC) metadata structure
@@ -850,9 +910,11 @@ static int doDescribeInstances(struct nc_state_t *nc, ncMetadata * pMeta, char *
 {
     ncInstance *instance = NULL;
     ncInstance *tmp = NULL;
+    instanceSnapshot *snapshot = NULL;
+    bunchOfInstances *head = NULL;
+    boolean *dups = NULL;
     int total = 0;
     int i = 0;
-    int j = 0;
     int k = 0;
 
     LOGDEBUG("invoked userId=%s correlationId=%s epoch=%d services[0]{.name=%s .type=%s .uris[0]=%s}\n",
@@ -861,41 +923,47 @@ static int doDescribeInstances(struct nc_state_t *nc, ncMetadata * pMeta, char *
     *outInstsLen = 0;
     *outInsts = NULL;
 
-    sem_p(inst_copy_sem);
+    if ((instIdsLen > 0) && ((dups = find_duplicate_ids(instIds, instIdsLen)) == NULL))
+        return EUCA_MEMORY_ERROR;
+
+    snapshot = acquire_instances_copy();
     if (instIdsLen == 0)               // describe all instances
-        total = total_instances(&global_instances_copy);
+        total = total_instances(snapshot ? &snapshot->head : NULL);
     else
         total = instIdsLen;
 
     *outInsts = EUCA_ZALLOC(total, sizeof(ncInstance *));
     if ((*outInsts) == NULL) {
-        sem_v(inst_copy_sem);
+        release_instances_copy(&snapshot);
+        EUCA_FREE(dups);
         return EUCA_MEMORY_ERROR;
     }
 
     k = 0;
-    for (i = 0; (instance = get_instance(&global_instances_copy)) != NULL; i++) {
+    head = (snapshot ? snapshot->head : NULL);
+    for (i = 0; (instIdsLen > 0) ? (i < instIdsLen) : (head != NULL); i++) {
+        if (instIdsLen > 0) {
+            // look up the requested instances only, once each
+            if (dups[i] || (snapshot == NULL) || ((instance = find_instance(&snapshot->head, instIds[i])) == NULL))
+                continue;
+        } else {
+            instance = head->instance;
+            head = head->next;
+        }
+
         // only pick ones the user (or admin) is allowed to see
         if (strcmp(pMeta->userId, nc->admin_user_id)
             && strcmp(pMeta->userId, instance->userId))
             continue;
 
-        if (instIdsLen > 0) {
-            for (j = 0; j < instIdsLen; j++)
-                if (!strcmp(instance->instanceId, instIds[j]))
-                    break;
-
-            if (j >= instIdsLen)
-                // instance of no relevance right now
-                continue;
-        }
         // (* outInsts)[k++] = instance;
         tmp = (ncInstance *) EUCA_ALLOC(1, sizeof(ncInstance));
         memcpy(tmp, instance, sizeof(ncInstance));
         (*outInsts)[k++] = tmp;
     }
     *outInstsLen = k;
-    sem_v(inst_copy_sem);
+    release_instances_copy(&snapshot);
+    EUCA_FREE(dups);
 
     return EUCA_OK;
 }
@@ -935,6 +1003,8 @@ static int doDescribeResource(struct nc_state_t *nc, ncMetadata * pMeta, char *r
 {
     ncResource *res = NULL;
     ncInstance *inst = NULL;
+    instanceSnapshot *snapshot = NULL;
+    bunchOfInstances *head = NULL;
 
     // stats to re-calculate now
     long long mem_free = 0;
@@ -962,15 +1032,16 @@ static int doDescribeResource(struct nc_state_t *nc, ncMetadata * pMeta, char *r
         }
     }
 
-    sem_p(inst_copy_sem);
-    while ((inst = get_instance(&global_instances_copy)) != NULL) {
+    snapshot = acquire_instances_copy();
+    for (head = (snapshot ? snapshot->head : NULL); head; head = head->next) {
+        inst = head->instance;
         if (inst->state == TEARDOWN)
             continue;                  // they don't take up resources
         sum_mem += inst->params.mem;
         sum_disk += get_disk_use_gb(&(inst->params));
         sum_cores += inst->params.cores;
     }
-    sem_v(inst_copy_sem);
+    release_instances_copy(&snapshot);
 
     disk_free = nc->disk_max - sum_disk;
     if (disk_free < 0)
@@ -999,6 +1070,10 @@ static int doDescribeResource(struct nc_state_t *nc, ncMetadata * pMeta, char *r
         LOGERROR("out of memory\n");
         return (EUCA_MEMORY_ERROR);
     }
+    // advertise the images this node can hand out to its peers
+    if ((res->imagePeerPort = image_peers_port()) > 0) {
+        res->cachedImagesLen = image_peers_list_cached(res->cachedImages, MAX_CACHED_IMAGES_ADVERTISED);
+    }
     (*outRes) = res;
 
     LOGDEBUG("Core status:   in-use %d physical %lld over-committed %s\n", sum_cores, nc->phy_max_cores, (((sum_cores + cores_free) > nc->phy_max_cores) ? "yes" : "no"));
@@ -2599,14 +2674,19 @@ static int doDescribeSensors(struct nc_state_t *nc, ncMetadata * pMeta, int hist
                              int instIdsLen, char **sensorIds, int sensorIdsLen, sensorResource *** outResources, int *outResourcesLen)
 {
     int total;
+    boolean *dups = NULL;
 
     int err = sensor_config(historySize, collectionIntervalTimeMs); // update the config parameters if they are different
     if (err != 0)
         LOGERROR("failed to update sensor configuration (err=%d)\n", err);
 
-    sem_p(inst_copy_sem);
+    if ((instIdsLen > 0) && ((dups = find_duplicate_ids(instIds, instIdsLen)) == NULL))
+        return EUCA_MEMORY_ERROR;
+
+    // the published copy is read without inst_copy_sem, see doDescribeInstances()
+    instanceSnapshot *snapshot = acquire_instances_copy();
     if (instIdsLen == 0)               // describe all instances
-        total = total_instances(&global_instances_copy);
+        total = total_instances(snapshot ? &snapshot->head : NULL);
     else
         total = instIdsLen;
 
@@ -2614,7 +2694,8 @@ static int doDescribeSensors(struct nc_state_t *nc, ncMetadata * pMeta, int hist
     if (total > 0) {
         rss = EUCA_ZALLOC(total, sizeof(sensorResource *));
         if (rss == NULL) {
-            sem_v(inst_copy_sem);
+            release_instances_copy(&snapshot);
+            EUCA_FREE(dups);
             return EUCA_MEMORY_ERROR;
         }
     }
@@ -2622,24 +2703,22 @@ static int doDescribeSensors(struct nc_state_t *nc, ncMetadata * pMeta, int hist
     int k = 0;
 
     ncInstance *instance;
-    for (int i = 0; (instance = get_instance(&global_instances_copy)) != NULL; i++) {
+    bunchOfInstances *head = (snapshot ? snapshot->head : NULL);
+    for (int i = 0; (instIdsLen > 0) ? (i < instIdsLen) : (head != NULL); i++) {
+        if (instIdsLen > 0) {
+            // look up the requested instances only, once each
+            if (dups[i] || (snapshot == NULL) || ((instance = find_instance(&snapshot->head, instIds[i])) == NULL))
+                continue;
+        } else {
+            instance = head->instance;
+            head = head->next;
+        }
+
         // only pick ones the user (or admin) is allowed to see
         if (strcmp(pMeta->userId, nc->admin_user_id)
             && strcmp(pMeta->userId, instance->userId))
             continue;
 
-        if (instIdsLen > 0) {
-            int j;
-
-            for (j = 0; j < instIdsLen; j++)
-                if (!strcmp(instance->instanceId, instIds[j]))
-                    break;
-
-            if (j >= instIdsLen)
-                // instance of no relevance right now
-                continue;
-        }
-
         assert(k < total);
         rss[k] = EUCA_ZALLOC(1, sizeof(sensorResource));
         if (sensor_get_instance_data(instance->instanceId, sensorIds, sensorIdsLen, rss + k, 1) != EUCA_OK) {
@@ -2652,7 +2731,8 @@ static int doDescribeSensors(struct nc_state_t *nc, ncMetadata * pMeta, int hist
 
     *outResourcesLen = k;
     *outResources = rss;
-    sem_v(inst_copy_sem);
+    release_instances_copy(&snapshot);
+    EUCA_FREE(dups);
 
     LOGDEBUG("found %d resource(s)\n", k);
     return EUCA_OK;
@@ -2704,6 +2784,70 @@ static int doModifyNode(struct nc_state_t *nc, ncMetadata * pMeta, char *stateNa
     return ret;
 }
 
+//!
+//! Handles the image pre-warm request: queues the images that are not yet in
+//! the cache for a background download and reports the state of the cache.
+//! Images that cannot be cached are skipped, they do not fail the request.
+//!
+//! @param[in]  nc a pointer to the NC state structure
+//! @param[in]  pMeta a pointer to the node controller (NC) metadata structure
+//! @param[in]  images VBRs of the images to bring into the cache (may be empty to only get the report)
+//! @param[in]  imagesLen number of VBRs in the list
+//! @param[out] outResidency the images present in and on their way to the cache (caller frees)
+//!
+//! @return EUCA_OK on success or the following error codes:
+//!         \li EUCA_MEMORY_ERROR: if we fail to allocate the report
+//!         \li any error of stat_image_residency() or prewarm_images()
+//!
+static int doPrewarmImages(struct nc_state_t *nc, ncMetadata * pMeta, virtualBootRecord * images, int imagesLen, ncImageResidency ** outResidency)
+{
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    int ret = EUCA_OK;
+    int queuedLen = 0;
+    char artifactId[CACHED_IMAGE_ID_SIZE] = "";
+    ncImageResidency *residency = NULL;
+
+    if ((residency = EUCA_ZALLOC(1, sizeof(ncImageResidency))) == NULL) {
+        LOGERROR("out of memory\n");
+        return (EUCA_MEMORY_ERROR);
+    }
+
+    if ((ret = stat_image_residency(residency)) != EUCA_OK) {
+        EUCA_FREE(residency);
+        return (ret);
+    }
+    // keep the images that are neither in the cache yet nor invalid, compacting the list in place. The
+    // cache holds versions of an image under the hash of their digest, so only the current one counts.
+    for (i = 0; i < imagesLen; i++) {
+        if ((vbr_parse_image(&images[i], pMeta) != EUCA_OK) || (vbr_get_image_artifact_id(&images[i], artifactId, sizeof(artifactId), NULL) != EUCA_OK)) {
+            LOGWARN("[%s] skipping image that cannot be pre-warmed\n", images[i].id);
+            continue;
+        }
+        for (k = 0; (k < residency->residentImagesLen) && strcmp(residency->residentImages[k], artifactId); k++) ;
+        if (k < residency->residentImagesLen) {
+            LOGDEBUG("[%s] image is already in the cache as %s\n", images[i].id, artifactId);
+            continue;
+        }
+        if (j != i)
+            memcpy(&images[j], &images[i], sizeof(virtualBootRecord));
+        j++;
+    }
+    queuedLen = j;
+
+    if (queuedLen > 0) {
+        LOGINFO("pre-warming %d of %d requested images\n", queuedLen, imagesLen);
+        if (((ret = prewarm_images(images, queuedLen)) != EUCA_OK) || ((ret = stat_image_residency(residency)) != EUCA_OK)) {
+            EUCA_FREE(residency);
+            return (ret);
+        }
+    }
+
+    *outResidency = residency;
+    return (EUCA_OK);
+}
+
 //!
 //! Handles the instance migration request.
 //!
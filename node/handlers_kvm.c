@@ -978,8 +978,7 @@ static int doMigrateInstances(struct nc_state_t *nc, ncMetadata * pMeta, ncInsta
             set_instance_params(instance);
 
             if ((error = create_instance_backing(instance, TRUE))   // create files that back the disks
-                || (error = gen_instance_xml(instance)) // create euca-specific instance XML file
-                || (error = gen_libvirt_instance_xml(instance))) {  // transform euca-specific XML into libvirt XML
+                || (error = gen_instance_and_libvirt_xml(instance))) {  // create euca-specific instance XML file and transform it into libvirt XML
                 LOGERROR("[%s] failed to prepare images for migrating instance (error=%d)\n", instance->instanceId, error);
                 goto failed_dest;
             }
@@ -415,7 +415,10 @@ adb_ncStartNetworkResponse_t *ncStartNetworkMarshal(adb_ncStartNetwork_t * ncSta
 //!
 adb_ncDescribeResourceResponse_t *ncDescribeResourceMarshal(adb_ncDescribeResource_t * ncDescribeResource, const axutil_env_t * env)
 {
+    int i = 0;
     int error = EUCA_OK;
+    int imagePeersLen = 0;
+    char **imagePeers = NULL;
     ncMetadata meta = { 0 };
     ncResource *outRes = NULL;
     axis2_char_t *resourceType = NULL;
@@ -432,12 +435,20 @@ adb_ncDescribeResourceResponse_t *ncDescribeResourceMarshal(adb_ncDescribeResour
 
         // get operation-specific fields from input
         resourceType = adb_ncDescribeResourceType_get_resourceType(input, env);
-
+        if ((imagePeersLen = adb_ncDescribeResourceType_sizeof_imagePeers(input, env)) > 0) {
+            if ((imagePeers = EUCA_ZALLOC(imagePeersLen, sizeof(char *))) == NULL) {
+                LOGERROR("out of memory\n");
+                imagePeersLen = 0;
+            }
+            for (i = 0; i < imagePeersLen; i++) {
+                imagePeers[i] = adb_ncDescribeResourceType_get_imagePeers_at(input, env, i);
+            }
+        }
         // do it
         EUCA_MESSAGE_UNMARSHAL(ncDescribeResourceType, input, (&meta));
 
         threadCorrelationId *corr_id = set_corrid(meta.correlationId);
-        if ((error = doDescribeResource(&meta, resourceType, &outRes)) != EUCA_OK) {
+        if ((error = doDescribeResource(&meta, resourceType, imagePeers, imagePeersLen, &outRes)) != EUCA_OK) {
             LOGERROR("failed error=%d\n", error);
             adb_ncDescribeResourceResponseType_set_return(output, env, AXIS2_FALSE);
         } else {
@@ -458,9 +469,14 @@ adb_ncDescribeResourceResponse_t *ncDescribeResourceMarshal(adb_ncDescribeResour
             adb_ncDescribeResourceResponseType_set_numberOfCoresAvailable(output, env, outRes->numberOfCoresAvailable);
             adb_ncDescribeResourceResponseType_set_publicSubnets(output, env, outRes->publicSubnets);
             adb_ncDescribeResourceResponseType_set_hypervisor(output, env, outRes->hypervisor);
+            adb_ncDescribeResourceResponseType_set_imagePeerPort(output, env, outRes->imagePeerPort);
+            for (i = 0; i < outRes->cachedImagesLen; i++) {
+                adb_ncDescribeResourceResponseType_add_cachedImages(output, env, outRes->cachedImages[i]);
+            }
             free_resource(&outRes);
         }
         unset_corrid(corr_id);
+        EUCA_FREE(imagePeers);
         // set response to output
         adb_ncDescribeResourceResponse_set_ncDescribeResourceResponse(response, env, output);
     }
@@ -1664,6 +1680,83 @@ adb_ncModifyNodeResponse_t *ncModifyNodeMarshal(adb_ncModifyNode_t * ncModifyNod
     return (response);
 }
 
+//!
+//! Unmarshals, executes, responds to the image pre-warm request.
+//!
+//! @param[in] ncPrewarmImages a pointer to the image pre-warm request parameters
+//! @param[in] env pointer to the AXIS2 environment structure
+//!
+//! @return a pointer to the request's response structure
+//!
+adb_ncPrewarmImagesResponse_t *ncPrewarmImagesMarshal(adb_ncPrewarmImages_t * ncPrewarmImages, const axutil_env_t * env)
+{
+    int i = 0;
+    int error = EUCA_OK;
+    int imagesLen = 0;
+    ncMetadata meta = { 0 };
+    virtualBootRecord *images = NULL;
+    ncImageResidency *outResidency = NULL;
+    adb_virtualBootRecordType_t *vbr_type = NULL;
+    adb_ncPrewarmImagesType_t *input = NULL;
+    adb_ncPrewarmImagesResponse_t *response = NULL;
+    adb_ncPrewarmImagesResponseType_t *output = NULL;
+    long long call_time = time_ms();
+
+    pthread_mutex_lock(&ncHandlerLock);
+    {
+        input = adb_ncPrewarmImages_get_ncPrewarmImages(ncPrewarmImages, env);
+        response = adb_ncPrewarmImagesResponse_create(env);
+        output = adb_ncPrewarmImagesResponseType_create(env);
+
+        // get operation-specific fields from input
+        if ((imagesLen = adb_ncPrewarmImagesType_sizeof_images(input, env)) > MAX_PREWARM_IMAGES) {
+            LOGWARN("pre-warming only the first %d of %d images\n", MAX_PREWARM_IMAGES, imagesLen);
+            imagesLen = MAX_PREWARM_IMAGES;
+        }
+        if ((imagesLen > 0) && ((images = EUCA_ZALLOC(imagesLen, sizeof(virtualBootRecord))) == NULL)) {
+            LOGERROR("out of memory\n");
+            imagesLen = 0;
+        }
+        for (i = 0; i < imagesLen; i++) {
+            if ((vbr_type = adb_ncPrewarmImagesType_get_images_at(input, env, i)) != NULL)
+                copy_vbr_type_from_adb(&images[i], vbr_type, env);
+        }
+
+        // do it
+        EUCA_MESSAGE_UNMARSHAL(ncPrewarmImagesType, input, (&meta));
+
+        eventlog("NC", meta.userId, meta.correlationId, "PrewarmImages", "begin");
+        threadCorrelationId *corr_id = set_corrid(meta.correlationId);
+        if ((error = doPrewarmImages(&meta, images, imagesLen, &outResidency)) != EUCA_OK) {
+            LOGERROR("failed error=%d\n", error);
+            adb_ncPrewarmImagesResponseType_set_return(output, env, AXIS2_FALSE);
+        } else {
+            // set standard fields in output
+            adb_ncPrewarmImagesResponseType_set_return(output, env, AXIS2_TRUE);
+            adb_ncPrewarmImagesResponseType_set_correlationId(output, env, meta.correlationId);
+            adb_ncPrewarmImagesResponseType_set_userId(output, env, meta.userId);
+
+            // set operation-specific fields in output
+            for (i = 0; i < outResidency->residentImagesLen; i++) {
+                adb_ncPrewarmImagesResponseType_add_residentImages(output, env, outResidency->residentImages[i]);
+            }
+            for (i = 0; i < outResidency->pendingImagesLen; i++) {
+                adb_ncPrewarmImagesResponseType_add_pendingImages(output, env, outResidency->pendingImages[i]);
+            }
+            EUCA_FREE(outResidency);
+        }
+        unset_corrid(corr_id);
+        eventlog("NC", meta.userId, meta.correlationId, "PrewarmImages", "end");
+        EUCA_FREE(images);
+
+        // set response to output
+        adb_ncPrewarmImagesResponse_set_ncPrewarmImagesResponse(response, env, output);
+    }
+    pthread_mutex_unlock(&ncHandlerLock);
+    nc_update_message_stats("PrewarmImages", (long)(time_ms() - call_time), error);
+    return (response);
+}
+
 //!
 //! Unmarshals, executes, responds to the instance migration request.
 //!
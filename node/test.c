@@ -267,6 +267,19 @@ int main(int argc, char **argv)
         assert(n == EUCA_OK);
         n = total_instances(&bag);
         assert(n == INSTS - 2);
+        n = add_instance(&bag, Insts[1]);
+        assert(n == EUCA_DUPLICATE_ERROR);
+        assert(find_instance(&bag, Insts[0]->instanceId) == NULL);
+        assert(find_instance(&bag, Insts[INSTS / 2]->instanceId) == Insts[INSTS / 2]);
+        assert(bag->instance == Insts[1]);
+        assert(bag->last->instance == Insts[INSTS - 2]);
+
+        instanceSnapshot *snapshot = snapshot_instances(&bag);
+        assert(snapshot != NULL);
+        assert(total_instances(&snapshot->head) == INSTS - 2);
+        assert(find_instance(&snapshot->head, Insts[1]->instanceId) != Insts[1]);
+        free_instance_snapshot(&snapshot);
+        assert(snapshot == NULL);
 
         printf("========> testing volume struct management\n");
         ncVolume *v;
@@ -112,6 +112,8 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+#define XML_DOC_CACHE_SIZE                          8   //!< Number of parsed XML files kept for the get_xpath_*() readers
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  TYPEDEFS                                  |
@@ -130,6 +132,17 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! A parsed XML file, valid for as long as the file on disk is unchanged
+typedef struct xml_doc_cache_entry_t {
+    char path[EUCA_MAX_PATH];          //!< Path the document was parsed from, empty if the entry is unused
+    xmlDocPtr doc;                     //!< The parsed document
+    dev_t dev;                         //!< Device of the file when it was parsed
+    ino_t ino;                         //!< Inode of the file when it was parsed, catches replacement by rename
+    off_t size;                        //!< Size of the file when it was parsed
+    struct timespec mtime;             //!< Modification time of the file when it was parsed
+    unsigned long long last_used;      //!< Value of doc_cache_clock at the last lookup, for LRU eviction
+} xml_doc_cache_entry;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXTERNAL VARIABLES                             |
@@ -159,6 +172,16 @@ static boolean config_cpu_passthrough = 0;  //!< Set to TRUE if host CPU should
 static char xslt_path[EUCA_MAX_PATH] = "";  //!< Destination path for the XSLT files
 static pthread_mutex_t xml_mutex = PTHREAD_MUTEX_INITIALIZER;   //!< process-global mutex
 static char VERSION = 1; // XML version. Please up it if new element/attribute is added
+
+static xsltStylesheetPtr xslt_cache = NULL;    //!< Parsed XSL-T stylesheet, reused across transformations
+static char xslt_cache_path[EUCA_MAX_PATH] = "";    //!< Path the cached stylesheet was parsed from
+static time_t xslt_cache_mtime = 0;    //!< Modification time of the stylesheet file when it was cached
+
+static xml_doc_cache_entry doc_cache[XML_DOC_CACHE_SIZE] = { {{0}} };  //!< Parsed XML files, protected by xml_mutex
+static unsigned long long doc_cache_clock = 0;  //!< Incremented on every cache lookup
+#ifdef __STANDALONE
+static boolean doc_cache_bypass = FALSE;    //!< Set by the benchmark to parse the file on every query, as without the cache
+#endif /* __STANDALONE */
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                              STATIC PROTOTYPES                             |
@@ -177,8 +200,15 @@ static int write_xml_file(const xmlDocPtr doc, const char *instanceId, const cha
 static void write_vbr_xml(xmlNodePtr vbrs, const virtualBootRecord * vbr);
 static void prep_nic_xml_node(xmlNodePtr nic, const netConfig * net, const char * bridgeDeviceName, const char * hypervisorType, const char * osPlatform, const char * osVirtioNetwork);
 static int gen_nic_xml_without_lock(const ncInstance * instance, const netConfig * net);
+static xmlDocPtr build_instance_doc(const ncInstance * instance);
+static xmlDocPtr build_nic_doc(const ncInstance * instance, const netConfig * net);
 
 static void error_handler(void *ctx, const char *fmt, ...) _attribute_format_(2, 3);
+static xsltStylesheetPtr get_xslt_stylesheet(const char *xsltStylesheetPath);
+static void flush_xslt_stylesheet(void);
+static xmlDocPtr get_cached_doc(const char *xml_path);
+static void flush_cached_doc(const char *xml_path);
+static int transform_xml_doc(xsltStylesheetPtr cur, xmlDocPtr doc, const char *inputName, const char *outputXmlPath, char *outputXmlBuffer, int outputXmlBufferSize);
 static int apply_xslt_stylesheet(const char *xsltStylesheetPath, const char *inputXmlPath, const char *outputXmlPath, char *outputXmlBuffer, int outputXmlBufferSize);
 
 #ifdef __STANDALONE
@@ -197,6 +227,7 @@ int main(int argc, char **argv);
 
 #ifdef __STANDALONE                    // if compiling as a stand-alone binary (for unit testing)
 #define INIT() if (!initialized) init_xml(NULL)
+#define BENCH_ITERATIONS 100           //!< Number of libvirt XML generations timed by the unit test
 #elif __STANDALONE2
 #define INIT() if (!initialized) init_xml(NULL)
 #else // if linking against an NC, find nc_state symbol
@@ -361,6 +392,7 @@ static int write_xml_file(const xmlDocPtr doc, const char *instanceId, const cha
     mode_t old_umask = umask(~BACKING_FILE_PERM);   // ensure the generated XML file has the right perms
 
     chmod(path, BACKING_FILE_PERM);    // ensure perms in case when XML file exists
+    flush_cached_doc(path);            // do not rely on the mtime alone, its granularity may be coarse
     if ((ret = xmlSaveFormatFileEnc(path, doc, "UTF-8", 1)) > 0) {
         LOGTRACE("[%s] wrote %s XML to %s\n", instanceId, type, path);
     } else {
@@ -515,6 +547,84 @@ static void prep_nic_xml_node(xmlNodePtr nic, const netConfig * net, const char
 int gen_instance_xml(const ncInstance * instance)
 {
     int ret = EUCA_ERROR;
+    xmlDocPtr doc = NULL;
+
+    INIT();
+
+    pthread_mutex_lock(&xml_mutex);
+    {
+        if ((doc = build_instance_doc(instance)) != NULL) {
+            ret = write_xml_file(doc, instance->instanceId, instance->xmlFilePath, "instance");
+            xmlFreeDoc(doc);
+        }
+    }
+    pthread_mutex_unlock(&xml_mutex);
+    return (ret);
+}
+
+//!
+//! Same as calling gen_instance_xml() followed by gen_libvirt_instance_xml(), except
+//! that the instance document is transformed while still in memory, so instance.xml
+//! and the eni-XXX.xml files are written but never parsed back, and the stylesheet
+//! is the cached one.
+//!
+//! @param[in] instance a pointer to the instance to generate XML from
+//!
+//! @return EUCA_OK on success or proper error code. Known error code returned include EUCA_ERROR and EUCA_IO_ERROR.
+//!
+//! @see gen_instance_xml()
+//! @see gen_libvirt_instance_xml()
+//!
+int gen_instance_and_libvirt_xml(const ncInstance * instance)
+{
+    int ret = EUCA_ERROR;
+    char lpath[EUCA_MAX_PATH] = "";
+    xmlDocPtr doc = NULL;
+    xmlDocPtr nic_doc = NULL;
+    xsltStylesheetPtr cur = NULL;
+
+    INIT();
+
+    pthread_mutex_lock(&xml_mutex);
+    {
+        if ((doc = build_instance_doc(instance)) != NULL) {
+            if ((ret = write_xml_file(doc, instance->instanceId, instance->xmlFilePath, "instance")) == EUCA_OK) {
+                if ((cur = get_xslt_stylesheet(xslt_path)) != NULL) {
+                    ret = transform_xml_doc(cur, doc, instance->xmlFilePath, instance->libvirtFilePath, NULL, 0);
+
+                    // Generate a separate eni-xyz-libvirt.xml for each secondary nic for detachability
+                    for (int i = 0; ((ret == EUCA_OK) && (i < EUCA_MAX_NICS)); i++) {
+                        const netConfig *net = instance->secNetCfgs + i;
+                        if (strlen(net->interfaceId) == 0) // empty slot
+                            continue;
+                        snprintf(lpath, sizeof(lpath), EUCALYPTUS_NIC_LIBVIRT_XML_PATH_FORMAT, instance->instancePath, net->interfaceId);
+                        if ((nic_doc = build_nic_doc(instance, net)) != NULL) {
+                            transform_xml_doc(cur, nic_doc, net->interfaceId, lpath, NULL, 0);
+                            xmlFreeDoc(nic_doc);
+                        }
+                    }
+                } else {
+                    ret = EUCA_IO_ERROR;
+                }
+            }
+            xmlFreeDoc(doc);
+        }
+    }
+    pthread_mutex_unlock(&xml_mutex);
+    return (ret);
+}
+
+//!
+//! Builds the in-memory instance metadata document. As a side effect, the
+//! eni-XXX.xml file of every secondary network interface is (re)written.
+//! Caller must hold xml_mutex.
+//!
+//! @param[in] instance a pointer to the instance to generate XML from
+//!
+//! @return a new XML document the caller must free with xmlFreeDoc() or NULL on failure
+//!
+static xmlDocPtr build_instance_doc(const ncInstance * instance)
+{
     int i = 0;
     int j = 0;
     char *path = NULL;
@@ -542,9 +652,6 @@ int gen_instance_xml(const ncInstance * instance)
     xmlNodePtr vols = NULL;
     const virtualBootRecord *vbr = NULL;
 
-    INIT();
-
-    pthread_mutex_lock(&xml_mutex);
     {
         doc = xmlNewDoc(BAD_CAST "1.0");
         instanceNode = xmlNewNode(NULL, BAD_CAST "instance");
@@ -797,13 +904,12 @@ int gen_instance_xml(const ncInstance * instance)
             _ELEMENT(ts, "migrationTime", str);
         }
 
-        ret = write_xml_file(doc, instance->instanceId, instance->xmlFilePath, "instance");
+        return (doc);
+    }
 
 free:
-        xmlFreeDoc(doc);
-    }
-    pthread_mutex_unlock(&xml_mutex);
-    return (ret);
+    xmlFreeDoc(doc);
+    return (NULL);
 }
 
 
@@ -845,6 +951,27 @@ static int gen_nic_xml_without_lock(const ncInstance * instance, const netConfig
 
     int ret = EUCA_ERROR;
     char path[EUCA_MAX_PATH] = "";
+    xmlDocPtr doc = NULL;
+
+    doc = build_nic_doc(instance, net);
+
+    snprintf(path, sizeof(path), EUCALYPTUS_NIC_XML_PATH_FORMAT, instance->instancePath, net->interfaceId);
+    ret = write_xml_file(doc, instance->instanceId, path, "nic");
+    xmlFreeDoc(doc);
+
+    return (ret);
+}
+
+//!
+//! Builds the in-memory nic document for a given network interface. Caller must lock
+//!
+//! @param[in] instance a pointer to instance structure
+//! @param[in] net a pointer to netConfig structure
+//!
+//! @return a new XML document the caller must free with xmlFreeDoc()
+//!
+static xmlDocPtr build_nic_doc(const ncInstance * instance, const netConfig * net)
+{
     char ver_s[4] = "";
     xmlDocPtr doc = NULL;
     xmlNodePtr nic = NULL;
@@ -857,11 +984,7 @@ static int gen_nic_xml_without_lock(const ncInstance * instance, const netConfig
 
     prep_nic_xml_node(nic, net, instance->params.guestNicDeviceName, instance->hypervisorType, instance->platform, _BOOL(config_use_virtio_net));
 
-    snprintf(path, sizeof(path), EUCALYPTUS_NIC_XML_PATH_FORMAT, instance->instancePath, net->interfaceId);
-    ret = write_xml_file(doc, instance->instanceId, path, "nic");
-    xmlFreeDoc(doc);
-
-    return (ret);
+    return (doc);
 }
 
 
@@ -1354,18 +1477,143 @@ static void error_handler(void *ctx, const char *fmt, ...)
 }
 
 //!
-//! Processes input XML file (e.g., instance metadata) into output XML file or string (e.g., for libvirt)
-//! using XSL-T specification file (e.g., libvirt.xsl)
+//! Returns the parsed XSL-T stylesheet, parsing it only the first time it is requested
+//! or when the file at xsltStylesheetPath has been modified since it was last parsed,
+//! so that site edits to libvirt.xsl still take effect without an NC restart. The
+//! returned stylesheet belongs to the cache and must not be freed by the caller.
+//! Caller must hold xml_mutex.
 //!
-//! @param[in]  xsltStylesheetPath a string containing the path to the XSLT Stylesheet
-//! @param[in]  inputXmlPath a string containing the path of the input XML document
+//! @param[in] xsltStylesheetPath a string containing the path to the XSLT Stylesheet
+//!
+//! @return a pointer to the parsed stylesheet or NULL on failure
+//!
+static xsltStylesheetPtr get_xslt_stylesheet(const char *xsltStylesheetPath)
+{
+    struct stat st = { 0 };
+
+    if (stat(xsltStylesheetPath, &st) != 0) {
+        LOGERROR("failed to stat XSL-T stylesheet file %s\n", xsltStylesheetPath);
+        return (NULL);
+    }
+
+    if ((xslt_cache != NULL) && !strcmp(xslt_cache_path, xsltStylesheetPath) && (xslt_cache_mtime == st.st_mtime))
+        return (xslt_cache);
+
+    flush_xslt_stylesheet();
+    if ((xslt_cache = xsltParseStylesheetFile((const xmlChar *)xsltStylesheetPath)) == NULL) {
+        LOGERROR("failed to open and parse XSL-T stylesheet file %s\n", xsltStylesheetPath);
+        return (NULL);
+    }
+    euca_strncpy(xslt_cache_path, xsltStylesheetPath, sizeof(xslt_cache_path));
+    xslt_cache_mtime = st.st_mtime;
+    LOGDEBUG("parsed and cached XSL-T stylesheet %s\n", xsltStylesheetPath);
+
+    return (xslt_cache);
+}
+
+//!
+//! Drops the cached XSL-T stylesheet, if any. Caller must hold xml_mutex.
+//!
+static void flush_xslt_stylesheet(void)
+{
+    if (xslt_cache != NULL) {
+        xsltFreeStylesheet(xslt_cache);
+        xslt_cache = NULL;
+    }
+    xslt_cache_path[0] = '\0';
+    xslt_cache_mtime = 0;
+}
+
+//!
+//! Returns the parsed XML file at xml_path, parsing it only if it is not in the cache
+//! or if the file has changed since it was parsed. read_instance_xml() alone issues
+//! dozens of queries against the same file, each of which used to parse it anew. The
+//! returned document belongs to the cache and is only valid while the caller holds
+//! xml_mutex; it must not be modified or freed.
+//!
+//! @param[in] xml_path a string containing the path to the XML file to parse
+//!
+//! @return a pointer to the parsed document or NULL on failure
+//!
+static xmlDocPtr get_cached_doc(const char *xml_path)
+{
+    int i = 0;
+    struct stat st = { 0 };
+    xml_doc_cache_entry *entry = NULL;
+
+    doc_cache_clock++;
+    if (stat(xml_path, &st) != 0) {
+        flush_cached_doc(xml_path);
+        return (NULL);
+    }
+#ifdef __STANDALONE
+    if (doc_cache_bypass)
+        flush_cached_doc(xml_path);
+#endif /* __STANDALONE */
+
+    for (i = 0; i < XML_DOC_CACHE_SIZE; i++) {
+        if (!strcmp(doc_cache[i].path, xml_path)) {
+            entry = &doc_cache[i];
+            if ((entry->dev == st.st_dev) && (entry->ino == st.st_ino) && (entry->size == st.st_size) &&
+                (entry->mtime.tv_sec == st.st_mtim.tv_sec) && (entry->mtime.tv_nsec == st.st_mtim.tv_nsec)) {
+                entry->last_used = doc_cache_clock;
+                return (entry->doc);
+            }
+            break;
+        }
+        // otherwise prefer an unused entry, then the least recently used one
+        if ((entry == NULL) || ((entry->path[0] != '\0') && ((doc_cache[i].path[0] == '\0') || (doc_cache[i].last_used < entry->last_used))))
+            entry = &doc_cache[i];
+    }
+
+    if (entry->doc != NULL)
+        xmlFreeDoc(entry->doc);
+    bzero(entry, sizeof(xml_doc_cache_entry));
+
+    if ((entry->doc = xmlParseFile(xml_path)) == NULL)
+        return (NULL);
+
+    euca_strncpy(entry->path, xml_path, sizeof(entry->path));
+    entry->dev = st.st_dev;
+    entry->ino = st.st_ino;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim;
+    entry->last_used = doc_cache_clock;
+    return (entry->doc);
+}
+
+//!
+//! Drops the parsed document for xml_path from the cache, or all of them if xml_path
+//! is NULL. Caller must hold xml_mutex.
+//!
+//! @param[in] xml_path a string containing the path to the XML file or NULL
+//!
+static void flush_cached_doc(const char *xml_path)
+{
+    int i = 0;
+
+    for (i = 0; i < XML_DOC_CACHE_SIZE; i++) {
+        if ((doc_cache[i].path[0] != '\0') && ((xml_path == NULL) || !strcmp(doc_cache[i].path, xml_path))) {
+            xmlFreeDoc(doc_cache[i].doc);
+            bzero(&doc_cache[i], sizeof(xml_doc_cache_entry));
+        }
+    }
+}
+
+//!
+//! Processes an in-memory XML document (e.g., instance metadata) into output XML file or string
+//! (e.g., for libvirt) using an already parsed XSL-T stylesheet
+//!
+//! @param[in]  cur the parsed XSL-T stylesheet to apply
+//! @param[in]  doc the input XML document
+//! @param[in]  inputName a name for the input document, used in log messages
 //! @param[in]  outputXmlPath a string containing the path of the output XML document
 //! @param[out] outputXmlBuffer a string that will contain the output XML data if non NULL and non-0 length.
 //! @param[in]  outputXmlBufferSize the length of outputXmlBuffer
 //!
 //! @return EUCA_OK on success or proper error code. Known error code returned include EUCA_ERROR and EUCA_IO_ERROR.
 //!
-static int apply_xslt_stylesheet(const char *xsltStylesheetPath, const char *inputXmlPath, const char *outputXmlPath, char *outputXmlBuffer, int outputXmlBufferSize)
+static int transform_xml_doc(xsltStylesheetPtr cur, xmlDocPtr doc, const char *inputName, const char *outputXmlPath, char *outputXmlBuffer, int outputXmlBufferSize)
 {
     int err = EUCA_OK;
     int i = 0;
@@ -1376,70 +1624,92 @@ static int apply_xslt_stylesheet(const char *xsltStylesheetPath, const char *inp
     FILE *fp = NULL;
     xmlChar *buf = NULL;
     boolean applied_ok = FALSE;
-    xmlDocPtr doc = NULL;
-    xsltStylesheetPtr cur = NULL;
     xsltTransformContextPtr ctxt = NULL;
     xmlDocPtr res = NULL;
 
-    INIT();
-    if ((cur = xsltParseStylesheetFile((const xmlChar *)xsltStylesheetPath)) != NULL) {
-        if ((doc = xmlParseFile(inputXmlPath)) != NULL) {
-            ctxt = xsltNewTransformContext(cur, doc);   // need context to get result
-            xsltSetCtxtParseOptions(ctxt, 0);   //! @todo do we want any XSL-T parsing options?
-
-            res = xsltApplyStylesheetUser(cur, doc, NULL, NULL, NULL, ctxt);    // applies XSLT to XML
-            applied_ok = ((ctxt->state == XSLT_STATE_OK) ? TRUE : FALSE);   // errors are communicated via ctxt->state
-            xsltFreeTransformContext(ctxt);
-
-            if (res && applied_ok) {
-                // save to a file, if path was provied
-                if (outputXmlPath != NULL) {
-                    if ((fp = fopen(outputXmlPath, "w")) != NULL) {
-                        if ((bytes = xsltSaveResultToFile(fp, res, cur)) == -1) {
-                            LOGERROR("failed to save XML document to %s\n", outputXmlPath);
-                            err = EUCA_IO_ERROR;
-                        }
-                        fclose(fp);
-                    } else {
-                        LOGERROR("failed to create file %s\n", outputXmlPath);
-                        err = EUCA_IO_ERROR;
-                    }
+    ctxt = xsltNewTransformContext(cur, doc);   // need context to get result
+    xsltSetCtxtParseOptions(ctxt, 0);  //! @todo do we want any XSL-T parsing options?
+
+    res = xsltApplyStylesheetUser(cur, doc, NULL, NULL, NULL, ctxt);    // applies XSLT to XML
+    applied_ok = ((ctxt->state == XSLT_STATE_OK) ? TRUE : FALSE);   // errors are communicated via ctxt->state
+    xsltFreeTransformContext(ctxt);
+
+    if (res && applied_ok) {
+        // save to a file, if path was provied
+        if (outputXmlPath != NULL) {
+            flush_cached_doc(outputXmlPath);
+            if ((fp = fopen(outputXmlPath, "w")) != NULL) {
+                if ((bytes = xsltSaveResultToFile(fp, res, cur)) == -1) {
+                    LOGERROR("failed to save XML document to %s\n", outputXmlPath);
+                    err = EUCA_IO_ERROR;
                 }
-                // convert to an ASCII buffer, if such was provided
-                if (err == EUCA_OK && outputXmlBuffer != NULL && outputXmlBufferSize > 0) {
-                    if (xsltSaveResultToString(&buf, &buf_size, res, cur) == 0) {
-                        // success
-                        if (buf_size < outputXmlBufferSize) {
-                            bzero(outputXmlBuffer, outputXmlBufferSize);
-                            for (i = 0, j = 0; i < buf_size; i++) {
-                                c = ((char)buf[i]);
-                                if (c != '\n')  // remove newlines
-                                    outputXmlBuffer[j++] = c;
-                            }
-                        } else {
-                            LOGERROR("XML string buffer is too small (%d > %d)\n", buf_size, outputXmlBufferSize);
-                            err = EUCA_ERROR;
-                        }
-                        xmlFree(buf);
-                    } else {
-                        LOGERROR("failed to save XML document to a string\n");
-                        err = EUCA_ERROR;
+                fclose(fp);
+            } else {
+                LOGERROR("failed to create file %s\n", outputXmlPath);
+                err = EUCA_IO_ERROR;
+            }
+        }
+        // convert to an ASCII buffer, if such was provided
+        if (err == EUCA_OK && outputXmlBuffer != NULL && outputXmlBufferSize > 0) {
+            if (xsltSaveResultToString(&buf, &buf_size, res, cur) == 0) {
+                // success
+                if (buf_size < outputXmlBufferSize) {
+                    bzero(outputXmlBuffer, outputXmlBufferSize);
+                    for (i = 0, j = 0; i < buf_size; i++) {
+                        c = ((char)buf[i]);
+                        if (c != '\n') // remove newlines
+                            outputXmlBuffer[j++] = c;
                     }
+                } else {
+                    LOGERROR("XML string buffer is too small (%d > %d)\n", buf_size, outputXmlBufferSize);
+                    err = EUCA_ERROR;
                 }
+                xmlFree(buf);
             } else {
-                LOGERROR("failed to apply stylesheet %s to %s\n", xsltStylesheetPath, inputXmlPath);
+                LOGERROR("failed to save XML document to a string\n");
                 err = EUCA_ERROR;
             }
-            if (res != NULL)
-                xmlFreeDoc(res);
+        }
+    } else {
+        LOGERROR("failed to apply stylesheet to %s\n", inputName);
+        err = EUCA_ERROR;
+    }
+
+    if (res != NULL)
+        xmlFreeDoc(res);
+    return (err);
+}
+
+//!
+//! Processes input XML file (e.g., instance metadata) into output XML file or string (e.g., for libvirt)
+//! using XSL-T specification file (e.g., libvirt.xsl)
+//!
+//! @param[in]  xsltStylesheetPath a string containing the path to the XSLT Stylesheet
+//! @param[in]  inputXmlPath a string containing the path of the input XML document
+//! @param[in]  outputXmlPath a string containing the path of the output XML document
+//! @param[out] outputXmlBuffer a string that will contain the output XML data if non NULL and non-0 length.
+//! @param[in]  outputXmlBufferSize the length of outputXmlBuffer
+//!
+//! @return EUCA_OK on success or proper error code. Known error code returned include EUCA_ERROR and EUCA_IO_ERROR.
+//!
+//! @see transform_xml_doc()
+//!
+static int apply_xslt_stylesheet(const char *xsltStylesheetPath, const char *inputXmlPath, const char *outputXmlPath, char *outputXmlBuffer, int outputXmlBufferSize)
+{
+    int err = EUCA_OK;
+    xmlDocPtr doc = NULL;
+    xsltStylesheetPtr cur = NULL;
+
+    INIT();
+    if ((cur = get_xslt_stylesheet(xsltStylesheetPath)) != NULL) {
+        if ((doc = xmlParseFile(inputXmlPath)) != NULL) {
+            err = transform_xml_doc(cur, doc, inputXmlPath, outputXmlPath, outputXmlBuffer, outputXmlBufferSize);
             xmlFreeDoc(doc);
         } else {
             LOGERROR("failed to parse XML document %s\n", inputXmlPath);
             err = EUCA_ERROR;
         }
-        xsltFreeStylesheet(cur);
     } else {
-        LOGERROR("failed to open and parse XSL-T stylesheet file %s\n", xsltStylesheetPath);
         err = EUCA_IO_ERROR;
     }
 
@@ -1574,7 +1844,7 @@ int get_xpath_xml(const char *xml_path, const char *xpath, char *buf, int buf_le
     LOGTRACE("searching for '%s' in '%s'\n", xpath, xml_path);
     pthread_mutex_lock(&xml_mutex);
     {
-        if ((doc = xmlParseFile(xml_path)) != NULL) {
+        if ((doc = get_cached_doc(xml_path)) != NULL) {
             if ((context = xmlXPathNewContext(doc)) != NULL) {
                 if ((result = xmlXPathEvalExpression(((const xmlChar *)xpath), context)) != NULL) {
                     if (!xmlXPathNodeSetIsEmpty(result->nodesetval)) {
@@ -1609,7 +1879,6 @@ int get_xpath_xml(const char *xml_path, const char *xpath, char *buf, int buf_le
             } else {
                 LOGERROR("failed to set xpath '%s' context for '%s'\n", xpath, xml_path);
             }
-            xmlFreeDoc(doc);
         } else {
             LOGDEBUG("failed to parse XML in '%s'\n", xml_path);
         }
@@ -1643,7 +1912,7 @@ char **get_xpath_content(const char *xml_path, const char *xpath)
     LOGTRACE("searching for '%s' in '%s'\n", xpath, xml_path);
     pthread_mutex_lock(&xml_mutex);
     {
-        if ((doc = xmlParseFile(xml_path)) != NULL) {
+        if ((doc = get_cached_doc(xml_path)) != NULL) {
             if ((context = xmlXPathNewContext(doc)) != NULL) {
                 if ((result = xmlXPathEvalExpression(((const xmlChar *)xpath), context)) != NULL) {
                     if (!xmlXPathNodeSetIsEmpty(result->nodesetval)) {
@@ -1667,7 +1936,6 @@ char **get_xpath_content(const char *xml_path, const char *xpath)
             } else {
                 LOGERROR("failed to set xpath '%s' context for '%s'\n", xpath, xml_path);
             }
-            xmlFreeDoc(doc);
         } else {
             LOGDEBUG("failed to parse XML in '%s'\n", xml_path);
         }
@@ -1876,6 +2144,7 @@ static void create_dummy_instance(const char *file)
     _ATTRIBUTE(nic, "publicIp", "192.168.51.51");
     _ATTRIBUTE(nic, "privateIp", "192.168.98.51");
     _ATTRIBUTE(nic, "bridgeDeviceName", "br0");
+    _ATTRIBUTE(nic, "guestDeviceName", "vn_eni-12345678");
 
     // add dummy state info
     xmlNodePtr states = _NODE(instance, "states");
@@ -1982,6 +2251,55 @@ int main(int argc, char **argv)
         goto out;
     }
 
+    // a rewritten file must not be served from the parsed document cache
+    euca_strncpy(instance.launchIndex, "7", sizeof(instance.launchIndex));
+    if ((gen_instance_xml(&instance) != EUCA_OK) || (read_instance_xml(out_path2, &instance2) != EUCA_OK) || strcmp(instance2.launchIndex, "7")) {
+        LOGERROR("re-read of rewritten %s returned stale launchIndex '%s'\n", out_path2, instance2.launchIndex);
+        goto out;
+    }
+
+    LOGINFO("benchmarking instance XML loading over %d iterations\n", BENCH_ITERATIONS);
+    {
+        long long t_start = 0;
+        long long t_uncached = 0;
+        long long t_cold = 0;
+        long long t_cached = 0;
+
+        // without the cache, every get_xpath_* query of a load parses the file again
+        err = EUCA_OK;
+        doc_cache_bypass = TRUE;
+        t_start = time_usec();
+        for (int i = 0; ((err == EUCA_OK) && (i < BENCH_ITERATIONS)); i++) {
+            bzero(&instance2, sizeof(ncInstance));
+            err = read_instance_xml(in_path, &instance2);
+        }
+        t_uncached = time_usec() - t_start;
+        doc_cache_bypass = FALSE;
+
+        // a cold cache costs one parse per load, as when adopting instances after a restart
+        t_start = time_usec();
+        for (int i = 0; ((err == EUCA_OK) && (i < BENCH_ITERATIONS)); i++) {
+            flush_cached_doc(NULL);
+            bzero(&instance2, sizeof(ncInstance));
+            err = read_instance_xml(in_path, &instance2);
+        }
+        t_cold = time_usec() - t_start;
+
+        t_start = time_usec();
+        for (int i = 0; ((err == EUCA_OK) && (i < BENCH_ITERATIONS)); i++) {
+            bzero(&instance2, sizeof(ncInstance));
+            err = read_instance_xml(in_path, &instance2);
+        }
+        t_cached = time_usec() - t_start;
+
+        if (err != EUCA_OK) {
+            LOGERROR("failed to read instance XML during benchmark\n");
+            goto out;
+        }
+        LOGINFO("per instance: %lld usec parsing on every query, %lld usec with a cold cache, %lld usec with a warm one\n", (t_uncached / BENCH_ITERATIONS),
+                (t_cold / BENCH_ITERATIONS), (t_cached / BENCH_ITERATIONS));
+    }
+
     LOGINFO("parsing stylesheet %s\n", xslt_path);
     if ((err = apply_xslt_stylesheet(xslt_path, in_path, out_path, NULL, 0)) != EUCA_OK)
         goto out;
@@ -2015,6 +2333,50 @@ int main(int argc, char **argv)
     }
     LOGINFO("extracted %s as {%s}\n", xpath2, buf);
 
+    LOGINFO("benchmarking libvirt XML generation over %d instances\n", BENCH_ITERATIONS);
+    {
+        long long t_start = 0;
+        long long t_cold = 0;
+        long long t_cached = 0;
+        long long t_inmem = 0;
+        xmlDocPtr doc = NULL;
+        xsltStylesheetPtr cur = NULL;
+
+        // stylesheet parsed for every instance, as before it was cached
+        t_start = time_usec();
+        for (int i = 0; ((err == EUCA_OK) && (i < BENCH_ITERATIONS)); i++) {
+            flush_xslt_stylesheet();
+            err = apply_xslt_stylesheet(xslt_path, in_path, out_path, NULL, 0);
+        }
+        t_cold = time_usec() - t_start;
+
+        // cached stylesheet, instance XML parsed back from disk
+        t_start = time_usec();
+        for (int i = 0; ((err == EUCA_OK) && (i < BENCH_ITERATIONS)); i++) {
+            err = apply_xslt_stylesheet(xslt_path, in_path, out_path, NULL, 0);
+        }
+        t_cached = time_usec() - t_start;
+
+        // cached stylesheet applied to the in-memory document
+        if ((err == EUCA_OK) && ((doc = xmlParseFile(in_path)) != NULL) && ((cur = get_xslt_stylesheet(xslt_path)) != NULL)) {
+            t_start = time_usec();
+            for (int i = 0; ((err == EUCA_OK) && (i < BENCH_ITERATIONS)); i++) {
+                err = transform_xml_doc(cur, doc, in_path, out_path, NULL, 0);
+            }
+            t_inmem = time_usec() - t_start;
+        }
+        if (doc != NULL)
+            xmlFreeDoc(doc);
+        flush_xslt_stylesheet();
+
+        if (err != EUCA_OK) {
+            LOGERROR("failed to generate libvirt XML during benchmark\n");
+            goto out;
+        }
+        LOGINFO("per instance: %lld usec uncached, %lld usec cached stylesheet, %lld usec in-memory\n",
+                (t_cold / BENCH_ITERATIONS), (t_cached / BENCH_ITERATIONS), (t_inmem / BENCH_ITERATIONS));
+    }
+
 out:
     if (err) {
         LOGINFO("leaving around files %s and %s\n", out_path, in_path);
@@ -122,6 +122,7 @@ int gen_instance_xml(const ncInstance * instance);
 int gen_nic_xml(const ncInstance * instance, const netConfig * net);
 int read_instance_xml(const char *xml_path, ncInstance * instance);
 int gen_libvirt_instance_xml(const ncInstance * instance);
+int gen_instance_and_libvirt_xml(const ncInstance * instance);
 int gen_volume_xml(const char *volumeId, const ncInstance * instance, const char *devName, const char *remoteDev);
 int gen_libvirt_volume_xml(const char *volumeId, const ncInstance * instance);
 int gen_libvirt_nic_xml(const char * instancePath, const char * eniId);
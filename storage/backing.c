@@ -81,14 +81,19 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdarg.h>
+#include <stddef.h>                    // offsetof
 #include <fcntl.h>
 #include <errno.h>
 #include <limits.h>
 #include <assert.h>
 #include <dirent.h>
+#include <sys/mman.h>                  // mmap
+#include <sys/syscall.h>               // SYS_ioprio_set, SYS_gettid
+#include <pthread.h>
 
 #include <eucalyptus.h>
 #include <misc.h>                      // logprintfl, ensure_...
+#include <hash.h>                      // jenkins
 #include <data.h>                      // ncInstance
 #include "instance33.h"                // ncInstance as of 3.3.*, for upgrade
 #include <handlers.h>                  // nc_state
@@ -101,6 +106,7 @@
 #include "storage-windows.h"
 #include "backing.h"
 #include "vbr.h"
+#include "image_peers.h"
 #include <ebs_utils.h>
 #include "xml.h"
 
@@ -118,6 +124,16 @@
 #define INSTANCE_FILE_NAME                       "instance.xml"
 #define INSTANCE_LIBVIRT_FILE_NAME               "instance-libvirt.xml"
 #define INSTANCE_CONSOLE_FILE_NAME               "console.log"
+#define INSTANCE_CHECKPOINT_FILE_NAME            "instance.bin" //!< binary checkpoint (not to be confused with the v3.3 "instance.checkpoint")
+
+#define INSTANCE_CHECKPOINT_MAGIC                "EUCAINST"
+#define INSTANCE_CHECKPOINT_VERSION              2  //!< Please up it whenever the checkpoint header or the meaning of an ncInstance field changes
+
+#define PREWARM_WORK_PREFIX                      "prewarm"  //!< Work prefix of pre-warm trees (which never create work blobs)
+#define PREWARM_IMAGE_REGEX                      "^e[mkr]i-"    //!< Cache blobs that hold downloaded images, kernels and ramdisks
+#define PREWARM_IOPRIO_WHO_PROCESS               1  //!< IOPRIO_WHO_PROCESS from linux/ioprio.h, which targets a single thread
+#define PREWARM_IOPRIO_CLASS_IDLE                3  //!< IOPRIO_CLASS_IDLE from linux/ioprio.h
+#define PREWARM_IOPRIO_CLASS_SHIFT               13 //!< IOPRIO_CLASS_SHIFT from linux/ioprio.h
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -137,6 +153,16 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! Header of the binary instance checkpoint, followed on disk by the ncInstance struct
+typedef struct instance_checkpoint_header_t {
+    char magic[8];                     //!< Always INSTANCE_CHECKPOINT_MAGIC (not NULL-terminated)
+    u32 version;                       //!< INSTANCE_CHECKPOINT_VERSION of the writer
+    u32 header_size;                   //!< Size of this header
+    u64 payload_size;                  //!< sizeof(ncInstance) of the writer, so any change to the struct invalidates the checkpoint
+    u32 checksum;                      //!< Jenkins hash of the payload
+    u32 layout;                        //!< instance_checkpoint_layout() of the writer, which catches fields moved or resized within the same sizeof(ncInstance)
+} instance_checkpoint_header;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXTERNAL VARIABLES                             |
@@ -164,6 +190,13 @@ static blobstore *cache_bs = NULL;
 static blobstore *work_bs = NULL;
 static sem *disk_sem = NULL;
 
+static pthread_mutex_t prewarm_mutex = PTHREAD_MUTEX_INITIALIZER;   //!< Guards the pre-warm queue and state below
+static virtualBootRecord prewarm_queue[MAX_PREWARM_IMAGES]; //!< Images waiting to be fetched into the cache, in request order
+static int prewarm_queue_len = 0;
+static char prewarm_current[CACHED_IMAGE_ID_SIZE] = ""; //!< Image being fetched by the pre-warm thread, if any
+static boolean prewarm_running = FALSE;
+static boolean prewarm_bail = FALSE;
+
 static bunchOfInstances **instances = NULL;
 
 /*----------------------------------------------------------------------------*\
@@ -178,6 +211,12 @@ static void set_id(const ncInstance * instance, virtualBootRecord * vbr, char *i
 static void set_id2(const ncInstance * instance, const char *suffix, char *id, unsigned int id_size);
 static void set_path(char *path, unsigned int path_size, const ncInstance * instance, const char *filename);
 static int stale_blob_examiner(const blockblob * bb);
+static u32 instance_checkpoint_layout(void);
+static int write_instance_checkpoint(const ncInstance * instance);
+static int read_instance_checkpoint(const char *checkpoint_path, ncInstance * instance);
+static boolean is_prewarm_pending(const char *id);
+static void *prewarm_thread(void *arg);
+static void add_resident_image(ncImageResidency * residency, const char *artifact_id);
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -328,6 +367,7 @@ int stat_backing_store(const char *conf_instances_path, blobstore_meta * work_me
 //!       \li the work blobstore is created and our global work_bs variable is set
 //!       \li the cache blobstore is created if necessary and the cache_bs variable is set
 //!       \li the disk semaphore is created if necessary
+//!       \li the cache is served to the peers of this node if NC_IMAGE_PEER_PORT is set
 //!
 int init_backing_store(const char *conf_instances_path, unsigned int conf_work_size_mb, unsigned int conf_cache_size_mb)
 {
@@ -400,7 +440,32 @@ int init_backing_store(const char *conf_instances_path, unsigned int conf_work_s
         LOGERROR("failed to create and initialize disk semaphore\n");
         return (EUCA_PERMISSION_ERROR);
     }
+    return (EUCA_OK);
+}
+
+//!
+//! Serves the cache blobstore to the other nodes of the cluster. Failure only
+//! costs us the peers' help, the images are still downloaded from their origin.
+//!
+//! @param[in] bind_ip the cluster-facing address of this node
+//! @param[in] port the TCP port to serve the images on, 0 to leave peer distribution disabled
+//!
+//! @return EUCA_OK on success (or when disabled) or EUCA_ERROR on failure
+//!
+//! @pre init_backing_store() must have been called successfully
+//!
+int share_cached_images(const char *bind_ip, int port)
+{
+    char keys_path[EUCA_MAX_PATH] = "";
+
+    if (port <= 0)
+        return (EUCA_OK);
 
+    snprintf(keys_path, sizeof(keys_path), "%s/cache-peer-keys", instances_path);
+    if (image_peers_start(cache_bs, keys_path, bind_ip, port) != EUCA_OK) {
+        LOGWARN("peer image distribution is disabled on this node\n");
+        return (EUCA_ERROR);
+    }
     return (EUCA_OK);
 }
 
@@ -595,11 +660,178 @@ static int stale_blob_examiner(const blockblob * bb)
 //!
 int save_instance_struct(const ncInstance * instance)
 {
+    int ret = EUCA_OK;
+
     if (instance->state == TEARDOWN) {
         return EUCA_OK;                // instance is without disk state => nowhere to write metadata
+    }
+
+    if ((ret = gen_instance_xml(instance)) == EUCA_OK) {
+        // the XML remains authoritative, so failing to write the binary checkpoint is not fatal
+        write_instance_checkpoint(instance);
+    }
+    return (ret);
+}
+
+//!
+//! Computes a fingerprint of the ncInstance layout this binary was built with, so that a
+//! checkpoint written by a build where fields moved or changed size is rejected even when
+//! sizeof(ncInstance) happens to be the same.
+//!
+//! @return the layout fingerprint
+//!
+static u32 instance_checkpoint_layout(void)
+{
+    // offset and size of the fields whose position matters to whoever reads the checkpoint back,
+    // down into the nested structs, so that reordering or resizing any of them changes the result
+    static const u64 layout[] = {
+        sizeof(ncInstance),
+        offsetof(ncInstance, instanceId), sizeof(((ncInstance *) 0)->instanceId),
+        offsetof(ncInstance, imageId), sizeof(((ncInstance *) 0)->imageId),
+        offsetof(ncInstance, stateName), sizeof(((ncInstance *) 0)->stateName),
+        offsetof(ncInstance, state), sizeof(((ncInstance *) 0)->state),
+        offsetof(ncInstance, migration_state), sizeof(((ncInstance *) 0)->migration_state),
+        offsetof(ncInstance, keyName), sizeof(((ncInstance *) 0)->keyName),
+        offsetof(ncInstance, launchTime), sizeof(((ncInstance *) 0)->launchTime),
+        offsetof(ncInstance, params), sizeof(virtualMachine),
+        offsetof(virtualMachine, boot), offsetof(virtualMachine, virtualBootRecord), sizeof(virtualBootRecord),
+        offsetof(virtualMachine, virtualBootRecordLen),
+        offsetof(ncInstance, ncnet), sizeof(netConfig),
+        offsetof(ncInstance, tcb), sizeof(pthread_t),
+        offsetof(ncInstance, instancePath), offsetof(ncInstance, xmlFilePath),
+        offsetof(ncInstance, userData), sizeof(((ncInstance *) 0)->userData),
+        offsetof(ncInstance, groupNames), offsetof(ncInstance, groupIds),
+        offsetof(ncInstance, volumes), sizeof(ncVolume), EUCA_MAX_VOLUMES,
+        offsetof(ncInstance, last_stat), offsetof(ncInstance, guestStateName),
+        offsetof(ncInstance, credential), offsetof(ncInstance, hasFloppy),
+    };
+
+    return (jenkins((const char *)layout, sizeof(layout)));
+}
+
+//!
+//! Atomically writes the binary checkpoint of the instance structure (INSTANCE_CHECKPOINT_FILE_NAME)
+//! next to instance.xml: the header and struct are written to a temporary file, which is then
+//! renamed over the previous checkpoint. Pointers in the struct are saved as-is and must be
+//! fixed up by the reader.
+//!
+//! @param[in] instance pointer to the instance to save
+//!
+//! @return EUCA_OK on success or EUCA_IO_ERROR on failure
+//!
+//! @see read_instance_checkpoint()
+//!
+static int write_instance_checkpoint(const ncInstance * instance)
+{
+    int fd = -1;
+    char path[EUCA_MAX_PATH] = "";
+    char tmp_path[EUCA_MAX_PATH] = "";
+    instance_checkpoint_header hdr = { {0} };
+
+    set_path(path, sizeof(path), instance, INSTANCE_CHECKPOINT_FILE_NAME);
+    snprintf(tmp_path, sizeof(tmp_path), "%s-XXXXXX", path);
+
+    memcpy(hdr.magic, INSTANCE_CHECKPOINT_MAGIC, sizeof(hdr.magic));
+    hdr.version = INSTANCE_CHECKPOINT_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.payload_size = sizeof(ncInstance);
+    hdr.checksum = jenkins((const char *)instance, sizeof(ncInstance));
+    hdr.layout = instance_checkpoint_layout();
+
+    // a unique temporary file, since several threads may checkpoint the same instance at once
+    if ((fd = mkstemp(tmp_path)) < 0) {
+        LOGWARN("[%s] failed to create instance checkpoint %s: %s\n", instance->instanceId, tmp_path, strerror(errno));
+        return (EUCA_IO_ERROR);
+    }
+    fchmod(fd, BACKING_FILE_PERM);
+
+    if ((write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) || (write(fd, instance, sizeof(ncInstance)) != sizeof(ncInstance))) {
+        LOGWARN("[%s] failed to write instance checkpoint %s: %s\n", instance->instanceId, tmp_path, strerror(errno));
+        close(fd);
+        unlink(tmp_path);
+        return (EUCA_IO_ERROR);
+    }
+    close(fd);
+
+    if (rename(tmp_path, path) != 0) {
+        LOGWARN("[%s] failed to rename instance checkpoint %s to %s: %s\n", instance->instanceId, tmp_path, path, strerror(errno));
+        unlink(tmp_path);
+        return (EUCA_IO_ERROR);
+    }
+
+    LOGTRACE("[%s] wrote instance checkpoint to %s\n", instance->instanceId, path);
+    return (EUCA_OK);
+}
+
+//!
+//! Loads the instance structure from its binary checkpoint, provided the checkpoint is at least
+//! as recent as instance.xml and its version, size, layout and checksum all match. Any mismatch is
+//! reported as an error so the caller falls back on the XML.
+//!
+//! @param[in]  checkpoint_path path to the binary checkpoint file
+//! @param[out] instance pointer to the instance structure to fill
+//!
+//! @return EUCA_OK on success, EUCA_NOT_FOUND_ERROR if there is no usable checkpoint or EUCA_ERROR if it is invalid
+//!
+//! @see write_instance_checkpoint()
+//!
+static int read_instance_checkpoint(const char *checkpoint_path, ncInstance * instance)
+{
+    int fd = -1;
+    int ret = EUCA_ERROR;
+    u8 *map = NULL;
+    size_t map_size = sizeof(instance_checkpoint_header) + sizeof(ncInstance);
+    struct stat cp_stat = { 0 };
+    struct stat xml_stat = { 0 };
+    const instance_checkpoint_header *hdr = NULL;
+    const ncInstance *payload = NULL;
+
+    if ((fd = open(checkpoint_path, O_RDONLY)) < 0)
+        return (EUCA_NOT_FOUND_ERROR);
+
+    if (fstat(fd, &cp_stat) != 0) {
+        close(fd);
+        return (EUCA_NOT_FOUND_ERROR);
+    }
+    // the XML may have been regenerated on its own (e.g., with gen_instance_xml()), in which case it wins
+    if ((stat(instance->xmlFilePath, &xml_stat) == 0)
+        && ((xml_stat.st_mtim.tv_sec > cp_stat.st_mtim.tv_sec)
+            || ((xml_stat.st_mtim.tv_sec == cp_stat.st_mtim.tv_sec) && (xml_stat.st_mtim.tv_nsec > cp_stat.st_mtim.tv_nsec)))) {
+        LOGDEBUG("[%s] instance checkpoint %s is older than %s\n", instance->instanceId, checkpoint_path, instance->xmlFilePath);
+        close(fd);
+        return (EUCA_NOT_FOUND_ERROR);
+    }
+
+    if (cp_stat.st_size != map_size) {
+        LOGWARN("[%s] instance checkpoint %s has unexpected size (%ld != %ld)\n", instance->instanceId, checkpoint_path, cp_stat.st_size, map_size);
+        close(fd);
+        return (EUCA_ERROR);
+    }
+
+    map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOGWARN("[%s] failed to map instance checkpoint %s: %s\n", instance->instanceId, checkpoint_path, strerror(errno));
+        return (EUCA_ERROR);
+    }
+
+    hdr = (const instance_checkpoint_header *)map;
+    payload = (const ncInstance *)(map + sizeof(instance_checkpoint_header));
+    if (memcmp(hdr->magic, INSTANCE_CHECKPOINT_MAGIC, sizeof(hdr->magic)) || (hdr->version != INSTANCE_CHECKPOINT_VERSION)
+        || (hdr->header_size != sizeof(instance_checkpoint_header)) || (hdr->payload_size != sizeof(ncInstance))
+        || (hdr->layout != instance_checkpoint_layout())) {
+        LOGINFO("[%s] ignoring instance checkpoint %s from a different version\n", instance->instanceId, checkpoint_path);
+    } else if (hdr->checksum != jenkins((const char *)payload, sizeof(ncInstance))) {
+        LOGWARN("[%s] instance checkpoint %s failed checksum verification\n", instance->instanceId, checkpoint_path);
     } else {
-        return gen_instance_xml(instance);
+        memcpy(instance, payload, sizeof(ncInstance));
+        instance->tcb = 0;             // thread handles and pointers are meaningless across restarts
+        instance->params.boot = NULL;
+        ret = EUCA_OK;
     }
+
+    munmap(map, map_size);
+    return (ret);
 }
 
 //!
@@ -621,6 +853,8 @@ ncInstance *load_instance_struct(const char *instanceId)
     char tmp_path[EUCA_MAX_PATH] = "";
     char user_paths[EUCA_MAX_PATH] = "";
     char checkpoint_path[EUCA_MAX_PATH] = "";
+    char binary_path[EUCA_MAX_PATH] = "";
+    boolean from_binary = FALSE;
     ncInstance *instance = NULL;
     struct dirent *dir_entry = NULL;
     struct stat mystat = { 0 };
@@ -666,6 +900,7 @@ ncInstance *load_instance_struct(const char *instanceId)
     // and load metadata from it (as part of a "warm" upgrade from 3.3.0 and 3.3.1).
     set_path(checkpoint_path, sizeof(checkpoint_path), instance, "instance.checkpoint");
     set_path(instance->xmlFilePath, sizeof(instance->xmlFilePath), instance, INSTANCE_FILE_NAME);
+    set_path(binary_path, sizeof(binary_path), instance, INSTANCE_CHECKPOINT_FILE_NAME);
     if (check_file(checkpoint_path) == 0) {
         ncInstance33 instance33;
         {                              // read in the checkpoint
@@ -698,7 +933,10 @@ ncInstance *load_instance_struct(const char *instanceId)
         }
         memcpy(instance, &instance33, sizeof(ncInstance33));
         LOGINFO("[%s] upgraded instance checkpoint from v3.3\n", instance->instanceId);
-    } else {                           // no binary checkpoint, so we expect an XML-formatted checkpoint
+    } else if (read_instance_checkpoint(binary_path, instance) == EUCA_OK) {
+        LOGDEBUG("[%s] loaded instance from binary checkpoint %s\n", instance->instanceId, binary_path);
+        from_binary = TRUE;
+    } else {                           // no usable binary checkpoint, so we expect an XML-formatted checkpoint
         char *xmlFP;
         if ((xmlFP = EUCA_ALLOC(sizeof(instance->xmlFilePath), sizeof(char))) == NULL) {
             LOGERROR("out of memory (for temporary string allocation)\n");
@@ -749,9 +987,13 @@ ncInstance *load_instance_struct(const char *instanceId)
     }
 
     // save the struct back to disk after the upgrade routine had a chance to modify it
-    if (gen_instance_xml(instance) != EUCA_OK) {
-        LOGERROR("failed to create instance XML in %s\n", instance->xmlFilePath);
-        goto free;
+    // (a struct restored from a binary checkpoint is already in the current format)
+    if (!from_binary) {
+        if (gen_instance_xml(instance) != EUCA_OK) {
+            LOGERROR("failed to create instance XML in %s\n", instance->xmlFilePath);
+            goto free;
+        }
+        write_instance_checkpoint(instance);
     }
     // remove the binary checkpoint because it is no longer needed and not used past 3.3
     unlink(checkpoint_path);
@@ -1049,3 +1291,201 @@ int destroy_instance_backing(ncInstance * instance, boolean do_destroy_files)
 
     return (ret);
 }
+
+//!
+//! Checks whether an image is already queued or being fetched by the pre-warm thread
+//!
+//! @param[in] id the image identifier (emi|eki|eri-XXXXXXXX)
+//!
+//! @return TRUE if the image is pending or FALSE otherwise
+//!
+//! @pre The caller must hold prewarm_mutex
+//!
+static boolean is_prewarm_pending(const char *id)
+{
+    int i = 0;
+
+    if (!strcmp(prewarm_current, id))
+        return (TRUE);
+
+    for (i = 0; i < prewarm_queue_len; i++) {
+        if (!strcmp(prewarm_queue[i].id, id))
+            return (TRUE);
+    }
+    return (FALSE);
+}
+
+//!
+//! Fetches the queued images into the cache blobstore, one at a time, until the
+//! queue is empty. The thread uses the idle I/O class so that it only gets the
+//! disk when nothing else wants it, and each image takes one of the disk slots
+//! that instance launches use, so pre-warming never adds more than one to the
+//! number of concurrent disk-intensive operations.
+//!
+//! @param[in] arg unused
+//!
+//! @return Always NULL
+//!
+static void *prewarm_thread(void *arg)
+{
+    int rc = 0;
+    time_t started = 0;
+    artifact *sentinel = NULL;
+    virtualBootRecord vbr = { {0} };
+
+    if (syscall(SYS_ioprio_set, PREWARM_IOPRIO_WHO_PROCESS, syscall(SYS_gettid), (PREWARM_IOPRIO_CLASS_IDLE << PREWARM_IOPRIO_CLASS_SHIFT)) != 0) {
+        LOGWARN("failed to lower the I/O priority of image pre-warming: %s\n", strerror(errno));
+    }
+    art_set_instanceId(PREWARM_WORK_PREFIX);
+
+    for (;;) {
+        pthread_mutex_lock(&prewarm_mutex);
+        {
+            if (prewarm_queue_len == 0) {
+                prewarm_current[0] = '\0';
+                prewarm_running = FALSE;
+                pthread_mutex_unlock(&prewarm_mutex);
+                break;
+            }
+            memcpy(&vbr, &prewarm_queue[0], sizeof(virtualBootRecord));
+            memmove(&prewarm_queue[0], &prewarm_queue[1], (--prewarm_queue_len) * sizeof(virtualBootRecord));
+            euca_strncpy(prewarm_current, vbr.id, sizeof(prewarm_current));
+        }
+        pthread_mutex_unlock(&prewarm_mutex);
+
+        started = time(NULL);
+        if ((sentinel = vbr_alloc_image_tree(&vbr, &prewarm_bail)) == NULL) {
+            LOGERROR("[%s] failed to prepare the pre-warm of image\n", vbr.id);
+            continue;
+        }
+
+        sem_p(disk_sem);
+        {
+            rc = art_implement_tree(sentinel, work_bs, cache_bs, PREWARM_WORK_PREFIX, INSTANCE_PREP_TIMEOUT_USEC);
+        }
+        sem_v(disk_sem);
+        art_free(sentinel);
+
+        if (rc != EUCA_OK) {
+            LOGERROR("[%s] failed to pre-warm image into the cache\n", vbr.id);
+        } else {
+            LOGINFO("[%s] image pre-warmed into the cache in %ld seconds\n", vbr.id, (long)(time(NULL) - started));
+        }
+    }
+
+    return (NULL);
+}
+
+//!
+//! Queues images to be fetched into the cache blobstore in the background.
+//! Images already queued or being fetched are skipped, as are images beyond
+//! the capacity of the queue.
+//!
+//! @param[in] vbrs the image VBRs, each verified by vbr_parse_image()
+//! @param[in] vbrsLen the number of VBRs in the list
+//!
+//! @return EUCA_OK on success or the following error codes:
+//!         \li EUCA_UNSUPPORTED_ERROR: if this node has no cache
+//!         \li EUCA_THREAD_ERROR: if the pre-warm thread could not be started
+//!
+int prewarm_images(virtualBootRecord * vbrs, int vbrsLen)
+{
+    int i = 0;
+    int ret = EUCA_OK;
+    pthread_t tid = { 0 };
+
+    if (cache_bs == NULL) {
+        LOGWARN("images cannot be pre-warmed on a node without a cache\n");
+        return (EUCA_UNSUPPORTED_ERROR);
+    }
+
+    pthread_mutex_lock(&prewarm_mutex);
+    {
+        for (i = 0; i < vbrsLen; i++) {
+            if (is_prewarm_pending(vbrs[i].id))
+                continue;
+            if (prewarm_queue_len == MAX_PREWARM_IMAGES) {
+                LOGWARN("[%s] pre-warm queue is full, not queuing image\n", vbrs[i].id);
+                continue;
+            }
+            memcpy(&prewarm_queue[prewarm_queue_len++], &vbrs[i], sizeof(virtualBootRecord));
+            LOGDEBUG("[%s] queued image for pre-warming\n", vbrs[i].id);
+        }
+
+        if (!prewarm_running && (prewarm_queue_len > 0)) {
+            if (pthread_create(&tid, NULL, prewarm_thread, NULL) != 0) {
+                LOGERROR("failed to start the image pre-warm thread\n");
+                ret = EUCA_THREAD_ERROR;
+            } else {
+                pthread_detach(tid);
+                prewarm_running = TRUE;
+            }
+        }
+    }
+    pthread_mutex_unlock(&prewarm_mutex);
+
+    return (ret);
+}
+
+//!
+//! Adds a cache artifact to a residency report, once. The full artifact ID is kept,
+//! since the hash of the image digest it ends with tells apart versions of an image.
+//!
+//! @param[in,out] residency the report to add to
+//! @param[in]     artifact_id the artifact identifier (emi-XXXXXXXX-YYYYYYYY)
+//!
+static void add_resident_image(ncImageResidency * residency, const char *artifact_id)
+{
+    int i = 0;
+
+    for (i = 0; i < residency->residentImagesLen; i++) {
+        if (!strcmp(residency->residentImages[i], artifact_id))
+            return;
+    }
+    if (residency->residentImagesLen < MAX_PREWARM_IMAGES)
+        euca_strncpy(residency->residentImages[residency->residentImagesLen++], artifact_id, CACHED_IMAGE_ID_SIZE);
+}
+
+//!
+//! Reports which images are fully present in the cache blobstore and which
+//! ones are still being pre-warmed
+//!
+//! @param[out] residency the report to fill in
+//!
+//! @return EUCA_OK on success or EUCA_UNSUPPORTED_ERROR if this node has no cache
+//!
+int stat_image_residency(ncImageResidency * residency)
+{
+    int i = 0;
+    blockblob_meta *matches = NULL;
+    blockblob_meta *bm = NULL;
+    blockblob_meta *next = NULL;
+
+    bzero(residency, sizeof(ncImageResidency));
+    if (cache_bs == NULL)
+        return (EUCA_UNSUPPORTED_ERROR);
+
+    if (blobstore_search(cache_bs, PREWARM_IMAGE_REGEX, &matches) > 0) {
+        for (bm = matches; bm; bm = bm->next) {
+            // hollow blobs have no content and blobs being created are not complete yet
+            if (!bm->is_hollow && !(bm->in_use & BLOCKBLOB_STATUS_LOCKED))
+                add_resident_image(residency, bm->id);
+        }
+    }
+    for (bm = matches; bm; bm = next) {
+        next = bm->next;
+        EUCA_FREE(bm);
+    }
+
+    pthread_mutex_lock(&prewarm_mutex);
+    {
+        if (prewarm_current[0] != '\0')
+            euca_strncpy(residency->pendingImages[residency->pendingImagesLen++], prewarm_current, CACHED_IMAGE_ID_SIZE);
+        for (i = 0; (i < prewarm_queue_len) && (residency->pendingImagesLen < MAX_PREWARM_IMAGES); i++) {
+            euca_strncpy(residency->pendingImages[residency->pendingImagesLen++], prewarm_queue[i].id, CACHED_IMAGE_ID_SIZE);
+        }
+    }
+    pthread_mutex_unlock(&prewarm_mutex);
+
+    return (EUCA_OK);
+}
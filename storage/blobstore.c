@@ -4543,6 +4543,30 @@ blobstore *blockblob_get_blobstore(blockblob * bb)
     return bb->store;
 }
 
+//!
+//! Retrieves the signature the blob was created with, if one was provided
+//!
+//! @param[in]  bb
+//! @param[out] buf
+//! @param[in]  buf_size
+//!
+//! @return The length of the signature or -1 if the blob has no signature or in case of error
+//!
+int blockblob_get_sig(blockblob * bb, char *buf, int buf_size)
+{
+    int size = -1;
+
+    if ((bb == NULL) || (buf == NULL) || (buf_size < 1)) {
+        ERR(BLOBSTORE_ERROR_INVAL, NULL);
+        return -1;
+    }
+
+    if ((size = read_blockblob_metadata_path(BLOCKBLOB_PATH_SIG, bb->store, bb->id, buf, buf_size - 1)) < 0)
+        return -1;
+    buf[size] = '\0';
+    return size;
+}
+
 //!
 //! Returns the directory in which the blob files are located
 //!
@@ -323,6 +323,7 @@ int blockblob_clone(blockblob * bb, const blockmap * map, unsigned int map_size)
 const char *blockblob_get_dev(blockblob * bb);
 const char *blockblob_get_file(blockblob * bb);
 blobstore *blockblob_get_blobstore(blockblob * bb);
+int blockblob_get_sig(blockblob * bb, char *buf, int buf_size);
 int blockblob_get_dir(blockblob * bb, char *buf, int buflen);
 unsigned long long blockblob_get_size_blocks(blockblob * bb);
 unsigned long long blockblob_get_size_bytes(blockblob * bb);
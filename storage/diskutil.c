@@ -86,6 +86,9 @@
 #include <sys/stat.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <grp.h>
 
 #include <eucalyptus.h>
 #include <misc.h>                      // logprintfl
@@ -103,6 +106,7 @@
 #define LOOP_RETRIES                             9
 #define OUTPUT_ALLOC_CHUNK 1024
 #define MAX_OUTPUT_BYTES 1024*1024
+#define NATIVE_CP_CHUNK                          (128 * 1024)
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -191,6 +195,9 @@ static char service_key_path[EUCA_MAX_PATH] = "/var/lib/eucalyptus/keys/node-pk.
 static char *pruntf(boolean log_error, char *format, ...)
 _attribute_wur_ _attribute_format_(2, 3);
 static char *execlp_output(boolean log_error, ...);
+static int ch_native(const char *path, const char *user, const char *group, const int perms);
+static int mkdir_native(const char *path);
+static int cp_native(const char *from, const char *to);
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -1054,6 +1061,10 @@ int diskutil_ch(const char *path, const char *user, const char *group, const int
     LOGDEBUG("ch(own|mod) '%s' %s.%s %o\n", SP(path), ((user != NULL) ? user : "*"), ((group != NULL) ? group : "*"), perms);
 
     if (path) {
+        if (ch_native(path, user, group, perms) == EUCA_OK) {
+            return (EUCA_OK);
+        }
+
         if (user) {
             output = execlp_output(TRUE, helpers_path[ROOTWRAP], helpers_path[CHOWN], user, path, NULL);
             if (!output) {
@@ -1106,6 +1117,10 @@ int diskutil_mkdir(const char *path)
     char *output = NULL;
 
     if (path) {
+        if (mkdir_native(path) == EUCA_OK) {
+            return (EUCA_OK);
+        }
+
         if ((output = pruntf(TRUE, "%s %s -p %s", helpers_path[ROOTWRAP], helpers_path[MKDIR], path)) == NULL) {
             return (EUCA_ERROR);
         }
@@ -1136,6 +1151,10 @@ int diskutil_cp(const char *from, const char *to)
     char *output = NULL;
 
     if (from && to) {
+        if (cp_native(from, to) == EUCA_OK) {
+            return (EUCA_OK);
+        }
+
         if ((output = pruntf(TRUE, "%s %s %s %s", helpers_path[ROOTWRAP], helpers_path[CP], from, to)) == NULL) {
             return (EUCA_ERROR);
         }
@@ -1147,6 +1166,168 @@ int diskutil_cp(const char *from, const char *to)
     return (EUCA_INVALID_ERROR);
 }
 
+//!
+//! In-process equivalent of 'chown user path; chown :group path; chmod perms path'.
+//! Anything already in the requested state is left alone, so this also succeeds
+//! without privileges when nothing needs changing. On any failure the caller
+//! falls back to the rootwrap helpers, which report the real error.
+//!
+//! @param[in] path
+//! @param[in] user user name or NULL to leave unchanged
+//! @param[in] group group name or NULL to leave unchanged
+//! @param[in] perms permission bits or 0 to leave unchanged
+//!
+//! @return EUCA_OK on success or EUCA_ERROR if the helpers must be used
+//!
+static int ch_native(const char *path, const char *user, const char *group, const int perms)
+{
+    char buf[1024] = "";
+    uid_t uid = (uid_t) - 1;
+    gid_t gid = (gid_t) - 1;
+    struct stat st = { 0 };
+    struct passwd pwd = { 0 };
+    struct passwd *pw = NULL;
+    struct group grp = { 0 };
+    struct group *gr = NULL;
+
+    if (user) {
+        if ((getpwnam_r(user, &pwd, buf, sizeof(buf), &pw) != 0) || (pw == NULL))
+            return (EUCA_ERROR);
+        uid = pw->pw_uid;
+    }
+
+    if (group) {
+        if ((getgrnam_r(group, &grp, buf, sizeof(buf), &gr) != 0) || (gr == NULL))
+            return (EUCA_ERROR);
+        gid = gr->gr_gid;
+    }
+
+    if (stat(path, &st) != 0)
+        return (EUCA_ERROR);
+
+    if (uid == st.st_uid)
+        uid = (uid_t) - 1;
+    if (gid == st.st_gid)
+        gid = (gid_t) - 1;
+
+    if (((uid != (uid_t) - 1) || (gid != (gid_t) - 1)) && (chown(path, uid, gid) != 0)) {
+        LOGTRACE("native chown of %s failed: %s\n", path, strerror(errno));
+        return (EUCA_ERROR);
+    }
+
+    if ((perms > 0) && ((st.st_mode & 07777) != (perms & 07777)) && (chmod(path, perms) != 0)) {
+        LOGTRACE("native chmod of %s failed: %s\n", path, strerror(errno));
+        return (EUCA_ERROR);
+    }
+
+    return (EUCA_OK);
+}
+
+//!
+//! In-process equivalent of 'mkdir -p path'
+//!
+//! @param[in] path
+//!
+//! @return EUCA_OK on success or EUCA_ERROR if the helper must be used
+//!
+static int mkdir_native(const char *path)
+{
+    int i = 0;
+    int len = strlen(path);
+    char *path_copy = NULL;
+    struct stat st = { 0 };
+
+    if ((len == 0) || ((path_copy = strdup(path)) == NULL))
+        return (EUCA_ERROR);
+
+    for (i = 1; i <= len; i++) {
+        if ((path_copy[i] != '/') && (path_copy[i] != '\0'))
+            continue;
+        if (path_copy[i - 1] == '/')
+            continue;
+
+        path_copy[i] = '\0';
+        if ((mkdir(path_copy, 0777) != 0) && ((errno != EEXIST) || (stat(path_copy, &st) != 0) || !S_ISDIR(st.st_mode))) {
+            LOGTRACE("native mkdir of %s failed: %s\n", path_copy, strerror(errno));
+            EUCA_FREE(path_copy);
+            return (EUCA_ERROR);
+        }
+        path_copy[i] = path[i];
+    }
+
+    EUCA_FREE(path_copy);
+    return (EUCA_OK);
+}
+
+//!
+//! In-process equivalent of 'cp from to' for a regular file copied onto a file
+//! path. Directory destinations and anything unusual are left to the helper.
+//!
+//! @param[in] from
+//! @param[in] to
+//!
+//! @return EUCA_OK on success or EUCA_ERROR if the helper must be used
+//!
+static int cp_native(const char *from, const char *to)
+{
+    int ret = EUCA_ERROR;
+    int in = -1;
+    int out = -1;
+    char *buf = NULL;
+    ssize_t rbytes = 0;
+    ssize_t wbytes = 0;
+    ssize_t off = 0;
+    struct stat st = { 0 };
+    struct stat to_st = { 0 };
+
+    if ((stat(to, &to_st) == 0) && !S_ISREG(to_st.st_mode))
+        return (EUCA_ERROR);
+
+    if ((in = open(from, O_RDONLY | O_CLOEXEC)) < 0)
+        return (EUCA_ERROR);
+
+    if ((fstat(in, &st) != 0) || !S_ISREG(st.st_mode) || ((to_st.st_ino == st.st_ino) && (to_st.st_dev == st.st_dev)))
+        goto cleanup;
+
+    if ((buf = EUCA_ALLOC(NATIVE_CP_CHUNK, sizeof(char))) == NULL)
+        goto cleanup;
+
+    if ((out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, (st.st_mode & 0777))) < 0) {
+        LOGTRACE("native cp to %s failed: %s\n", to, strerror(errno));
+        goto cleanup;
+    }
+
+    while ((rbytes = read(in, buf, NATIVE_CP_CHUNK)) != 0) {
+        if (rbytes < 0) {
+            if (errno == EINTR)
+                continue;
+            goto cleanup;
+        }
+
+        for (off = 0; off < rbytes; off += wbytes) {
+            if ((wbytes = write(out, buf + off, rbytes - off)) < 0) {
+                if (errno == EINTR) {
+                    wbytes = 0;
+                    continue;
+                }
+                LOGTRACE("native cp to %s failed: %s\n", to, strerror(errno));
+                goto cleanup;
+            }
+        }
+    }
+
+    if (close(out) == 0)
+        ret = EUCA_OK;
+    out = -1;
+
+cleanup:
+    if (out >= 0)
+        close(out);
+    close(in);
+    EUCA_FREE(buf);
+    return (ret);
+}
+
 //!
 //!
 //!
@@ -1269,6 +1450,26 @@ static char *execlp_output(boolean log_error, ...)
     va_end(ap);
 
     char *output = NULL;
+    int rc = -1;
+
+    {                                  // hand it to a rootwrap broker if one is available
+        int status = -1;
+        int brc = euca_rootwrap_broker_exec(argv, TRUE, &status, &output);
+        if (brc != EUCA_UNSUPPORTED_ERROR) {
+            LOGTRACE("executed via rootwrap broker: %s\n", cmd);
+            if (brc == EUCA_SYSTEM_ERROR) {
+                LOGERROR("failed to run command via rootwrap broker\n");
+            } else if (WIFEXITED(status)) {
+                rc = WEXITSTATUS(status);
+                if (rc) {
+                    LOGERROR("child return non-zero status (%d)\n", rc);
+                }
+            } else {
+                LOGERROR("child process did not terminate normally\n");
+            }
+            goto check;
+        }
+    }
 
     // set up a pipe for getting stdout and stderror from child process
     int filedes[2];
@@ -1279,7 +1480,6 @@ static char *execlp_output(boolean log_error, ...)
     LOGTRACE("executing: %s\n", cmd);
 
     pid_t cpid = fork();
-    int rc = -1;
     if (cpid == -1) {
         LOGERROR("failed to fork\n");
         close(filedes[0]);
@@ -1342,6 +1542,7 @@ static char *execlp_output(boolean log_error, ...)
         }
     }
 
+check:
     if (rc) {
         // there were problems above
         if ((output != NULL) && strstr(cmd, "losetup") && strstr(output, ": No such device or address")) {
@@ -1432,6 +1633,44 @@ int main(int argc, char *argv[])
     output = execlp_output(TRUE, "ls", "a-ridiculously-long-name-that-does-not-exist", NULL);
     assert(output == NULL);
 
+    {                                  // test the in-process mkdir/cp/ch paths
+        char dir[] = "/tmp/euca-diskutil-XXXXXX";
+        char sub[EUCA_MAX_PATH] = "";
+        char file[EUCA_MAX_PATH] = "";
+        char copy[EUCA_MAX_PATH] = "";
+        struct stat st = { 0 };
+        struct passwd *pw = getpwuid(geteuid());
+        struct group *gr = getgrgid(getegid());
+
+        assert(mkdtemp(dir) != NULL);
+        snprintf(sub, sizeof(sub), "%s/a/b//c/", dir);
+        assert(diskutil_mkdir(sub) == EUCA_OK);
+        assert(diskutil_mkdir(sub) == EUCA_OK);
+        assert(stat(sub, &st) == 0 && S_ISDIR(st.st_mode));
+
+        snprintf(file, sizeof(file), "%s/a/file", dir);
+        snprintf(copy, sizeof(copy), "%s/a/b/copy", dir);
+        assert(diskutil_write2file(file, "diskutil native copy\n") == EUCA_OK);
+        assert(diskutil_cp(file, copy) == EUCA_OK);
+        output = file2str(copy);
+        assert(output && !strcmp(output, "diskutil native copy\n"));
+        EUCA_FREE(output);
+
+        assert(pw && gr);
+        assert(diskutil_ch(copy, pw->pw_name, gr->gr_name, 0600) == EUCA_OK);
+        assert(stat(copy, &st) == 0 && (st.st_mode & 0777) == 0600);
+
+        unlink(copy);
+        unlink(file);
+        snprintf(sub, sizeof(sub), "%s/a/b/c", dir);
+        rmdir(sub);
+        snprintf(sub, sizeof(sub), "%s/a/b", dir);
+        rmdir(sub);
+        snprintf(sub, sizeof(sub), "%s/a", dir);
+        rmdir(sub);
+        rmdir(dir);
+    }
+
     {                                  // test diskutil_get_parts()
         struct partition_table_entry parts[5];
         int n = diskutil_get_parts("/dev/sda", parts, 5);
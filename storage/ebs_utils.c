@@ -135,7 +135,6 @@ const char *euca_client_component_name = "nc";  //!< The client component name
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
-static sem *vol_sem = NULL;            //!< Semaphore to protect volume operations
 static int request_timeout_sec = DEFAULT_SC_REQUEST_TIMEOUT;
 
 /*----------------------------------------------------------------------------*\
@@ -146,6 +145,7 @@ static int request_timeout_sec = DEFAULT_SC_REQUEST_TIMEOUT;
 
 static int cleanup_volume_attachment(char *sc_url, int use_ws_sec, char *ws_sec_policy_file, ebs_volume_data * vol_data, char *connect_string, char *local_ip, char *local_iqn,
                                      int do_rescan);
+static void volume_lock_key(const char *volumeId, char *key, int key_len);
 static int redact_token(char *src_token, char *redacted);   //! Returns a redacted version of the token (eg. 'advaoiaavae' -> '*****avae'
 static int re_encrypt_token(char *in_token, char **out_token);  //! Decrypts token with NC cert and re-encrypts with the cloud public cert
 
@@ -162,7 +162,7 @@ static int re_encrypt_token(char *in_token, char **out_token);  //! Decrypts tok
 \*----------------------------------------------------------------------------*/
 
 //!
-//! Initialize ebs data structures and semaphores for EBS
+//! Initialize ebs data structures for EBS
 //! Should only be called once!
 //!
 //! @return
@@ -177,9 +177,6 @@ int init_ebs_utils(int sc_request_timeout_sec)
 {
     LOGDEBUG("Initializing EBS utils\n");
     request_timeout_sec = sc_request_timeout_sec;
-    if (vol_sem == NULL) {
-        vol_sem = sem_alloc(1, IPC_MUTEX_SEMAPHORE);
-    }
     LOGDEBUG("Completed EBS util initialization\n");
     return EUCA_OK;
 }
@@ -340,6 +337,7 @@ int connect_ebs_volume(const char *target_dev, const char *target_serial, const
     char *connect_string = NULL;
     char *xml = NULL;
     int do_rescan = 1;
+    char lock_key[EUCA_MAX_PATH] = "";
 
     if (sc_url == NULL || strlen(sc_url) == 0 || attachment_token == NULL || local_ip == NULL || local_iqn == NULL) {
         LOGERROR("Cannont connect ebs volume. Got NULL input parameters.\n");
@@ -367,8 +365,10 @@ int connect_ebs_volume(const char *target_dev, const char *target_serial, const
         return EUCA_ERROR;
     }
 
+    // operations on different volumes proceed in parallel, the iSCSI layer serializes per target
+    volume_lock_key((*vol_data)->volumeId, lock_key, sizeof(lock_key));
     LOGTRACE("Requesting volume lock\n");
-    sem_p(vol_sem);                    //Acquire the lock, after this, failure requires 'goto release' for release of lock
+    sem_key_p(lock_key);               //Acquire the lock, after this, failure requires 'goto release' for release of lock
     LOGTRACE("Got volume lock\n");
 
     LOGTRACE("Calling ExportVolume on SC at %s\n", sc_url);
@@ -403,7 +403,7 @@ int connect_ebs_volume(const char *target_dev, const char *target_serial, const
 
 release:
     LOGTRACE("Releasing volume lock\n");
-    sem_v(vol_sem);
+    sem_key_v(lock_key);
     LOGTRACE("Released volume lock\n");
 
     if (reencrypted_token != NULL) {
@@ -442,6 +442,7 @@ int disconnect_ebs_volume(char *sc_url, int use_ws_sec, char *ws_sec_policy_file
     int ret = EUCA_ERROR;
     int norescan = 0;                  //send a 0 to indicate no rescan requested
     ebs_volume_data *vol_data = NULL;
+    char lock_key[EUCA_MAX_PATH] = "";
 
     if (attachment_token == NULL || connect_string == NULL || local_ip == NULL || local_iqn == NULL) {
         LOGERROR("Cannont disconnect ebs volume. Got NULL input parameters.\n");
@@ -455,15 +456,16 @@ int disconnect_ebs_volume(char *sc_url, int use_ws_sec, char *ws_sec_policy_file
         return EUCA_ERROR;
     }
 
+    volume_lock_key(vol_data->volumeId, lock_key, sizeof(lock_key));
     LOGTRACE("Requesting volume lock\n");
-    sem_p(vol_sem);
+    sem_key_p(lock_key);
     {
         LOGTRACE("Got volume lock\n");
         ret = cleanup_volume_attachment(sc_url, use_ws_sec, ws_sec_policy_file, vol_data, connect_string, local_ip, local_iqn, norescan);
         LOGTRACE("cleanup_volume_attachment returned: %d\n", ret);
         LOGTRACE("Releasing volume lock\n");
     }
-    sem_v(vol_sem);
+    sem_key_v(lock_key);
     LOGTRACE("Released volume lock\n");
 
     EUCA_FREE(vol_data);
@@ -492,15 +494,17 @@ int disconnect_ebs_volume_with_struct(char *sc_url, int use_ws_sec, char *ws_sec
 {
     int ret = EUCA_ERROR;
     int do_rescan = 0;                 // don't do rescan
+    char lock_key[EUCA_MAX_PATH] = "";
 
     if (vol_data == NULL) {
         LOGERROR("Could not disconnect volume, got null volume data struct\n");
         return EUCA_ERROR;
     }
 
+    volume_lock_key(vol_data->volumeId, lock_key, sizeof(lock_key));
     LOGTRACE("Requesting volume lock\n");
     //Grab a lock.
-    sem_p(vol_sem);
+    sem_key_p(lock_key);
     LOGTRACE("Got volume lock\n");
 
     ret = cleanup_volume_attachment(sc_url, use_ws_sec, ws_sec_policy_file, vol_data, vol_data->connect_string, local_ip, local_iqn, do_rescan);
@@ -508,7 +512,7 @@ int disconnect_ebs_volume_with_struct(char *sc_url, int use_ws_sec, char *ws_sec
 
     LOGTRACE("Releasing volume lock\n");
     //Release the volume lock
-    sem_v(vol_sem);
+    sem_key_v(lock_key);
     LOGTRACE("Released volume lock\n");
     return ret;
 }
@@ -596,6 +600,18 @@ static int cleanup_volume_attachment(char *sc_url, int use_ws_sec, char *ws_sec_
     }
 }
 
+//!
+//! Builds the name of the lock serializing attach and detach of one volume
+//!
+//! @param[in]  volumeId the volume
+//! @param[out] key buffer for the lock name
+//! @param[in]  key_len size of the key buffer
+//!
+static void volume_lock_key(const char *volumeId, char *key, int key_len)
+{
+    snprintf(key, key_len, "ebs:%s", volumeId);
+}
+
 //! Decrypts the encrypted token and re-encrypts with the public cloud cert.
 //! Used for preparation for request to SC for Export/Unexport.
 //!
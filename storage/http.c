@@ -149,6 +149,12 @@ struct write_request {
 };
 #endif /* ! _UNIT_TEST */
 
+//! Cache validators captured from the response headers of a conditional GET
+struct validator_request {
+    char *etag;                        //!< receives the ETag header value (HTTP_VALIDATOR_SIZE bytes)
+    char *last_modified;               //!< receives the Last-Modified header value (HTTP_VALIDATOR_SIZE bytes)
+};
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXTERNAL VARIABLES                             |
@@ -181,6 +187,7 @@ static boolean curl_initialized = FALSE;    //!< boolean to indicate if we have
 
 static size_t read_data(char *buffer, size_t size, size_t nitems, void *params);
 static size_t write_data(void *buffer, size_t size, size_t nmemb, void *params);
+static size_t header_data(char *buffer, size_t size, size_t nitems, void *params);
 static char hch_to_int(char ch);
 static char int_to_hch(char i);
 
@@ -422,6 +429,50 @@ static size_t write_data(void *buffer, size_t size, size_t nmemb, void *params)
     return (wrote);
 }
 
+//!
+//! Libcurl header callback used by http_get_if_changed() to remember the ETag
+//! and Last-Modified values of the response for the next conditional request.
+//!
+//! @param[in] buffer one complete header line (not NUL terminated)
+//! @param[in] size the size of each item
+//! @param[in] nitems the number of items
+//! @param[in] params a transparent pointer to a validator_request structure
+//!
+//! @return The number of bytes consumed (always size * nitems)
+//!
+static size_t header_data(char *buffer, size_t size, size_t nitems, void *params)
+{
+    size_t len = size * nitems;
+    size_t namelen = 0;
+    size_t vallen = 0;
+    char *value = NULL;
+    char *dest = NULL;
+    struct validator_request *validators = params;
+
+    if (!strncasecmp(buffer, "ETag:", (namelen = 5)) && (len > namelen)) {
+        dest = validators->etag;
+    } else if (!strncasecmp(buffer, "Last-Modified:", (namelen = 14)) && (len > namelen)) {
+        dest = validators->last_modified;
+    }
+
+    if (dest) {
+        value = buffer + namelen;
+        vallen = len - namelen;
+        while (vallen && ((*value == ' ') || (*value == '\t'))) {
+            value++;
+            vallen--;
+        }
+        while (vallen && ((value[vallen - 1] == '\r') || (value[vallen - 1] == '\n') || (value[vallen - 1] == ' '))) {
+            vallen--;
+        }
+        if (vallen < HTTP_VALIDATOR_SIZE) {
+            memcpy(dest, value, vallen);
+            dest[vallen] = '\0';
+        }
+    }
+    return (len);
+}
+
 //!
 //! Converts hex character to integer
 //!
@@ -743,6 +794,130 @@ int http_get_timeout(const char *url, const char *outfile, int total_retries, in
     return (code);
 }
 
+//!
+//! Process a conditional HTTP get request to the given URL. When validators from a
+//! previous response are given, the request carries If-None-Match/If-Modified-Since
+//! so an unchanged resource costs a 304 and no transfer. No retries are attempted;
+//! this is meant for callers that poll the URL anyway.
+//!
+//! @param[in]     url the request URL
+//! @param[in]     outfile path to the file receiving the body when the resource changed
+//! @param[in,out] etag the ETag of the last response (HTTP_VALIDATOR_SIZE bytes, empty if unknown)
+//! @param[in,out] last_modified the Last-Modified of the last response (HTTP_VALIDATOR_SIZE bytes, empty if unknown)
+//! @param[in]     connect_timeout the libcurl connect timeout (libcurl option CURLOPT_CONNECTTIMEOUT)
+//! @param[in]     total_timeout the libcurl total timeout value (libcurl option CURLOPT_TIMEOUT)
+//! @param[out]    not_modified set to TRUE if the server answered 304 and outfile was left empty
+//!
+//! @return EUCA_OK on success (including 304) or the following error codes:
+//!         \li EUCA_ERROR: on failure
+//!         \li EUCA_INVALID_ERROR: if any parameter does not meet the preconditions
+//!         \li EUCA_ACCESS_ERROR: if we fail to access the outfile.
+//!
+//! @pre \li url, outfile, etag, last_modified and not_modified must not be NULL.
+//!      \li The url parameter must start with "http://"
+//!
+//! @post On a 200 response, outfile holds the body and etag/last_modified hold the new validators.
+//!
+int http_get_if_changed(const char *url, const char *outfile, char *etag, char *last_modified, int connect_timeout, int total_timeout, boolean * not_modified)
+{
+    int code = EUCA_ERROR;
+    long httpcode = 0L;
+    char header[HTTP_VALIDATOR_SIZE + 32] = "";
+    char new_etag[HTTP_VALIDATOR_SIZE] = "";
+    char new_last_modified[HTTP_VALIDATOR_SIZE] = "";
+    char error_msg[CURL_ERROR_SIZE] = { 0 };
+    FILE *fp = NULL;
+    CURL *curl = NULL;
+    CURLcode result = CURLE_OK;
+    struct curl_slist *headers = NULL;
+    struct write_request params = { 0 };
+    struct validator_request validators = { new_etag, new_last_modified };
+
+    if (!url || !outfile || !etag || !last_modified || !not_modified) {
+        LOGERROR("invalid params: outfile=%s, url=%s\n", SP(outfile), SP(url));
+        return (EUCA_INVALID_ERROR);
+    }
+
+    *not_modified = FALSE;
+    if (strncasecmp(url, "http://", 7) != 0) {
+        LOGERROR("URL must start with http://...\n");
+        return (EUCA_INVALID_ERROR);
+    }
+
+    if ((fp = fopen64(outfile, "w")) == NULL) {
+        LOGERROR("failed to open %s for writing\n", outfile);
+        return (EUCA_ACCESS_ERROR);
+    }
+    setbuf(fp, NULL);
+
+    if ((curl = curl_easy_init()) == NULL) {
+        LOGERROR("could not initialize libcurl\n");
+        fclose(fp);
+        return (EUCA_ERROR);
+    }
+
+    if (etag[0] != '\0') {
+        snprintf(header, sizeof(header), "If-None-Match: %s", etag);
+        headers = curl_slist_append(headers, header);
+    }
+    if (last_modified[0] != '\0') {
+        snprintf(header, sizeof(header), "If-Modified-Since: %s", last_modified);
+        headers = curl_slist_append(headers, header);
+    }
+
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_msg);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    if (headers) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    }
+
+    params.fp = fp;
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &params);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &validators);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_data);
+
+    if (connect_timeout > 0) {
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, connect_timeout);
+    }
+
+    if (total_timeout > 0) {
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, total_timeout);
+    }
+
+    if ((result = curl_easy_perform(curl)) != CURLE_OK) {
+        LOGERROR("%s (%d)\n", error_msg, result);
+    } else {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpcode);
+        switch (httpcode) {
+        case 200L:
+            LOGTRACE("fetched %lld bytes from %s into %s\n", params.total_wrote, url, outfile);
+            // a server that stops sending a validator must not leave a stale one behind
+            snprintf(etag, HTTP_VALIDATOR_SIZE, "%s", new_etag);
+            snprintf(last_modified, HTTP_VALIDATOR_SIZE, "%s", new_last_modified);
+            code = EUCA_OK;
+            break;
+        case 304L:
+            LOGTRACE("%s not modified since last fetch\n", url);
+            *not_modified = TRUE;
+            code = EUCA_OK;
+            break;
+        default:
+            LOGERROR("server responded with HTTP code %ld for %s\n", httpcode, url);
+            break;
+        }
+    }
+    fclose(fp);
+
+    if (code != EUCA_OK) {
+        remove(outfile);
+    }
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+    return (code);
+}
+
 #ifdef _UNIT_TEST
 //!
 //! Main entry point of the application
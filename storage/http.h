@@ -83,6 +83,8 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+#define HTTP_VALIDATOR_SIZE                      256    //!< room for an ETag or Last-Modified response header value
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  TYPEDEFS                                  |
@@ -118,6 +120,7 @@ char *url_encode(const char *unencoded);
 char *url_decode(const char *encoded);
 int http_get(const char *url, const char *outfile, boolean * bail_flag);
 int http_get_timeout(const char *url, const char *outfile, int total_retries, int first_timeout, int connect_timeout, int total_timeout, boolean * bail_flag);
+int http_get_if_changed(const char *url, const char *outfile, char *etag, char *last_modified, int connect_timeout, int total_timeout, boolean * not_modified);
 char *http_get2str(const char *url, boolean * bail_flag);
 
 /*----------------------------------------------------------------------------*\
@@ -0,0 +1,1185 @@
+// -*- mode: C; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+// vim: set softtabstop=4 shiftwidth=4 tabstop=4 expandtab:
+
+/*************************************************************************
+ * Copyright 2009-2012 Eucalyptus Systems, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ *
+ * Please contact Eucalyptus Systems, Inc., 6755 Hollister Ave., Goleta
+ * CA 93117, USA or visit http://www.eucalyptus.com/licenses/ if you need
+ * additional information or have any questions.
+ *
+ * This file may incorporate work covered under the following copyright
+ * and permission notice:
+ *
+ *   Software License Agreement (BSD License)
+ *
+ *   Copyright (c) 2008, Regents of the University of California
+ *   All rights reserved.
+ *
+ *   Redistribution and use of this software in source and binary forms,
+ *   with or without modification, are permitted provided that the
+ *   following conditions are met:
+ *
+ *     Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *     Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE. USERS OF THIS SOFTWARE ACKNOWLEDGE
+ *   THE POSSIBLE PRESENCE OF OTHER OPEN SOURCE LICENSED MATERIAL,
+ *   COPYRIGHTED MATERIAL OR PATENTED MATERIAL IN THIS SOFTWARE,
+ *   AND IF ANY SUCH MATERIAL IS DISCOVERED THE PARTY DISCOVERING
+ *   IT MAY INFORM DR. RICH WOLSKI AT THE UNIVERSITY OF CALIFORNIA,
+ *   SANTA BARBARA WHO WILL THEN ASCERTAIN THE MOST APPROPRIATE REMEDY,
+ *   WHICH IN THE REGENTS' DISCRETION MAY INCLUDE, WITHOUT LIMITATION,
+ *   REPLACEMENT OF THE CODE SO IDENTIFIED, LICENSING OF THE CODE SO
+ *   IDENTIFIED, OR WITHDRAWAL OF THE CODE CAPABILITY TO THE EXTENT
+ *   NEEDED TO COMPLY WITH ANY SUCH LICENSES OR RIGHTS.
+ ************************************************************************/
+
+//!
+//! @file storage/image_peers.c
+//! Peer-to-peer distribution of image artifacts between the nodes of a cluster.
+//!
+//! Every node with a cache blobstore runs a small HTTP range server that hands
+//! out complete, signed cache blobs by artifact identifier ("GET /<id>", always
+//! answered with at most IMAGE_PEER_CHUNK_BYTES of content). The CC tells each
+//! node which of its peers have which artifacts (the hints piggy-back on the
+//! periodic ncDescribeResource exchange) and the image creators in vbr.c try
+//! those peers before going to object storage or the CC proxy.
+//!
+//! The server listens on the cluster-facing address of the node only and
+//! answers only the nodes the CC lists as peers ("* <ip>" hints). Each artifact
+//! is keyed by the SHA-256 of the manifest digest it was built from, which
+//! vbr.c hands over with image_peers_set_digest(). A request carries an
+//! HMAC-SHA256, under that key, of the artifact, the range and a fresh nonce,
+//! so only a node that read the manifest gets the bytes. The response carries
+//! the SHA-256 of the range and an HMAC of it bound to the same nonce.
+//!
+//! This is transport integrity and mutual proof of knowledge of the digest,
+//! not a content check: the manifest digest describes the encrypted bundle,
+//! not the unbundled image, so nothing the requesting node knows independently
+//! can vouch for the bytes themselves. They are trusted because they come from
+//! a node the CC vouches for. Any mismatch or error makes the caller fall back
+//! to the regular download path.
+//!
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  INCLUDES                                  |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <curl/curl.h>
+#include <curl/easy.h>
+#include <openssl/sha.h>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+
+#include <eucalyptus.h>
+#include <misc.h>
+#include <log.h>
+#include <euca_string.h>
+
+#include "blobstore.h"
+#include "image_peers.h"
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  DEFINES                                   |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+#define IMAGE_PEER_MAX_REQUEST                  4096    //!< Largest request header the server accepts
+#define IMAGE_PEER_MAX_SIG                    262144    //!< Largest blob signature, same as MAX_ARTIFACT_SIG in vbr.h
+#define IMAGE_PEER_MAX_SOURCES                     8    //!< Most peers tried for a single artifact
+#define IMAGE_PEER_BACKLOG                        16    //!< Listen queue length of the server socket
+#define IMAGE_PEER_ID_REGEX              "^e[mkr]i-"    //!< Cache blobs worth advertising: downloaded images, kernels and ramdisks
+#define IMAGE_PEER_LIST_TTL_SEC                   30    //!< How long a listing of the cache is reused before the blobstore is scanned again
+#define IMAGE_PEER_NONCE_BYTES                    16    //!< Size of the random value a client binds each request to
+#define IMAGE_PEER_KEY_CONTEXT  "euca-image-peer-key\n"  //!< Prefix of the manifest digest when deriving an artifact key
+#define SHA256_HEX_SIZE           (SHA256_DIGEST_LENGTH * 2 + 1)    //!< Buffer size of a hex-encoded SHA-256 digest
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  TYPEDEFS                                  |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                ENUMERATIONS                                |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                 STRUCTURES                                 |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+//! A peer that, according to the CC, holds a given artifact in its cache
+typedef struct image_peer_hint_t {
+    char id[CACHED_IMAGE_ID_SIZE];     //!< Artifact identifier
+    char host[HOSTNAME_SIZE];          //!< Peer address
+    int port;                          //!< Peer image server port
+} image_peer_hint;
+
+//! The key of an artifact, derived from the manifest digest it was built from
+typedef struct image_peer_key_t {
+    char id[CACHED_IMAGE_ID_SIZE];     //!< Artifact identifier
+    char key[SHA256_HEX_SIZE];         //!< Hex-encoded SHA-256 of IMAGE_PEER_KEY_CONTEXT and the manifest digest
+    time_t last_used;                  //!< When the key was last set or used, for eviction
+} image_peer_key;
+
+//! Receive state of a single chunk request
+typedef struct image_peer_chunk_t {
+    char *buf;                         //!< Chunk buffer (IMAGE_PEER_CHUNK_BYTES long)
+    long long len;                     //!< Bytes received so far
+    long long max;                     //!< Bytes expected for this range
+    long long total;                   //!< Blob size, as reported in Content-Range
+    char chunk_sha256[SHA256_HEX_SIZE];    //!< Value of the IMAGE_PEER_HEADER_CHUNK response header
+    char proof[SHA256_HEX_SIZE];       //!< Value of the IMAGE_PEER_HEADER_PROOF response header
+} image_peer_chunk;
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                             EXTERNAL VARIABLES                             |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                              GLOBAL VARIABLES                              |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                              STATIC VARIABLES                              |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+static blobstore *peer_bs = NULL;      //!< Blobstore served to the peers (the cache)
+static int peer_port = 0;              //!< Port the server listens on (0 when not running)
+static int peer_uploads = 0;           //!< Number of requests being served
+static image_peer_hint peer_hints[IMAGE_PEER_MAX_HINTS] = { {{0}} };    //!< Latest hints received from the CC
+static int peer_hints_len = 0;         //!< Number of valid entries in peer_hints
+static char peer_cached[MAX_CACHED_IMAGES_ADVERTISED][CACHED_IMAGE_ID_SIZE] = { {0} };  //!< Last listing of the served blobs
+static int peer_cached_len = 0;        //!< Number of valid entries in peer_cached
+static time_t peer_cached_time = 0;    //!< When peer_cached was built
+static struct in_addr peer_clients[MAXNODES] = { {0} };    //!< Nodes the CC lists as peers, the only ones the server answers
+static int peer_clients_len = 0;       //!< Number of valid entries in peer_clients
+static image_peer_key peer_keys[IMAGE_PEER_MAX_KEYS] = { {{0}} };  //!< Keys of the artifacts this node built or may fetch
+static int peer_keys_len = 0;          //!< Number of valid entries in peer_keys
+static char peer_keys_path[EUCA_MAX_PATH] = "";  //!< File the keys are kept in across restarts
+static pthread_mutex_t peer_mutex = PTHREAD_MUTEX_INITIALIZER;  //!< Protects the hints, the clients, the keys, the cache listing and the upload count
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                              STATIC PROTOTYPES                             |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+static void sha256_hex(const void *data, size_t len, char *out);
+static void hmac_sha256_hex(const char *key, const char *msg, char *out);
+static boolean valid_image_id(const char *id);
+static boolean image_peer_get_key(const char *id, char *key);
+static void image_peers_load_keys(void);
+static void image_peers_save_keys(void);
+static boolean image_peer_client_allowed(struct in_addr addr);
+static int send_all(int fd, const char *buf, size_t len);
+static void send_status(int fd, int code, const char *reason);
+static void *image_peer_upload(void *arg);
+static void *image_peer_server(void *arg);
+static int compare_last_accessed(const void *a, const void *b);
+static size_t image_peer_header(char *buffer, size_t size, size_t nmemb, void *params);
+static size_t image_peer_body(void *buffer, size_t size, size_t nmemb, void *params);
+static int image_peer_fetch_from(const image_peer_hint * peer, const char *key, unsigned long long size_bytes, int fd, char *buf);
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                   MACROS                                   |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                               IMPLEMENTATION                               |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+//!
+//! Computes the hex-encoded SHA-256 digest of a buffer
+//!
+//! @param[in]  data the buffer to digest
+//! @param[in]  len the length of the buffer
+//! @param[out] out the resulting string, SHA256_HEX_SIZE long
+//!
+static void sha256_hex(const void *data, size_t len, char *out)
+{
+    int i = 0;
+    unsigned char md[SHA256_DIGEST_LENGTH] = { 0 };
+
+    SHA256((const unsigned char *)data, len, md);
+    for (i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        snprintf(out + (i * 2), 3, "%02x", md[i]);
+    }
+}
+
+//!
+//! Computes the hex-encoded HMAC-SHA256 of a string
+//!
+//! @param[in]  key the key (a hex-encoded artifact key)
+//! @param[in]  msg the message to authenticate
+//! @param[out] out the resulting string, SHA256_HEX_SIZE long
+//!
+static void hmac_sha256_hex(const char *key, const char *msg, char *out)
+{
+    int i = 0;
+    unsigned int md_len = 0;
+    unsigned char md[EVP_MAX_MD_SIZE] = { 0 };
+
+    HMAC(EVP_sha256(), key, strlen(key), (const unsigned char *)msg, strlen(msg), md, &md_len);
+    for (i = 0; (i < SHA256_DIGEST_LENGTH) && (i < (int)md_len); i++) {
+        snprintf(out + (i * 2), 3, "%02x", md[i]);
+    }
+}
+
+//!
+//! Checks that a requested artifact identifier is a plain blob name
+//!
+//! @param[in] id the identifier to check
+//!
+//! @return TRUE if the identifier can be looked up in the blobstore, FALSE otherwise
+//!
+static boolean valid_image_id(const char *id)
+{
+    const char *p = NULL;
+
+    if ((id == NULL) || (id[0] == '\0') || (id[0] == '.') || (strlen(id) >= CACHED_IMAGE_ID_SIZE))
+        return (FALSE);
+
+    for (p = id; *p; p++) {
+        if (!isalnum(*p) && (*p != '-') && (*p != '_') && (*p != '.'))
+            return (FALSE);
+    }
+    return (TRUE);
+}
+
+//!
+//! Looks up the key of an artifact
+//!
+//! @param[in]  id the artifact identifier
+//! @param[out] key the key, SHA256_HEX_SIZE long
+//!
+//! @return TRUE if the key is known, FALSE otherwise
+//!
+static boolean image_peer_get_key(const char *id, char *key)
+{
+    int i = 0;
+    boolean found = FALSE;
+
+    pthread_mutex_lock(&peer_mutex);
+    {
+        for (i = 0; i < peer_keys_len; i++) {
+            if (!strcmp(peer_keys[i].id, id)) {
+                euca_strncpy(key, peer_keys[i].key, SHA256_HEX_SIZE);
+                peer_keys[i].last_used = time(NULL);
+                found = TRUE;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&peer_mutex);
+    return (found);
+}
+
+//!
+//! Reads the artifact keys saved by a previous run, one "<artifact-id> <key>"
+//! per line
+//!
+static void image_peers_load_keys(void)
+{
+    FILE *fp = NULL;
+    image_peer_key entry = { {0} };
+
+    if ((fp = fopen(peer_keys_path, "r")) == NULL)
+        return;
+
+    pthread_mutex_lock(&peer_mutex);
+    {
+        while ((peer_keys_len < IMAGE_PEER_MAX_KEYS) && (fscanf(fp, "%47s %64s", entry.id, entry.key) == 2)) {
+            if (valid_image_id(entry.id) && (strlen(entry.key) == (SHA256_HEX_SIZE - 1))) {
+                entry.last_used = time(NULL);
+                peer_keys[peer_keys_len++] = entry;
+            }
+        }
+    }
+    pthread_mutex_unlock(&peer_mutex);
+
+    fclose(fp);
+    LOGDEBUG("loaded %d image peer keys from %s\n", peer_keys_len, peer_keys_path);
+}
+
+//!
+//! Saves the artifact keys so that the blobs in the cache can still be served
+//! after a restart. Caller must hold peer_mutex.
+//!
+static void image_peers_save_keys(void)
+{
+    int i = 0;
+    int fd = -1;
+    FILE *fp = NULL;
+    char tmp_path[EUCA_MAX_PATH + 8] = "";
+
+    if (peer_keys_path[0] == '\0')
+        return;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", peer_keys_path);
+    if (((fd = open(tmp_path, (O_WRONLY | O_CREAT | O_TRUNC), 0600)) < 0) || ((fp = fdopen(fd, "w")) == NULL)) {
+        LOGWARN("failed to save image peer keys to %s: %s\n", tmp_path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    for (i = 0; i < peer_keys_len; i++) {
+        fprintf(fp, "%s %s\n", peer_keys[i].id, peer_keys[i].key);
+    }
+
+    if ((fclose(fp) != 0) || (rename(tmp_path, peer_keys_path) != 0)) {
+        LOGWARN("failed to save image peer keys to %s: %s\n", peer_keys_path, strerror(errno));
+        unlink(tmp_path);
+    }
+}
+
+//!
+//! Checks whether a connecting node is one the CC lists as a peer
+//!
+//! @param[in] addr the address the connection comes from
+//!
+//! @return TRUE if the node may fetch images from us, FALSE otherwise
+//!
+static boolean image_peer_client_allowed(struct in_addr addr)
+{
+    int i = 0;
+    boolean allowed = FALSE;
+
+    pthread_mutex_lock(&peer_mutex);
+    {
+        for (i = 0; (i < peer_clients_len) && !allowed; i++) {
+            allowed = (peer_clients[i].s_addr == addr.s_addr);
+        }
+    }
+    pthread_mutex_unlock(&peer_mutex);
+    return (allowed);
+}
+
+//!
+//! Writes a whole buffer to a socket
+//!
+//! @param[in] fd the socket
+//! @param[in] buf the data to send
+//! @param[in] len the length of the data
+//!
+//! @return EUCA_OK on success or EUCA_ERROR if the peer went away or timed out
+//!
+static int send_all(int fd, const char *buf, size_t len)
+{
+    ssize_t sent = 0;
+
+    while (len > 0) {
+        if ((sent = send(fd, buf, len, MSG_NOSIGNAL)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return (EUCA_ERROR);
+        }
+        buf += sent;
+        len -= sent;
+    }
+    return (EUCA_OK);
+}
+
+//!
+//! Sends an HTTP response without a body
+//!
+//! @param[in] fd the socket
+//! @param[in] code the HTTP status code
+//! @param[in] reason the HTTP reason phrase
+//!
+static void send_status(int fd, int code, const char *reason)
+{
+    char hdr[256] = "";
+
+    snprintf(hdr, sizeof(hdr), "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", code, reason);
+    send_all(fd, hdr, strlen(hdr));
+}
+
+//!
+//! Serves a single range request from a peer. Only complete blobs that were
+//! created with a signature, and whose key we know, are served: a blob being
+//! created is locked by its creator and cannot be opened until it is done.
+//!
+//! @param[in] arg the connected socket, cast to a pointer
+//!
+//! @return Always NULL
+//!
+static void *image_peer_upload(void *arg)
+{
+    int fd = (int)((long)arg);
+    int blocks_fd = -1;
+    ssize_t got = 0;
+    size_t req_len = 0;
+    long long start = 0;
+    long long end = -1;
+    long long len = 0;
+    long long done = 0;
+    unsigned long long size = 0;
+    char req[IMAGE_PEER_MAX_REQUEST] = "";
+    char id[CACHED_IMAGE_ID_SIZE] = "";
+    char key[SHA256_HEX_SIZE] = "";
+    char nonce[(IMAGE_PEER_NONCE_BYTES * 2) + 1] = "";
+    char proof[SHA256_HEX_SIZE] = "";
+    char expected[SHA256_HEX_SIZE] = "";
+    char chunk_sha256[SHA256_HEX_SIZE] = "";
+    char msg[256] = "";
+    char hdr[1024] = "";
+    char *field = NULL;
+    char *sig = NULL;
+    char *buf = NULL;
+    const char *blocks_path = NULL;
+    blockblob *bb = NULL;
+    struct timeval tv = { IMAGE_PEER_IO_TIMEOUT_SEC, 0 };
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // read the request header
+    while (strstr(req, "\r\n\r\n") == NULL) {
+        if (req_len >= (sizeof(req) - 1)) {
+            send_status(fd, 400, "Bad Request");
+            goto cleanup;
+        }
+        if ((got = recv(fd, req + req_len, sizeof(req) - 1 - req_len, 0)) <= 0) {
+            if ((got < 0) && (errno == EINTR))
+                continue;
+            goto cleanup;
+        }
+        req_len += got;
+        req[req_len] = '\0';
+    }
+
+    if ((sscanf(req, "GET /%47[^ ] HTTP/", id) != 1) || !valid_image_id(id)) {
+        send_status(fd, 400, "Bad Request");
+        goto cleanup;
+    }
+    // peers always ask for an explicit range and prove they know the manifest digest
+    if (((field = strcasestr(req, "\r\nRange: bytes=")) == NULL) || (sscanf(field + strlen("\r\nRange: bytes="), "%lld-%lld", &start, &end) != 2)
+        || ((field = strcasestr(req, "\r\n" IMAGE_PEER_HEADER_NONCE ": ")) == NULL)
+        || (sscanf(field + strlen("\r\n" IMAGE_PEER_HEADER_NONCE ": "), "%32[0-9a-f]", nonce) != 1)
+        || ((field = strcasestr(req, "\r\n" IMAGE_PEER_HEADER_PROOF ": ")) == NULL)
+        || (sscanf(field + strlen("\r\n" IMAGE_PEER_HEADER_PROOF ": "), "%64[0-9a-f]", proof) != 1)) {
+        send_status(fd, 400, "Bad Request");
+        goto cleanup;
+    }
+
+    if (!image_peer_get_key(id, key)) {
+        // we cannot tell whether the requester read the manifest
+        send_status(fd, 404, "Not Found");
+        goto cleanup;
+    }
+    snprintf(msg, sizeof(msg), "%s %lld-%lld %s", id, start, end, nonce);
+    hmac_sha256_hex(key, msg, expected);
+    if ((strlen(proof) != strlen(expected)) || CRYPTO_memcmp(proof, expected, strlen(expected))) {
+        LOGWARN("refused %s to a peer that does not know its manifest digest\n", id);
+        send_status(fd, 403, "Forbidden");
+        goto cleanup;
+    }
+
+    if ((bb = blockblob_open(peer_bs, id, 0, 0, NULL, IMAGE_PEER_OPEN_TIMEOUT_USEC)) == NULL) {
+        if (blobstore_get_error() == BLOBSTORE_ERROR_NOENT) {
+            send_status(fd, 404, "Not Found");
+        } else {
+            send_status(fd, 503, "Service Unavailable");
+        }
+        goto cleanup;
+    }
+
+    if (((sig = EUCA_ALLOC(IMAGE_PEER_MAX_SIG, sizeof(char))) == NULL) || (blockblob_get_sig(bb, sig, IMAGE_PEER_MAX_SIG) < 1)
+        || ((blocks_path = blockblob_get_file(bb)) == NULL)) {
+        // not a complete downloaded image, or not a plain file
+        send_status(fd, 404, "Not Found");
+        goto cleanup;
+    }
+
+    size = blockblob_get_size_bytes(bb);
+    if ((start < 0) || ((unsigned long long)start >= size) || (end < start)) {
+        send_status(fd, 416, "Requested Range Not Satisfiable");
+        goto cleanup;
+    }
+    if ((unsigned long long)end >= size)
+        end = size - 1;
+    if ((end - start + 1) > IMAGE_PEER_CHUNK_BYTES)
+        end = start + IMAGE_PEER_CHUNK_BYTES - 1;
+    len = end - start + 1;
+
+    if (((buf = EUCA_ALLOC(len, sizeof(char))) == NULL) || ((blocks_fd = open(blocks_path, O_RDONLY)) < 0)) {
+        send_status(fd, 500, "Internal Server Error");
+        goto cleanup;
+    }
+    for (done = 0; done < len; done += got) {
+        if ((got = pread(blocks_fd, buf + done, len - done, start + done)) <= 0) {
+            if ((got < 0) && (errno == EINTR)) {
+                got = 0;
+                continue;
+            }
+            LOGWARN("failed to read %s for a peer: %s\n", id, ((got < 0) ? strerror(errno) : "short file"));
+            send_status(fd, 500, "Internal Server Error");
+            goto cleanup;
+        }
+    }
+    close(blocks_fd);
+    blocks_fd = -1;
+
+    // the data is in memory, let other users of the blob at it while we send
+    blockblob_close(bb);
+    bb = NULL;
+
+    sha256_hex(buf, len, chunk_sha256);
+    snprintf(msg, sizeof(msg), "%s %lld-%lld/%llu %s", nonce, start, end, size, chunk_sha256);
+    hmac_sha256_hex(key, msg, proof);
+    snprintf(hdr, sizeof(hdr), "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\nContent-Length: %lld\r\n"
+             "Content-Range: bytes %lld-%lld/%llu\r\n%s: %s\r\n%s: %s\r\nConnection: close\r\n\r\n", len, start, end, size,
+             IMAGE_PEER_HEADER_CHUNK, chunk_sha256, IMAGE_PEER_HEADER_PROOF, proof);
+    if ((send_all(fd, hdr, strlen(hdr)) == EUCA_OK) && (send_all(fd, buf, len) == EUCA_OK)) {
+        LOGTRACE("served %s bytes %lld-%lld to a peer\n", id, start, end);
+    }
+
+cleanup:
+    if (blocks_fd >= 0)
+        close(blocks_fd);
+    if (bb)
+        blockblob_close(bb);
+    EUCA_FREE(buf);
+    EUCA_FREE(sig);
+    close(fd);
+
+    pthread_mutex_lock(&peer_mutex);
+    peer_uploads--;
+    pthread_mutex_unlock(&peer_mutex);
+    return (NULL);
+}
+
+//!
+//! Accepts peer connections and hands each one to a detached upload thread.
+//! Connections from nodes the CC does not list as peers are turned away.
+//!
+//! @param[in] arg the listening socket, cast to a pointer
+//!
+//! @return Always NULL (never returns unless accept fails permanently)
+//!
+static void *image_peer_server(void *arg)
+{
+    int sock = (int)((long)arg);
+    int fd = -1;
+    boolean busy = FALSE;
+    char client_ip[INET_ADDRSTRLEN] = "";
+    socklen_t client_len = 0;
+    struct sockaddr_in client = { 0 };
+    pthread_t tid = { 0 };
+    pthread_attr_t tattr = { {0} };
+
+    pthread_attr_init(&tattr);
+    pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED);
+
+    for (;;) {
+        client_len = sizeof(client);
+        if ((fd = accept(sock, (struct sockaddr *)&client, &client_len)) < 0) {
+            if ((errno == EINTR) || (errno == ECONNABORTED) || (errno == EMFILE) || (errno == ENFILE)) {
+                if ((errno == EMFILE) || (errno == ENFILE))
+                    sleep(1);
+                continue;
+            }
+            LOGERROR("image peer server stopped accepting connections: %s\n", strerror(errno));
+            break;
+        }
+
+        if ((client.sin_family != AF_INET) || !image_peer_client_allowed(client.sin_addr)) {
+            LOGDEBUG("refused image peer connection from %s\n", inet_ntop(AF_INET, &client.sin_addr, client_ip, sizeof(client_ip)));
+            close(fd);
+            continue;
+        }
+
+        pthread_mutex_lock(&peer_mutex);
+        {
+            if ((busy = (peer_uploads >= IMAGE_PEER_MAX_UPLOADS)) == FALSE)
+                peer_uploads++;
+        }
+        pthread_mutex_unlock(&peer_mutex);
+
+        if (busy) {
+            // the requesting peer will move on to another source
+            send_status(fd, 503, "Service Unavailable");
+            close(fd);
+            continue;
+        }
+
+        if (pthread_create(&tid, &tattr, image_peer_upload, (void *)((long)fd)) != 0) {
+            LOGWARN("failed to spawn an image peer upload thread\n");
+            close(fd);
+            pthread_mutex_lock(&peer_mutex);
+            peer_uploads--;
+            pthread_mutex_unlock(&peer_mutex);
+        }
+    }
+
+    pthread_attr_destroy(&tattr);
+    close(sock);
+    peer_port = 0;
+    return (NULL);
+}
+
+//!
+//! Starts serving the blobs of the given blobstore to the peers of this node
+//!
+//! @param[in] bs the blobstore to serve (the cache)
+//! @param[in] keys_path the file the artifact keys are kept in across restarts
+//! @param[in] bind_ip the cluster-facing address of this node, the only one the server listens on
+//! @param[in] port the TCP port to listen on, 0 to leave peer distribution disabled
+//!
+//! @return EUCA_OK on success (or when disabled) or EUCA_ERROR on failure
+//!
+//! @pre \p bs, \p keys_path and \p bind_ip must be valid whenever \p port is set
+//!
+//! @post On success, image_peers_port() reports the port and image_peers_list_cached() lists \p bs
+//!
+int image_peers_start(blobstore * bs, const char *keys_path, const char *bind_ip, int port)
+{
+    int sock = -1;
+    int on = 1;
+    pthread_t tid = { 0 };
+    struct sockaddr_in addr = { 0 };
+
+    if (port <= 0)
+        return (EUCA_OK);
+
+    if (bs == NULL) {
+        LOGWARN("peer image distribution needs a cache, not serving images to peers\n");
+        return (EUCA_ERROR);
+    }
+
+    if (peer_port > 0)
+        return (EUCA_OK);
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if ((bind_ip == NULL) || (keys_path == NULL) || (inet_pton(AF_INET, bind_ip, &addr.sin_addr) != 1)) {
+        LOGERROR("invalid address '%s' for the image peer server\n", SP(bind_ip));
+        return (EUCA_ERROR);
+    }
+
+    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        LOGERROR("failed to create the image peer server socket: %s\n", strerror(errno));
+        return (EUCA_ERROR);
+    }
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if ((bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(sock, IMAGE_PEER_BACKLOG) < 0)) {
+        LOGERROR("failed to listen for image peers on %s:%d: %s\n", bind_ip, port, strerror(errno));
+        close(sock);
+        return (EUCA_ERROR);
+    }
+
+    euca_strncpy(peer_keys_path, keys_path, sizeof(peer_keys_path));
+    image_peers_load_keys();
+
+    peer_bs = bs;
+    peer_port = port;
+    if (pthread_create(&tid, NULL, image_peer_server, (void *)((long)sock)) != 0) {
+        LOGERROR("failed to spawn the image peer server thread\n");
+        peer_port = 0;
+        close(sock);
+        return (EUCA_ERROR);
+    }
+    pthread_detach(tid);
+
+    LOGINFO("serving cached images to peers on %s:%d\n", bind_ip, port);
+    return (EUCA_OK);
+}
+
+//!
+//! Returns the port of the image peer server
+//!
+//! @return the port or 0 if this node does not serve images to its peers
+//!
+int image_peers_port(void)
+{
+    return (peer_port);
+}
+
+//!
+//! Orders blob metadata from the most to the least recently accessed
+//!
+//! @param[in] a pointer to the first blockblob_meta pointer
+//! @param[in] b pointer to the second blockblob_meta pointer
+//!
+//! @return a negative, zero or positive value as for qsort()
+//!
+static int compare_last_accessed(const void *a, const void *b)
+{
+    const blockblob_meta *ma = *((const blockblob_meta **)a);
+    const blockblob_meta *mb = *((const blockblob_meta **)b);
+
+    if (ma->last_accessed == mb->last_accessed)
+        return (0);
+    return ((ma->last_accessed > mb->last_accessed) ? -1 : 1);
+}
+
+//!
+//! Lists the image artifacts this node can serve, most recently used first.
+//! The blobstore is scanned at most every IMAGE_PEER_LIST_TTL_SEC seconds.
+//!
+//! @param[out] ids the artifact identifiers
+//! @param[in]  max_ids the capacity of \p ids
+//!
+//! @return the number of identifiers written to \p ids
+//!
+int image_peers_list_cached(char ids[][CACHED_IMAGE_ID_SIZE], int max_ids)
+{
+    int i = 0;
+    int found = 0;
+    int count = 0;
+    time_t now = time(NULL);
+    blockblob_meta *matches = NULL;
+    blockblob_meta *bm = NULL;
+    blockblob_meta *next = NULL;
+    blockblob_meta **sorted = NULL;
+
+    if ((peer_port <= 0) || (peer_bs == NULL) || (max_ids <= 0))
+        return (0);
+
+    pthread_mutex_lock(&peer_mutex);
+    {
+        if ((now - peer_cached_time) >= IMAGE_PEER_LIST_TTL_SEC) {
+            peer_cached_len = 0;
+            peer_cached_time = now;
+            if ((found = blobstore_search(peer_bs, IMAGE_PEER_ID_REGEX, &matches)) > 0) {
+                if ((sorted = EUCA_ZALLOC(found, sizeof(blockblob_meta *))) != NULL) {
+                    for (bm = matches, i = 0; bm && (i < found); bm = bm->next) {
+                        // hollow blobs have no content and blobs being created are not complete yet
+                        if (!bm->is_hollow && !(bm->in_use & BLOCKBLOB_STATUS_LOCKED) && (strlen(bm->id) < CACHED_IMAGE_ID_SIZE))
+                            sorted[i++] = bm;
+                    }
+                    qsort(sorted, i, sizeof(blockblob_meta *), compare_last_accessed);
+                    for (peer_cached_len = 0; (peer_cached_len < i) && (peer_cached_len < MAX_CACHED_IMAGES_ADVERTISED); peer_cached_len++) {
+                        euca_strncpy(peer_cached[peer_cached_len], sorted[peer_cached_len]->id, CACHED_IMAGE_ID_SIZE);
+                    }
+                    EUCA_FREE(sorted);
+                }
+            }
+            for (bm = matches; bm; bm = next) {
+                next = bm->next;
+                EUCA_FREE(bm);
+            }
+        }
+
+        for (count = 0; (count < peer_cached_len) && (count < max_ids); count++) {
+            euca_strncpy(ids[count], peer_cached[count], CACHED_IMAGE_ID_SIZE);
+        }
+    }
+    pthread_mutex_unlock(&peer_mutex);
+
+    return (count);
+}
+
+//!
+//! Replaces the "who has image X" hints of this node. Each hint is formatted
+//! as "<artifact-id> <host>:<port>". Hints formatted as "* <ip>" list the
+//! nodes of the cluster, which are the only ones allowed to fetch from us.
+//!
+//! @param[in] hints the list of hints provided by the CC
+//! @param[in] hintsLen the number of hints in the list
+//!
+//! @return EUCA_OK
+//!
+int image_peers_set_hints(char **hints, int hintsLen)
+{
+    int i = 0;
+    char ip[INET_ADDRSTRLEN] = "";
+    image_peer_hint hint = { {0} };
+
+    pthread_mutex_lock(&peer_mutex);
+    {
+        peer_hints_len = 0;
+        peer_clients_len = 0;
+        for (i = 0; i < hintsLen; i++) {
+            if (hints[i] == NULL)
+                continue;
+
+            if (!strncmp(hints[i], "* ", 2)) {
+                if ((peer_clients_len < MAXNODES) && (sscanf(hints[i] + 2, "%15s", ip) == 1) && (inet_pton(AF_INET, ip, &peer_clients[peer_clients_len]) == 1))
+                    peer_clients_len++;
+                continue;
+            }
+
+            if ((peer_hints_len >= IMAGE_PEER_MAX_HINTS) || (sscanf(hints[i], "%47s %255[^:]:%d", hint.id, hint.host, &hint.port) != 3))
+                continue;
+            if (!valid_image_id(hint.id) || (hint.port <= 0))
+                continue;
+            peer_hints[peer_hints_len++] = hint;
+        }
+    }
+    pthread_mutex_unlock(&peer_mutex);
+
+    LOGTRACE("received %d image peer hints for %d peers\n", peer_hints_len, peer_clients_len);
+    return (EUCA_OK);
+}
+
+//!
+//! Remembers the manifest digest an artifact is built from. Only nodes that
+//! know the digest can fetch the artifact from us, and we only fetch it from
+//! nodes that know it too. The least recently used key is forgotten when
+//! IMAGE_PEER_MAX_KEYS artifacts are known.
+//!
+//! @param[in] id the artifact identifier
+//! @param[in] digest the manifest digest the artifact is built from
+//!
+//! @return EUCA_OK on success or EUCA_INVALID_ERROR if an argument is invalid
+//!
+int image_peers_set_digest(const char *id, const char *digest)
+{
+    int i = 0;
+    int slot = -1;
+    char *material = NULL;
+    char key[SHA256_HEX_SIZE] = "";
+
+    if (peer_port <= 0)
+        return (EUCA_OK);
+
+    if (!valid_image_id(id) || (digest == NULL))
+        return (EUCA_INVALID_ERROR);
+
+    if ((material = EUCA_ALLOC(strlen(IMAGE_PEER_KEY_CONTEXT) + strlen(digest) + 1, sizeof(char))) == NULL)
+        return (EUCA_MEMORY_ERROR);
+    sprintf(material, "%s%s", IMAGE_PEER_KEY_CONTEXT, digest);
+    sha256_hex(material, strlen(material), key);
+    EUCA_FREE(material);
+
+    pthread_mutex_lock(&peer_mutex);
+    {
+        for (i = 0; i < peer_keys_len; i++) {
+            if (!strcmp(peer_keys[i].id, id)) {
+                slot = i;
+                break;
+            }
+            if ((slot < 0) || (peer_keys[i].last_used < peer_keys[slot].last_used))
+                slot = i;
+        }
+        if ((i == peer_keys_len) && (peer_keys_len < IMAGE_PEER_MAX_KEYS))
+            slot = peer_keys_len++;
+
+        peer_keys[slot].last_used = time(NULL);
+        if (strcmp(peer_keys[slot].id, id) || strcmp(peer_keys[slot].key, key)) {
+            euca_strncpy(peer_keys[slot].id, id, sizeof(peer_keys[slot].id));
+            euca_strncpy(peer_keys[slot].key, key, sizeof(peer_keys[slot].key));
+            image_peers_save_keys();
+        }
+    }
+    pthread_mutex_unlock(&peer_mutex);
+    return (EUCA_OK);
+}
+
+//!
+//! libcurl header handler, picks up the verification headers and the blob size
+//!
+//! @param[in] buffer the header line (not NULL-terminated)
+//! @param[in] size the size of each element
+//! @param[in] nmemb the number of elements
+//! @param[in] params the image_peer_chunk being received
+//!
+//! @return the number of bytes consumed
+//!
+static size_t image_peer_header(char *buffer, size_t size, size_t nmemb, void *params)
+{
+    size_t len = size * nmemb;
+    long long first = 0;
+    long long last = 0;
+    char line[256] = "";
+    char *value = NULL;
+    image_peer_chunk *chunk = (image_peer_chunk *) params;
+
+    if (len >= sizeof(line))
+        return (len);
+    memcpy(line, buffer, len);
+    line[len] = '\0';
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if ((value = strchr(line, ':')) == NULL)
+        return (len);
+    *value++ = '\0';
+    while (*value == ' ')
+        value++;
+
+    if (!strcasecmp(line, IMAGE_PEER_HEADER_CHUNK)) {
+        euca_strncpy(chunk->chunk_sha256, value, sizeof(chunk->chunk_sha256));
+    } else if (!strcasecmp(line, IMAGE_PEER_HEADER_PROOF)) {
+        euca_strncpy(chunk->proof, value, sizeof(chunk->proof));
+    } else if (!strcasecmp(line, "Content-Range")) {
+        if (sscanf(value, "bytes %lld-%lld/%lld", &first, &last, &chunk->total) != 3)
+            chunk->total = -1;
+    }
+    return (len);
+}
+
+//!
+//! libcurl write handler, collects the range into the chunk buffer
+//!
+//! @param[in] buffer the received data
+//! @param[in] size the size of each element
+//! @param[in] nmemb the number of elements
+//! @param[in] params the image_peer_chunk being received
+//!
+//! @return the number of bytes consumed. Anything beyond the requested range aborts the transfer.
+//!
+static size_t image_peer_body(void *buffer, size_t size, size_t nmemb, void *params)
+{
+    size_t len = size * nmemb;
+    image_peer_chunk *chunk = (image_peer_chunk *) params;
+
+    if ((chunk->len + (long long)len) > chunk->max)
+        return (0);
+    memcpy(chunk->buf + chunk->len, buffer, len);
+    chunk->len += len;
+    return (len);
+}
+
+//!
+//! Fetches a whole artifact from one peer, chunk by chunk. Every request proves
+//! we know the manifest digest and every response must prove the peer does too.
+//!
+//! @param[in] peer the peer to fetch from
+//! @param[in] key the key of the artifact (see image_peers_set_digest())
+//! @param[in] size_bytes the expected size of the artifact
+//! @param[in] fd the destination file
+//! @param[in] buf a buffer of IMAGE_PEER_CHUNK_BYTES bytes
+//!
+//! @return EUCA_OK on success or EUCA_ERROR if the peer could not provide an intact copy
+//!
+static int image_peer_fetch_from(const image_peer_hint * peer, const char *key, unsigned long long size_bytes, int fd, char *buf)
+{
+    int i = 0;
+    int ret = EUCA_ERROR;
+    long httpcode = 0L;
+    ssize_t wrote = 0;
+    long long offset = 0;
+    long long done = 0;
+    unsigned char nonce_bytes[IMAGE_PEER_NONCE_BYTES] = { 0 };
+    char nonce[(IMAGE_PEER_NONCE_BYTES * 2) + 1] = "";
+    char url[512] = "";
+    char range[64] = "";
+    char msg[256] = "";
+    char proof[SHA256_HEX_SIZE] = "";
+    char nonce_hdr[128] = "";
+    char proof_hdr[128] = "";
+    char chunk_sha256[SHA256_HEX_SIZE] = "";
+    char error_msg[CURL_ERROR_SIZE] = "";
+    CURL *curl = NULL;
+    CURLcode result = CURLE_OK;
+    struct curl_slist *headers = NULL;
+    image_peer_chunk chunk = { 0 };
+
+    if ((curl = curl_easy_init()) == NULL) {
+        LOGERROR("could not initialize libcurl\n");
+        return (EUCA_ERROR);
+    }
+
+    snprintf(url, sizeof(url), "http://%s:%d/%s", peer->host, peer->port, peer->id);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_msg);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long)IMAGE_PEER_IO_TIMEOUT_SEC);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, image_peer_header);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &chunk);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, image_peer_body);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &chunk);
+
+    for (offset = 0; offset < (long long)size_bytes; offset += chunk.len) {
+        bzero(&chunk, sizeof(chunk));
+        chunk.buf = buf;
+        chunk.max = (((long long)size_bytes - offset) > IMAGE_PEER_CHUNK_BYTES) ? IMAGE_PEER_CHUNK_BYTES : ((long long)size_bytes - offset);
+        chunk.total = -1;
+        snprintf(range, sizeof(range), "%lld-%lld", offset, (offset + chunk.max - 1));
+        curl_easy_setopt(curl, CURLOPT_RANGE, range);
+
+        if (RAND_bytes(nonce_bytes, sizeof(nonce_bytes)) != 1) {
+            LOGERROR("failed to generate a nonce for %s\n", peer->id);
+            goto cleanup;
+        }
+        for (i = 0; i < IMAGE_PEER_NONCE_BYTES; i++) {
+            snprintf(nonce + (i * 2), 3, "%02x", nonce_bytes[i]);
+        }
+        snprintf(msg, sizeof(msg), "%s %s %s", peer->id, range, nonce);
+        hmac_sha256_hex(key, msg, proof);
+        snprintf(nonce_hdr, sizeof(nonce_hdr), "%s: %s", IMAGE_PEER_HEADER_NONCE, nonce);
+        snprintf(proof_hdr, sizeof(proof_hdr), "%s: %s", IMAGE_PEER_HEADER_PROOF, proof);
+        curl_slist_free_all(headers);
+        headers = curl_slist_append(curl_slist_append(NULL, nonce_hdr), proof_hdr);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+        if ((result = curl_easy_perform(curl)) != CURLE_OK) {
+            LOGWARN("failed to fetch %s from peer %s:%d: %s (%d)\n", peer->id, peer->host, peer->port, error_msg, result);
+            goto cleanup;
+        }
+
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpcode);
+        if (httpcode != 206L) {
+            LOGDEBUG("peer %s:%d responded with HTTP code %ld for %s\n", peer->host, peer->port, httpcode, peer->id);
+            goto cleanup;
+        }
+
+        if ((chunk.total != (long long)size_bytes) || (chunk.len != chunk.max)) {
+            LOGWARN("peer %s:%d holds a different %s, not using it\n", peer->host, peer->port, peer->id);
+            goto cleanup;
+        }
+
+        sha256_hex(chunk.buf, chunk.len, chunk_sha256);
+        snprintf(msg, sizeof(msg), "%s %s/%llu %s", nonce, range, size_bytes, chunk_sha256);
+        hmac_sha256_hex(key, msg, proof);
+        if (strcmp(chunk.chunk_sha256, chunk_sha256) || (strlen(chunk.proof) != strlen(proof)) || CRYPTO_memcmp(chunk.proof, proof, strlen(proof))) {
+            LOGWARN("integrity check failed on %s range %s from peer %s:%d\n", peer->id, range, peer->host, peer->port);
+            goto cleanup;
+        }
+
+        for (done = 0; done < chunk.len; done += wrote) {
+            if ((wrote = pwrite(fd, chunk.buf + done, chunk.len - done, offset + done)) <= 0) {
+                if ((wrote < 0) && (errno == EINTR)) {
+                    wrote = 0;
+                    continue;
+                }
+                LOGERROR("failed to write %s fetched from a peer: %s\n", peer->id, strerror(errno));
+                goto cleanup;
+            }
+        }
+    }
+    ret = EUCA_OK;
+
+cleanup:
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+    return (ret);
+}
+
+//!
+//! Tries to fetch an artifact from the peers that, according to the CC, have
+//! it in their cache. Peers are tried in turn, starting at a random one so that
+//! the load of a fleet-wide rollout spreads across all holders.
+//!
+//! @param[in] id the artifact identifier
+//! @param[in] size_bytes the size of the artifact
+//! @param[in] dest_path the file to write the artifact to
+//!
+//! @return EUCA_OK on success or the following error codes:
+//!         \li EUCA_NOT_FOUND_ERROR: if no peer is known to have the artifact or its digest is unknown
+//!         \li EUCA_ERROR: if none of the peers could provide an intact copy
+//!
+//! @pre \p dest_path must exist and be at least \p size_bytes long (a blob's blocks file)
+//! @pre image_peers_set_digest() must have been called for \p id
+//!
+int image_peers_fetch(const char *id, unsigned long long size_bytes, const char *dest_path)
+{
+    int i = 0;
+    int fd = -1;
+    int first = 0;
+    int num_sources = 0;
+    int ret = EUCA_ERROR;
+    char key[SHA256_HEX_SIZE] = "";
+    char *buf = NULL;
+    image_peer_hint sources[IMAGE_PEER_MAX_SOURCES] = { {{0}} };
+
+    if ((id == NULL) || (dest_path == NULL) || (size_bytes == 0) || !image_peer_get_key(id, key))
+        return (EUCA_NOT_FOUND_ERROR);
+
+    pthread_mutex_lock(&peer_mutex);
+    {
+        for (i = 0; (i < peer_hints_len) && (num_sources < IMAGE_PEER_MAX_SOURCES); i++) {
+            if (!strcmp(peer_hints[i].id, id))
+                sources[num_sources++] = peer_hints[i];
+        }
+    }
+    pthread_mutex_unlock(&peer_mutex);
+
+    if (num_sources == 0)
+        return (EUCA_NOT_FOUND_ERROR);
+
+    if ((buf = EUCA_ALLOC(IMAGE_PEER_CHUNK_BYTES, sizeof(char))) == NULL) {
+        LOGERROR("out of memory\n");
+        return (EUCA_ERROR);
+    }
+
+    if ((fd = open(dest_path, O_WRONLY)) < 0) {
+        LOGERROR("failed to open %s for writing: %s\n", dest_path, strerror(errno));
+        EUCA_FREE(buf);
+        return (EUCA_ERROR);
+    }
+
+    first = rand() % num_sources;
+    for (i = 0; i < num_sources; i++) {
+        image_peer_hint *peer = &sources[(first + i) % num_sources];
+        LOGDEBUG("fetching %s from peer %s:%d\n", id, peer->host, peer->port);
+        if ((ret = image_peer_fetch_from(peer, key, size_bytes, fd, buf)) == EUCA_OK) {
+            LOGINFO("fetched %s (%llu bytes) from peer %s:%d\n", id, size_bytes, peer->host, peer->port);
+            break;
+        }
+    }
+
+    close(fd);
+    EUCA_FREE(buf);
+    return (ret);
+}
@@ -106,6 +106,18 @@
 #define DISCONNECT_TIMEOUT                        600
 #define GET_TIMEOUT                                60
 
+//! @{
+//! @name Layout of the connection string handed out by the SC
+//! <protocol>,<provider>,<user>,<auth_mode>,<lun>,<password>,<netdev0>,<ip0>,<store0>,<netdev1>,<ip1>,<store1>,...
+#define DEV_STRING_PROTOCOL_FIELD                   0
+#define DEV_STRING_PASSWORD_FIELD                   5
+#define DEV_STRING_PATHS_FIELD                      6
+#define DEV_STRING_FIELDS_PER_PATH                  3
+//! @}
+
+#define PROTOCOL_RBD                            "rbd"
+#define MAX_TARGET_LOCKS                           16   //!< most paths a multipath volume can have
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  TYPEDEFS                                  |
@@ -156,7 +168,6 @@ static char ceph_keyring[EUCA_MAX_PATH] = DEFAULT_CEPH_KEYRING;
 // path to ceph conf file on the local host
 static char ceph_conf[EUCA_MAX_PATH] = DEFAULT_CEPH_CONF;
 
-static sem *iscsi_sem = NULL;          //!< for serializing attach and detach invocations
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -164,6 +175,10 @@ static sem *iscsi_sem = NULL;          //!< for serializing attach and detach in
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+static int compare_keys(const void *a, const void *b);
+static int lock_targets(const char *dev_string, char **keys);
+static void unlock_targets(char **keys, int nkeys);
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                   MACROS                                   |
@@ -210,9 +225,110 @@ void init_iscsi(const char *euca_home, const char *new_ceph_user, const char *ne
         euca_strncpy(ceph_conf, new_ceph_conf, sizeof(ceph_conf));
         LOGDEBUG("Ceph configuration path: %s\n", ceph_conf);
     }
-    // initialize the semaphore on first invocation only
-    if (iscsi_sem == NULL) {
-        iscsi_sem = sem_alloc(1, IPC_MUTEX_SEMAPHORE);
+}
+
+//!
+//! qsort() comparator for lock keys
+//!
+static int compare_keys(const void *a, const void *b)
+{
+    return (strcmp(*((char *const *)a), *((char *const *)b)));
+}
+
+//!
+//! Locks every storage target the connection string refers to, so that scripts
+//! working on the same target (sharing its session and node records) run one at
+//! a time while attachments to other targets proceed in parallel. An iSCSI path
+//! is keyed by portal and target IQN, an RBD volume by its libvirt secret, which
+//! the connect script may (re)define. Keys are taken in sorted order so that two
+//! multipath volumes sharing several targets cannot deadlock.
+//!
+//! @param[in]  dev_string the connection string
+//! @param[out] keys an array of at least MAX_TARGET_LOCKS entries receiving the locked keys
+//!
+//! @return the number of keys locked, to be passed to unlock_targets()
+//!
+static int lock_targets(const char *dev_string, char **keys)
+{
+    int i = 0;
+    int field = 0;
+    int nkeys = 0;
+    int locked = 0;
+    char *copy = NULL;
+    char *next = NULL;
+    char *value = NULL;
+    char *protocol = "";
+    char *password = "";
+    char *ip = NULL;
+    char key[EUCA_MAX_PATH] = "";
+
+    if ((copy = strdup(dev_string)) != NULL) {
+        for (next = copy, field = 0; ((value = strsep(&next, ",")) != NULL) && (nkeys < MAX_TARGET_LOCKS); field++) {
+            if (field == DEV_STRING_PROTOCOL_FIELD) {
+                protocol = value;
+            } else if (field == DEV_STRING_PASSWORD_FIELD) {
+                password = value;
+                if (!strcmp(protocol, PROTOCOL_RBD)) {
+                    snprintf(key, sizeof(key), "rbd:%s", password);
+                    if ((keys[nkeys] = strdup(key)) != NULL)
+                        nkeys++;
+                    break;
+                }
+            } else if (field >= DEV_STRING_PATHS_FIELD) {
+                switch ((field - DEV_STRING_PATHS_FIELD) % DEV_STRING_FIELDS_PER_PATH) {
+                case 1:
+                    ip = value;
+                    break;
+                case 2:
+                    // the scripts ignore a trailing '.' on the target name
+                    if (strlen(value) && (value[strlen(value) - 1] == '.'))
+                        value[strlen(value) - 1] = '\0';
+                    snprintf(key, sizeof(key), "iscsi:%s,%s", ((ip) ? (ip) : ("")), value);
+                    if ((keys[nkeys] = strdup(key)) != NULL)
+                        nkeys++;
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+        EUCA_FREE(copy);
+    }
+    // when the string cannot be understood, fall back on a lock for the whole string
+    if (nkeys == 0) {
+        snprintf(key, sizeof(key), "iscsi:%s", dev_string);
+        if ((keys[nkeys] = strdup(key)) != NULL)
+            nkeys++;
+    }
+
+    qsort(keys, nkeys, sizeof(char *), compare_keys);
+    for (i = 0; i < nkeys; i++) {
+        if ((locked > 0) && !strcmp(keys[locked - 1], keys[i])) {
+            // same target reached through another path
+            EUCA_FREE(keys[i]);
+            continue;
+        }
+        keys[locked] = keys[i];
+        sem_key_p(keys[locked++]);
+    }
+    for (i = locked; i < nkeys; i++)
+        keys[i] = NULL;
+    return (locked);
+}
+
+//!
+//! Releases the locks taken by lock_targets() and frees the keys
+//!
+//! @param[in] keys the keys filled in by lock_targets()
+//! @param[in] nkeys the value returned by lock_targets()
+//!
+static void unlock_targets(char **keys, int nkeys)
+{
+    int i = 0;
+
+    for (i = nkeys - 1; i >= 0; i--) {
+        sem_key_v(keys[i]);
+        EUCA_FREE(keys[i]);
     }
 }
 
@@ -226,6 +342,8 @@ void init_iscsi(const char *euca_home, const char *new_ceph_user, const char *ne
 char *connect_iscsi_target(const char *volume_id, const char *target_dev, const char *target_serial, const char *target_bus, const char *dev_string)
 {
     int ret = 0;
+    int nkeys = 0;
+    char *keys[MAX_TARGET_LOCKS] = { NULL };
     char command[EUCA_MAX_PATH] = "";
     char stdout_str[MAX_OUTPUT] = "";
     char stderr_str[MAX_OUTPUT] = "";
@@ -236,9 +354,9 @@ char *connect_iscsi_target(const char *volume_id, const char *target_dev, const
              connect_storage_cmd_path, home, volume_id, target_dev, target_serial, target_bus, ceph_user, ceph_keyring, ceph_conf, dev_string);
     LOGDEBUG("invoking `%s`\n", command);
 
-    sem_p(iscsi_sem);
+    nkeys = lock_targets(dev_string, keys);
     ret = timeshell(command, stdout_str, stderr_str, MAX_OUTPUT, CONNECT_TIMEOUT);
-    sem_v(iscsi_sem);
+    unlock_targets(keys, nkeys);
     LOGDEBUG("connect script returned: %d, stdout: '%s', stderr: '%s'\n", ret, stdout_str, stderr_str);
 
     if (ret == 0)
@@ -257,6 +375,8 @@ char *connect_iscsi_target(const char *volume_id, const char *target_dev, const
 int disconnect_iscsi_target(const char *dev_string, boolean do_rescan)
 {
     int ret = 0;
+    int nkeys = 0;
+    char *keys[MAX_TARGET_LOCKS] = { NULL };
     char command[EUCA_MAX_PATH] = "";
     char stdout_str[MAX_OUTPUT] = "";
     char stderr_str[MAX_OUTPUT] = "";
@@ -266,9 +386,9 @@ int disconnect_iscsi_target(const char *dev_string, boolean do_rescan)
     snprintf(command, EUCA_MAX_PATH, "%s %s,,,,,,,,%s%s", disconnect_storage_cmd_path, home, dev_string, (do_rescan) ? (" norescan") : (""));
     LOGDEBUG("invoking `%s`\n", command);
 
-    sem_p(iscsi_sem);
+    nkeys = lock_targets(dev_string, keys);
     ret = timeshell(command, stdout_str, stderr_str, MAX_OUTPUT, DISCONNECT_TIMEOUT);
-    sem_v(iscsi_sem);
+    unlock_targets(keys, nkeys);
     LOGDEBUG("disconnect script returned: %d, stdout: '%s', stderr: '%s'\n", ret, stdout_str, stderr_str);
 
     return (ret);
@@ -284,6 +404,8 @@ int disconnect_iscsi_target(const char *dev_string, boolean do_rescan)
 char *get_iscsi_target(const char *dev_string)
 {
     int ret = 0;
+    int nkeys = 0;
+    char *keys[MAX_TARGET_LOCKS] = { NULL };
     char command[EUCA_MAX_PATH] = "";
     char stdout_str[MAX_OUTPUT] = "";
     char stderr_str[MAX_OUTPUT] = "";
@@ -292,9 +414,9 @@ char *get_iscsi_target(const char *dev_string)
     snprintf(command, EUCA_MAX_PATH, "%s %s,,,,,,,,%s", get_storage_cmd_path, home, dev_string);
     LOGDEBUG("invoking `%s`\n", command);
 
-    sem_p(iscsi_sem);
+    nkeys = lock_targets(dev_string, keys);
     ret = timeshell(command, stdout_str, stderr_str, MAX_OUTPUT, GET_TIMEOUT);
-    sem_v(iscsi_sem);
+    unlock_targets(keys, nkeys);
     LOGDEBUG("get storage script returned: %d, stdout: '%s', stderr: '%s'\n", ret, stdout_str, stderr_str);
 
     if (ret == 0)
@@ -275,7 +275,7 @@ int scStubDestroy(scStub * pStub)
 //! @param[in] token the token to be Exportd by the SC
 //! @param[in] ip the NC's ip to be used for token resolution
 //! @param[in] iqn the NC's iqn to be used for token resolution
-//! @param[in] connection_string a pointer to a pointer to hold the resulting volume connection structure on return
+//! @param[in] connection_string a pointer to a pointer to hold the resulting volume connection string on return (caller frees)
 //!
 //! @return EUCA_OK on success or EUCA_ERROR on failure.
 //!
@@ -324,11 +324,15 @@ int scExportVolumeStub(scStub * pStub, char *correlationId, char *userId, char *
             //Set return values
             char *returned_vol_id = adb_ExportVolumeResponseType_get_volumeId(response, env);
             //Ensure that the returned token is for the requested vol.
-            if (strcmp(returned_vol_id, volumeId) == 0) {
-                *connection_string = adb_ExportVolumeResponseType_get_connectionString(response, env);
+            if ((returned_vol_id != NULL) && (strcmp(returned_vol_id, volumeId) == 0)) {
+                char *connect = adb_ExportVolumeResponseType_get_connectionString(response, env);
+                *connection_string = ((connect != NULL) ? strdup(connect) : NULL);
             }
         }
+        adb_ExportVolumeResponse_free(output, env);
     }
+    // stubs are cached and reused, so release everything this call allocated
+    adb_ExportVolume_free(input, env);
 
     return (status);
 }
@@ -383,6 +387,8 @@ int scUnexportVolumeStub(scStub * pStub, char *correlationId, char *userId, char
             LOGERROR("[%s] returned an error\n", volumeId);
             status = 1;
         }
+        adb_UnexportVolumeResponse_free(output, env);
     }
+    adb_UnexportVolume_free(input, env);
     return (status);
 }
@@ -78,10 +78,12 @@
 #include <stdlib.h>
 #define __USE_GNU                      /* strnlen */
 #include <string.h>                    /* strlen, strcpy */
-#include <sys/types.h>                 /* fork */
-#include <sys/wait.h>                  /* waitpid */
+#include <sys/types.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
 #include <eucalyptus.h>
@@ -122,6 +124,15 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! A cached SC stub, used by at most one thread at a time
+typedef struct sc_client_t {
+    scStub *scs;                       //!< stub (and AXIS2 environment) reused across calls, NULL if not created yet
+    char url[EUCA_MAX_PATH];           //!< endpoint the stub was created for
+    char policy[EUCA_MAX_PATH];        //!< WS-Security policy file the stub was initialized with
+    int use_ws_sec;                    //!< whether WS-Security was engaged on the stub
+    boolean busy;                      //!< checked out by a thread
+} sc_client;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXTERNAL VARIABLES                             |
@@ -142,12 +153,24 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+static pthread_mutex_t sc_client_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t sc_stub_mutex = PTHREAD_MUTEX_INITIALIZER;  //!< serializes AXIS2 stub and WS-Security setup, which are not thread-safe
+static pthread_cond_t sc_client_cond = PTHREAD_COND_INITIALIZER;    //!< signalled whenever a client is checked back in
+static sc_client sc_clients[SC_CLIENT_POOL_SIZE] = { {0} };
+
+//! Operations scClientCall() knows about, and their timing
+static const char *sc_client_ops[] = { "ExportVolume", "UnexportVolume", NULL };
+static sc_client_op_stats sc_client_stats[2] = { {0} };
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                              STATIC PROTOTYPES                             |
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+static sc_client *sc_client_checkout(char *scURL, int use_ws_sec, char *ws_sec_policy_file_path, long long deadline_ms);
+static void sc_client_checkin(sc_client * client);
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                   MACROS                                   |
@@ -160,11 +183,121 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//!
+//! Takes a free client from the pool, waiting until the deadline for one,
+//! and makes sure its stub points at the given SC with the given security setup.
+//! Stubs are kept across calls so the AXIS2 environment, service client and
+//! WS-Security policy are only set up once per endpoint, unless a call on them
+//! fails. The stub gets whatever time is left until the deadline as its AXIS2 timeout.
+//!
+//! @param[in] scURL the URL of the SC
+//! @param[in] use_ws_sec an integer/boolean to indicate if WS-Sec should be used
+//! @param[in] ws_sec_policy_file_path the SC client policy file
+//! @param[in] deadline_ms when the whole call must be over, as returned by time_ms()
+//!
+//! @return a client reserved for the caller or NULL on failure
+//!
+static sc_client *sc_client_checkout(char *scURL, int use_ws_sec, char *ws_sec_policy_file_path, long long deadline_ms)
+{
+    int i = 0;
+    long long remaining_ms = 0;
+    const char *policy = ((use_ws_sec && ws_sec_policy_file_path) ? ws_sec_policy_file_path : "");
+    sc_client *client = NULL;
+    sc_client *idle = NULL;
+    struct timespec deadline = { 0 };
+
+    deadline.tv_sec = (time_t) (deadline_ms / 1000);
+    deadline.tv_nsec = (long)((deadline_ms % 1000) * 1000000);
+
+    pthread_mutex_lock(&sc_client_mutex);
+    while (client == NULL) {
+        // prefer a free client already set up for this endpoint, then an unused one, then any free one
+        for (i = 0, idle = NULL; i < SC_CLIENT_POOL_SIZE; i++) {
+            if (sc_clients[i].busy)
+                continue;
+            if (sc_clients[i].scs && !strcmp(sc_clients[i].url, scURL) && (sc_clients[i].use_ws_sec == use_ws_sec) && !strcmp(sc_clients[i].policy, policy)) {
+                client = &sc_clients[i];
+                break;
+            }
+            if ((idle == NULL) || (idle->scs && (sc_clients[i].scs == NULL)))
+                idle = &sc_clients[i];
+        }
+
+        if (client == NULL)
+            client = idle;
+
+        if ((client == NULL) && (pthread_cond_timedwait(&sc_client_cond, &sc_client_mutex, &deadline) == ETIMEDOUT)) {
+            pthread_mutex_unlock(&sc_client_mutex);
+            LOGERROR("timed out waiting for one of %d SC clients to call %s\n", SC_CLIENT_POOL_SIZE, scURL);
+            return (NULL);
+        }
+    }
+    client->busy = TRUE;
+    pthread_mutex_unlock(&sc_client_mutex);
+
+    if (client->scs && (strcmp(client->url, scURL) || (client->use_ws_sec != use_ws_sec) || strcmp(client->policy, policy))) {
+        pthread_mutex_lock(&sc_stub_mutex);
+        scStubDestroy(client->scs);
+        pthread_mutex_unlock(&sc_stub_mutex);
+        client->scs = NULL;
+    }
+
+    if (client->scs == NULL) {
+        LOGDEBUG("creating SC client stub for %s\n", scURL);
+        pthread_mutex_lock(&sc_stub_mutex);
+        {
+            if ((client->scs = scStubCreate(scURL, NULL, NULL)) != NULL) {
+                if (use_ws_sec) {
+                    LOGTRACE("Configuring and Initializing WS-SEC for SC Client\n");
+                    if (InitWSSEC(client->scs->env, client->scs->stub, ws_sec_policy_file_path)) {
+                        LOGERROR("Error initializing WSSEC state for SC Client\n");
+                    }
+                }
+            }
+        }
+        pthread_mutex_unlock(&sc_stub_mutex);
+
+        if (client->scs == NULL) {
+            LOGERROR("failed to create SC client stub for %s\n", scURL);
+            sc_client_checkin(client);
+            return (NULL);
+        }
+
+        euca_strncpy(client->url, scURL, sizeof(client->url));
+        euca_strncpy(client->policy, policy, sizeof(client->policy));
+        client->use_ws_sec = use_ws_sec;
+    }
+
+    if ((remaining_ms = deadline_ms - time_ms()) <= 0) {
+        LOGERROR("no time left to call %s\n", scURL);
+        sc_client_checkin(client);
+        return (NULL);
+    }
+
+    axis2_options_set_timeout_in_milli_seconds(axis2_stub_get_options(client->scs->stub, client->scs->env), client->scs->env, (long)remaining_ms);
+    return (client);
+}
+
+//!
+//! Returns a client taken with sc_client_checkout() to the pool
+//!
+//! @param[in] client
+//!
+static void sc_client_checkin(sc_client * client)
+{
+    pthread_mutex_lock(&sc_client_mutex);
+    client->busy = FALSE;
+    pthread_cond_signal(&sc_client_cond);
+    pthread_mutex_unlock(&sc_client_mutex);
+}
+
 //!
 //! Make a call to the SC as specified with a string and a timeout.
 //!
-//! This implementation is heavily borrowed from the CC's ncClientCall.
-//! Uses fork/exec for client to preserve memory since Axis's destroy/free have issues
+//! Calls are made in-process on a pool of cached stubs, so at most
+//! SC_CLIENT_POOL_SIZE calls run concurrently. Further callers wait for a free
+//! stub, and that wait counts against the timeout of the call: the SC only
+//! gets the time left once a stub is ready.
 //!
 //! @param[in] correlationId a pointer to the correlationId string to use for the call to the SC
 //! @param[in] userId a pointer to the userId string to use for the call to the SC
@@ -175,7 +308,7 @@
 //! @param[in] scOp the operation to perform (i.e. "ExportVolume", "UnexportVolume",...)
 //! @param[in] ...
 //!
-//! @return
+//! @return 0 on success or 1 on failure
 //!
 //! @pre
 //!
@@ -183,17 +316,16 @@
 //!
 int scClientCall(char *correlationId, char *userId, int use_ws_sec, char *ws_sec_policy_file_path, int timeout, char *scURL, char *scOp, ...)
 {
-    int pid = 0;
-    int rc = 0;
-    int ret = 0;
-    int status = 0;
-    int opFail = 0;
-    int len = 0;
-    int rbytes = 0;
-    int filedes[2] = { 0 };
-    char *localCorrelationId = NULL;
-    char *localUserId = NULL;
-    scStub *scs = NULL;
+    int op = 0;
+    int rc = 1;
+    long elapsed_ms = 0;
+    long long start_ms = time_ms();
+    char *volumeId = NULL;
+    char *token = NULL;
+    char *ip = NULL;
+    char *iqn = NULL;
+    char **connectInfo = NULL;
+    sc_client *client = NULL;
     va_list al = { {0} };
 
     LOGTRACE("invoked: scOps=%s scURL=%s timeout=%d\n", scOp, scURL, timeout);  // these are common
@@ -201,155 +333,93 @@ int scClientCall(char *correlationId, char *userId, int use_ws_sec, char *ws_sec
     if (timeout <= 0)
         timeout = DEFAULT_SC_REQUEST_TIMEOUT;
 
-    if ((rc = pipe(filedes)) != 0) {
-        LOGERROR("cannot create pipe scOps=%s\n", scOp);
+    for (op = 0; sc_client_ops[op] && strcmp(sc_client_ops[op], scOp); op++) ;
+    if (sc_client_ops[op] == NULL) {
+        LOGWARN("\tscOps=%s operation '%s' not found\n", scOp, scOp);
         return (1);
     }
 
+    // args for both operations: char *volumeId, char *token, char *ip, char *iqn
+    // ExportVolume also takes: char **connectionInfo (for return)
     va_start(al, scOp);
+    volumeId = va_arg(al, char *);
+    token = va_arg(al, char *);
+    ip = va_arg(al, char *);
+    iqn = va_arg(al, char *);
+    if (!strcmp(scOp, "ExportVolume")) {
+        connectInfo = va_arg(al, char **);
+        if (connectInfo)
+            *connectInfo = NULL;
+    }
+    va_end(al);
 
-    //Fork and exec the client stub...do this for mem protection
-    pid = fork();
-    if (!pid) {
-        //I'm the child, do the call.
-        if (correlationId) {
-            localCorrelationId = strdup(correlationId);
-        } else {
-            localCorrelationId = strdup("unset");
-        }
-        if (userId) {
-            localUserId = strdup(userId);
-        } else {
-            localUserId = strdup("eucalyptus");
-        }
-
-        close(filedes[0]);
-        scs = scStubCreate(scURL, NULL, NULL);
-        if (use_ws_sec) {
-            LOGTRACE("Configuring and Initializing WS-SEC for SC Client\n");
-            rc = InitWSSEC(scs->env, scs->stub, ws_sec_policy_file_path);
-            if (rc) {
-                LOGERROR("Error initializing WSSEC state for SC Client\n");
-            }
-        }
+    if ((client = sc_client_checkout(scURL, use_ws_sec, ws_sec_policy_file_path, start_ms + ((long long)timeout * 1000))) != NULL) {
+        if (!correlationId)
+            correlationId = "unset";
+        if (!userId)
+            userId = "eucalyptus";
 
-        LOGTRACE("\tscOps=%s ppid=%d client calling '%s'\n", scOp, getppid(), scOp);
+        LOGTRACE("\tscOps=%s client calling '%s'\n", scOp, scOp);
         if (!strcmp(scOp, "ExportVolume")) {
-            // args: char *volumeId
-            // args: char *token
-            // args: char *ip
-            // args: char *iqn
-            // args: char **connectionInfo (for return)
-            char *volumeId = va_arg(al, char *);
-            char *token = va_arg(al, char *);
-            char *ip = va_arg(al, char *);
-            char *iqn = va_arg(al, char *);
-            char **connectInfo = va_arg(al, char **);
-
             LOGTRACE("Calling Export Volume Stub\n");
-            rc = scExportVolumeStub(scs, localCorrelationId, localUserId, volumeId, token, ip, iqn, connectInfo);
-            if (connectInfo) {
-                if (!rc && *connectInfo) {
-                    len = strlen(*connectInfo) + 1;
-                    LOGTRACE("SC Client child received output %d in length: %s\n", len, *connectInfo);
-                    rc = write(filedes[1], &len, sizeof(int));
-                    rc = write(filedes[1], *connectInfo, sizeof(char) * len);
-                    rc = 0;
-                } else {
-                    len = 0;
-                    LOGTRACE("SC Client child received output %d in length\n", len);
-                    rc = write(filedes[1], &len, sizeof(int));
-                    rc = 1;
-                }
+            rc = scExportVolumeStub(client->scs, correlationId, userId, volumeId, token, ip, iqn, connectInfo);
+            if (!rc && connectInfo && *connectInfo) {
+                LOGTRACE("SC Client received output %d in length: %s\n", (int)strlen(*connectInfo) + 1, *connectInfo);
+            } else {
+                rc = 1;
             }
-        } else if (!strcmp(scOp, "UnexportVolume")) {
-            // args: char *volumeId
-            // args: char *token
-            // args: char *ip
-            // args: char *iqn
-            char *volumeId = va_arg(al, char *);
-            char *token = va_arg(al, char *);
-            char *ip = va_arg(al, char *);
-            char *iqn = va_arg(al, char *);
-
-            LOGTRACE("Calling Unexport Volume Stub\n");
-            rc = scUnexportVolumeStub(scs, localCorrelationId, localUserId, volumeId, token, ip, iqn);
         } else {
-            LOGWARN("\tscOps=%s operation '%s' not found\n", scOp, scOp);
-            rc = 1;
+            LOGTRACE("Calling Unexport Volume Stub\n");
+            rc = scUnexportVolumeStub(client->scs, correlationId, userId, volumeId, token, ip, iqn);
         }
 
-        LOGTRACE("\tscOps=%s ppid=%d done calling '%s' with exit code '%d'\n", scOp, getppid(), scOp, rc);
+        // a stub that failed or timed out may be left mid-exchange, so never hand it out again
         if (rc) {
-            ret = 1;
-        } else {
-            ret = 0;
+            pthread_mutex_lock(&sc_stub_mutex);
+            scStubDestroy(client->scs);
+            pthread_mutex_unlock(&sc_stub_mutex);
+            client->scs = NULL;
         }
-        close(filedes[1]);
-        exit(ret);
-    } else {
-        // parent returns for each client call
-        close(filedes[1]);
+        sc_client_checkin(client);
+    }
 
-        if (!strcmp(scOp, "ExportVolume")) {
-            // args: char *volumeId
-            // args: char *token
-            // args: char *ip
-            // args: char *iqn
-            // args: char **connectionInfo (for return)
-            char *volumeId = NULL;
-            char *token = NULL;
-            char *ip = NULL;
-            char *iqn = NULL;
-            char **connectInfo = NULL;
-
-            volumeId = va_arg(al, char *);
-            token = va_arg(al, char *);
-            ip = va_arg(al, char *);
-            iqn = va_arg(al, char *);
-            connectInfo = va_arg(al, char **);
-
-            if (connectInfo) {
-                *connectInfo = NULL;
-            }
+    elapsed_ms = (long)(time_ms() - start_ms);
+    pthread_mutex_lock(&sc_client_mutex);
+    {
+        sc_client_stats[op].calls++;
+        sc_client_stats[op].total_ms += elapsed_ms;
+        if (elapsed_ms > sc_client_stats[op].max_ms)
+            sc_client_stats[op].max_ms = elapsed_ms;
+        if (rc)
+            sc_client_stats[op].failures++;
+    }
+    pthread_mutex_unlock(&sc_client_mutex);
 
-            if (connectInfo) {
-                rbytes = timeread(filedes[0], &len, sizeof(int), timeout);
-                if (rbytes <= 0) {
-                    LOGTRACE("SC Client received output length of %d, not writing data\n", rbytes);
-                    killwait(pid);
-                    opFail = 1;
-                } else {
-                    LOGTRACE("SC Client getting %d bytes of output from SC call\n", len);
-                    *connectInfo = EUCA_ALLOC(len, sizeof(char));
-                    if (!*connectInfo) {
-                        LOGFATAL("out of memory! scOps=%s\n", scOp);
-                        exit(1);
-                    }
-                    rbytes = timeread(filedes[0], *connectInfo, len, timeout);
-                    LOGTRACE("SC Client got %d bytes in connect info %s\n", rbytes, *connectInfo);
-                    if (rbytes <= 0) {
-                        killwait(pid);
-                        opFail = 1;
-                    }
-                }
-            }
-        } else {
-            //Nothing to do in default case (success/fail in exit code)
-        }
+    LOGDEBUG("\tdone scOps=%s clientrc=%d in %ld ms\n", scOp, rc, elapsed_ms);
+    return ((rc) ? 1 : 0);
+}
 
-        close(filedes[0]);
-        rc = timewait(pid, &status, timeout);
-        rc = WEXITSTATUS(status);
-    }
+//!
+//! Returns the timing of the calls made so far for one SC operation
+//!
+//! @param[in]  scOp the operation (i.e. "ExportVolume", "UnexportVolume")
+//! @param[out] stats the counters
+//!
+//! @return EUCA_OK on success or EUCA_NOT_FOUND_ERROR for an unknown operation
+//!
+int scClientGetStats(const char *scOp, sc_client_op_stats * stats)
+{
+    int op = 0;
 
-    LOGDEBUG("\tdone scOps=%s clientrc=%d opFail=%d\n", scOp, rc, opFail);
-    if (rc || opFail) {
-        ret = 1;
-    } else {
-        ret = 0;
-    }
+    if ((scOp == NULL) || (stats == NULL))
+        return (EUCA_INVALID_ERROR);
 
-    va_end(al);
-    return (ret);
+    for (op = 0; sc_client_ops[op] && strcmp(sc_client_ops[op], scOp); op++) ;
+    if (sc_client_ops[op] == NULL)
+        return (EUCA_NOT_FOUND_ERROR);
+
+    pthread_mutex_lock(&sc_client_mutex);
+    *stats = sc_client_stats[op];
+    pthread_mutex_unlock(&sc_client_mutex);
+    return (EUCA_OK);
 }
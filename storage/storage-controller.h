@@ -84,6 +84,7 @@
 \*----------------------------------------------------------------------------*/
 
 #define DEFAULT_SC_REQUEST_TIMEOUT                  45  //!< 45  second sync call timeout
+#define SC_CLIENT_POOL_SIZE                          8  //!< maximum number of concurrent in-process SC calls, each with its own cached stub
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -103,6 +104,14 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! Timing of the calls made for one SC operation
+typedef struct sc_client_op_stats_t {
+    long calls;                        //!< number of calls made
+    long failures;                     //!< number of calls that failed or timed out
+    long total_ms;                     //!< sum of call durations, including time spent waiting for a free client
+    long max_ms;                       //!< longest call
+} sc_client_op_stats;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXPORTED VARIABLES                             |
@@ -116,6 +125,7 @@
 \*----------------------------------------------------------------------------*/
 
 int scClientCall(char *correlationId, char *userId, int use_ws_sec, char *ws_sec_policy_file_path, int timeout, char *scURL, char *scOp, ...);
+int scClientGetStats(const char *scOp, sc_client_op_stats * stats);
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
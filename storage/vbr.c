@@ -102,6 +102,7 @@
 #include "diskutil.h"
 //#include "iscsi.h"
 #include "http.h"
+#include "image_peers.h"
 #include "ebs_utils.h"
 #include <ipc.h>
 
@@ -121,6 +122,9 @@
 
 #define ARTIFACT_RETRY_SLEEP_USEC                500000LL
 
+#define DIGEST_CACHE_SIZE                        64 //!< number of image digests remembered across launches
+#define DIGEST_CACHE_TTL_SEC                     300    //!< how long a digest is trusted before asking the server again
+
 #ifdef _UNIT_TEST
 #define BS_SIZE                                  20000000000 / 512
 #define KEY1                                     "ssh-rsa AAAAB3NzaC1yc2EAAAADAQABAAABAQCVWU+h3gDF4sGjUB7t...\n"
@@ -156,6 +160,17 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! An image digest (manifest) fetched for an earlier launch
+typedef struct digest_cache_entry_t {
+    char id[SMALL_CHAR_BUFFER_SIZE];   //!< image ID (emi|eki|eri) the digest belongs to, empty if the entry is unused
+    char url[EUCA_MAX_PATH];           //!< where the digest was fetched from
+    char *digest;                      //!< the digest itself
+    char etag[HTTP_VALIDATOR_SIZE];    //!< ETag of the response, for revalidation of URL digests
+    char last_modified[HTTP_VALIDATOR_SIZE];    //!< Last-Modified of the response, for revalidation of URL digests
+    time_t validated;                  //!< when the server last handed out or confirmed the digest
+    time_t last_used;                  //!< for picking an entry to evict
+} digest_cache_entry;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXTERNAL VARIABLES                             |
@@ -187,6 +202,9 @@ const char *euca_client_component_name = "nc";  //!< The client component name
 static __thread char current_instanceId[512] = "";  //!< instance ID that is being serviced, for logging only
 static sem *hostconfig_sem;
 
+static pthread_mutex_t digest_cache_mutex = PTHREAD_MUTEX_INITIALIZER;  //!< protects digest_cache
+static digest_cache_entry digest_cache[DIGEST_CACHE_SIZE] = { {{0}} };
+
 #ifdef _UNIT_TEST
 static blobstore *cache_bs = NULL;
 static blobstore *work_bs = NULL;
@@ -237,6 +255,10 @@ static void art_print_tree(const char *prefix, artifact * a);
 static int art_gen_id(char *buf, unsigned int buf_size, const char *first, const char *sig);
 static void convert_id(const char *src, char *dst, unsigned int size);
 static char *url_get_digest(const char *url, boolean * bail_flag);
+static char *url_get_digest_if_changed(const char *url, char *etag, char *last_modified, boolean * not_modified);
+static char *digest_cache_lookup(const char *id, const char *url, boolean * fresh, char *etag, char *last_modified);
+static void digest_cache_store(const char *id, const char *url, const char *digest, const char *etag, const char *last_modified);
+static char *get_digest(const virtualBootRecord * vbr, const char *url, boolean * bail_flag);
 static artifact *art_alloc_vbr(virtualBootRecord * vbr, boolean do_make_work_copy, boolean is_migration_dest, boolean must_be_file, const char *sshkey, boolean * bail_flag);
 static artifact *art_alloc_disk(virtualBootRecord * vbr, artifact * prereqs[], int num_prereqs, artifact * parts[], int num_parts,
                                 artifact * emi_disk, boolean do_make_work_copy, boolean is_migration_dest);
@@ -1026,6 +1048,12 @@ static int url_creator(artifact * a)
         LOGINFO("[%s] skipping download of %s\n", a->instanceId, vbr->preparedResourceLocation);
         return (EUCA_OK);
     }
+#ifndef _UNIT_TEST
+    if (image_peers_fetch(a->id, blockblob_get_size_bytes(a->bb), dest_path) == EUCA_OK) {
+        LOGINFO("[%s] obtained %s from a peer\n", a->instanceId, vbr->preparedResourceLocation);
+        return (EUCA_OK);
+    }
+#endif /* ! _UNIT_TEST */
     LOGINFO("[%s] downloading %s\n", a->instanceId, vbr->preparedResourceLocation);
     if (http_get(vbr->preparedResourceLocation, dest_path, NULL) != EUCA_OK) {
         LOGERROR("[%s] failed to download component %s\n", a->instanceId, vbr->preparedResourceLocation);
@@ -1058,6 +1086,12 @@ static int objectstorage_creator(artifact * a)
         LOGINFO("[%s] skipping download of %s\n", a->instanceId, vbr->preparedResourceLocation);
         return (EUCA_OK);
     }
+#ifndef _UNIT_TEST
+    if (image_peers_fetch(a->id, blockblob_get_size_bytes(a->bb), dest_path) == EUCA_OK) {
+        LOGINFO("[%s] obtained %s from a peer\n", a->instanceId, vbr->preparedResourceLocation);
+        return (EUCA_OK);
+    }
+#endif /* ! _UNIT_TEST */
     LOGINFO("[%s] downloading %s\n", a->instanceId, vbr->preparedResourceLocation);
 
 #if !defined( _UNIT_TEST) && !defined(_NO_EBS)
@@ -1913,6 +1947,177 @@ static char *url_get_digest(const char *url, boolean * bail_flag)
     return digest_str;
 }
 
+//!
+//! Fetches a digest from a URL unless it is unchanged since the response that
+//! produced the given validators. Unlike url_get_digest(), makes a single attempt.
+//!
+//! @param[in]     url
+//! @param[in,out] etag validator from the previous response, updated on a new one (HTTP_VALIDATOR_SIZE bytes)
+//! @param[in,out] last_modified validator from the previous response, updated on a new one (HTTP_VALIDATOR_SIZE bytes)
+//! @param[out]    not_modified set to TRUE if the server confirmed the digest has not changed
+//!
+//! @return the new digest (to be freed by the caller) or NULL if unchanged or on failure
+//!
+static char *url_get_digest_if_changed(const char *url, char *etag, char *last_modified, boolean * not_modified)
+{
+    int tmp_fd = -1;
+    char *digest_str = NULL;
+    char digest_path[] = "/tmp/url-digest-XXXXXX";
+
+    *not_modified = FALSE;
+    if ((tmp_fd = safe_mkstemp(digest_path)) < 0) {
+        LOGERROR("failed to create a digest file %s\n", digest_path);
+        return (NULL);
+    }
+    close(tmp_fd);
+
+    if (http_get_if_changed(url, digest_path, etag, last_modified, 10, 30, not_modified) != EUCA_OK) {
+        LOGWARN("failed to revalidate digest from %s\n", url);
+    } else if (!(*not_modified)) {
+        digest_str = file2strn(digest_path, 100000);
+    }
+    unlink(digest_path);
+    return (digest_str);
+}
+
+//!
+//! Looks up the digest of an image fetched for an earlier launch. Caller must
+//! not hold digest_cache_mutex.
+//!
+//! @param[in]  id the image ID
+//! @param[in]  url where the digest comes from
+//! @param[out] fresh set to TRUE if the digest was validated less than DIGEST_CACHE_TTL_SEC ago
+//! @param[out] etag receives the validator to revalidate with (HTTP_VALIDATOR_SIZE bytes)
+//! @param[out] last_modified receives the validator to revalidate with (HTTP_VALIDATOR_SIZE bytes)
+//!
+//! @return a copy of the digest (to be freed by the caller) or NULL if not cached
+//!
+static char *digest_cache_lookup(const char *id, const char *url, boolean * fresh, char *etag, char *last_modified)
+{
+    int i = 0;
+    char *digest = NULL;
+    time_t now = time(NULL);
+
+    *fresh = FALSE;
+    pthread_mutex_lock(&digest_cache_mutex);
+    {
+        for (i = 0; i < DIGEST_CACHE_SIZE; i++) {
+            if ((digest_cache[i].digest != NULL) && !strcmp(digest_cache[i].id, id) && !strcmp(digest_cache[i].url, url)) {
+                if ((digest = strdup(digest_cache[i].digest)) != NULL) {
+                    *fresh = ((now - digest_cache[i].validated) < DIGEST_CACHE_TTL_SEC);
+                    euca_strncpy(etag, digest_cache[i].etag, HTTP_VALIDATOR_SIZE);
+                    euca_strncpy(last_modified, digest_cache[i].last_modified, HTTP_VALIDATOR_SIZE);
+                    digest_cache[i].last_used = now;
+                }
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&digest_cache_mutex);
+    return (digest);
+}
+
+//!
+//! Remembers a digest the server just handed out or confirmed, evicting the least
+//! recently used entry if the cache is full.
+//!
+//! @param[in] id the image ID
+//! @param[in] url where the digest came from
+//! @param[in] digest the digest
+//! @param[in] etag validator of the response, may be empty
+//! @param[in] last_modified validator of the response, may be empty
+//!
+static void digest_cache_store(const char *id, const char *url, const char *digest, const char *etag, const char *last_modified)
+{
+    int i = 0;
+    char *copy = NULL;
+    time_t now = time(NULL);
+    digest_cache_entry *entry = NULL;
+
+    if ((copy = strdup(digest)) == NULL)
+        return;
+
+    pthread_mutex_lock(&digest_cache_mutex);
+    {
+        for (i = 0; i < DIGEST_CACHE_SIZE; i++) {
+            if ((digest_cache[i].digest != NULL) && !strcmp(digest_cache[i].id, id) && !strcmp(digest_cache[i].url, url)) {
+                entry = &digest_cache[i];
+                break;
+            }
+            if ((entry == NULL) || ((entry->digest != NULL) && ((digest_cache[i].digest == NULL) || (digest_cache[i].last_used < entry->last_used))))
+                entry = &digest_cache[i];
+        }
+
+        EUCA_FREE(entry->digest);
+        euca_strncpy(entry->id, id, sizeof(entry->id));
+        euca_strncpy(entry->url, url, sizeof(entry->url));
+        euca_strncpy(entry->etag, etag, sizeof(entry->etag));
+        euca_strncpy(entry->last_modified, last_modified, sizeof(entry->last_modified));
+        entry->digest = copy;
+        entry->validated = now;
+        entry->last_used = now;
+    }
+    pthread_mutex_unlock(&digest_cache_mutex);
+}
+
+//!
+//! Returns the digest of the image behind a VBR, going to the network only when
+//! the cached copy is older than DIGEST_CACHE_TTL_SEC. A stale URL digest is
+//! revalidated with a conditional request, so an unchanged manifest is not sent
+//! again; object storage digests are fetched anew. Concurrent launches of the
+//! same image wait for a single fetch rather than each making their own.
+//!
+//! @param[in] vbr the VBR of the image
+//! @param[in] url where the digest comes from
+//! @param[in] bail_flag
+//!
+//! @return the digest (to be freed by the caller) or NULL on failure
+//!
+static char *get_digest(const virtualBootRecord * vbr, const char *url, boolean * bail_flag)
+{
+    char *digest = NULL;
+    char *fetched = NULL;
+    char lock_key[EUCA_MAX_PATH + 8] = "";
+    char etag[HTTP_VALIDATOR_SIZE] = "";
+    char last_modified[HTTP_VALIDATOR_SIZE] = "";
+    boolean fresh = FALSE;
+    boolean not_modified = FALSE;
+
+    snprintf(lock_key, sizeof(lock_key), "digest:%s", url);
+    sem_key_p(lock_key);
+
+    if (((digest = digest_cache_lookup(vbr->id, url, &fresh, etag, last_modified)) != NULL) && fresh) {
+        LOGDEBUG("[%s] using cached digest of %s\n", current_instanceId, vbr->id);
+        sem_key_v(lock_key);
+        return (digest);
+    }
+
+    if (vbr->locationType == NC_LOCATION_URL) {
+        if (((fetched = url_get_digest_if_changed(url, etag, last_modified, &not_modified)) == NULL) && !not_modified) {
+            // fall back on the retrying download, which does not give us validators
+            etag[0] = last_modified[0] = '\0';
+            fetched = url_get_digest(url, bail_flag);
+        }
+    } else {
+        fetched = objectstorage_get_digest(url);
+    }
+
+    if (fetched != NULL) {
+        EUCA_FREE(digest);
+        digest = fetched;
+        digest_cache_store(vbr->id, url, digest, etag, last_modified);
+    } else if (not_modified && (digest != NULL)) {
+        LOGDEBUG("[%s] cached digest of %s is still current\n", current_instanceId, vbr->id);
+        digest_cache_store(vbr->id, url, digest, etag, last_modified);
+    } else {
+        // never launch from a digest the server could not confirm
+        EUCA_FREE(digest);
+    }
+
+    sem_key_v(lock_key);
+    return (digest);
+}
+
 //!
 //!
 //!
@@ -1942,7 +2147,7 @@ static artifact *art_alloc_vbr(virtualBootRecord * vbr, boolean do_make_work_cop
             // get the digest for size and signature
             char manifestURL[EUCA_MAX_PATH] = "";
             snprintf(manifestURL, EUCA_MAX_PATH, "%s.manifest.xml", vbr->preparedResourceLocation);
-            blob_digest = url_get_digest(manifestURL, bail_flag);
+            blob_digest = get_digest(vbr, manifestURL, bail_flag);
             if (blob_digest == NULL)
                 goto u_out;
 
@@ -1956,6 +2161,9 @@ static artifact *art_alloc_vbr(virtualBootRecord * vbr, boolean do_make_work_cop
             char art_id[48];
             if (art_gen_id(art_id, sizeof(art_id), vbr->id, blob_digest) != EUCA_OK)
                 goto u_out;
+#ifndef _UNIT_TEST
+            image_peers_set_digest(art_id, blob_digest);
+#endif /* ! _UNIT_TEST */
 
             // allocate artifact struct
             a = art_alloc(art_id, art_id, bb_size_bytes, !is_migration_dest, must_be_file, FALSE, url_creator, vbr);
@@ -1966,7 +2174,7 @@ u_out:
         }
     case NC_LOCATION_OBJECT_STORAGE:{
             // get the digest for size and signature
-            if ((blob_digest = objectstorage_get_digest(vbr->preparedResourceLocation)) == NULL) {
+            if ((blob_digest = get_digest(vbr, vbr->preparedResourceLocation, bail_flag)) == NULL) {
                 LOGERROR("[%s] failed to obtain image digest from  objectstorage\n", current_instanceId);
                 goto w_out;
             }
@@ -1984,6 +2192,9 @@ u_out:
                 LOGERROR("[%s] failed to generate artifact id\n", current_instanceId);
                 goto w_out;
             }
+#ifndef _UNIT_TEST
+            image_peers_set_digest(art_id, blob_digest);
+#endif /* ! _UNIT_TEST */
             // allocate artifact struct
             a = art_alloc(art_id, art_id, bb_size_bytes, !is_migration_dest, must_be_file, FALSE, objectstorage_creator, vbr);
 
@@ -2531,6 +2742,98 @@ out:
     return root;
 }
 
+//!
+//! Parses and verifies an image VBR that is to be brought into the cache ahead
+//! of any instance needing it. Only machine images, kernels and ramdisks that
+//! are downloaded (and thus cached) qualify.
+//!
+//! @param[in] vbr pointer to a VBR record to parse and verify
+//! @param[in] pMeta a pointer to the node controller (NC) metadata structure
+//!
+//! @return EUCA_OK if the image can be pre-warmed or EUCA_INVALID_ERROR otherwise
+//!
+int vbr_parse_image(virtualBootRecord * vbr, ncMetadata * pMeta)
+{
+    if (parse_rec(vbr, NULL, pMeta) != EUCA_OK)
+        return (EUCA_INVALID_ERROR);
+
+    if ((vbr->type != NC_RESOURCE_IMAGE) && (vbr->type != NC_RESOURCE_KERNEL) && (vbr->type != NC_RESOURCE_RAMDISK)) {
+        LOGERROR("resource '%s' of type '%s' is not an image\n", vbr->id, vbr->typeName);
+        return (EUCA_INVALID_ERROR);
+    }
+
+    switch (vbr->locationType) {
+    case NC_LOCATION_URL:
+    case NC_LOCATION_OBJECT_STORAGE:
+    case NC_LOCATION_IMAGING:
+        break;
+    default:
+        LOGERROR("image '%s' at '%s' is not downloaded into the cache\n", vbr->id, vbr->resourceLocation);
+        return (EUCA_INVALID_ERROR);
+    }
+
+    return (EUCA_OK);
+}
+
+//!
+//! Creates a tree of artifacts that downloads a single image into the cache
+//! (caller must free the tree). The image artifact is allocated exactly as
+//! vbr_alloc_tree() allocates it for a launch, so that the launch finds it.
+//!
+//! @param[in] vbr pointer to an image VBR verified by vbr_parse_image()
+//! @param[in] bail_flag flag indicating that the download should bail
+//!
+//! @return A pointer to the root of artifact tree or NULL on error
+//!
+artifact *vbr_alloc_image_tree(virtualBootRecord * vbr, boolean * bail_flag)
+{
+    artifact *root = NULL;
+    artifact *dep = NULL;
+    boolean is_prereq = ((vbr->type == NC_RESOURCE_KERNEL) || (vbr->type == NC_RESOURCE_RAMDISK));
+
+    if ((root = art_alloc(vbr->id, NULL, -1, FALSE, FALSE, FALSE, NULL, NULL)) == NULL)   // allocate a sentinel artifact
+        return (NULL);
+
+    if ((dep = art_alloc_vbr(vbr, FALSE, FALSE, is_prereq, NULL, bail_flag)) == NULL) {
+        ART_FREE(root);
+        return (NULL);
+    }
+
+    if (art_add_dep(root, dep) != EUCA_OK) {
+        ART_FREE(dep);
+        ART_FREE(root);
+        return (NULL);
+    }
+
+    art_print_tree("", root);
+    return (root);
+}
+
+//!
+//! Finds the identifier under which the current version of an image is kept
+//! in the cache: the image ID with the hash of the image digest appended, the
+//! same as vbr_alloc_image_tree() and vbr_alloc_tree() use for its artifact.
+//!
+//! @param[in]  vbr pointer to an image VBR verified by vbr_parse_image()
+//! @param[out] id buffer for the artifact identifier
+//! @param[in]  id_size size of the buffer
+//! @param[in]  bail_flag flag indicating that fetching the digest should bail
+//!
+//! @return EUCA_OK on success or EUCA_ERROR if the digest could not be obtained
+//!
+int vbr_get_image_artifact_id(virtualBootRecord * vbr, char *id, unsigned int id_size, boolean * bail_flag)
+{
+    artifact *a = NULL;
+    boolean is_prereq = ((vbr->type == NC_RESOURCE_KERNEL) || (vbr->type == NC_RESOURCE_RAMDISK));
+
+    if ((a = art_alloc_vbr(vbr, FALSE, FALSE, is_prereq, NULL, bail_flag)) == NULL)
+        return (EUCA_ERROR);
+
+    euca_strncpy(id, a->id, id_size);
+    ART_FREE(a);
+    return (EUCA_OK);
+}
+
 //!
 //! Either opens a blockblob or creates it
 //!
@@ -178,6 +178,9 @@ artifact *art_alloc(const char *id, const char *sig, long long size_bytes, boole
 void art_set_instanceId(const char *instanceId);
 artifact *vbr_alloc_tree(virtualMachine * vm, boolean do_make_work_copy, boolean is_migration_dest, const char *sshkey, boolean * bail_flag,
                          const char *instanceId);
+int vbr_parse_image(virtualBootRecord * vbr, ncMetadata * pMeta);
+artifact *vbr_alloc_image_tree(virtualBootRecord * vbr, boolean * bail_flag);
+int vbr_get_image_artifact_id(virtualBootRecord * vbr, char *id, unsigned int id_size, boolean * bail_flag);
 int art_implement_tree(artifact * root, blobstore * work_bs, blobstore * cache_bs, const char *work_prefix, long long timeout_usec);
 
 /*----------------------------------------------------------------------------*\
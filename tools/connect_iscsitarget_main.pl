@@ -63,6 +63,7 @@
 use Crypt::OpenSSL::Random ;
 use Crypt::OpenSSL::RSA ;
 use MIME::Base64;
+use Fcntl qw(:flock);
 
 delete @ENV{qw(IFS CDPATH ENV BASH_ENV)};
 $ENV{'PATH'}='/bin:/usr/bin:/sbin:/usr/sbin/';
@@ -365,12 +366,22 @@ sub login_target {
 
 sub ensure_and_get_iface {
   my ($netdev) = @_;
+  # the NC only serializes connects per target, so two of them may race to create an iface
+  my $lockfile = "$euca_home/var/run/eucalyptus/iscsi-iface.lock";
+  my $lock_fh;
+  if (open($lock_fh, ">>", $lockfile)) {
+    flock($lock_fh, LOCK_EX);
+  } else {
+    print STDERR "Unable to open $lockfile, creating iface without a lock\n";
+    undef $lock_fh;
+  }
   %ifaces = lookup_iface();
   if (is_null_or_empty($ifaces{$netdev})) {
     $name = allocate_iface(values %ifaces);
     create_iface($name, $netdev);
     %ifaces = lookup_iface();
   }
+  close($lock_fh) if defined($lock_fh);
   return $ifaces{$netdev};
 }
 
@@ -131,6 +131,8 @@ static inline long long datetime_to_unixms(axutil_date_time_t * dt, const axutil
 static inline axutil_date_time_t *unixms_to_datetime(const axutil_env_t * env, long long timestampMs) _attribute_wur_;
 
 // ADB to and to ADB convertion helpers
+static inline void copy_vbr_type_from_adb(virtualBootRecord * vbr, adb_virtualBootRecordType_t * vbr_type, const axutil_env_t * env);
+static inline adb_virtualBootRecordType_t *copy_vbr_type_to_adb(const axutil_env_t * env, virtualBootRecord * vbr) _attribute_wur_;
 static inline void copy_vm_type_from_adb(virtualMachine * params, adb_virtualMachineType_t * vm_type, const axutil_env_t * env);
 static inline adb_virtualMachineType_t *copy_vm_type_to_adb(const axutil_env_t * env, virtualMachine * params) _attribute_wur_;
 static inline adb_serviceInfoType_t *copy_service_info_type_to_adb(const axutil_env_t * env, serviceInfoType * input) _attribute_wur_;
@@ -302,6 +304,52 @@ static inline axutil_date_time_t *unixms_to_datetime(const axutil_env_t * env, l
     return (NULL);
 }
 
+//!
+//! Helper to convert the ADB information into our virtual boot record structure
+//!
+//! @param[in] vbr a pointer to the virtual boot record to fill in
+//! @param[in] vbr_type a pointer to the ADB virtual boot record info
+//! @param[in] env pointer to the AXIS2 environment structure
+//!
+static inline void copy_vbr_type_from_adb(virtualBootRecord * vbr, adb_virtualBootRecordType_t * vbr_type, const axutil_env_t * env)
+{
+    euca_strncpy(vbr->resourceLocation, adb_virtualBootRecordType_get_resourceLocation(vbr_type, env), BIG_CHAR_BUFFER_SIZE);
+    LOGTRACE("resource location: %s\n", vbr->resourceLocation);
+    euca_strncpy(vbr->guestDeviceName, adb_virtualBootRecordType_get_guestDeviceName(vbr_type, env), SMALL_CHAR_BUFFER_SIZE);
+    LOGTRACE("   guest dev name: %s\n", vbr->guestDeviceName);
+    vbr->sizeBytes = (long long)adb_virtualBootRecordType_get_size(vbr_type, env);
+    LOGTRACE("             size: %lld\n", vbr->sizeBytes);
+    euca_strncpy(vbr->formatName, adb_virtualBootRecordType_get_format(vbr_type, env), SMALL_CHAR_BUFFER_SIZE);
+    LOGTRACE("           format: %s\n", vbr->formatName);
+    euca_strncpy(vbr->id, adb_virtualBootRecordType_get_id(vbr_type, env), SMALL_CHAR_BUFFER_SIZE);
+    LOGTRACE("               id: %s\n", vbr->id);
+    euca_strncpy(vbr->typeName, adb_virtualBootRecordType_get_type(vbr_type, env), SMALL_CHAR_BUFFER_SIZE);
+    LOGTRACE("             type: %s\n", vbr->typeName);
+}
+
+//!
+//! Helper to convert a virtual boot record structure into an ADB structure
+//!
+//! @param[in] env pointer to the AXIS2 environment structure
+//! @param[in] vbr a pointer to the virtual boot record to convert
+//!
+//! @return a pointer to the converted value or NULL if any error occured.
+//!
+static inline adb_virtualBootRecordType_t *copy_vbr_type_to_adb(const axutil_env_t * env, virtualBootRecord * vbr)
+{
+    adb_virtualBootRecordType_t *vbr_type = NULL;
+
+    if ((vbr_type = adb_virtualBootRecordType_create(env)) != NULL) {
+        adb_virtualBootRecordType_set_resourceLocation(vbr_type, env, vbr->resourceLocation);
+        adb_virtualBootRecordType_set_guestDeviceName(vbr_type, env, vbr->guestDeviceName);
+        adb_virtualBootRecordType_set_size(vbr_type, env, (int64_t) vbr->sizeBytes);
+        adb_virtualBootRecordType_set_format(vbr_type, env, vbr->formatName);
+        adb_virtualBootRecordType_set_id(vbr_type, env, vbr->id);
+        adb_virtualBootRecordType_set_type(vbr_type, env, vbr->typeName);
+    }
+    return (vbr_type);
+}
+
 //!
 //! Helper to conver the ADB information into our virtual machine structure
 //!
@@ -323,18 +371,7 @@ static inline void copy_vm_type_from_adb(virtualMachine * params, adb_virtualMac
         params->virtualBootRecordLen = adb_virtualMachineType_sizeof_virtualBootRecord(vm_type, env);
         for (i = 0; ((i < EUCA_MAX_VBRS) && (i < params->virtualBootRecordLen)); i++) {
             if ((vbr_type = adb_virtualMachineType_get_virtualBootRecord_at(vm_type, env, i)) != NULL) {
-                euca_strncpy(params->virtualBootRecord[i].resourceLocation, adb_virtualBootRecordType_get_resourceLocation(vbr_type, env), BIG_CHAR_BUFFER_SIZE);
-                LOGTRACE("resource location: %s\n", params->virtualBootRecord[i].resourceLocation);
-                euca_strncpy(params->virtualBootRecord[i].guestDeviceName, adb_virtualBootRecordType_get_guestDeviceName(vbr_type, env), SMALL_CHAR_BUFFER_SIZE);
-                LOGTRACE("   guest dev name: %s\n", params->virtualBootRecord[i].guestDeviceName);
-                params->virtualBootRecord[i].sizeBytes = (long long)adb_virtualBootRecordType_get_size(vbr_type, env);
-                LOGTRACE("             size: %lld\n", params->virtualBootRecord[i].sizeBytes);
-                euca_strncpy(params->virtualBootRecord[i].formatName, adb_virtualBootRecordType_get_format(vbr_type, env), SMALL_CHAR_BUFFER_SIZE);
-                LOGTRACE("           format: %s\n", params->virtualBootRecord[i].formatName);
-                euca_strncpy(params->virtualBootRecord[i].id, adb_virtualBootRecordType_get_id(vbr_type, env), SMALL_CHAR_BUFFER_SIZE);
-                LOGTRACE("               id: %s\n", params->virtualBootRecord[i].id);
-                euca_strncpy(params->virtualBootRecord[i].typeName, adb_virtualBootRecordType_get_type(vbr_type, env), SMALL_CHAR_BUFFER_SIZE);
-                LOGTRACE("             type: %s\n", params->virtualBootRecord[i].typeName);
+                copy_vbr_type_from_adb(&(params->virtualBootRecord[i]), vbr_type, env);
             }
         }
     }
@@ -365,13 +402,7 @@ static inline adb_virtualMachineType_t *copy_vm_type_to_adb(const axutil_env_t *
             for (i = 0; ((i < EUCA_MAX_VBRS) && (i < params->virtualBootRecordLen)); i++) {
                 vbr = &params->virtualBootRecord[i];
                 if (strlen(vbr->resourceLocation) > 0) {
-                    if ((vbr_type = adb_virtualBootRecordType_create(env)) != NULL) {
-                        adb_virtualBootRecordType_set_resourceLocation(vbr_type, env, vbr->resourceLocation);
-                        adb_virtualBootRecordType_set_guestDeviceName(vbr_type, env, vbr->guestDeviceName);
-                        adb_virtualBootRecordType_set_size(vbr_type, env, (int64_t) vbr->sizeBytes);
-                        adb_virtualBootRecordType_set_format(vbr_type, env, vbr->formatName);
-                        adb_virtualBootRecordType_set_id(vbr_type, env, vbr->id);
-                        adb_virtualBootRecordType_set_type(vbr_type, env, vbr->typeName);
+                    if ((vbr_type = copy_vbr_type_to_adb(env, vbr)) != NULL) {
                         adb_virtualMachineType_add_virtualBootRecord(vm_type, env, vbr_type);
                     }
                 }
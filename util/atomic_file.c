@@ -77,7 +77,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
 
 #include <log.h>
 #include <http.h>
@@ -90,6 +95,10 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! Events that mean the watched source was (re)written, replaced or removed. IN_MODIFY is
+//! left out on purpose so that a writer still in the middle of the file does not wake us.
+#define ATOMIC_FILE_WATCH_EVENTS       (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  TYPEDEFS                                  |
@@ -134,6 +143,8 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+static void atomic_file_drain_events(atomic_file * file);
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                   MACROS                                   |
@@ -204,6 +215,7 @@ int atomic_file_get(atomic_file * file, boolean * file_updated)
     int fd = 0;
     int ret = 0;
     int rc = 0;
+    boolean not_modified = FALSE;
     char *hash = NULL;
     char type[32] = "";
     char hostname[512] = "";
@@ -218,6 +230,16 @@ int atomic_file_get(atomic_file * file, boolean * file_updated)
     ret = 0;
     *file_updated = FALSE;
 
+    // with a watch in place, an unchanged source costs nothing until an event says otherwise
+    if (file->watching) {
+        atomic_file_drain_events(file);
+        if (!file->changed && ((time(NULL) - file->lastcheck) < ATOMIC_FILE_RECHECK_SEC) && !check_file(file->dest)) {
+            return (0);
+        }
+        file->changed = FALSE;
+    }
+    file->lastcheck = time(NULL);
+
     snprintf(file->tmpfile, EUCA_MAX_PATH, "%s", file->tmpfilebase);
     fd = safe_mkstemp(file->tmpfile);
     if (fd < 0) {
@@ -237,10 +259,17 @@ int atomic_file_get(atomic_file * file, boolean * file_updated)
     snprintf(path, EUCA_MAX_PATH, "/%s", tmppath);
 
     if (!strcmp(type, "http")) {
-        rc = http_get_timeout(file->source, file->tmpfile, 0, 0, 10, 15, NULL);
+        // a lost dest file has to be fetched again in full
+        if (check_file(file->dest)) {
+            file->etag[0] = file->last_modified[0] = '\0';
+        }
+        rc = http_get_if_changed(file->source, file->tmpfile, file->etag, file->last_modified, 10, 15, &not_modified);
         if (rc) {
             LOGERROR("http client failed to fetch file URL=%s: check http server status\n", file->source);
             ret = 1;
+        } else if (not_modified) {
+            unlink(file->tmpfile);
+            return (0);
         }
     } else if (!strcmp(type, "file")) {
         if (!strlen(path) || copy_file(path, file->tmpfile)) {
@@ -285,10 +314,139 @@ int atomic_file_get(atomic_file * file, boolean * file_updated)
         }
     }
 
+    // do not lose the event that brought us here if the source could not be read
+    if (ret && file->watching) {
+        file->changed = TRUE;
+    }
+
     unlink(file->tmpfile);
     return (ret);
 }
 
+//!
+//! Sets up an inotify watch on the directory of a file:// source so that atomic_file_wait()
+//! returns as soon as the source is rewritten and atomic_file_get() does not have to copy
+//! and hash an unchanged source. The directory is watched rather than the file itself so
+//! that a source replaced with rename() keeps being tracked. http:// sources need no watch
+//! as atomic_file_get() already uses conditional requests for them.
+//!
+//! @param[in] file pointer to an initialized atomic file
+//!
+//! @return 0 if the source is being watched (or needs no watch) or 1 if we fall back on polling
+//!
+//! @see atomic_file_wait()
+//!
+int atomic_file_watch(atomic_file * file)
+{
+    int port = 0;
+    char type[32] = "";
+    char hostname[512] = "";
+    char path[EUCA_MAX_PATH] = "";
+    char dir[EUCA_MAX_PATH] = "";
+    char base[EUCA_MAX_PATH] = "";
+    char tmpsource[EUCA_MAX_PATH] = "";
+    char tmppath[EUCA_MAX_PATH] = "";
+
+    if (!file) {
+        return (1);
+    }
+
+    if (file->watching) {
+        return (0);
+    }
+
+    snprintf(tmpsource, EUCA_MAX_PATH, "%s", file->source);
+    tokenize_uri(tmpsource, type, hostname, &port, tmppath);
+    if (strcmp(type, "file")) {
+        return (0);
+    }
+
+    snprintf(path, EUCA_MAX_PATH, "/%s", tmppath);
+    snprintf(dir, EUCA_MAX_PATH, "%s", path);
+    snprintf(base, EUCA_MAX_PATH, "%s", path);
+    snprintf(file->watchname, EUCA_MAX_PATH, "%s", basename(base));
+
+    if ((file->watchfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        LOGWARN("cannot initialize inotify: polling %s instead\n", path);
+        return (1);
+    }
+
+    if (inotify_add_watch(file->watchfd, dirname(dir), ATOMIC_FILE_WATCH_EVENTS) < 0) {
+        LOGWARN("cannot watch directory of %s: polling it instead\n", path);
+        close(file->watchfd);
+        return (1);
+    }
+
+    LOGDEBUG("watching %s for changes\n", path);
+    file->watching = TRUE;
+    file->changed = TRUE;
+    return (0);
+}
+
+//!
+//! Blocks until the watched source changes or the timeout expires. Without a watch
+//! (http:// source, or inotify not available) this simply sleeps for the timeout.
+//! A signal ends the wait early.
+//!
+//! @param[in] file pointer to an atomic file
+//! @param[in] timeout_ms the maximum number of milliseconds to wait
+//!
+//! @return TRUE if a change to the source was seen, FALSE otherwise
+//!
+//! @see atomic_file_watch()
+//!
+int atomic_file_wait(atomic_file * file, int timeout_ms)
+{
+    struct pollfd pfd = { 0 };
+
+    if (!file || !file->watching) {
+        poll(NULL, 0, timeout_ms);
+        return (FALSE);
+    }
+
+    atomic_file_drain_events(file);
+    if (!file->changed) {
+        pfd.fd = file->watchfd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            atomic_file_drain_events(file);
+        }
+    }
+    return (file->changed);
+}
+
+//!
+//! Consumes all pending inotify events and flags the file as changed if one
+//! of them was about the source (or if events were lost).
+//!
+//! @param[in] file pointer to a watched atomic file
+//!
+static void atomic_file_drain_events(atomic_file * file)
+{
+    ssize_t len = 0;
+    char *ptr = NULL;
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event = NULL;
+
+    while ((len = read(file->watchfd, buf, sizeof(buf))) > 0) {
+        for (ptr = buf; ptr < (buf + len); ptr += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)ptr;
+            if (event->mask & IN_Q_OVERFLOW) {
+                file->changed = TRUE;
+            } else if (event->mask & IN_IGNORED) {
+                // the directory itself went away, go back to polling
+                LOGWARN("watch on the directory of %s was removed: polling it instead\n", file->source);
+                close(file->watchfd);
+                file->watching = FALSE;
+                file->changed = TRUE;
+                return;
+            } else if (event->len && !strcmp(event->name, file->watchname)) {
+                file->changed = TRUE;
+            }
+        }
+    }
+}
+
 //!
 //! Function description.
 //!
@@ -383,6 +541,9 @@ int atomic_file_free(atomic_file * file)
 
     if (file->currhash)
         EUCA_FREE(file->currhash);
+
+    if (file->watching)
+        close(file->watchfd);
     bzero(file, sizeof(atomic_file));
     return (0);
 }
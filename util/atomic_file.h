@@ -77,12 +77,17 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+#include <time.h>
+#include <http.h>                      // HTTP_VALIDATOR_SIZE
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  DEFINES                                   |
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+#define ATOMIC_FILE_RECHECK_SEC                   60    //!< a watched source is still read this often, in case an event was missed
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  TYPEDEFS                                  |
@@ -108,6 +113,13 @@ typedef struct atomic_file_t {
     char source[EUCA_MAX_PATH];
     char *lasthash, *currhash;
     int dosort;
+    boolean watching;                  //!< TRUE if watchfd holds an inotify watch on the directory of a file:// source
+    int watchfd;                       //!< inotify descriptor (only valid when watching is TRUE)
+    boolean changed;                   //!< an event (or a periodic recheck) says the source has to be read again
+    time_t lastcheck;                  //!< when the source was last actually read
+    char watchname[EUCA_MAX_PATH];     //!< basename of the source within the watched directory
+    char etag[HTTP_VALIDATOR_SIZE];    //!< ETag of the last http:// fetch
+    char last_modified[HTTP_VALIDATOR_SIZE];    //!< Last-Modified of the last http:// fetch
 } atomic_file;
 
 /*----------------------------------------------------------------------------*\
@@ -125,6 +137,8 @@ typedef struct atomic_file_t {
 int atomic_file_init(atomic_file * file, char *source, char *dest, int dosort);
 int atomic_file_set_source(atomic_file * file, char *newsource);
 int atomic_file_get(atomic_file * file, boolean * file_updated);
+int atomic_file_watch(atomic_file * file);
+int atomic_file_wait(atomic_file * file, int timeout_ms);
 int atomic_file_free(atomic_file * file);
 int atomic_file_sort_tmpfile(atomic_file * file);
 int strcmp_ptr(const void *ina, const void *inb);
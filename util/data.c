@@ -89,6 +89,9 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+#define INSTANCE_INDEX_MIN_SIZE                  64    //!< Initial number of buckets of an instance list index
+#define INSTANCE_INDEX_LOAD_FACTOR                2    //!< Grow the index when there are more than this many instances per bucket
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  TYPEDEFS                                  |
@@ -285,6 +288,10 @@ const char *euca_error_names[] = {
 \*----------------------------------------------------------------------------*/
 
 static ncVolume *find_volume(ncInstance * pInstance, const char *interfaceId);
+static u32 instance_id_hash(const char *sInstanceId);
+static int instance_index_grow(bunchOfInstances * pHead, u32 size);
+static void instance_index_unlink(bunchOfInstances * pHead, bunchOfInstances * pNode);
+static bunchOfInstances *find_instance_node(bunchOfInstances * pHead, const char *sInstanceId);
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -602,6 +609,108 @@ void free_instance(ncInstance ** ppInstance)
     }
 }
 
+//!
+//! Computes the index hash of an instance identifier (32 bits FNV-1a)
+//!
+//! @param[in] sInstanceId the instance identifier string (i-XXXXXXXX)
+//!
+//! @return the hash value of the identifier
+//!
+static u32 instance_id_hash(const char *sInstanceId)
+{
+    u32 hash = 2166136261U;
+    const unsigned char *p = (const unsigned char *)sInstanceId;
+
+    while (*p) {
+        hash ^= *p++;
+        hash *= 16777619U;
+    }
+    return (hash);
+}
+
+//!
+//! (Re)builds the index of an instance list with the given number of buckets
+//!
+//! @param[in] pHead a pointer to the head of the list
+//! @param[in] size the number of buckets to use (must be a power of 2)
+//!
+//! @return EUCA_OK on success or EUCA_MEMORY_ERROR if we fail to allocate memory. On failure,
+//!         the existing index is left untouched.
+//!
+static int instance_index_grow(bunchOfInstances * pHead, u32 size)
+{
+    u32 bucket = 0;
+    bunchOfInstances *pNode = NULL;
+    bunchOfInstances **ppBuckets = NULL;
+    instanceIndex *pIndex = pHead->index;
+
+    if ((ppBuckets = EUCA_ZALLOC(size, sizeof(bunchOfInstances *))) == NULL)
+        return (EUCA_MEMORY_ERROR);
+
+    if (pIndex == NULL) {
+        if ((pIndex = EUCA_ZALLOC(1, sizeof(instanceIndex))) == NULL) {
+            EUCA_FREE(ppBuckets);
+            return (EUCA_MEMORY_ERROR);
+        }
+        pHead->index = pIndex;
+    }
+
+    for (pNode = pHead; pNode; pNode = pNode->next) {
+        bucket = instance_id_hash(pNode->instance->instanceId) & (size - 1);
+        pNode->hash_next = ppBuckets[bucket];
+        ppBuckets[bucket] = pNode;
+    }
+
+    EUCA_FREE(pIndex->buckets);
+    pIndex->buckets = ppBuckets;
+    pIndex->size = size;
+    return (EUCA_OK);
+}
+
+//!
+//! Removes a node from the index of its instance list
+//!
+//! @param[in] pHead a pointer to the head of the list
+//! @param[in] pNode a pointer to the node to remove from the index
+//!
+static void instance_index_unlink(bunchOfInstances * pHead, bunchOfInstances * pNode)
+{
+    bunchOfInstances **ppLink = NULL;
+    instanceIndex *pIndex = pHead->index;
+
+    ppLink = &(pIndex->buckets[instance_id_hash(pNode->instance->instanceId) & (pIndex->size - 1)]);
+    for (; *ppLink; ppLink = &((*ppLink)->hash_next)) {
+        if (*ppLink == pNode) {
+            *ppLink = pNode->hash_next;
+            break;
+        }
+    }
+    pNode->hash_next = NULL;
+}
+
+//!
+//! Looks up the list node holding the instance with the given identifier
+//!
+//! @param[in] pHead a pointer to the head of the list
+//! @param[in] sInstanceId the instance identifier string (i-XXXXXXXX)
+//!
+//! @return a pointer to the node if found. Otherwise, NULL is returned.
+//!
+static bunchOfInstances *find_instance_node(bunchOfInstances * pHead, const char *sInstanceId)
+{
+    bunchOfInstances *pNode = NULL;
+
+    if ((pHead == NULL) || (pHead->index == NULL))
+        return (NULL);
+
+    pNode = pHead->index->buckets[instance_id_hash(sInstanceId) & (pHead->index->size - 1)];
+    for (; pNode; pNode = pNode->hash_next) {
+        if (!strcmp(pNode->instance->instanceId, sInstanceId))
+            return (pNode);
+    }
+    return (NULL);
+}
+
 //!
 //! Adds an instance to an instance linked list
 //!
@@ -616,49 +725,55 @@ void free_instance(ncInstance ** ppInstance)
 //! @pre \li Both \p ppHead and \p pInstance field must not be NULL.
 //!      \li The instance must not be part of the list
 //!
-//! @post The instance is added to the list. If this is the first instance in the list,
-//!       the \p ppHead value is updated to point to this instance.
+//! @post The instance is appended to the list and indexed. If this is the first instance
+//!       in the list, the \p ppHead value is updated to point to this instance.
 //!
 int add_instance(bunchOfInstances ** ppHead, ncInstance * pInstance)
 {
+    u32 bucket = 0;
     bunchOfInstances *pNew = NULL;
-    bunchOfInstances *pLast = NULL;
-    bunchOfInstances *pNext = NULL;
+    bunchOfInstances *pHead = NULL;
 
     // Make sure our paramters are valid
     if ((ppHead == NULL) || (pInstance == NULL))
         return (EUCA_INVALID_ERROR);
 
+    // Make sure we're not trying to add a duplicate
+    if (find_instance_node(*ppHead, pInstance->instanceId) != NULL)
+        return (EUCA_DUPLICATE_ERROR);
+
     // Try to allocate memory for our instance list node
     if ((pNew = EUCA_ZALLOC(1, sizeof(bunchOfInstances))) == NULL)
         return (EUCA_MEMORY_ERROR);
 
     // Initialize our node
     pNew->instance = pInstance;
-    pNew->next = NULL;
 
     // Are we the first item in this list?
-    if (*ppHead == NULL) {
+    if ((pHead = *ppHead) == NULL) {
+        if (instance_index_grow(pNew, INSTANCE_INDEX_MIN_SIZE) != EUCA_OK) {
+            EUCA_FREE(pNew);
+            return (EUCA_MEMORY_ERROR);
+        }
+        pNew->count = 1;
+        pNew->last = pNew;
         *ppHead = pNew;
-        (*ppHead)->count = 1;
-    } else {
-        pNext = *ppHead;
+        return (EUCA_OK);
+    }
 
-        //
-        // Process the list to make sure we're not trying to add a duplicate
-        //
-        do {
-            pLast = pNext;
-            if (!strcmp(pLast->instance->instanceId, pInstance->instanceId)) {
-                EUCA_FREE(pNew);
-                return (EUCA_DUPLICATE_ERROR);
-            }
-            pNext = pLast->next;
-        } while (pLast->next);
+    // We're appending at the end so iteration keeps the insertion order
+    pNew->prev = pHead->last;
+    pHead->last->next = pNew;
+    pHead->last = pNew;
+    pHead->count++;
+
+    bucket = instance_id_hash(pInstance->instanceId) & (pHead->index->size - 1);
+    pNew->hash_next = pHead->index->buckets[bucket];
+    pHead->index->buckets[bucket] = pNew;
 
-        // We're at the end so add it there.
-        pLast->next = pNew;
-        (*ppHead)->count++;
+    // Keep the chains short. If we can't grow, the current index remains valid.
+    if (pHead->count > (INSTANCE_INDEX_LOAD_FACTOR * pHead->index->size)) {
+        instance_index_grow(pHead, (pHead->index->size << 1));
     }
 
     return (EUCA_OK);
@@ -683,32 +798,44 @@ int add_instance(bunchOfInstances ** ppHead, ncInstance * pInstance)
 //!
 int remove_instance(bunchOfInstances ** ppHead, ncInstance * pInstance)
 {
-    u32 count = 0;
     bunchOfInstances *pHead = NULL;
-    bunchOfInstances *pPrevious = NULL;
+    bunchOfInstances *pNode = NULL;
+    bunchOfInstances *pNext = NULL;
 
     // Make sure our parameters are valid
-    if (ppHead && pInstance) {
-        for (pHead = *ppHead; pHead; pPrevious = pHead, pHead = pHead->next) {
-            count = (*ppHead)->count;
+    if ((ppHead == NULL) || (pInstance == NULL))
+        return (EUCA_INVALID_ERROR);
 
-            if (!strcmp(pHead->instance->instanceId, pInstance->instanceId)) {
-                if (pPrevious) {
-                    pPrevious->next = pHead->next;
-                } else {
-                    *ppHead = pHead->next;
-                }
+    pHead = *ppHead;
+    if ((pNode = find_instance_node(pHead, pInstance->instanceId)) == NULL)
+        return (EUCA_NOT_FOUND_ERROR);
 
-                if (*ppHead) {
-                    (*ppHead)->count = count - 1;
-                }
-                EUCA_FREE(pHead);
-                return (EUCA_OK);
-            }
+    instance_index_unlink(pHead, pNode);
+
+    if (pNode->prev)
+        pNode->prev->next = pNode->next;
+    if (pNode->next)
+        pNode->next->prev = pNode->prev;
+
+    if (pNode == pHead) {
+        // The next node, if any, becomes the head and takes over the list-wide fields
+        if ((pNext = pNode->next) != NULL) {
+            pNext->count = pHead->count - 1;
+            pNext->last = pHead->last;
+            pNext->index = pHead->index;
+        } else {
+            EUCA_FREE(pHead->index->buckets);
+            EUCA_FREE(pHead->index);
         }
-        return (EUCA_NOT_FOUND_ERROR);
+        *ppHead = pNext;
+    } else {
+        if (pHead->last == pNode)
+            pHead->last = pNode->prev;
+        pHead->count--;
     }
-    return (EUCA_INVALID_ERROR);
+
+    EUCA_FREE(pNode);
+    return (EUCA_OK);
 }
 
 //!
@@ -752,15 +879,12 @@ int for_each_instance(bunchOfInstances ** ppHead, instance_action pFunction, voi
 //!
 ncInstance *find_instance(bunchOfInstances ** ppHead, const char *sInstanceId)
 {
-    bunchOfInstances *pHead = NULL;
+    bunchOfInstances *pNode = NULL;
 
     // Make sure our parameters aren't NULL
     if (ppHead && sInstanceId) {
-        for (pHead = *ppHead; pHead; pHead = pHead->next) {
-            if (!strcmp(pHead->instance->instanceId, sInstanceId)) {
-                return (pHead->instance);
-            }
-        }
+        if ((pNode = find_instance_node(*ppHead, sInstanceId)) != NULL)
+            return (pNode->instance);
     }
     return (NULL);
 }
@@ -808,6 +932,96 @@ int total_instances(bunchOfInstances ** ppHead)
     return (0);
 }
 
+//!
+//! Frees all the nodes of an instance list and, optionally, the instances they point to
+//!
+//! @param[in,out] ppHead a pointer to the pointer to the head of the list
+//! @param[in]     free_instances set to TRUE to also free the instances held in the list
+//!
+//! @post The list is emptied and \p (*ppHead) is set to NULL
+//!
+void free_instance_list(bunchOfInstances ** ppHead, boolean free_instances)
+{
+    bunchOfInstances *pHead = NULL;
+    bunchOfInstances *pNext = NULL;
+
+    if ((ppHead == NULL) || (*ppHead == NULL))
+        return;
+
+    if ((*ppHead)->index) {
+        EUCA_FREE((*ppHead)->index->buckets);
+        EUCA_FREE((*ppHead)->index);
+    }
+
+    for (pHead = *ppHead; pHead; pHead = pNext) {
+        pNext = pHead->next;
+        if (free_instances)
+            EUCA_FREE(pHead->instance);
+        EUCA_FREE(pHead);
+    }
+    *ppHead = NULL;
+}
+
+//!
+//! Creates a snapshot of an instance list. Every instance is copied so the snapshot remains
+//! valid regardless of what happens to the original list afterward.
+//!
+//! @param[in] ppHead a pointer to the pointer to the head of the list to copy
+//!
+//! @return a pointer to the new snapshot holding one reference or NULL if we fail to allocate memory
+//!
+//! @pre The \p ppHead field must not be NULL and the list must not change while it is copied
+//!
+//! @see free_instance_snapshot()
+//!
+instanceSnapshot *snapshot_instances(bunchOfInstances ** ppHead)
+{
+    bunchOfInstances *pHead = NULL;
+    ncInstance *pInstance = NULL;
+    instanceSnapshot *pSnapshot = NULL;
+
+    if (ppHead == NULL)
+        return (NULL);
+
+    if ((pSnapshot = EUCA_ZALLOC(1, sizeof(instanceSnapshot))) == NULL)
+        return (NULL);
+    pSnapshot->refs = 1;
+
+    for (pHead = *ppHead; pHead; pHead = pHead->next) {
+        if ((pInstance = EUCA_ZALLOC(1, sizeof(ncInstance))) == NULL) {
+            free_instance_snapshot(&pSnapshot);
+            return (NULL);
+        }
+
+        memcpy(pInstance, pHead->instance, sizeof(ncInstance));
+        if (add_instance(&(pSnapshot->head), pInstance) != EUCA_OK) {
+            EUCA_FREE(pInstance);
+            free_instance_snapshot(&pSnapshot);
+            return (NULL);
+        }
+    }
+
+    return (pSnapshot);
+}
+
+//!
+//! Frees a snapshot created by snapshot_instances() along with its copied instances
+//!
+//! @param[in,out] ppSnapshot a pointer to the snapshot pointer
+//!
+//! @pre The snapshot must not be referenced anymore
+//!
+//! @post The snapshot is freed and \p (*ppSnapshot) is set to NULL
+//!
+void free_instance_snapshot(instanceSnapshot ** ppSnapshot)
+{
+    if ((ppSnapshot == NULL) || (*ppSnapshot == NULL))
+        return;
+
+    free_instance_list(&((*ppSnapshot)->head), TRUE);
+    EUCA_FREE((*ppSnapshot));
+}
+
 //!
 //! Allocate and initialize a resource structure with given information. Resource is
 //! used to return information about resources
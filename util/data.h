@@ -101,6 +101,9 @@
 #define HOSTNAME_SIZE                             256   //!< Hostname buffer size
 #define CREDENTIAL_SIZE                            17   //!< Migration-credential buffer size (16 chars + NULL)
 #define MAX_SERVICE_URIS                            8   //!< Maximum number of serivce URIs Euca message can carry
+#define MAX_CACHED_IMAGES_ADVERTISED               32   //!< Maximum number of cached image artifacts a node advertises to its peers
+#define CACHED_IMAGE_ID_SIZE                       48   //!< Cached image artifact identifier buffer size
+#define MAX_PREWARM_IMAGES                         64   //!< Maximum number of images in a pre-warm request or in a residency report
 
 #define KEY_STRING_SIZE                          4096   //! Buffer to hold RSA pub/private keys
 #define INSTANCE_ID_LEN                            11   //! Length of the instance ID string (i-xxxxxxxx\0)
@@ -481,16 +484,44 @@ typedef struct ncResource_t {
     int numberOfCoresAvailable;        //!< Currently available number of core on this node controller
     char publicSubnets[CHAR_BUFFER_SIZE];   //!< Public subnet configured on this node controller
     char hypervisor[CHAR_BUFFER_SIZE]; //!< Node hypervisor
+    int imagePeerPort;                 //!< Port of the image peer server on this node (0 if peer distribution is disabled)
+    char cachedImages[MAX_CACHED_IMAGES_ADVERTISED][CACHED_IMAGE_ID_SIZE]; //!< Image artifacts this node can serve to its peers
+    int cachedImagesLen;               //!< Number of valid entries in cachedImages
 } ncResource;
 
-//! Instance list node structure
-//! @todo make this into something smarter than a linked list
+//! Structure defining which images are in the cache of a NC
+typedef struct ncImageResidency_t {
+    char residentImages[MAX_PREWARM_IMAGES][CACHED_IMAGE_ID_SIZE]; //!< Image artifacts (emi|eki|eri-XXXXXXXX-YYYYYYYY, with the hash of the digest) fully present in the cache
+    int residentImagesLen;             //!< Number of valid entries in residentImages
+    char pendingImages[MAX_PREWARM_IMAGES][CACHED_IMAGE_ID_SIZE];  //!< Images queued or being fetched into the cache
+    int pendingImagesLen;              //!< Number of valid entries in pendingImages
+} ncImageResidency;
+
+//! Instance list node structure. The list keeps insertion order for iteration and
+//! is indexed by instance identifier for lookups.
 typedef struct bunchOfInstances_t {
     ncInstance *instance;              //!< Pointer to this node's assigned instance
     int count;                         //!< Number of instances in the list. Only valid on first node.
     struct bunchOfInstances_t *next;   //!< Pointer to our next node.
+    struct bunchOfInstances_t *prev;   //!< Pointer to our previous node (NULL on the first node)
+    struct bunchOfInstances_t *last;   //!< Pointer to the last node of the list. Only valid on first node.
+    struct bunchOfInstances_t *hash_next;   //!< Pointer to the next node in the same index bucket
+    struct instanceIndex_t *index;     //!< Index of the nodes by instance identifier. Only valid on first node.
 } bunchOfInstances;
 
+//! Hash index of an instance list by instance identifier
+typedef struct instanceIndex_t {
+    u32 size;                          //!< Number of buckets (always a power of 2)
+    bunchOfInstances **buckets;        //!< Chains of nodes linked through their hash_next field
+} instanceIndex;
+
+//! Reference counted, read-only copy of an instance list. Readers keep using the copy
+//! they acquired while a newer one is published, and the last one to release it frees it.
+typedef struct instanceSnapshot_t {
+    bunchOfInstances *head;            //!< Copied instance list (the instances are copies too)
+    int refs;                          //!< Number of holders of this snapshot
+} instanceSnapshot;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXPORTED VARIABLES                             |
@@ -554,6 +585,9 @@ int for_each_instance(bunchOfInstances ** ppHead, instance_action pFunction, voi
 ncInstance *find_instance(bunchOfInstances ** ppHead, const char *instanceId);
 ncInstance *get_instance(bunchOfInstances ** ppHead);
 int total_instances(bunchOfInstances ** ppHead);
+void free_instance_list(bunchOfInstances ** ppHead, boolean free_instances);
+instanceSnapshot *snapshot_instances(bunchOfInstances ** ppHead);
+void free_instance_snapshot(instanceSnapshot ** ppSnapshot);
 //! @}
 
 //! @{
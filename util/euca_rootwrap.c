@@ -65,7 +65,9 @@
 
 //!
 //! @file util/euca_rootwrap.c
-//! Need to provide description
+//! Runs the given command as root. When invoked with --broker as the only
+//! argument it instead stays resident, reading requests on stdin and running
+//! allowlisted commands as root (see euca_rootwrap.h for the protocol).
 //!
 
 /*----------------------------------------------------------------------------*\
@@ -79,10 +81,18 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
 
 #include "eucalyptus.h"
 #include "misc.h"
 #include "euca_string.h"
+#include "euca_rootwrap.h"
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -128,12 +138,33 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! Commands the broker will run. Everything else is refused and the client
+//! falls back to exec'ing euca_rootwrap directly.
+static const char *broker_allowed_cmds[] = {
+    "chmod", "chown", "cp", "dd", "file", "losetup", "mkdir", "mkfs.ext3", "mkswap", "parted", "tune2fs",
+    "brctl", "ip", "arping", "iptables", "iptables-save", "iptables-restore", "ebtables", "ebtables-save",
+    "ebtables-restore", "ipset", "iscsiadm", "dmsetup", "blockdev", "kpartx", "mount", "umount", "cat",
+    NULL,
+};
+
+//! Directories from which absolute command paths are accepted by the broker
+static const char *broker_trusted_dirs[] = {
+    "/bin", "/sbin", "/usr/bin", "/usr/sbin", "/usr/local/bin", "/usr/local/sbin",
+    NULL,
+};
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                              STATIC PROTOTYPES                             |
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+static int read_full(int fd, void *buf, size_t len);
+static int write_full(int fd, const void *buf, size_t len);
+static int broker_allowed(const char *cmd);
+static int broker_run(char **argv, uint32_t flags, int *status, char **output, uint32_t * output_len);
+static int broker_serve(int fd);
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                   MACROS                                   |
@@ -146,6 +177,245 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//!
+//! Reads exactly len bytes, retrying on short reads and EINTR
+//!
+//! @param[in] fd
+//! @param[in] buf
+//! @param[in] len
+//!
+//! @return 0 on success, -1 on error or EOF
+//!
+static int read_full(int fd, void *buf, size_t len)
+{
+    ssize_t rc = 0;
+    char *p = buf;
+
+    while (len > 0) {
+        if ((rc = read(fd, p, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        if (rc == 0)
+            return (-1);
+        p += rc;
+        len -= rc;
+    }
+    return (0);
+}
+
+//!
+//! Writes exactly len bytes, retrying on short writes and EINTR
+//!
+//! @param[in] fd
+//! @param[in] buf
+//! @param[in] len
+//!
+//! @return 0 on success, -1 on error
+//!
+static int write_full(int fd, const void *buf, size_t len)
+{
+    ssize_t rc = 0;
+    const char *p = buf;
+
+    while (len > 0) {
+        if ((rc = write(fd, p, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        p += rc;
+        len -= rc;
+    }
+    return (0);
+}
+
+//!
+//! Checks a command against the broker allowlist. Bare names are resolved
+//! through PATH as usual, absolute paths must live in a trusted directory.
+//!
+//! @param[in] cmd argv[0] of the request
+//!
+//! @return TRUE if the broker may run the command
+//!
+static int broker_allowed(const char *cmd)
+{
+    int i = 0;
+    size_t dirlen = 0;
+    const char *base = strrchr(cmd, '/');
+
+    if (base) {
+        dirlen = base - cmd;
+        base++;
+        for (i = 0; broker_trusted_dirs[i]; i++) {
+            if ((strlen(broker_trusted_dirs[i]) == dirlen) && !strncmp(cmd, broker_trusted_dirs[i], dirlen))
+                break;
+        }
+        if (broker_trusted_dirs[i] == NULL)
+            return (FALSE);
+    } else {
+        base = cmd;
+    }
+
+    for (i = 0; broker_allowed_cmds[i]; i++) {
+        if (!strcmp(base, broker_allowed_cmds[i]))
+            return (TRUE);
+    }
+    return (FALSE);
+}
+
+//!
+//! Runs one command for the broker and waits for it
+//!
+//! @param[in]  argv NULL-terminated argument list
+//! @param[in]  flags request flags (ROOTWRAP_BROKER_CAPTURE_OUTPUT)
+//! @param[out] status waitpid() status of the command
+//! @param[out] output captured stdout+stderr, if requested (caller frees)
+//! @param[out] output_len length of the captured output
+//!
+//! @return ROOTWRAP_BROKER_RAN or ROOTWRAP_BROKER_FAILED
+//!
+static int broker_run(char **argv, uint32_t flags, int *status, char **output, uint32_t * output_len)
+{
+    int fds[2] = { -1, -1 };
+    int devnull = -1;
+    size_t size = 0;
+    ssize_t rc = 0;
+    char discard[4096];
+    pid_t pid = -1;
+
+    *status = -1;
+    *output = NULL;
+    *output_len = 0;
+
+    if ((flags & ROOTWRAP_BROKER_CAPTURE_OUTPUT) && (pipe(fds) != 0))
+        return (ROOTWRAP_BROKER_FAILED);
+
+    if ((pid = fork()) < 0) {
+        if (fds[0] >= 0) {
+            close(fds[0]);
+            close(fds[1]);
+        }
+        return (ROOTWRAP_BROKER_FAILED);
+    }
+
+    if (pid == 0) {
+        // our stdin is the request socket, keep the command away from it
+        if ((devnull = open("/dev/null", O_RDONLY)) >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            close(devnull);
+        } else {
+            close(STDIN_FILENO);
+        }
+        if (fds[1] >= 0) {
+            close(fds[0]);
+            dup2(fds[1], STDOUT_FILENO);
+            dup2(fds[1], STDERR_FILENO);
+            close(fds[1]);
+        }
+        signal(SIGPIPE, SIG_DFL);
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+
+    if (fds[0] >= 0) {
+        close(fds[1]);
+        size = 4096;
+        *output = malloc(size);
+        for (;;) {
+            if ((*output != NULL) && (*output_len == size) && (size < ROOTWRAP_BROKER_MAX_OUTPUT)) {
+                char *grown = realloc(*output, size * 2);
+                if (grown) {
+                    *output = grown;
+                    size *= 2;
+                }
+            }
+            if ((*output != NULL) && (*output_len < size))
+                rc = read(fds[0], *output + *output_len, size - *output_len);
+            else
+                rc = read(fds[0], discard, sizeof(discard));
+            if (rc < 0 && errno == EINTR)
+                continue;
+            if (rc <= 0)
+                break;
+            if ((*output != NULL) && (*output_len < size))
+                *output_len += rc;
+        }
+        close(fds[0]);
+    }
+
+    while (waitpid(pid, status, 0) < 0) {
+        if (errno != EINTR) {
+            *status = -1;
+            break;
+        }
+    }
+    return (ROOTWRAP_BROKER_RAN);
+}
+
+//!
+//! Broker main loop. Serves requests from fd until the client goes away.
+//!
+//! @param[in] fd the request socket
+//!
+//! @return 0 when the client closes its end, 1 on a protocol error
+//!
+static int broker_serve(int fd)
+{
+    int i = 0;
+    int status = -1;
+    char *output = NULL;
+    char **argv = NULL;
+    uint32_t len = 0;
+    rootwrap_broker_request req = { 0 };
+    rootwrap_broker_response resp = { 0 };
+    rootwrap_broker_hello hello = { ROOTWRAP_BROKER_MAGIC, (uint32_t) getpid() };
+
+    signal(SIGPIPE, SIG_IGN);
+    if (write_full(fd, &hello, sizeof(hello)) != 0)
+        return (1);
+
+    while (read_full(fd, &req, sizeof(req)) == 0) {
+        if ((req.magic != ROOTWRAP_BROKER_MAGIC) || (req.argc < 1) || (req.argc > ROOTWRAP_BROKER_MAX_ARGS))
+            return (1);
+
+        if ((argv = calloc(req.argc + 1, sizeof(char *))) == NULL)
+            return (1);
+
+        for (i = 0; i < req.argc; i++) {
+            if ((read_full(fd, &len, sizeof(len)) != 0) || (len > ROOTWRAP_BROKER_MAX_ARG_LEN) || ((argv[i] = calloc(len + 1, 1)) == NULL)
+                || (read_full(fd, argv[i], len) != 0)) {
+                return (1);
+            }
+        }
+
+        resp.magic = ROOTWRAP_BROKER_MAGIC;
+        resp.seq = req.seq;
+        resp.status = -1;
+        resp.output_len = 0;
+        if (!broker_allowed(argv[0])) {
+            resp.result = ROOTWRAP_BROKER_DENIED;
+        } else {
+            resp.result = broker_run(argv, req.flags, &status, &output, &resp.output_len);
+            resp.status = status;
+        }
+
+        if ((write_full(fd, &resp, sizeof(resp)) != 0) || ((resp.output_len > 0) && (write_full(fd, output, resp.output_len) != 0)))
+            return (1);
+
+        free(output);
+        output = NULL;
+        for (i = 0; i < req.argc; i++)
+            free(argv[i]);
+        free(argv);
+        argv = NULL;
+    }
+
+    return (0);
+}
+
 //!
 //! Main entry point of the application
 //!
@@ -164,6 +434,18 @@ int main(int argc, char **argv)
     if (argc <= 1) {
         exit(1);
     }
+
+    if ((argc == 2) && !strcmp(argv[1], ROOTWRAP_BROKER_FLAG)) {
+        if (setresgid(((gid_t) 0), ((gid_t) 0), ((gid_t) 0)) || setresuid(((uid_t) 0), ((uid_t) 0), ((uid_t) 0)) || (geteuid() != 0)) {
+            // never serve requests without privileges, tell the client so it stops starting brokers
+            rootwrap_broker_hello hello = { ROOTWRAP_BROKER_MAGIC_UNPRIVILEGED, (uint32_t) getpid() };
+            perror("euca_rootwrap broker");
+            signal(SIGPIPE, SIG_IGN);
+            write_full(STDIN_FILENO, &hello, sizeof(hello));
+            exit(1);
+        }
+        exit(broker_serve(STDIN_FILENO));
+    }
     // Allocate memory for our new argument list so we can sanitize every arguments...
     if ((newargv = calloc((argc), sizeof(char *))) == NULL) {
         perror("alloc");
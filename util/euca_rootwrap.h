@@ -0,0 +1,145 @@
+// -*- mode: C; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+// vim: set softtabstop=4 shiftwidth=4 tabstop=4 expandtab:
+
+/*************************************************************************
+ * Copyright 2009-2012 Eucalyptus Systems, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ *
+ * Please contact Eucalyptus Systems, Inc., 6755 Hollister Ave., Goleta
+ * CA 93117, USA or visit http://www.eucalyptus.com/licenses/ if you need
+ * additional information or have any questions.
+ *
+ * This file may incorporate work covered under the following copyright
+ * and permission notice:
+ *
+ *   Software License Agreement (BSD License)
+ *
+ *   Copyright (c) 2008, Regents of the University of California
+ *   All rights reserved.
+ *
+ *   Redistribution and use of this software in source and binary forms,
+ *   with or without modification, are permitted provided that the
+ *   following conditions are met:
+ *
+ *     Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *     Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE. USERS OF THIS SOFTWARE ACKNOWLEDGE
+ *   THE POSSIBLE PRESENCE OF OTHER OPEN SOURCE LICENSED MATERIAL,
+ *   COPYRIGHTED MATERIAL OR PATENTED MATERIAL IN THIS SOFTWARE,
+ *   AND IF ANY SUCH MATERIAL IS DISCOVERED THE PARTY DISCOVERING
+ *   IT MAY INFORM DR. RICH WOLSKI AT THE UNIVERSITY OF CALIFORNIA,
+ *   SANTA BARBARA WHO WILL THEN ASCERTAIN THE MOST APPROPRIATE REMEDY,
+ *   WHICH IN THE REGENTS' DISCRETION MAY INCLUDE, WITHOUT LIMITATION,
+ *   REPLACEMENT OF THE CODE SO IDENTIFIED, LICENSING OF THE CODE SO
+ *   IDENTIFIED, OR WITHDRAWAL OF THE CODE CAPABILITY TO THE EXTENT
+ *   NEEDED TO COMPLY WITH ANY SUCH LICENSES OR RIGHTS.
+ ************************************************************************/
+
+#ifndef _INCLUDE_EUCA_ROOTWRAP_H_
+#define _INCLUDE_EUCA_ROOTWRAP_H_
+
+//!
+//! @file util/euca_rootwrap.h
+//! Wire protocol shared by the euca_rootwrap broker (euca_rootwrap --broker)
+//! and its client in misc.c. The broker reads requests from its stdin, which
+//! is one end of a socketpair created by the client, runs each allowed
+//! command as root and writes back one response per request, in order. Any
+//! number of requests may be written before reading the responses.
+//!
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  INCLUDES                                  |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  DEFINES                                   |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+#define ROOTWRAP_BROKER_FLAG                     "--broker"
+
+#define ROOTWRAP_BROKER_MAGIC                    0x45525742 //!< "ERWB"
+#define ROOTWRAP_BROKER_MAGIC_UNPRIVILEGED       0x45525755 //!< "ERWU", hello of a broker that could not become root
+#define ROOTWRAP_BROKER_MAX_ARGS                 256
+#define ROOTWRAP_BROKER_MAX_ARG_LEN              4096
+#define ROOTWRAP_BROKER_MAX_OUTPUT               (1024 * 1024)   //!< captured output beyond this is discarded
+#define ROOTWRAP_BROKER_HELLO_TIMEOUT_MS         5000
+
+#define ROOTWRAP_BROKER_CAPTURE_OUTPUT           0x1 //!< request flag: return stdout+stderr instead of inheriting them
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                ENUMERATIONS                                |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+//! Outcome of a broker request, separate from the command's own exit status
+typedef enum rootwrap_broker_result_t {
+    ROOTWRAP_BROKER_RAN = 0,           //!< command was run, status holds its waitpid() status
+    ROOTWRAP_BROKER_DENIED = 1,        //!< command is not on the broker's allowlist
+    ROOTWRAP_BROKER_FAILED = 2,        //!< broker could not run the command (fork/pipe failure)
+} rootwrap_broker_result;
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                 STRUCTURES                                 |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+//! Sent by the broker once it is running as root and ready for requests
+typedef struct rootwrap_broker_hello_t {
+    uint32_t magic;
+    uint32_t pid;
+} rootwrap_broker_hello;
+
+//! Request header, followed by argc (uint32_t length, bytes) pairs
+typedef struct rootwrap_broker_request_t {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t flags;
+    uint32_t argc;
+} rootwrap_broker_request;
+
+//! Response header, followed by output_len bytes of captured output
+typedef struct rootwrap_broker_response_t {
+    uint32_t magic;
+    uint32_t seq;
+    int32_t result;                    //!< one of rootwrap_broker_result
+    int32_t status;                    //!< waitpid() status of the command
+    uint32_t output_len;
+} rootwrap_broker_response;
+
+#endif /* ! _INCLUDE_EUCA_ROOTWRAP_H_ */
@@ -219,6 +219,8 @@
 #define CONFIG_NC_SWAP_SIZE                     "SWAP_SIZE"
 #define CONFIG_SAVE_INSTANCES                   "MANUAL_INSTANCES_CLEANUP"
 #define CONFIG_CONCURRENT_DISK_OPS              "CONCURRENT_DISK_OPS"
+#define CONFIG_NC_ROOTWRAP_BROKERS              "NC_ROOTWRAP_BROKERS"
+#define CONFIG_NC_IMAGE_PEER_PORT               "NC_IMAGE_PEER_PORT"
 #define CONFIG_SC_REQUEST_TIMEOUT               "SC_REQUEST_TIMEOUT"
 #define CONFIG_CONCURRENT_CLEANUP_OPS           "CONCURRENT_CLEANUP_OPS"
 #define CONFIG_DISABLE_SNAPSHOTS                "DISABLE_CACHE_SNAPSHOTS"
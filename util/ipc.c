@@ -116,6 +116,15 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! An entry in the keyed lock table, alive while anyone holds or waits for it
+typedef struct keyed_lock_t {
+    char *key;                         //!< what is being locked
+    int refs;                          //!< holder plus waiters
+    boolean held;                      //!< someone owns the lock
+    pthread_cond_t cond;               //!< signalled on release
+    struct keyed_lock_t *next;
+} keyed_lock;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXTERNAL VARIABLES                             |
@@ -136,6 +145,9 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+static pthread_mutex_t keyed_locks_mutex = PTHREAD_MUTEX_INITIALIZER;   //!< protects keyed_locks and all entries
+static keyed_lock *keyed_locks = NULL; //!< entries for keys currently locked or waited on
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                              STATIC PROTOTYPES                             |
@@ -472,3 +484,95 @@ int sem_v(sem * pSem)
 {
     return (sem_verhogen(pSem, TRUE));
 }
+
+//!
+//! Acquires an in-process lock named by an arbitrary string, blocking while another
+//! thread holds a lock with the same key. Useful for serializing work on one object
+//! (a volume, a storage target) without serializing work on unrelated ones. Locks
+//! only exist while held or waited on, so the set of keys need not be known upfront.
+//!
+//! @param[in] key the name of the lock
+//!
+//! @return 0 on success or -1 on failure
+//!
+//! @see sem_key_v()
+//!
+//! @pre The key field must not be NULL.
+//!
+//! @post On success, the caller owns the lock and must release it with sem_key_v()
+//!
+int sem_key_p(const char *key)
+{
+    keyed_lock *pLock = NULL;
+
+    if (key == NULL)
+        return (-1);
+
+    pthread_mutex_lock(&keyed_locks_mutex);
+    {
+        for (pLock = keyed_locks; pLock && strcmp(pLock->key, key); pLock = pLock->next) ;
+
+        if (pLock == NULL) {
+            if (((pLock = EUCA_ZALLOC(1, sizeof(keyed_lock))) == NULL) || ((pLock->key = strdup(key)) == NULL)) {
+                EUCA_FREE(pLock);
+                pthread_mutex_unlock(&keyed_locks_mutex);
+                return (-1);
+            }
+            pthread_cond_init(&(pLock->cond), NULL);
+            pLock->next = keyed_locks;
+            keyed_locks = pLock;
+        }
+
+        pLock->refs++;
+        while (pLock->held)
+            pthread_cond_wait(&(pLock->cond), &keyed_locks_mutex);
+        pLock->held = TRUE;
+    }
+    pthread_mutex_unlock(&keyed_locks_mutex);
+
+    LOGEXTREME("%s locked\n", key);
+    return (0);
+}
+
+//!
+//! Releases a lock acquired with sem_key_p(), waking up one of its waiters if any.
+//!
+//! @param[in] key the name of the lock
+//!
+//! @return 0 on success or -1 if the key was not locked
+//!
+//! @see sem_key_p()
+//!
+int sem_key_v(const char *key)
+{
+    keyed_lock *pLock = NULL;
+    keyed_lock **ppLock = NULL;
+
+    if (key == NULL)
+        return (-1);
+
+    pthread_mutex_lock(&keyed_locks_mutex);
+    {
+        for (ppLock = &keyed_locks; *ppLock && strcmp((*ppLock)->key, key); ppLock = &((*ppLock)->next)) ;
+
+        if (((pLock = *ppLock) == NULL) || !pLock->held) {
+            pthread_mutex_unlock(&keyed_locks_mutex);
+            LOGERROR("%s is not locked\n", key);
+            return (-1);
+        }
+
+        pLock->held = FALSE;
+        if (--pLock->refs == 0) {
+            *ppLock = pLock->next;
+            pthread_cond_destroy(&(pLock->cond));
+            EUCA_FREE(pLock->key);
+            EUCA_FREE(pLock);
+        } else {
+            pthread_cond_signal(&(pLock->cond));
+        }
+    }
+    pthread_mutex_unlock(&keyed_locks_mutex);
+
+    LOGEXTREME("%s unlocked\n", key);
+    return (0);
+}
@@ -159,6 +159,12 @@ int sem_verhogen(sem * pSem, boolean doLog);
 int sem_v(sem * pSem);
 //! @}
 
+//! @{
+//! @name Keyed lock APIs, serializing threads that work on the same named object
+int sem_key_p(const char *key);
+int sem_key_v(const char *key);
+//! @}
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                           STATIC INLINE PROTOTYPES                         |
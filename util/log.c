@@ -91,6 +91,7 @@
 #define SYSLOG_NAMES                   // we want facilities as strings
 #include <syslog.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include "eucalyptus.h"
 #include "log.h"
@@ -109,6 +110,16 @@
 #define DEFAULT_LOG_LEVEL                             4 //!< log level if none is specified (4==INFO)
 #define LOGFH_DEFAULT                            stdout //!< without a file, this is where log output goes
 #define USE_STANDARD_PREFIX                      "(standard)"   //!< a special string that means no custom prefix
+#define LOG_PREFIX_MAX                               64 //!< maximum length of a prefix specification, and so of its compiled form
+
+//! @{
+//! @name asynchronous logging parameters
+#define LOG_ASYNC_RING_SIZE                  (128 * 1024)   //!< size of each per-thread ring buffer, in bytes
+#define LOG_ASYNC_MAX_LINE                    (32 * 1024)   //!< longer lines bypass the rings and are written synchronously
+#define LOG_ASYNC_BATCH_SIZE                  (64 * 1024)   //!< the writer thread writes out at most this many bytes at once
+#define LOG_ASYNC_FLUSH_MS                            50    //!< the writer thread drains the rings at least this often
+#define LOG_ASYNC_FULL_WAIT_MS                       100    //!< how long a thread waits for room in its full ring before writing synchronously
+//! @}
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -122,12 +133,54 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! Log files the asynchronous writer can send lines to
+typedef enum log_target_e {
+    LOG_TARGET_MAIN = 0,               //!< log_file_path (or the log stream if no file is set)
+    LOG_TARGET_REQ_TRACK,              //!< log_file_path_req_track
+    LOG_TARGET_MAX,
+} log_target_e;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                 STRUCTURES                                 |
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! Per-thread, single producer and single consumer ring buffer of log lines. The owning
+//! thread only moves 'head' and the writer thread only moves 'tail', so neither side
+//! needs a lock. Positions are free running and wrap around naturally.
+typedef struct log_ring_t {
+    volatile u32 head;                 //!< position where the owning thread writes the next record
+    volatile u32 tail;                 //!< position where the writer thread reads the next record
+    volatile u32 in_use;               //!< set while a thread owns this ring
+    volatile u32 overflowed;           //!< number of lines written synchronously because the ring stayed full (owner only)
+    u32 overflowed_reported;           //!< number of those lines already reported (writer only)
+    struct log_ring_t *next;           //!< next ring in the list of all rings
+    char data[LOG_ASYNC_RING_SIZE];    //!< the records themselves
+} log_ring;
+
+//! One step of a compiled log prefix specification
+typedef struct log_prefix_op_t {
+    char field;                        //!< field to print ('T', 'L', 'p', 't', 'm', 'F' or 's') or '\0' for literal text
+    boolean left_justify;              //!< for truncated fields: truncate on the right and pad on the right
+    int width;                         //!< for truncated fields: width of the field or 0 to use the length of the value
+    int literal_start;                 //!< for literal text: offset of the text in the 'literals' buffer
+    int literal_len;                   //!< for literal text: length of the text
+} log_prefix_op;
+
+//! Log prefix specification compiled by log_prefix_compile(), so logprintfl() does not need to parse it for every line
+typedef struct log_prefix_t {
+    int nops;                          //!< number of operations in 'ops'
+    log_prefix_op ops[LOG_PREFIX_MAX]; //!< operations to execute in order
+    char literals[LOG_PREFIX_MAX];     //!< literal text referenced by the operations
+} log_prefix;
+
+//! Header preceding each line in a ring
+typedef struct log_record_t {
+    u32 len;                           //!< length of the line that follows, without terminating character
+    u32 target;                        //!< where to write it (log_target_e)
+} log_record;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXTERNAL VARIABLES                             |
@@ -216,10 +269,41 @@ static long log_max_size_bytes = MAXLOGFILESIZE;
 static char log_file_path[EUCA_MAX_PATH] = "";
 static char log_file_path_req_track[EUCA_MAX_PATH] = "";
 static char log_custom_prefix[34] = USE_STANDARD_PREFIX;    //!< any other string means use it as custom prefix
+static log_prefix log_custom_prefixes[2];   //!< compiled custom prefix, the one not in use is recompiled on change
+static log_prefix *volatile log_custom_ops = NULL;  //!< compiled custom prefix in use or NULL for the standard ones
 static sem *log_sem = NULL;            //!< if set, the semaphore will be used when logging & rotating logs
 static int syslog_facility = -1;       //!< if not -1 then we are logging to a syslog facility
 //! @}
 
+//! @{
+//! @name asynchronous logging state
+static volatile boolean log_async_enabled = FALSE;  //!< set while producers should queue their lines
+static boolean log_async_running = FALSE;   //!< set while the writer thread should keep going
+static pthread_t log_async_thread;     //!< the writer thread
+static pthread_mutex_t log_async_mutex = PTHREAD_MUTEX_INITIALIZER; //!< guards starting and stopping the writer
+static pthread_cond_t log_async_cond = PTHREAD_COND_INITIALIZER;    //!< used to wake up the writer thread
+static pthread_mutex_t log_write_mutex = PTHREAD_MUTEX_INITIALIZER; //!< serializes log writes within the process while the writer runs
+static pthread_once_t log_async_once = PTHREAD_ONCE_INIT;   //!< one-time registration of the hooks below
+static pthread_key_t log_async_key;    //!< releases the ring of an exiting thread
+static log_ring *volatile log_async_rings = NULL;  //!< all the rings ever allocated by this process (never shrinks)
+static __thread log_ring *log_async_ring = NULL;  //!< the ring owned by the current thread
+static char log_async_batch[LOG_TARGET_MAX][LOG_ASYNC_BATCH_SIZE];  //!< writer-side output buffers
+static int log_async_batch_len[LOG_TARGET_MAX] = { 0 };    //!< number of bytes pending in each output buffer
+static volatile long long log_async_written = 0;   //!< lines written out by the writer thread
+//! @}
+
+//! @{
+//! @name prefix formatting caches
+static pthread_once_t log_prefix_once = PTHREAD_ONCE_INIT;  //!< one-time compilation of the standard prefixes
+static log_prefix log_standard_prefixes[EUCA_LOG_OFF + 1];  //!< compiled log_level_prefix[] specifications
+static char log_level_labels[EUCA_LOG_OFF + 1][6];  //!< log level names as printed by the 'L' field
+static __thread time_t log_timestamp_sec = 0;  //!< second for which log_timestamp was formatted
+static __thread int log_timestamp_len = 0;  //!< length of log_timestamp
+static __thread char log_timestamp[32] = "";    //!< timestamp formatted for the current second
+static __thread char log_tid[21] = "";  //!< formatted thread identifier of the current thread, set on first use
+static char log_pid[11] = "";          //!< formatted process identifier, set on first use
+//! @}
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                              STATIC PROTOTYPES                             |
@@ -230,8 +314,28 @@ static FILE *get_file_impl(const char *log_file, FILE * fp, ino_t * log_inop, bo
 static void release_file(const char *log_file);
 
 static int fill_timestamp(char *buf, int buf_size);
-static int log_line(const char *log_file, const char *line);
-static int print_field_truncated(const char **log_spec, char *buf, int left, const char *field);
+static int log_write(const char *log_file, const char *buf, size_t len);
+static int log_line(const char *log_file, log_level_e level, const char *line);
+
+static void log_async_init(void);
+static void log_async_release_ring(void *arg);
+static void log_async_atfork_prepare(void);
+static void log_async_atfork_parent(void);
+static void log_async_atfork_child(void);
+static void log_async_atexit(void);
+static log_ring *log_async_get_ring(void);
+static void log_async_copy_in(log_ring * ring, u32 pos, const void *src, u32 len);
+static void log_async_copy_out(log_ring * ring, u32 pos, void *dst, u32 len);
+static int log_async_enqueue(const char *log_file, log_level_e level, const char *line);
+static void log_async_flush_batch(log_target_e target);
+static void log_async_append(log_target_e target, const char *buf, u32 len);
+static void log_async_reserve(log_target_e target, u32 len);
+static void log_async_drain(void);
+static void *log_async_writer(void *arg);
+static void log_prefix_init(void);
+static void log_prefix_atfork_child(void);
+static void log_prefix_compile(log_prefix * prefix, const char *log_spec);
+static int print_field_truncated(const log_prefix_op * op, char *buf, int left, const char *field);
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -548,11 +652,29 @@ int log_file_set(const char *file, const char *req_track_file)
 //!
 int log_prefix_set(const char *log_spec)
 {
+    char new_prefix[sizeof(log_custom_prefix)] = "";
+    log_prefix *prefix = NULL;
+
     // @todo eventually, enable empty prefix
     if ((log_spec == NULL) || (strlen(log_spec) == 0))
-        euca_strncpy(log_custom_prefix, USE_STANDARD_PREFIX, sizeof(log_custom_prefix));
+        euca_strncpy(new_prefix, USE_STANDARD_PREFIX, sizeof(new_prefix));
     else
-        euca_strncpy(log_custom_prefix, log_spec, sizeof(log_custom_prefix));
+        euca_strncpy(new_prefix, log_spec, sizeof(new_prefix));
+
+    // this gets called for every request in the CC, so only recompile on change
+    if (strcmp(new_prefix, log_custom_prefix) == 0)
+        return (EUCA_OK);
+
+    euca_strncpy(log_custom_prefix, new_prefix, sizeof(log_custom_prefix));
+    if (strcmp(log_custom_prefix, USE_STANDARD_PREFIX) == 0) {
+        log_custom_ops = NULL;
+    } else {
+        // compile into the copy not in use so threads logging right now are not affected
+        prefix = ((log_custom_ops == &log_custom_prefixes[0]) ? &log_custom_prefixes[1] : &log_custom_prefixes[0]);
+        log_prefix_compile(prefix, log_custom_prefix);
+        __sync_synchronize();
+        log_custom_ops = prefix;
+    }
     return (EUCA_OK);
 }
 
@@ -682,48 +804,473 @@ static int fill_timestamp(char *buf, int buf_size)
     time_t t = time(NULL);
     struct tm tm = { 0 };
 
-    localtime_r(&t, &tm);
-    return (strftime(buf, buf_size, "%F %T", &tm));
+    // only format the time once per second (and per thread)
+    if ((t != log_timestamp_sec) || (log_timestamp_len == 0)) {
+        localtime_r(&t, &tm);
+        log_timestamp_len = strftime(log_timestamp, sizeof(log_timestamp), "%F %T", &tm);
+        log_timestamp_sec = t;
+    }
+
+    if (log_timestamp_len >= buf_size)
+        return (0);
+    memcpy(buf, log_timestamp, log_timestamp_len + 1);
+    return (log_timestamp_len);
+}
+
+//!
+//! Writes a buffer into a log file, holding the log semaphore if one is set.
+//!
+//! @param[in] log_file string containing the log file name
+//! @param[in] buf the buffer to write
+//! @param[in] len the number of bytes to write from buf
+//!
+//! @return EUCA_OK on success or EUCA_ERROR on failure
+//!
+static int log_write(const char *log_file, const char *buf, size_t len)
+{
+    int rc = EUCA_ERROR;
+    FILE *pFh = NULL;
+    boolean locked = FALSE;
+
+    // the semaphore may not be set yet, or not at all, and the writer thread shares get_file() with us
+    if (log_async_running) {
+        pthread_mutex_lock(&log_write_mutex);
+        locked = TRUE;
+    }
+
+    if (log_sem)
+        sem_prolaag(log_sem, FALSE);
+
+    if ((pFh = get_file(log_file, FALSE)) != NULL) {
+        fwrite(buf, 1, len, pFh);
+        fflush(pFh);
+        release_file(log_file);
+        rc = EUCA_OK;
+    }
+
+    if (log_sem)
+        sem_verhogen(log_sem, FALSE);
+
+    if (locked)
+        pthread_mutex_unlock(&log_write_mutex);
+
+    return (rc);
 }
 
 //!
-//! This is the function that ultimately dumps a buffer into a log.
+//! This is the function that ultimately dumps a buffer into a log. When asynchronous
+//! logging is on, the line is handed over to the writer thread instead.
 //!
 //! @param[in] log_file string containing the log file name
+//! @param[in] level the log level of the line
 //! @param[in] line the string buffer to log
 //!
 //! @return EUCA_OK on success or EUCA_ERROR on failure
 //!
 //! @pre The given line pointer must not be NULL.
 //!
-//! @post The given line is written into the log file
+//! @post The given line is written into the log file or queued for the writer thread
 //!
-static int log_line(const char *log_file, const char *line)
+static int log_line(const char *log_file, log_level_e level, const char *line)
 {
-    int rc = EUCA_ERROR;
-    FILE *pFh = NULL;
+    if (log_async_enabled && (log_async_enqueue(log_file, level, line) == EUCA_OK))
+        return (EUCA_OK);
+    return (log_write(log_file, line, strlen(line)));
+}
 
-    if (log_sem) {
-        sem_prolaag(log_sem, FALSE);
+//!
+//! One-time registration of the hooks needed by asynchronous logging
+//!
+static void log_async_init(void)
+{
+    pthread_key_create(&log_async_key, log_async_release_ring);
+    pthread_atfork(log_async_atfork_prepare, log_async_atfork_parent, log_async_atfork_child);
+    atexit(log_async_atexit);
+}
+
+//!
+//! Thread-specific data destructor giving the ring of an exiting thread back for reuse.
+//! Lines still in the ring are written out by the writer thread as usual.
+//!
+//! @param[in] arg a pointer to the ring owned by the exiting thread
+//!
+static void log_async_release_ring(void *arg)
+{
+    log_ring *ring = arg;
+
+    log_async_ring = NULL;
+    __sync_synchronize();
+    ring->in_use = 0;
+}
 
-        if ((pFh = get_file(log_file, FALSE)) != NULL) {
-            fprintf(pFh, "%s", line);
-            fflush(pFh);
-            release_file(log_file);
-            rc = EUCA_OK;
+//!
+//! Makes sure no other thread is starting or stopping the writer while we fork
+//!
+static void log_async_atfork_prepare(void)
+{
+    pthread_mutex_lock(&log_async_mutex);
+    pthread_mutex_lock(&log_write_mutex);
+}
+
+//!
+//! Resumes normal operation in the parent after a fork
+//!
+static void log_async_atfork_parent(void)
+{
+    pthread_mutex_unlock(&log_write_mutex);
+    pthread_mutex_unlock(&log_async_mutex);
+}
+
+//!
+//! The child of a fork has no writer thread, so it goes back to synchronous logging until
+//! log_async_set() is called again. Lines queued by the parent are the parent's to write.
+//!
+static void log_async_atfork_child(void)
+{
+    log_ring *ring = NULL;
+
+    log_async_enabled = FALSE;
+    log_async_running = FALSE;
+    for (ring = log_async_rings; ring; ring = ring->next) {
+        ring->tail = ring->head;
+        ring->overflowed_reported = ring->overflowed;
+        ring->in_use = ((ring == log_async_ring) ? 1 : 0);
+    }
+    for (int i = 0; i < LOG_TARGET_MAX; i++)
+        log_async_batch_len[i] = 0;
+    pthread_cond_init(&log_async_cond, NULL);
+    pthread_mutex_unlock(&log_write_mutex);
+    pthread_mutex_unlock(&log_async_mutex);
+}
+
+//!
+//! Writes out whatever is still queued when the process exits normally
+//!
+static void log_async_atexit(void)
+{
+    log_async_set(FALSE);
+}
+
+//!
+//! Retrieves the ring owned by the current thread, taking over a released ring or
+//! allocating a new one the first time a thread logs.
+//!
+//! @return a pointer to the ring or NULL if we are out of memory
+//!
+static log_ring *log_async_get_ring(void)
+{
+    log_ring *ring = NULL;
+
+    if (log_async_ring != NULL)
+        return (log_async_ring);
+
+    for (ring = log_async_rings; ring; ring = ring->next) {
+        if (!ring->in_use && __sync_bool_compare_and_swap(&(ring->in_use), 0, 1))
+            break;
+    }
+
+    if (ring == NULL) {
+        if ((ring = EUCA_ZALLOC(1, sizeof(log_ring))) == NULL)
+            return (NULL);
+        ring->in_use = 1;
+        do {
+            ring->next = log_async_rings;
+        } while (!__sync_bool_compare_and_swap(&log_async_rings, ring->next, ring));
+    }
+
+    log_async_ring = ring;
+    pthread_setspecific(log_async_key, ring);
+    return (ring);
+}
+
+//!
+//! Copies bytes into a ring at a given position, wrapping around the end of the ring
+//!
+//! @param[in] ring the ring to copy into
+//! @param[in] pos the free running position to copy at
+//! @param[in] src the bytes to copy
+//! @param[in] len the number of bytes to copy
+//!
+static void log_async_copy_in(log_ring * ring, u32 pos, const void *src, u32 len)
+{
+    u32 start = (pos % LOG_ASYNC_RING_SIZE);
+    u32 first = (((LOG_ASYNC_RING_SIZE - start) < len) ? (LOG_ASYNC_RING_SIZE - start) : len);
+
+    memcpy(ring->data + start, src, first);
+    memcpy(ring->data, ((const char *)src) + first, len - first);
+}
+
+//!
+//! Copies bytes out of a ring from a given position, wrapping around the end of the ring
+//!
+//! @param[in]  ring the ring to copy from
+//! @param[in]  pos the free running position to copy from
+//! @param[out] dst where to copy the bytes
+//! @param[in]  len the number of bytes to copy
+//!
+static void log_async_copy_out(log_ring * ring, u32 pos, void *dst, u32 len)
+{
+    u32 start = (pos % LOG_ASYNC_RING_SIZE);
+    u32 first = (((LOG_ASYNC_RING_SIZE - start) < len) ? (LOG_ASYNC_RING_SIZE - start) : len);
+
+    memcpy(dst, ring->data + start, first);
+    memcpy(((char *)dst) + first, ring->data, len - first);
+}
+
+//!
+//! Queues a log line in the ring of the current thread. Lines are never dropped: when the
+//! ring is full, the thread wakes up the writer and waits up to LOG_ASYNC_FULL_WAIT_MS for
+//! room, so a thread logging faster than the disk takes its lines is slowed down to the
+//! writer's pace. If the ring is still full after that, the line is written synchronously.
+//!
+//! @param[in] log_file string containing the log file name
+//! @param[in] level the log level of the line
+//! @param[in] line the string buffer to log
+//!
+//! @return EUCA_OK if the line was queued, EUCA_ERROR if the caller must write it synchronously.
+//!
+static int log_async_enqueue(const char *log_file, log_level_e level, const char *line)
+{
+    u32 pos = 0;
+    u32 used = 0;
+    u32 need = 0;
+    int waited_ms = 0;
+    log_ring *ring = NULL;
+    log_record rec = { 0 };
+
+    if (log_file == log_file_path)
+        rec.target = LOG_TARGET_MAIN;
+    else if (log_file == log_file_path_req_track)
+        rec.target = LOG_TARGET_REQ_TRACK;
+    else
+        return (EUCA_ERROR);
+
+    // fatal lines must make it out even if we are about to die
+    if ((level >= EUCA_LOG_FATAL) || ((rec.len = strlen(line)) > LOG_ASYNC_MAX_LINE))
+        return (EUCA_ERROR);
+
+    if ((ring = log_async_get_ring()) == NULL)
+        return (EUCA_ERROR);
+
+    need = sizeof(log_record) + rec.len;
+    pos = ring->head;
+    used = pos - ring->tail;
+    __sync_synchronize();              // read 'tail' before overwriting what it protects
+    while ((LOG_ASYNC_RING_SIZE - used) < need) {
+        // the writer thread never waits on its own ring
+        if ((waited_ms >= LOG_ASYNC_FULL_WAIT_MS) || pthread_equal(pthread_self(), log_async_thread)) {
+            ring->overflowed++;
+            return (EUCA_ERROR);
         }
+        pthread_cond_signal(&log_async_cond);
+        usleep(1000);
+        waited_ms++;
+        used = pos - ring->tail;
+        __sync_synchronize();
+    }
 
-        sem_verhogen(log_sem, FALSE);
-    } else {
-        if ((pFh = get_file(log_file, FALSE)) != NULL) {
-            fprintf(pFh, "%s", line);
-            fflush(pFh);
-            release_file(log_file);
-            rc = EUCA_OK;
+    log_async_copy_in(ring, pos, &rec, sizeof(log_record));
+    log_async_copy_in(ring, pos + sizeof(log_record), line, rec.len);
+    __sync_synchronize();              // publish the record before moving 'head'
+    ring->head = pos + need;
+
+    if ((used + need) > (LOG_ASYNC_RING_SIZE / 2))
+        pthread_cond_signal(&log_async_cond);
+    return (EUCA_OK);
+}
+
+//!
+//! Writes out the pending output buffer of a given target
+//!
+//! @param[in] target the log file the buffer is for
+//!
+static void log_async_flush_batch(log_target_e target)
+{
+    const char *log_file = ((target == LOG_TARGET_MAIN) ? log_file_path : log_file_path_req_track);
+
+    if (log_async_batch_len[target] == 0)
+        return;
+
+    // the request tracking log may have been unset since the lines were queued
+    if ((target == LOG_TARGET_MAIN) || (log_file[0] != '\0'))
+        log_write(log_file, log_async_batch[target], log_async_batch_len[target]);
+    log_async_batch_len[target] = 0;
+}
+
+//!
+//! Appends a line to the output buffer of a given target
+//!
+//! @param[in] target the log file the line is for
+//! @param[in] buf the line to append
+//! @param[in] len the length of the line
+//!
+static void log_async_append(log_target_e target, const char *buf, u32 len)
+{
+    log_async_reserve(target, len);
+    memcpy(log_async_batch[target] + log_async_batch_len[target], buf, len);
+    log_async_batch_len[target] += len;
+}
+
+//!
+//! Makes room for a line in the output buffer of a given target, writing the buffer out if needed
+//!
+//! @param[in] target the log file the line is for
+//! @param[in] len the length of the line (at most LOG_ASYNC_BATCH_SIZE)
+//!
+static void log_async_reserve(log_target_e target, u32 len)
+{
+    if ((log_async_batch_len[target] + len) > LOG_ASYNC_BATCH_SIZE)
+        log_async_flush_batch(target);
+}
+
+//!
+//! Moves every queued line from the rings into the log files. Only the writer thread (or
+//! log_async_set() once the writer thread is gone) calls this.
+//!
+static void log_async_drain(void)
+{
+    u32 pos = 0;
+    u32 head = 0;
+    u32 overflowed = 0;
+    u32 lost = 0;
+    u32 target = 0;
+    int offset = 0;
+    log_ring *ring = NULL;
+    log_record rec = { 0 };
+    char line[256] = "";
+
+    for (ring = log_async_rings; ring; ring = ring->next) {
+        head = ring->head;
+        __sync_synchronize();          // read 'head' before the records it protects
+        for (pos = ring->tail; pos != head; pos += (sizeof(log_record) + rec.len)) {
+            log_async_copy_out(ring, pos, &rec, sizeof(log_record));
+            log_async_reserve(rec.target, rec.len);
+            log_async_copy_out(ring, pos + sizeof(log_record), log_async_batch[rec.target] + log_async_batch_len[rec.target], rec.len);
+            log_async_batch_len[rec.target] += rec.len;
+            log_async_written++;
+        }
+        __sync_synchronize();          // done reading before the producer may reuse the space
+        ring->tail = pos;
+
+        if ((overflowed = ring->overflowed) != ring->overflowed_reported) {
+            lost += (overflowed - ring->overflowed_reported);
+            ring->overflowed_reported = overflowed;
         }
     }
 
-    return (rc);
+    if (lost > 0) {
+        offset = fill_timestamp(line, sizeof(line));
+        offset += snprintf(line + offset, sizeof(line) - offset, "  WARN | wrote %u log message(s) synchronously, possibly out of order, asynchronous log buffer was full\n", lost);
+        log_async_append(LOG_TARGET_MAIN, line, offset);
+    }
+
+    for (target = 0; target < LOG_TARGET_MAX; target++)
+        log_async_flush_batch(target);
+}
+
+//!
+//! Writer thread draining the rings periodically or whenever a producer wakes it up
+//!
+//! @param[in] arg UNUSED
+//!
+//! @return Always return NULL
+//!
+static void *log_async_writer(void *arg)
+{
+    struct timeval tv = { 0 };
+    struct timespec ts = { 0 };
+
+    pthread_mutex_lock(&log_async_mutex);
+    while (log_async_running) {
+        pthread_mutex_unlock(&log_async_mutex);
+        log_async_drain();
+        pthread_mutex_lock(&log_async_mutex);
+
+        if (!log_async_running)
+            break;
+
+        gettimeofday(&tv, NULL);
+        ts.tv_sec = tv.tv_sec;
+        ts.tv_nsec = (tv.tv_usec + (LOG_ASYNC_FLUSH_MS * 1000)) * 1000;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec += ts.tv_nsec / 1000000000L;
+            ts.tv_nsec %= 1000000000L;
+        }
+        pthread_cond_timedwait(&log_async_cond, &log_async_mutex, &ts);
+    }
+    pthread_mutex_unlock(&log_async_mutex);
+
+    log_async_drain();
+    return (NULL);
+}
+
+//!
+//! Turns asynchronous logging on or off for this process. When on, log lines are queued in
+//! lock-free per-thread rings and a writer thread writes them out in batches, handling log
+//! rotation as it goes. No line is dropped: a thread whose ring is full waits for the writer
+//! thread, then writes synchronously if that takes too long (and the number of such lines
+//! gets logged). FATAL
+//! and very long lines are always written synchronously. Lines queued within the last
+//! LOG_ASYNC_FLUSH_MS milliseconds may be lost if the process is killed.
+//!
+//! @param[in] enable set to TRUE to turn asynchronous logging on, FALSE to turn it off
+//!
+//! @return EUCA_OK on success or EUCA_THREAD_ERROR if the writer thread cannot be started
+//!
+//! @post When turning asynchronous logging off, all queued lines have been written out on return.
+//!       A forked child always starts with asynchronous logging off.
+//!
+int log_async_set(boolean enable)
+{
+    boolean stop = FALSE;
+
+    pthread_once(&log_async_once, log_async_init);
+
+    pthread_mutex_lock(&log_async_mutex);
+    {
+        if (enable && !log_async_running) {
+            log_async_running = TRUE;
+            if (pthread_create(&log_async_thread, NULL, log_async_writer, NULL) != 0) {
+                log_async_running = FALSE;
+                pthread_mutex_unlock(&log_async_mutex);
+                return (EUCA_THREAD_ERROR);
+            }
+            log_async_enabled = TRUE;
+        } else if (!enable && log_async_running) {
+            log_async_enabled = FALSE;
+            log_async_running = FALSE;
+            pthread_cond_signal(&log_async_cond);
+            stop = TRUE;
+        }
+    }
+    pthread_mutex_unlock(&log_async_mutex);
+
+    if (stop) {
+        pthread_join(log_async_thread, NULL);
+        // pick up what was queued by threads that saw the old setting
+        log_async_drain();
+    }
+    return (EUCA_OK);
+}
+
+//!
+//! Retrieves the asynchronous logging counters of this process
+//!
+//! @param[out] written if not NULL, set to the number of lines written out by the writer thread
+//! @param[out] overflowed if not NULL, set to the number of lines written synchronously because a ring stayed full
+//!
+void log_async_stats(long long *written, long long *overflowed)
+{
+    long long total = 0;
+    log_ring *ring = NULL;
+
+    for (ring = log_async_rings; ring; ring = ring->next)
+        total += ring->overflowed;
+
+    if (written)
+        *written = log_async_written;
+    if (overflowed)
+        *overflowed = total;
 }
 
 //!
@@ -743,7 +1290,7 @@ int logprintf(const char *format, ...)
 {
     int rc = -1;
     int offset = -1;
-    char buf[LOGLINEBUF] = "";
+    char buf[LOGLINEBUF];              // not initialized on purpose, zeroing it costs more than formatting the line
     va_list ap = { {0} };
 
     // start with current timestamp
@@ -758,69 +1305,154 @@ int logprintf(const char *format, ...)
 
     if (rc < 0)
         return (rc);
-    return (log_line(log_file_path, buf));
+    return (log_line(log_file_path, EUCA_LOG_INFO, buf));
+}
+
+//!
+//! One-time initialization of the prefix formatting caches
+//!
+static void log_prefix_init(void)
+{
+    for (int l = 0; l <= EUCA_LOG_OFF; l++) {
+        char name[6];
+        euca_strncpy(name, log_level_names[l], sizeof(name));  // we want hard truncation
+        snprintf(log_level_labels[l], sizeof(log_level_labels[l]), "%5s", name);
+        log_prefix_compile(&log_standard_prefixes[l], log_level_prefix[l]);
+    }
+    pthread_atfork(NULL, NULL, log_prefix_atfork_child);
 }
 
 //!
+//! The child of a fork has its own process identifier and the forking thread has a new
+//! thread identifier, so forget the cached ones.
 //!
+static void log_prefix_atfork_child(void)
+{
+    log_pid[0] = '\0';
+    log_tid[0] = '\0';
+}
+
 //!
-//! @param[in] log_spec
-//! @param[in] buf
-//! @param[in] left
-//! @param[in] field
+//! Compiles a prefix specification (see log_level_prefix[]) into a list of operations
 //!
-//! @return the number of bytes written in our string buffer 'buf'
+//! @param[out] prefix the compiled prefix
+//! @param[in]  log_spec the prefix specification
 //!
-static int print_field_truncated(const char **log_spec, char *buf, int left, const char *field)
+static void log_prefix_compile(log_prefix * prefix, const char *log_spec)
 {
     int i = 0;
-    int offset = 0;
-    int in_field_len = strlen(field);
-    int out_field_len = MAX_FIELD_LENGTH;
+    char c = '\0';
+    char cn = '\0';
     char *nend = NULL;
-    char format[10] = "";
-    boolean left_justify = FALSE;
     const char *nstart = NULL;
+    log_prefix_op *op = NULL;
+    int nliterals = 0;
 
-    if (in_field_len < out_field_len) {
-        // unless specified, we'll use length of the field or max
-        out_field_len = in_field_len;
-    }
-    // first, look ahead down s[] to see if we have length  and alignment specified (leading '-' means left-justified)
-    nstart = (*log_spec) + 1;
-    if (*nstart == '-') {
-        // a leading zero
-        left_justify = TRUE;
-        nstart++;
-    }
+    bzero(prefix, sizeof(log_prefix));
+    for (; (*log_spec != '\0') && (prefix->nops < LOG_PREFIX_MAX); log_spec++) {
+        // see if we have a formatting character or a regular one
+        c = log_spec[0];
+        cn = log_spec[1];
+        if ((c != '%')                 // not a special formatting char
+            || (c == '%' && cn == '%') // formatting char, escaped
+            || (c == '%' && cn == '\0')) { // formatting char at the end
+            if ((c == '%') && (cn == '%')) {
+                // swallow the one extra '%' in input
+                log_spec++;
+            }
+        } else {
+            // move past the '%' to the formatting char
+            log_spec++;
+            c = *log_spec;
+            switch (c) {
+            case 'T':
+            case 'L':
+                op = &(prefix->ops[prefix->nops++]);
+                op->field = c;
+                continue;
+
+            case 'p':
+            case 't':
+            case 'm':
+            case 'F':
+            case 's':
+                op = &(prefix->ops[prefix->nops++]);
+                op->field = c;
+
+                // look ahead to see if we have length and alignment specified (leading '-' means left-justified)
+                nstart = log_spec + 1;
+                if (*nstart == '-') {
+                    op->left_justify = TRUE;
+                    nstart++;
+                }
+
+                i = (int)strtoll(nstart, &nend, 10);
+                if (nstart != nend) {
+                    // we have some digits, skip them
+                    log_spec = nend - 1;
+                    // sanity check
+                    if ((i > 1) && (i < 100))
+                        op->width = i;
+                }
+                continue;
+
+            default:
+                // not supported, print the character itself
+                break;
+            }
+        }
 
-    i = (int)strtoll(nstart, &nend, 10);
-    if (nstart != nend) {
-        // we have some digits, move the pointer ahead so caller will skip digits
-        *log_spec = nend - 1;
-        // sanity check
-        if ((i > 1) && (i < 100)) {
-            out_field_len = i;
+        // literal character, append it to the previous literal operation if there is one
+        op = ((prefix->nops > 0) ? &(prefix->ops[prefix->nops - 1]) : NULL);
+        if ((op == NULL) || (op->field != '\0')) {
+            op = &(prefix->ops[prefix->nops++]);
+            op->literal_start = nliterals;
         }
+        prefix->literals[nliterals++] = c;
+        op->literal_len++;
     }
-    // create a format string that would truncate the field to len and then print the field into 's'
+}
+
+//!
+//! Prints a prefix field, truncated and padded as requested by the prefix operation
+//!
+//! @param[in] op the prefix operation
+//! @param[in] buf the string buffer to print into
+//! @param[in] left the space left in buf
+//! @param[in] field the value of the field
+//!
+//! @return the number of bytes written in our string buffer 'buf' or -1 if there isn't enough room
+//!
+static int print_field_truncated(const log_prefix_op * op, char *buf, int left, const char *field)
+{
+    int offset = 0;
+    int copy_len = 0;
+    int in_field_len = strlen(field);
+    int out_field_len = op->width;
+
+    if (out_field_len == 0) {
+        // unless specified, we'll use length of the field or max
+        out_field_len = ((in_field_len < MAX_FIELD_LENGTH) ? in_field_len : MAX_FIELD_LENGTH);
+    }
+
     if (left < (out_field_len + 1)) {
         // not enough room left
         return -1;
     }
-    // when right-justifying, we want to truncate the field on the left (when left-justifying the
-    // snprintf below will truncate on the right)
-    if (left_justify == FALSE) {
+    // when right-justifying, we want to truncate the field on the left (when left-justifying
+    // we truncate on the right)
+    if ((op->left_justify == FALSE) && (in_field_len > out_field_len))
         offset = in_field_len - out_field_len;
-        if (offset < 0)
-            offset = 0;
-    }
 
-    snprintf(format, sizeof(format), "%%%s%ds", (left_justify) ? "-" : "", out_field_len);
-    if (snprintf(buf, (out_field_len + 1), format, field + offset) < out_field_len) {
-        // error in snprintf
-        return -1;
+    copy_len = (((in_field_len - offset) < out_field_len) ? (in_field_len - offset) : out_field_len);
+    if (op->left_justify) {
+        memcpy(buf, field + offset, copy_len);
+        memset(buf + copy_len, ' ', out_field_len - copy_len);
+    } else {
+        memset(buf, ' ', out_field_len - copy_len);
+        memcpy(buf + (out_field_len - copy_len), field + offset, copy_len);
     }
+    buf[out_field_len] = '\0';
 
     return (out_field_len);
 }
@@ -858,11 +1490,11 @@ int logprintfl(const char *func, const char *file, int line, log_level_e level,
     int offset = 0;
     char *s = NULL;
     char c = '\0';
-    char cn = '\0';
     boolean custom_spec = FALSE;
-    char buf[LOGLINEBUF] = "";
+    char buf[LOGLINEBUF];              // not initialized on purpose, zeroing it costs more than formatting the line
     va_list ap = { {0} };
-    const char *prefix_spec = NULL;
+    const log_prefix *prefix = NULL;
+    const log_prefix_op *op = NULL;
     boolean is_corrid = FALSE;
     char buf_corrid[128] = "";
 
@@ -876,85 +1508,73 @@ int logprintfl(const char *func, const char *file, int line, log_level_e level,
         return (-1);
     }
 
+    buf[0] = '\0';
     threadCorrelationId *corr_id = get_corrid();
     if (corr_id != NULL && corr_id->correlation_id != NULL && strlen(corr_id->correlation_id) >= 74) {
         is_corrid = TRUE;
     }
 
-    if (strcmp(log_custom_prefix, USE_STANDARD_PREFIX) == 0) {
-        prefix_spec = log_level_prefix[log_level];
+    pthread_once(&log_prefix_once, log_prefix_init);
+    if ((prefix = log_custom_ops) == NULL) {
+        prefix = &log_standard_prefixes[log_level];
         custom_spec = FALSE;
     } else {
-        prefix_spec = log_custom_prefix;
         custom_spec = TRUE;
     }
 
-    // go over prefix format for the log level (defined in log.h or custom)
-    for (; *prefix_spec != '\0'; prefix_spec++) {
+    // go over the compiled prefix format for the log level (defined in log.h or custom)
+    for (op = prefix->ops; op < (prefix->ops + prefix->nops); op++) {
         s = buf + offset;
         if ((left = sizeof(buf) - offset - 1) < 1) {
             // not enough room in internal buffer for a prefix
             return -1;
         }
-        // see if we have a formatting character or a regular one
-        c = prefix_spec[0];
-        cn = prefix_spec[1];
-        if ((c != '%')                 // not a special formatting char
-            || (c == '%' && cn == '%') // formatting char, escaped
-            || (c == '%' && cn == '\0')) {  // formatting char at the end
-            s[0] = c;
-            s[1] = '\0';
-            offset++;
-            if ((c == '%') && (cn == '%')) {
-                // swallow the one extra '%' in input
-                prefix_spec++;
-            }
-            continue;
-        }
-        // move past the '%' to the formatting char
-        prefix_spec++;
 
         size = 0;
-        switch (*prefix_spec) {
+        switch (op->field) {
+        case '\0':
+            // literal text
+            if ((size = op->literal_len) >= left)
+                size = -1;
+            else
+                memcpy(s, prefix->literals + op->literal_start, size);
+            s[(size > 0) ? size : 0] = '\0';
+            break;
+
         case 'T':
             // timestamp
             size = fill_timestamp(s, left);
             break;
 
-        case 'L':{
-                // log-level
-                char l[6];
-                euca_strncpy(l, log_level_names[level], 6); // we want hard truncation
-                size = snprintf(s, left, "%5s", l);
-                break;
-            }
+        case 'L':
+            // log-level
+            size = snprintf(s, left, "%s", log_level_labels[level]);
+            break;
 
-        case 'p':{
-                // process ID
-                char p[11];
-                snprintf(p, sizeof(p), "%010d", getpid());  // 10 chars is enough for max 32-bit unsigned integer
-                size = print_field_truncated(&prefix_spec, s, left, p);
-                break;
-            }
+        case 'p':
+            // process ID
+            if (log_pid[0] == '\0')
+                snprintf(log_pid, sizeof(log_pid), "%010d", getpid());  // 10 chars is enough for max 32-bit unsigned integer
+            size = print_field_truncated(op, s, left, log_pid);
+            break;
 
-        case 't':{
-                // thread ID
-                char t[21];
-                snprintf(t, sizeof(t), "%020d", (pid_t) syscall(SYS_gettid));   // 20 chars is enough for max 64-bit unsigned integer
-                size = print_field_truncated(&prefix_spec, s, left, t);
-                break;
-            }
+        case 't':
+            // thread ID
+            if (log_tid[0] == '\0')
+                snprintf(log_tid, sizeof(log_tid), "%020d", (pid_t) syscall(SYS_gettid));   // 20 chars is enough for max 64-bit unsigned integer
+            size = print_field_truncated(op, s, left, log_tid);
+            break;
 
         case 'm':
             // method
-            size = print_field_truncated(&prefix_spec, s, left, func);
+            size = print_field_truncated(op, s, left, func);
             break;
 
         case 'F':{
                 // file-and-line
                 char file_and_line[64];
                 snprintf(file_and_line, sizeof(file_and_line), "%s:%d", file, line);
-                size = print_field_truncated(&prefix_spec, s, left, file_and_line);
+                size = print_field_truncated(op, s, left, file_and_line);
                 break;
             }
 
@@ -967,21 +1587,11 @@ int logprintfl(const char *func, const char *file, int line, log_level_e level,
                 // unfortunately, many fields in 'struct rusage' aren't supported on Linux (notably: ru_ixrss, ru_idrss, ru_isrss)
                 char size_str[64];
                 snprintf(size_str, sizeof(size_str), "%05ld", u.ru_maxrss / 1024);
-                size = print_field_truncated(&prefix_spec, s, left, size_str);
+                size = print_field_truncated(op, s, left, size_str);
                 break;
             }
 
-        case '?':
-            // not supported currently
-            s[0] = '?';
-            s[1] = '\0';
-            size = 1;
-            break;
-
         default:
-            s[0] = *prefix_spec;
-            s[1] = '\0';
-            size = 1;
             break;
         }
 
@@ -1036,7 +1646,7 @@ int logprintfl(const char *func, const char *file, int line, log_level_e level,
     }
 
     if (is_corrid && log_file_path_req_track != NULL) {
-        log_line(log_file_path_req_track, buf);
+        log_line(log_file_path_req_track, level, buf);
         sprintf(buf_corrid, "[%.8s-%.4s] ", corr_id->correlation_id, corr_id->correlation_id + 47);
         if ((s = strstr(buf, buf_corrid)) != NULL) {
             offset = 16;
@@ -1049,7 +1659,7 @@ int logprintfl(const char *func, const char *file, int line, log_level_e level,
             s[offset - 16] = '\0';
         }
     }
-    if ((rc = log_line(log_file_path, buf)) != EUCA_OK)
+    if ((rc = log_line(log_file_path, level, buf)) != EUCA_OK)
         return (rc);
 
     return EUCA_OK;
@@ -1163,3 +1773,132 @@ void log_dump_trace(char *buf, int buf_size)
 
     EUCA_FREE(strings);
 }
+
+#ifdef _UNIT_TEST
+
+#define TEST_LOG                                 "./test_log.log"   //!< log file used by the benchmark
+#define TEST_THREADS                                      8 //!< number of threads logging concurrently
+#define TEST_LINES                                   100000 //!< number of lines logged by each thread
+
+//!
+//! Logs TEST_LINES debug lines
+//!
+//! @param[in] arg UNUSED
+//!
+//! @return Always return NULL
+//!
+static void *test_logger(void *arg)
+{
+    for (int i = 0; i < TEST_LINES; i++) {
+        LOGDEBUG("benchmark line %d of %d with a short payload to make it look like a real log line\n", i, TEST_LINES);
+    }
+    return (NULL);
+}
+
+//!
+//! Runs TEST_THREADS threads logging TEST_LINES lines each
+//!
+//! @return the number of microseconds it took, until all lines were written out
+//!
+static long long test_run(boolean async)
+{
+    struct timeval start = { 0 };
+    struct timeval end = { 0 };
+    pthread_t threads[TEST_THREADS];
+
+    unlink(TEST_LOG);
+    log_file_set(TEST_LOG, NULL);
+    log_async_set(async);
+
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < TEST_THREADS; i++)
+        pthread_create(&threads[i], NULL, test_logger, NULL);
+    for (int i = 0; i < TEST_THREADS; i++)
+        pthread_join(threads[i], NULL);
+    log_async_set(FALSE);              // wait for all lines to be written out
+    gettimeofday(&end, NULL);
+
+    return (((end.tv_sec - start.tv_sec) * 1000000LL) + (end.tv_usec - start.tv_usec));
+}
+
+//!
+//! Counts the benchmark lines in the test log file
+//!
+//! @return the number of lines
+//!
+static long long test_count_lines(void)
+{
+    long long lines = 0;
+    char buf[512] = "";
+    FILE *fp = NULL;
+
+    if ((fp = fopen(TEST_LOG, "r")) != NULL) {
+        while (fgets(buf, sizeof(buf), fp)) {
+            if (strstr(buf, "benchmark line"))
+                lines++;
+        }
+        fclose(fp);
+    }
+    return (lines);
+}
+
+//!
+//! Main entry point of the application. Measures the cost of formatting a line, compares
+//! synchronous and asynchronous logging throughput and checks that no lines go missing
+//! without being accounted for.
+//!
+//! @param[in] argc the number of parameter passed on the command line
+//! @param[in] argv the list of arguments
+//!
+//! @return EUCA_OK on success or EUCA_ERROR on failure.
+//!
+int main(int argc, char **argv)
+{
+    long long usec = 0;
+    long long lines = 0;
+    long long written = 0;
+    long long overflowed = 0;
+    long long total = (long long)TEST_THREADS * TEST_LINES;
+    struct timeval start = { 0 };
+    struct timeval end = { 0 };
+    sem *s = NULL;
+
+    if ((s = sem_alloc(1, IPC_MUTEX_SEMAPHORE)) == NULL) {
+        printf("failed to allocate the log semaphore\n");
+        return (EUCA_ERROR);
+    }
+    log_sem_set(s);
+
+    // formatting cost alone: with a maximum log size of 0, nothing gets written
+    log_params_set(EUCA_LOG_DEBUG, 0, 0);
+    gettimeofday(&start, NULL);
+    test_logger(NULL);
+    gettimeofday(&end, NULL);
+    usec = ((end.tv_sec - start.tv_sec) * 1000000LL) + (end.tv_usec - start.tv_usec);
+    printf("formatting:   %d lines in %lld usec (%lld nsec/line)\n", TEST_LINES, usec, (usec * 1000) / TEST_LINES);
+
+    log_params_set(EUCA_LOG_DEBUG, 0, 1024LL * 1024 * 1024);
+    usec = test_run(FALSE);
+    lines = test_count_lines();
+    printf("synchronous:  %lld lines in %lld usec (%.0f lines/sec)\n", lines, usec, (lines * 1000000.0) / usec);
+    if (lines != total) {
+        printf("expected %lld lines\n", total);
+        return (EUCA_ERROR);
+    }
+
+    usec = test_run(TRUE);
+    lines = test_count_lines();
+    log_async_stats(&written, &overflowed);
+    // only the lines that made it to the file count, lines that did not fit in the rings were written synchronously
+    printf("asynchronous: %lld lines in %lld usec (%.0f lines/sec), %.1f%% dropped, %.1f%% written synchronously\n", lines, usec,
+           (lines * 1000000.0) / usec, ((total - lines) * 100.0) / total, (overflowed * 100.0) / total);
+    if (lines != total) {
+        printf("lines lost: written=%lld synchronous=%lld in file=%lld expected=%lld\n", written, overflowed, lines, total);
+        return (EUCA_ERROR);
+    }
+
+    unlink(TEST_LOG);
+    return (EUCA_OK);
+}
+
+#endif /* _UNIT_TEST */
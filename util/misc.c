@@ -99,6 +99,8 @@
 #include <sys/mman.h>                  // mmap
 #include <pthread.h>
 #include <sys/select.h>                // pselect
+#include <sys/socket.h>                // socketpair
+#include <poll.h>
 
 #include "eucalyptus.h"
 
@@ -109,6 +111,7 @@
 #include "log.h"
 #include "euca_string.h"
 #include "ipc.h"
+#include "euca_rootwrap.h"
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  DEFINES                                   |
@@ -121,6 +124,10 @@
 #define DEV_STR_IQNS_DELIMITER                    "|"
 #define DEV_STR_KEY_VAL_DELIMITER                 "="
 
+#define CONF_SNAPSHOT_MAX_FILES                    8    //!< Maximum number of configuration files kept parsed in memory
+#define ROOTWRAP_BROKER_MAX_CONNS                 16    //!< Upper bound on concurrently running rootwrap brokers
+#define ROOTWRAP_BROKER_RESPAWN_DELAY             30    //!< Seconds before starting a broker again after one failed to start
+
 #ifdef _UNIT_TEST
 #define _STR                                     "a lovely string"
 #endif /* _UNIT_TEST */
@@ -143,6 +150,36 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! A KEY=VALUE entry of a parsed configuration file
+typedef struct conf_entry_t {
+    char *key;                         //!< Name of the variable (points into the snapshot data)
+    char *value;                       //!< Value of the variable (points into the snapshot data) or NULL on parse error
+} conf_entry;
+
+//! Parsed snapshot of a configuration file, rebuilt whenever the file changes
+typedef struct conf_snapshot_t {
+    char path[EUCA_MAX_PATH];          //!< Path of the configuration file
+    dev_t dev;                         //!< Device of the file when it was parsed
+    ino_t ino;                         //!< Inode of the file when it was parsed
+    off_t size;                        //!< Size of the file when it was parsed
+    struct timespec mtime;             //!< Modification time of the file when it was parsed
+    struct timespec ctime;             //!< Change time of the file when it was parsed
+    char *data;                        //!< Private copy of the file content, NUL-terminated in place
+    conf_entry *entries;               //!< Entries, in file order
+    int max_entries;                   //!< Number of entries
+    int *index;                        //!< Open-addressing hash table of entry indices (-1 if empty)
+    u32 index_size;                    //!< Size of the hash table (power of 2)
+    u32 lastused;                      //!< Usage tick, used to recycle the least recently used slot
+} conf_snapshot;
+
+//! A running euca_rootwrap broker, serving one request at a time
+typedef struct rootwrap_broker_conn_t {
+    int fd;                            //!< Our end of the socketpair, -1 if the broker is not running
+    pid_t pid;                         //!< Broker process
+    u32 seq;                           //!< Sequence number of the last request
+    boolean busy;                      //!< Checked out by a thread
+} rootwrap_broker_conn;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXTERNAL VARIABLES                             |
@@ -163,14 +200,46 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! @{
+//! @name Parsed configuration file snapshots shared by all get_conf_var() callers of this process
+
+static conf_snapshot conf_snapshots[CONF_SNAPSHOT_MAX_FILES] = { {{0}} };
+static u32 conf_snapshot_tick = 0;
+static pthread_mutex_t conf_snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+//! @}
+
+//! @{
+//! @name Persistent euca_rootwrap brokers, started on demand (see euca_rootwrap_broker_init())
+
+static pthread_mutex_t rootwrap_broker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static rootwrap_broker_conn rootwrap_brokers[ROOTWRAP_BROKER_MAX_CONNS] = { {0} };
+static int rootwrap_broker_max = 0;    //!< 0 when brokers are disabled
+static pid_t rootwrap_broker_owner = -1;    //!< brokers belong to this process only, never to forked children
+static char rootwrap_broker_path[EUCA_MAX_PATH] = "";
+static rootwrap_broker_stats rootwrap_broker_counters = { 0 };
+static time_t rootwrap_broker_respawn_after = 0;    //!< no new broker is started before this time
+
+//! @}
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                              STATIC PROTOTYPES                             |
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
-static char *next_tag(const char *xml, int *start, int *end, int *single, int *closing);
-static char *find_cont(const char *xml, char *xpath);
+static u32 conf_key_hash(const char *key, size_t len);
+static int conf_snapshot_find(conf_snapshot * snap, const char *key);
+static void conf_snapshot_clear(conf_snapshot * snap);
+static int conf_snapshot_parse(conf_snapshot * snap, int fd, struct stat *pStat);
+static const char *xml_skip_special(const char *p);
+static char *find_cont(const char *xml, const char *xpath);
+static int rootwrap_broker_spawn(rootwrap_broker_conn * conn);
+static void rootwrap_broker_stop(rootwrap_broker_conn * conn);
+static rootwrap_broker_conn *rootwrap_broker_checkout(void);
+static void rootwrap_broker_checkin(rootwrap_broker_conn * conn, boolean broken);
+static int rootwrap_broker_send(int fd, const void *buf, size_t len);
+static int rootwrap_broker_recv(int fd, void *buf, size_t len);
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -558,6 +627,250 @@ char *getConfString(char configFiles[][EUCA_MAX_PATH], int numFiles, char *key)
     return (tmpstr);
 }
 
+//!
+//! Retrieves a "long" integer configuration value from a list of configuration files.
+//!
+//! @param[in]  configFiles the list of configuration file names
+//! @param[in]  numFiles the number of file names in the list
+//! @param[in]  key the name of the variable to look up
+//! @param[out] pVal set to the value if found and valid
+//!
+//! @return TRUE if the key was found and its value is a valid long integer, FALSE otherwise.
+//!
+boolean getConfLong(char configFiles[][EUCA_MAX_PATH], int numFiles, char *key, long *pVal)
+{
+    long v = 0;
+    char *endptr = NULL;
+    char *tmpstr = NULL;
+    boolean found = FALSE;
+
+    if ((pVal != NULL) && ((tmpstr = getConfString(configFiles, numFiles, key)) != NULL)) {
+        errno = 0;
+        v = strtol(tmpstr, &endptr, 10);
+        if ((errno == 0) && (endptr != tmpstr) && ((*endptr) == '\0')) {
+            (*pVal) = v;
+            found = TRUE;
+        }
+    }
+    EUCA_FREE(tmpstr);
+    return (found);
+}
+
+//!
+//! Retrieves a boolean configuration value from a list of configuration files. Values
+//! starting with 'Y', 'y', 'T', 't' or '1' are TRUE; 'N', 'n', 'F', 'f' or '0' are FALSE.
+//!
+//! @param[in]  configFiles the list of configuration file names
+//! @param[in]  numFiles the number of file names in the list
+//! @param[in]  key the name of the variable to look up
+//! @param[out] pVal set to the value if found and valid
+//!
+//! @return TRUE if the key was found and its value is a valid boolean, FALSE otherwise.
+//!
+boolean getConfBool(char configFiles[][EUCA_MAX_PATH], int numFiles, char *key, boolean * pVal)
+{
+    char *tmpstr = NULL;
+    boolean found = FALSE;
+
+    if ((pVal != NULL) && ((tmpstr = getConfString(configFiles, numFiles, key)) != NULL)) {
+        switch (tmpstr[0]) {
+        case 'Y':
+        case 'y':
+        case 'T':
+        case 't':
+        case '1':
+            (*pVal) = TRUE;
+            found = TRUE;
+            break;
+        case 'N':
+        case 'n':
+        case 'F':
+        case 'f':
+        case '0':
+            (*pVal) = FALSE;
+            found = TRUE;
+            break;
+        default:
+            break;
+        }
+    }
+    EUCA_FREE(tmpstr);
+    return (found);
+}
+
+//!
+//! Hashes a configuration key (FNV-1a)
+//!
+//! @param[in] key the key to hash
+//! @param[in] len the length of the key
+//!
+//! @return the hash value
+//!
+static u32 conf_key_hash(const char *key, size_t len)
+{
+    size_t i = 0;
+    u32 h = 2166136261U;
+
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619U;
+    }
+    return (h);
+}
+
+//!
+//! Looks up a key in a parsed configuration snapshot
+//!
+//! @param[in] snap the snapshot to search
+//! @param[in] key the name of the variable
+//!
+//! @return the index of the entry in snap->entries or -1 if not found
+//!
+static int conf_snapshot_find(conf_snapshot * snap, const char *key)
+{
+    u32 slot = 0;
+    int idx = 0;
+
+    if (snap->index_size == 0)
+        return (-1);
+
+    slot = conf_key_hash(key, strlen(key)) & (snap->index_size - 1);
+    while ((idx = snap->index[slot]) >= 0) {
+        if (!strcmp(snap->entries[idx].key, key))
+            return (idx);
+        slot = (slot + 1) & (snap->index_size - 1);
+    }
+    return (-1);
+}
+
+//!
+//! Releases the content of a configuration snapshot
+//!
+//! @param[in] snap the snapshot to clear
+//!
+static void conf_snapshot_clear(conf_snapshot * snap)
+{
+    EUCA_FREE(snap->data);
+    EUCA_FREE(snap->entries);
+    EUCA_FREE(snap->index);
+    bzero(snap, sizeof(conf_snapshot));
+}
+
+//!
+//! Parses a configuration file into a snapshot. Each line is scanned once, following
+//! the rules documented for get_conf_var(); if a variable is defined more than once, the
+//! first definition wins.
+//!
+//! @param[in] snap the snapshot to fill. Its path field must be set.
+//! @param[in] fd an open file descriptor on the configuration file
+//! @param[in] pStat the attributes of the open file
+//!
+//! @return EUCA_OK on success or EUCA_ERROR on failure
+//!
+static int conf_snapshot_parse(conf_snapshot * snap, int fd, struct stat *pStat)
+{
+    int i = 0;
+    int max = 0;
+    u32 slot = 0;
+    off_t len = 0;
+    ssize_t bytes = 0;
+    char *ptr = NULL;
+    char *key = NULL;
+    char *eol = NULL;
+    char *end = NULL;
+    char *value = NULL;
+    char path[EUCA_MAX_PATH] = "";
+
+    euca_strncpy(path, snap->path, EUCA_MAX_PATH);
+    conf_snapshot_clear(snap);
+    euca_strncpy(snap->path, path, EUCA_MAX_PATH);
+
+    if ((snap->data = EUCA_ZALLOC((pStat->st_size + 1), sizeof(char))) == NULL)
+        return (EUCA_ERROR);
+
+    // read() rather than mmap(), since the file may be truncated while we copy it, which would raise SIGBUS
+    while (len < pStat->st_size) {
+        if ((bytes = pread(fd, snap->data + len, (pStat->st_size - len), len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            conf_snapshot_clear(snap);
+            euca_strncpy(snap->path, path, EUCA_MAX_PATH);
+            return (EUCA_ERROR);
+        }
+        if (bytes == 0)
+            break;
+        len += bytes;
+    }
+
+    // count the lines to size the entries array
+    for (ptr = snap->data, max = 1; *ptr != '\0'; ptr++) {
+        if (*ptr == '\n')
+            max++;
+    }
+    snap->entries = EUCA_ZALLOC(max, sizeof(conf_entry));
+    for (snap->index_size = 16; snap->index_size < (u32) (2 * max); snap->index_size <<= 1) ;
+    snap->index = EUCA_ALLOC(snap->index_size, sizeof(int));
+    if (!snap->entries || !snap->index) {
+        conf_snapshot_clear(snap);
+        euca_strncpy(snap->path, path, EUCA_MAX_PATH);
+        return (EUCA_ERROR);
+    }
+    for (slot = 0; slot < snap->index_size; slot++)
+        snap->index[slot] = -1;
+
+    end = snap->data + len;
+    for (ptr = snap->data; ptr < end; ptr = eol + 1) {
+        if ((eol = strchr(ptr, '\n')) == NULL)
+            eol = end;
+        *eol = '\0';
+
+        // spaces are not considered (unless between ""). We look for the variable name
+        // first, then for an = then for the value
+        for (; ((*ptr != '\0') && isspace((int)*ptr)); ptr++) ;
+        for (key = ptr; ((*ptr != '\0') && !isspace((int)*ptr) && (*ptr != '=')); ptr++) ;
+        if (ptr == key)
+            continue;
+
+        value = ptr;
+        for (; ((*ptr != '\0') && isspace((int)*ptr)); ptr++) ;
+        if (*ptr != '=')
+            continue;
+        *value = '\0';
+
+        for (ptr++; ((*ptr != '\0') && isspace((int)*ptr)); ptr++) ;
+        if (*ptr == '"') {
+            // we have a quote, we need the companion on the same line
+            value = ++ptr;
+            for (; ((*ptr != '\0') && (*ptr != '"')); ptr++) ;
+            if (*ptr == '\0')
+                value = NULL;
+        } else {
+            // well we get the single word right after the =
+            value = ptr;
+            for (; (!isspace((int)*ptr) && (*ptr != '#') && (*ptr != '\0')); ptr++) ;
+        }
+        *ptr = '\0';
+
+        if (conf_snapshot_find(snap, key) >= 0)
+            continue;
+
+        i = snap->max_entries++;
+        snap->entries[i].key = key;
+        snap->entries[i].value = value;
+        slot = conf_key_hash(key, strlen(key)) & (snap->index_size - 1);
+        while (snap->index[slot] >= 0)
+            slot = (slot + 1) & (snap->index_size - 1);
+        snap->index[slot] = i;
+    }
+
+    snap->dev = pStat->st_dev;
+    snap->ino = pStat->st_ino;
+    snap->size = pStat->st_size;
+    snap->mtime = pStat->st_mtim;
+    snap->ctime = pStat->st_ctim;
+    return (EUCA_OK);
+}
+
 //!
 //! search for variable 'name' in file 'path' and return whatever is after
 //! = in value (which will need to be freed).
@@ -567,6 +880,9 @@ char *getConfString(char configFiles[][EUCA_MAX_PATH], int numFiles, char *key)
 //! TEST=test
 //!    TEST   = test
 //!
+//! The file is parsed once into an in-memory snapshot shared by the whole process;
+//! later lookups only stat() the file and re-parse it when it has changed.
+//!
 //! @param[in]     path
 //! @param[in]     name
 //! @param[in,out] value
@@ -584,11 +900,12 @@ char *getConfString(char configFiles[][EUCA_MAX_PATH], int numFiles, char *key)
 //!
 int get_conf_var(const char *path, const char *name, char **value)
 {
-    FILE *f = NULL;
-    char *buf = NULL;
-    char *ptr = NULL;
-    char *ret = NULL;
-    int len = 0;
+    int i = 0;
+    int fd = -1;
+    int ret = 0;
+    conf_snapshot *snap = NULL;
+    conf_snapshot *victim = NULL;
+    struct stat statbuf = { 0 };
 
     // sanity check
     if ((path == NULL) || (path[0] == '\0') || (name == NULL) || (name[0] == '\0') || (value == NULL)) {
@@ -597,65 +914,55 @@ int get_conf_var(const char *path, const char *name, char **value)
 
     *value = NULL;
 
-    if ((f = fopen(path, "r")) == NULL) {
+    if ((fd = open(path, O_RDONLY)) < 0) {
         return (-1);
     }
 
-    len = strlen(name);
-    buf = EUCA_ALLOC(32768, sizeof(char));
-    while (fgets(buf, 32768, f)) {
-        // the process here is fairly simple: spaces are not considered (unless between "")
-        // so we remove them before every step. We look for the variable *name* first, then
-        // for an = then for the value
-        for (ptr = buf; ((*ptr != '\0') && isspace((int)*ptr)); ptr++) ;
+    if (fstat(fd, &statbuf) != 0) {
+        close(fd);
+        return (-1);
+    }
 
-        if (strncmp(ptr, name, len) != 0) {
-            continue;
+    pthread_mutex_lock(&conf_snapshot_mutex);
+    {
+        for (i = 0; ((i < CONF_SNAPSHOT_MAX_FILES) && !snap); i++) {
+            if (!strcmp(conf_snapshots[i].path, path)) {
+                snap = &conf_snapshots[i];
+            } else if (!victim || (conf_snapshots[i].lastused < victim->lastused)) {
+                victim = &conf_snapshots[i];
+            }
         }
 
-        for (ptr += len; (*ptr != '\0') && isspace((int)*ptr); ptr++) ;
-
-        if (*ptr != '=') {
-            continue;
+        if (!snap) {
+            snap = victim;
+            conf_snapshot_clear(snap);
+            euca_strncpy(snap->path, path, EUCA_MAX_PATH);
         }
-        // we are in business
-        for (ptr++; (*ptr != '\0') && isspace((int)*ptr); ptr++) ;
+        snap->lastused = ++conf_snapshot_tick;
 
-        if (*ptr == '"') {
-            // we have a quote, we need the companion
-            ret = ++ptr;
-            while ((*ptr != '"')) {
-                if (*ptr == '\0') {
-                    // something wrong happened
-                    fclose(f);
-                    EUCA_FREE(buf);
-                    return (-1);
-                }
-                ptr++;
-            }
-        } else {
-            // well we get the single word right after the =
-            ret = ptr;
-            while (!isspace((int)*ptr) && (*ptr != '#') && (*ptr != '\0')) {
-                ptr++;
+        if (!snap->data || (snap->dev != statbuf.st_dev) || (snap->ino != statbuf.st_ino) || (snap->size != statbuf.st_size)
+            || (snap->mtime.tv_sec != statbuf.st_mtim.tv_sec) || (snap->mtime.tv_nsec != statbuf.st_mtim.tv_nsec)
+            || (snap->ctime.tv_sec != statbuf.st_ctim.tv_sec) || (snap->ctime.tv_nsec != statbuf.st_ctim.tv_nsec)) {
+            if (conf_snapshot_parse(snap, fd, &statbuf) != EUCA_OK) {
+                ret = -1;
             }
         }
 
-        *ptr = '\0';
-        if ((*value = strdup(ret)) == NULL) {
-            fclose(f);
-            EUCA_FREE(buf);
-            return (-1);
+        if ((ret == 0) && ((i = conf_snapshot_find(snap, name)) >= 0)) {
+            if (snap->entries[i].value == NULL) {
+                // unterminated quote
+                ret = -1;
+            } else if ((*value = strdup(snap->entries[i].value)) == NULL) {
+                ret = -1;
+            } else {
+                ret = 1;
+            }
         }
-
-        fclose(f);
-        EUCA_FREE(buf);
-        return (1);
     }
+    pthread_mutex_unlock(&conf_snapshot_mutex);
 
-    fclose(f);
-    EUCA_FREE(buf);
-    return (0);
+    close(fd);
+    return (ret);
 }
 
 //!
@@ -1150,87 +1457,40 @@ int minint(int a, int b)
 }
 
 //!
-//! given a null-terminated string in 'xml', finds the next complete <tag...>
-//! and returns its name in a newly allocated string (which must be freed by
-//! the caller) or returns NULL if no tag can be found or if the XML is not
-//! well formed; when not NULL, the following parameters are also returned:
+//! Given a pointer to a '<' in an XML string, returns a pointer to the '>'
+//! that closes it if it starts a declaration, a processing instruction, a
+//! comment or a CDATA section, none of which have an element name to match
+//! against, or NULL otherwise. A missing terminator is reported by returning
+//! a pointer to the end of the string.
 //!
-//!     start   = index of the '<' character
-//!     end     = index of the '>' character
-//!     single  = 1 if this is a <..../> tag
-//!     closing = 1 if this is a </....> tag
+//! @param[in] p pointer to the '<'
 //!
-//! @param[in]  xml
-//! @param[out] start
-//! @param[out] end
-//! @param[out] single
-//! @param[out] closing
-//!
-//! @return the name of the next complete xml tag
-//!
-//! @note the caller is responsible to free the returned memory
+//! @return pointer to the last character of the markup or NULL if p starts a tag
 //!
-static char *next_tag(const char *xml, int *start, int *end, int *single, int *closing)
+static const char *xml_skip_special(const char *p)
 {
-    int name_start = -1;
-    int name_end = -1;
-    int tag_start = -1;
-    char *ret = NULL;
-    const char *p = NULL;
-    const char *last_ch = NULL;
-
-    for (p = xml; *p; p++) {
-        if (*p == '<') {               // found a new tag
-            tag_start = (p - xml);     // record the char so its offset can be returned
-
-            *closing = 0;
-            if ((*(p + 1) == '/') || (*(p + 1) == '?')) {
-                if (*(p + 1) == '/')   // if followed by '/' then it is a "closing" tag
-                    *closing = 1;
-                name_start = (p - xml + 2);
-                p++;
-            } else {
-                name_start = (p - xml + 1);
-            }
-            continue;
-        }
+    const char *end = NULL;
 
-        if ((*p == ' ') && (name_start != -1) && (name_end == -1)) {    // a name may be terminated by a space
-            name_end = (p - 1 - xml);
-            continue;
-        }
-
-        if (*p == '>') {
-            if (name_start == -1)      // never saw '<', error
-                break;
-
-            if (p < (xml + 2))         // tag is too short, error
-                break;
+    if (p[1] == '?') {
+        end = strstr(p + 2, "?>");
+        return ((end != NULL) ? (end + 1) : (p + strlen(p)));
+    }
 
-            last_ch = p - 1;
-            if ((*last_ch == '/') || (*last_ch == '?')) {
-                *single = 1;           // preceded by '/' then it is a "single" tag
-                last_ch--;
-            } else {
-                *single = 0;
-            }
+    if (p[1] != '!')
+        return (NULL);
 
-            if ((name_start != -1) && (name_end == -1)) {   // a name may be terminated by '/' or '>' or '?'
-                name_end = (last_ch - xml);
-            }
+    if (!strncmp(p, "<!--", 4)) {
+        end = strstr(p + 4, "-->");
+        return ((end != NULL) ? (end + 2) : (p + strlen(p)));
+    }
 
-            if ((name_end - name_start) >= 0) { // we have a name rather than '<>'
-                if ((ret = EUCA_ZALLOC(name_end - name_start + 2, sizeof(char))) == NULL)
-                    break;
-                strncpy(ret, xml + name_start, name_end - name_start + 1);
-                *start = tag_start;
-                *end = p - xml;
-            }
-            break;
-        }
+    if (!strncmp(p, "<![CDATA[", 9)) {
+        end = strstr(p + 9, "]]>");
+        return ((end != NULL) ? (end + 2) : (p + strlen(p)));
     }
 
-    return (ret);
+    end = strchr(p, '>');              // <!DOCTYPE ...>, internal subsets are not supported
+    return ((end != NULL) ? end : (p + strlen(p)));
 }
 
 //!
@@ -1242,98 +1502,99 @@ static char *next_tag(const char *xml, int *start, int *end, int *single, int *c
 //!
 //! the content returned for xpath "a/c/e" is "baz"
 //!
+//! The XML is scanned once, in place. The stack of open elements holds
+//! pointers into 'xml' along with how much of 'xpath' each level matched,
+//! so neither tags nor paths are copied or re-assembled along the way and
+//! the only allocation is the returned content. Element names are compared
+//! without regard to case.
+//!
 //! @param[in] xml
 //! @param[in] xpath
 //!
-//! @return a pointer to the content we're looking for
+//! @return a pointer to the content we're looking for or NULL if not found or if the XML is not well formed
 //!
 //! @note the caller is responsible to free the returned memory
 //!
-static char *find_cont(const char *xml, char *xpath)
+static char *find_cont(const char *xml, const char *xpath)
 {
 #define _STK_SIZE            64
+#define _XPATH_MATCHED       -2        //!< the element is the one xpath points at
+#define _XPATH_MISMATCHED    -1        //!< the element is not on the way to xpath
 
-    int i = 0;
-    int xpathLen = 0;
-    int xml_offset = 0;
-    int tag_start = 1;
-    int tag_end = -1;
-    int single = 0;
-    int closing = 0;
-    int stk_p = -1;
-    int cont_len = 0;
-    char *ret = NULL;
+    int depth = 0;
+    int parent = 0;
+    int name_len = 0;
+    char quote = '\0';
     char *cont = NULL;
-    char *name = NULL;
-    char *name_lc = NULL;
-    char *n_stk[_STK_SIZE] = { NULL };
-    char xpath_cur[EUCA_MAX_PATH] = "";
-    const char *contp = NULL;
-    const char *c_stk[_STK_SIZE] = { NULL };
-
-    // iterate over tags until the matching xpath is reached or until no more tags are found in the 'xml'
-    bzero(n_stk, sizeof(char *) * _STK_SIZE);
-
-    for (xml_offset = 0; (name = next_tag(xml + xml_offset, &tag_start, &tag_end, &single, &closing)) != NULL; xml_offset += tag_end + 1) {
-        if (single) {
-            // not interested in singles because we are looking for content
-        } else if (!closing) {         // opening a tag
-            // put name and pointer to content onto the stack
-            stk_p++;
-            if (stk_p == _STK_SIZE)    // exceeding stack size, error
-                goto cleanup;
-            n_stk[stk_p] = euca_strduptolower(name);    // put a lower-case-only copy onto stack
-            c_stk[stk_p] = xml + xml_offset + tag_end + 1;
-        } else {                       // closing tag
-            // get the name in all lower-case, for consistency with xpath
-            name_lc = euca_strduptolower(name);
-            EUCA_FREE(name);
-            name = name_lc;
-
-            // name doesn't match last seen opening tag, error
-            if (stk_p >= 0) {
-                if (!n_stk[stk_p] || (strcmp(n_stk[stk_p], name) != 0)) {
-                    goto cleanup;
-                }
-            }
-            // construct the xpath of the closing tag based on stack contents
-            xpath_cur[0] = '\0';
-            for (i = 0, xpathLen = EUCA_MAX_PATH - 1; i <= stk_p; i++) {
-                if (i > 0) {
-                    strncat(xpath_cur, "/", (xpathLen - strlen(xpath_cur) - 1));
-                }
-                strncat(xpath_cur, n_stk[i], (xpathLen - strlen(xpath_cur) - 1));
-            }
+    boolean closing = FALSE;
+    const char *p = NULL;
+    const char *end = NULL;
+    const char *name = NULL;
+    const char *n_stk[_STK_SIZE] = { NULL };    // element names, pointing into xml
+    int l_stk[_STK_SIZE] = { 0 };      // lengths of the element names
+    const char *c_stk[_STK_SIZE] = { NULL };    // where the content of each element starts
+    int x_stk[_STK_SIZE] = { 0 };      // offset into xpath past the part matched by each level, or one of _XPATH_*
+
+    for (p = strchr(xml, '<'); p != NULL; p = strchr(end + 1, '<')) {
+        if ((end = xml_skip_special(p)) != NULL) {
+            if (*end == '\0')
+                return (NULL);
+            continue;
+        }
 
-            // pop the stack whether we have a match or not
-            if (stk_p < 0)             // past the bottom of the stack, error
-                goto cleanup;
+        closing = (p[1] == '/');
+        name = p + 1 + closing;
+        for (end = name; *end && (*end != '>') && (*end != '/') && !isspace(*end); end++) ;
+        if ((name_len = (end - name)) == 0)
+            return (NULL);
 
-            contp = c_stk[stk_p];
-            cont_len = xml + xml_offset + tag_start - contp;
-            EUCA_FREE(n_stk[stk_p]);
-            stk_p--;
+        // find the end of the tag, allowing for '>' inside quoted attribute values
+        for (quote = '\0'; *end && (quote || (*end != '>')); end++) {
+            if (quote) {
+                if (*end == quote)
+                    quote = '\0';
+            } else if ((*end == '"') || (*end == '\'')) {
+                quote = *end;
+            }
+        }
+        if (*end == '\0')
+            return (NULL);
 
-            // see if current xpath matches the requested one
-            if (strcmp(xpath, xpath_cur) == 0) {
-                if ((cont = EUCA_ZALLOC(cont_len + 1, sizeof(char))) == NULL)
-                    goto cleanup;
-                strncpy(cont, contp, cont_len);
-                ret = cont;
-                break;
+        if (closing) {
+            // must match the last opened element
+            if ((depth == 0) || (l_stk[depth - 1] != name_len) || strncasecmp(n_stk[depth - 1], name, name_len))
+                return (NULL);
+            depth--;
+            if (x_stk[depth] == _XPATH_MATCHED) {
+                if ((cont = EUCA_ZALLOC((p - c_stk[depth]) + 1, sizeof(char))) != NULL)
+                    memcpy(cont, c_stk[depth], (p - c_stk[depth]));
+                return (cont);
+            }
+        } else if (*(end - 1) != '/') {
+            // not interested in <single/> tags because we are looking for content
+            if (depth == _STK_SIZE)
+                return (NULL);
+
+            parent = ((depth == 0) ? 0 : x_stk[depth - 1]);
+            x_stk[depth] = _XPATH_MISMATCHED;
+            if ((parent >= 0) && !strncasecmp(xpath + parent, name, name_len)) {
+                if (xpath[parent + name_len] == '\0')
+                    x_stk[depth] = _XPATH_MATCHED;
+                else if (xpath[parent + name_len] == '/')
+                    x_stk[depth] = parent + name_len + 1;
             }
+            n_stk[depth] = name;
+            l_stk[depth] = name_len;
+            c_stk[depth] = end + 1;
+            depth++;
         }
-        EUCA_FREE(name);
-        name = NULL;
     }
 
-cleanup:
-    EUCA_FREE(name);                   // for exceptions
-    for (i = 0; i <= stk_p; i++)
-        EUCA_FREE(n_stk[i]);           // free everything on the stack
-    return (ret);
+    return (NULL);
 
 #undef _STK_SIZE
+#undef _XPATH_MATCHED
+#undef _XPATH_MISMATCHED
 }
 
 //!
@@ -1356,19 +1617,9 @@ cleanup:
 //!
 char *xpath_content(const char *xml, const char *xpath)
 {
-    char *ret = NULL;
-    char *xpath_l = NULL;
-
     if ((xml == NULL) || (xpath == NULL))
         return (NULL);
-
-    xpath_l = euca_strduptolower(xpath);    // lower-case copy of requested xpath
-    if (xpath_l != NULL) {
-        ret = find_cont(xml, xpath_l);
-        EUCA_FREE(xpath_l);
-    }
-
-    return (ret);
+    return (find_cont(xml, xpath));
 }
 
 //!
@@ -2148,9 +2399,11 @@ int euca_execlp(int *pStatus, const char *file, ...)
     }
 
     pid_t pid;
-    result = euca_execvp_fd(&pid, NULL, NULL, NULL, argv);
-    if (result == EUCA_OK) {
-        result = euca_waitpid(pid, pStatus);
+    if ((result = euca_rootwrap_broker_exec(argv, FALSE, pStatus, NULL)) == EUCA_UNSUPPORTED_ERROR) {
+        result = euca_execvp_fd(&pid, NULL, NULL, NULL, argv);
+        if (result == EUCA_OK) {
+            result = euca_waitpid(pid, pStatus);
+        }
     }
     free_char_list(argv);
 
@@ -2405,16 +2658,429 @@ int euca_execlp_log(int *pStatus, int (*custom_parser) (const char *line, void *
 
     pid_t pid;
     int child_fds[2];
-    result = euca_execvp_fd(&pid, NULL, &child_fds[0], &child_fds[1], argv);
-    if (result == EUCA_OK) {
-        log_fds(2, child_fds, custom_parser, parser_data);
-        result = euca_waitpid(pid, pStatus);
+    char *output = NULL;
+    if ((result = euca_rootwrap_broker_exec(argv, TRUE, pStatus, &output)) != EUCA_UNSUPPORTED_ERROR) {
+        for (char *line = output, *next = NULL; line && *line; line = next) {
+            if ((next = strchr(line, '\n')) != NULL)
+                *(next++) = '\0';
+            log_line_child(line, custom_parser, parser_data);
+        }
+        EUCA_FREE(output);
+    } else {
+        result = euca_execvp_fd(&pid, NULL, &child_fds[0], &child_fds[1], argv);
+        if (result == EUCA_OK) {
+            log_fds(2, child_fds, custom_parser, parser_data);
+            result = euca_waitpid(pid, pStatus);
+        }
     }
     free_char_list(argv);
 
     return result;
 }
 
+//!
+//! Enables persistent euca_rootwrap brokers for this process. Instead of
+//! exec'ing 'euca_rootwrap cmd ...' for every privileged command, the
+//! euca_execlp() family and diskutil hand commands to up to max_brokers
+//! long-lived 'euca_rootwrap --broker' children over socketpairs. Brokers
+//! are started on first use. Commands a broker refuses, or that arrive while
+//! all brokers are busy, still exec euca_rootwrap directly.
+//!
+//! @param[in] rootwrap_path path to the euca_rootwrap binary
+//! @param[in] max_brokers maximum number of brokers, 0 disables them
+//!
+//! @return EUCA_OK on success or EUCA_INVALID_ERROR on bad parameters
+//!
+int euca_rootwrap_broker_init(const char *rootwrap_path, int max_brokers)
+{
+    if ((rootwrap_path == NULL) || (max_brokers < 0))
+        return (EUCA_INVALID_ERROR);
+
+    euca_rootwrap_broker_shutdown();
+
+    pthread_mutex_lock(&rootwrap_broker_mutex);
+    {
+        euca_strncpy(rootwrap_broker_path, rootwrap_path, sizeof(rootwrap_broker_path));
+        rootwrap_broker_max = (max_brokers > ROOTWRAP_BROKER_MAX_CONNS) ? ROOTWRAP_BROKER_MAX_CONNS : max_brokers;
+        rootwrap_broker_owner = getpid();
+        rootwrap_broker_respawn_after = 0;
+        rootwrap_broker_counters.disabled = FALSE;
+        for (int i = 0; i < ROOTWRAP_BROKER_MAX_CONNS; i++) {
+            rootwrap_brokers[i].fd = -1;
+            rootwrap_brokers[i].busy = FALSE;
+        }
+    }
+    pthread_mutex_unlock(&rootwrap_broker_mutex);
+
+    LOGINFO("using up to %d rootwrap brokers via %s\n", max_brokers, rootwrap_path);
+    return (EUCA_OK);
+}
+
+//!
+//! Disables the rootwrap brokers and stops the idle ones. Brokers in use
+//! are stopped when they are checked back in.
+//!
+void euca_rootwrap_broker_shutdown(void)
+{
+    pthread_mutex_lock(&rootwrap_broker_mutex);
+    {
+        if (rootwrap_broker_owner == getpid()) {
+            for (int i = 0; i < ROOTWRAP_BROKER_MAX_CONNS; i++) {
+                if (!rootwrap_brokers[i].busy)
+                    rootwrap_broker_stop(&rootwrap_brokers[i]);
+            }
+        }
+        rootwrap_broker_max = 0;
+    }
+    pthread_mutex_unlock(&rootwrap_broker_mutex);
+}
+
+//!
+//! Copies the broker latency counters, for the component's stats sensor
+//!
+//! @param[out] stats
+//!
+void euca_rootwrap_broker_get_stats(rootwrap_broker_stats * stats)
+{
+    if (stats == NULL)
+        return;
+
+    pthread_mutex_lock(&rootwrap_broker_mutex);
+    {
+        *stats = rootwrap_broker_counters;
+        stats->running = 0;
+        for (int i = 0; (i < ROOTWRAP_BROKER_MAX_CONNS) && (rootwrap_broker_owner == getpid()); i++) {
+            if (rootwrap_brokers[i].fd >= 0)
+                stats->running++;
+        }
+    }
+    pthread_mutex_unlock(&rootwrap_broker_mutex);
+}
+
+//!
+//! Runs 'euca_rootwrap cmd ...' through a broker, if possible
+//!
+//! @param[in]  argv NULL-terminated argument list, argv[0] being euca_rootwrap
+//! @param[in]  capture if TRUE, stdout and stderr of the command are returned in output
+//! @param[out] pStatus waitpid() status of the command, if not NULL
+//! @param[out] output captured output (NUL-terminated, caller frees) when capture is TRUE
+//!
+//! @return EUCA_UNSUPPORTED_ERROR if the caller must exec the command itself, otherwise
+//!         what euca_waitpid() would return for the command, or EUCA_SYSTEM_ERROR if the
+//!         broker went away while running it
+//!
+int euca_rootwrap_broker_exec(char **argv, boolean capture, int *pStatus, char **output)
+{
+    int argc = 0;
+    char *req = NULL;
+    char *buf = NULL;
+    char *base = NULL;
+    size_t req_len = 0;
+    long long usec = 0;
+    uint32_t len = 0;
+    rootwrap_broker_conn *conn = NULL;
+    rootwrap_broker_request header = { 0 };
+    rootwrap_broker_response resp = { 0 };
+
+    if (output)
+        *output = NULL;
+
+    if ((rootwrap_broker_max == 0) || (argv == NULL) || (argv[0] == NULL) || (argv[1] == NULL))
+        return (EUCA_UNSUPPORTED_ERROR);
+
+    base = strrchr(argv[0], '/');
+    if (strcmp(argv[0], rootwrap_broker_path) && strcmp(((base != NULL) ? (base + 1) : argv[0]), "euca_rootwrap"))
+        return (EUCA_UNSUPPORTED_ERROR);
+
+    // the request is a header followed by the length-prefixed arguments, without euca_rootwrap itself
+    req_len = sizeof(header);
+    for (argc = 0; argv[argc + 1] != NULL; argc++) {
+        if ((argc >= ROOTWRAP_BROKER_MAX_ARGS) || (strlen(argv[argc + 1]) > ROOTWRAP_BROKER_MAX_ARG_LEN))
+            return (EUCA_UNSUPPORTED_ERROR);
+        req_len += sizeof(len) + strlen(argv[argc + 1]);
+    }
+
+    if ((conn = rootwrap_broker_checkout()) == NULL) {
+        pthread_mutex_lock(&rootwrap_broker_mutex);
+        rootwrap_broker_counters.fallbacks++;
+        pthread_mutex_unlock(&rootwrap_broker_mutex);
+        return (EUCA_UNSUPPORTED_ERROR);
+    }
+
+    if ((req = EUCA_ALLOC(req_len, sizeof(char))) == NULL) {
+        rootwrap_broker_checkin(conn, FALSE);
+        return (EUCA_UNSUPPORTED_ERROR);
+    }
+
+    header.magic = ROOTWRAP_BROKER_MAGIC;
+    header.seq = ++conn->seq;
+    header.flags = (capture ? ROOTWRAP_BROKER_CAPTURE_OUTPUT : 0);
+    header.argc = argc;
+    memcpy(req, &header, sizeof(header));
+    req_len = sizeof(header);
+    for (int i = 1; argv[i] != NULL; i++) {
+        len = strlen(argv[i]);
+        memcpy(req + req_len, &len, sizeof(len));
+        memcpy(req + req_len + sizeof(len), argv[i], len);
+        req_len += sizeof(len) + len;
+    }
+
+    usec = time_usec();
+    if (rootwrap_broker_send(conn->fd, req, req_len) != 0) {
+        // the request never made it, so the command did not run
+        LOGWARN("failed to send request to rootwrap broker %d: %s\n", conn->pid, strerror(errno));
+        rootwrap_broker_checkin(conn, TRUE);
+        EUCA_FREE(req);
+        return (EUCA_UNSUPPORTED_ERROR);
+    }
+    EUCA_FREE(req);
+
+    if ((rootwrap_broker_recv(conn->fd, &resp, sizeof(resp)) != 0) || (resp.magic != ROOTWRAP_BROKER_MAGIC) || (resp.seq != header.seq)
+        || (resp.output_len > ROOTWRAP_BROKER_MAX_OUTPUT) || ((buf = EUCA_ALLOC(resp.output_len + 1, sizeof(char))) == NULL)
+        || ((resp.output_len > 0) && (rootwrap_broker_recv(conn->fd, buf, resp.output_len) != 0))) {
+        LOGERROR("lost rootwrap broker %d while running %s\n", conn->pid, argv[1]);
+        rootwrap_broker_checkin(conn, TRUE);
+        EUCA_FREE(buf);
+        pthread_mutex_lock(&rootwrap_broker_mutex);
+        rootwrap_broker_counters.failures++;
+        pthread_mutex_unlock(&rootwrap_broker_mutex);
+        return (EUCA_SYSTEM_ERROR);
+    }
+    buf[resp.output_len] = '\0';
+    usec = time_usec() - usec;
+    LOGTRACE("rootwrap broker %d ran %s in %lld usec (result=%d status=%d)\n", conn->pid, argv[1], usec, resp.result, resp.status);
+    rootwrap_broker_checkin(conn, FALSE);
+
+    pthread_mutex_lock(&rootwrap_broker_mutex);
+    {
+        if (resp.result == ROOTWRAP_BROKER_RAN) {
+            rootwrap_broker_counters.requests++;
+            rootwrap_broker_counters.total_usec += usec;
+            if (usec > rootwrap_broker_counters.max_usec)
+                rootwrap_broker_counters.max_usec = usec;
+        } else {
+            rootwrap_broker_counters.fallbacks++;
+        }
+    }
+    pthread_mutex_unlock(&rootwrap_broker_mutex);
+
+    if (resp.result != ROOTWRAP_BROKER_RAN) {
+        EUCA_FREE(buf);
+        return (EUCA_UNSUPPORTED_ERROR);
+    }
+
+    if (capture && output)
+        *output = buf;
+    else
+        EUCA_FREE(buf);
+
+    if (pStatus)
+        (*pStatus) = resp.status;
+
+    if (WIFEXITED(resp.status))
+        return ((WEXITSTATUS(resp.status) == 0) ? EUCA_OK : EUCA_ERROR);
+
+    LOGDEBUG("child process did not terminate normally. status=%d\n", resp.status);
+    return (EUCA_THREAD_ERROR);
+}
+
+//!
+//! Starts a broker for the given slot and waits for it to report that it is
+//! running as root. Called without the broker mutex held.
+//!
+//! @param[in] conn
+//!
+//! @return EUCA_OK on success, EUCA_PERMISSION_ERROR if the broker reported it
+//!         cannot run as root or EUCA_ERROR if it did not start for another reason
+//!
+static int rootwrap_broker_spawn(rootwrap_broker_conn * conn)
+{
+    int sv[2] = { -1, -1 };
+    pid_t pid = -1;
+    struct pollfd pfd = { 0 };
+    rootwrap_broker_hello hello = { 0 };
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+        LOGERROR("socketpair() failed: %s\n", strerror(errno));
+        return (EUCA_ERROR);
+    }
+
+    if ((pid = fork()) < 0) {
+        LOGERROR("failed to fork rootwrap broker: %s\n", strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
+        return (EUCA_ERROR);
+    }
+
+    if (pid == 0) {
+        // only async-signal-safe calls past this point
+        if (dup2(sv[1], STDIN_FILENO) < 0)
+            _exit(127);
+        setpgid(0, 0);
+        execl(rootwrap_broker_path, rootwrap_broker_path, ROOTWRAP_BROKER_FLAG, (char *)NULL);
+        _exit(127);
+    }
+
+    close(sv[1]);
+    pfd.fd = sv[0];
+    pfd.events = POLLIN;
+    if ((poll(&pfd, 1, ROOTWRAP_BROKER_HELLO_TIMEOUT_MS) != 1) || (rootwrap_broker_recv(sv[0], &hello, sizeof(hello)) != 0)
+        || (hello.magic != ROOTWRAP_BROKER_MAGIC)) {
+        close(sv[0]);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        if (hello.magic == ROOTWRAP_BROKER_MAGIC_UNPRIVILEGED) {
+            LOGWARN("rootwrap broker %s cannot run as root, executing privileged commands directly\n", rootwrap_broker_path);
+            return (EUCA_PERMISSION_ERROR);
+        }
+        LOGWARN("rootwrap broker %s did not start, executing privileged commands directly for %d seconds\n", rootwrap_broker_path,
+                ROOTWRAP_BROKER_RESPAWN_DELAY);
+        return (EUCA_ERROR);
+    }
+
+    conn->fd = sv[0];
+    conn->pid = pid;
+    conn->seq = 0;
+    LOGDEBUG("started rootwrap broker %d\n", pid);
+    return (EUCA_OK);
+}
+
+//!
+//! Stops a broker. Closing our end makes it exit after its current command.
+//!
+//! @param[in] conn
+//!
+static void rootwrap_broker_stop(rootwrap_broker_conn * conn)
+{
+    if (conn->fd < 0)
+        return;
+
+    close(conn->fd);
+    conn->fd = -1;
+    waitpid(conn->pid, NULL, 0);
+}
+
+//!
+//! Takes an idle broker, starting a new one if all running brokers are busy
+//! and the limit allows it
+//!
+//! @return a broker reserved for the caller or NULL if the caller must exec directly
+//!
+static rootwrap_broker_conn *rootwrap_broker_checkout(void)
+{
+    int rc = EUCA_OK;
+    rootwrap_broker_conn *conn = NULL;
+    rootwrap_broker_conn *empty = NULL;
+
+    pthread_mutex_lock(&rootwrap_broker_mutex);
+    {
+        if ((rootwrap_broker_max > 0) && (rootwrap_broker_owner == getpid())) {
+            for (int i = 0; (i < rootwrap_broker_max) && (conn == NULL); i++) {
+                if (rootwrap_brokers[i].busy)
+                    continue;
+                if (rootwrap_brokers[i].fd >= 0)
+                    conn = &rootwrap_brokers[i];
+                else if ((empty == NULL) && (time(NULL) >= rootwrap_broker_respawn_after))
+                    empty = &rootwrap_brokers[i];
+            }
+            if (conn == NULL)
+                conn = empty;
+            if (conn)
+                conn->busy = TRUE;
+        }
+    }
+    pthread_mutex_unlock(&rootwrap_broker_mutex);
+
+    if (conn && (conn->fd < 0) && ((rc = rootwrap_broker_spawn(conn)) != EUCA_OK)) {
+        pthread_mutex_lock(&rootwrap_broker_mutex);
+        {
+            conn->busy = FALSE;
+            rootwrap_broker_counters.spawn_failures++;
+            if (rc == EUCA_PERMISSION_ERROR) {
+                // euca_rootwrap is not setuid root here, no broker will ever start
+                rootwrap_broker_max = 0;
+                rootwrap_broker_counters.disabled = TRUE;
+            } else {
+                // possibly transient (fork, resources, slow start): keep using the running brokers, retry later
+                rootwrap_broker_respawn_after = time(NULL) + ROOTWRAP_BROKER_RESPAWN_DELAY;
+            }
+        }
+        pthread_mutex_unlock(&rootwrap_broker_mutex);
+        conn = NULL;
+    }
+    return (conn);
+}
+
+//!
+//! Returns a broker taken with rootwrap_broker_checkout()
+//!
+//! @param[in] conn
+//! @param[in] broken if TRUE the connection is unusable and the broker is stopped
+//!
+static void rootwrap_broker_checkin(rootwrap_broker_conn * conn, boolean broken)
+{
+    if (broken || (rootwrap_broker_max == 0))
+        rootwrap_broker_stop(conn);
+
+    pthread_mutex_lock(&rootwrap_broker_mutex);
+    conn->busy = FALSE;
+    pthread_mutex_unlock(&rootwrap_broker_mutex);
+}
+
+//!
+//! Writes the whole buffer to a broker without risking SIGPIPE
+//!
+//! @param[in] fd
+//! @param[in] buf
+//! @param[in] len
+//!
+//! @return 0 on success or -1 on failure
+//!
+static int rootwrap_broker_send(int fd, const void *buf, size_t len)
+{
+    ssize_t rc = 0;
+    const char *p = buf;
+
+    while (len > 0) {
+        if ((rc = send(fd, p, len, MSG_NOSIGNAL)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        p += rc;
+        len -= rc;
+    }
+    return (0);
+}
+
+//!
+//! Reads exactly len bytes from a broker
+//!
+//! @param[in] fd
+//! @param[in] buf
+//! @param[in] len
+//!
+//! @return 0 on success or -1 on failure or EOF
+//!
+static int rootwrap_broker_recv(int fd, void *buf, size_t len)
+{
+    ssize_t rc = 0;
+    char *p = buf;
+
+    while (len > 0) {
+        if ((rc = recv(fd, p, len, 0)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        if (rc == 0)
+            return (-1);
+        p += rc;
+        len -= rc;
+    }
+    return (0);
+}
+
 //!
 //! Returns username of the real user ID of the calling process
 //!
@@ -2607,6 +3273,7 @@ static void drain_fd(const char *prefix, int fd)
 }
 
 #define COMPETITOR_ITERATIONS 10
+#define XPATH_BENCH_ITERATIONS 20000
 #define COMPETITIVE_PARTICIPANTS 5
 #define TEST_LOG "./test_misc.log"
 
@@ -2712,6 +3379,40 @@ int main(int argc, char **argv)
         EUCA_FREE(new_corr_id);
     }
 
+    printf("Testing get_conf_var() snapshots\n");
+    {
+        char conf[EUCA_MAX_PATH] = "/tmp/euca-misc-test.conf";
+        char confs[2][EUCA_MAX_PATH] = { "/tmp/euca-misc-test.conf", "/tmp/euca-misc-test-missing.conf" };
+        char *v = NULL;
+        long l = 0;
+        boolean b = FALSE;
+
+        fp = fopen(conf, "w");
+        assert(fp != NULL);
+        fprintf(fp, "# comment\nTEST=\"test value\"\n  TEST2   = word # trailing\nTEST=second\nTEST_NUM=42\nTEST_BOOL=\"Y\"\nBAD=\"unterminated\n");
+        fclose(fp);
+        assert(get_conf_var(conf, "TEST", &v) == 1 && !strcmp(v, "test value"));
+        EUCA_FREE(v);
+        assert(get_conf_var(conf, "TEST2", &v) == 1 && !strcmp(v, "word"));
+        EUCA_FREE(v);
+        assert(get_conf_var(conf, "TEST_", &v) == 0 && v == NULL);
+        assert(get_conf_var(conf, "BAD", &v) == -1 && v == NULL);
+        assert(getConfLong(confs, 2, "TEST_NUM", &l) && (l == 42));
+        assert(!getConfLong(confs, 2, "TEST2", &l));
+        assert(getConfBool(confs, 2, "TEST_BOOL", &b) && b);
+
+        // the snapshot must be refreshed once the file changes
+        fp = fopen(conf, "w");
+        assert(fp != NULL);
+        fprintf(fp, "TEST=changed\n");
+        fclose(fp);
+        assert(get_conf_var(conf, "TEST", &v) == 1 && !strcmp(v, "changed"));
+        EUCA_FREE(v);
+        assert(get_conf_var(conf, "TEST2", &v) == 0);
+        unlink(conf);
+        assert(get_conf_var(conf, "TEST", &v) == -1);
+    }
+
     // We're testing the euca_execlp() API.
     printf("Testing euca_execlp() in misc.c\n");
 
@@ -2876,6 +3577,84 @@ int main(int argc, char **argv)
         unlink(f2);
     }
 
+    {
+        printf("testing xpath_content\n");
+        struct {
+            const char *xml;
+            const char *xpath;
+            const char *expected;
+        } cases[] = {
+            {"<a><b>foo</b><c><d>bar</d><e>baz</e></c></a>", "a/c/e", "baz"},
+            {"<a><b>foo</b><c><d>bar</d><e>baz</e></c></a>", "a/c", "<d>bar</d><e>baz</e>"},
+            {"<a><b>foo</b><c><d>bar</d><e>baz</e></c></a>", "a/c/f", NULL},
+            {"<a><b>foo</b><c><d>bar</d><e>baz</e></c></a>", "/a/b", NULL},
+            {"<?xml version=\"1.0\"?>\n<A><!-- <b>no</b> --><B x=\"1>2\" y='/'>Yes</B></A>", "a/b", "Yes"},
+            {"<a><b/><b>second</b></a>", "a/b", "second"},
+            {"<a>\n  <b\n   attr=\"v\">multi\nline</b>\n</a>", "a/b", "multi\nline"},
+            {"<a><b><![CDATA[</c>]]></b></a>", "a/b", "<![CDATA[</c>]]>"},
+            {"<a><b>unclosed</a>", "a/b", NULL},
+            {"<a><b>truncated</b", "a/b", NULL},
+            {"<a><ab>x</ab><b>y</b></a>", "a/b", "y"},
+        };
+
+        for (int j = 0; j < (sizeof(cases) / sizeof(cases[0])); j++) {
+            char *cont = xpath_content(cases[j].xml, cases[j].xpath);
+            if (cases[j].expected == NULL) {
+                assert(cont == NULL);
+            } else {
+                assert((cont != NULL) && !strcmp(cont, cases[j].expected));
+            }
+            EUCA_FREE(cont);
+        }
+        assert(xpath_content(NULL, "a") == NULL);
+        assert(xpath_content("<a/>", NULL) == NULL);
+
+        // a bundle manifest as uploaded by euca-bundle-image, and an NC-style config document
+        char manifest[16384] = "";
+        char config[4096] = "";
+        int len = 0;
+
+        len = snprintf(manifest, sizeof(manifest), "<?xml version=\"1.0\" ?><manifest><version>2007-10-10</version><bundler><name>euca-tools</name>"
+                       "<version>1.3</version><release>31337</release></bundler><machine_configuration><architecture>x86_64</architecture>"
+                       "<block_device_mapping><mapping><virtual>ami</virtual><device>sda1</device></mapping><mapping><virtual>root</virtual>"
+                       "<device>/dev/sda1</device></mapping></block_device_mapping><kernel_id>eki-12345678</kernel_id></machine_configuration>"
+                       "<image><name>centos.img</name><user>000000000001</user><type>machine</type><digest algorithm=\"SHA1\">"
+                       "0123456789abcdef0123456789abcdef01234567</digest><size>1073741824</size><bundled_size>314572800</bundled_size>"
+                       "<ec2_encrypted_key algorithm=\"AES-128-CBC\">%0256d</ec2_encrypted_key><user_encrypted_key algorithm=\"AES-128-CBC\">"
+                       "%0256d</user_encrypted_key><ec2_encrypted_iv>%064d</ec2_encrypted_iv><user_encrypted_iv>%064d</user_encrypted_iv><parts count=\"31\">",
+                       0, 0, 0, 0);
+        for (int j = 0; j < 31; j++)
+            len += snprintf(manifest + len, sizeof(manifest) - len, "<part index=\"%d\"><filename>centos.img.part.%d</filename>"
+                            "<digest algorithm=\"SHA1\">0123456789abcdef0123456789abcdef01234567</digest></part>", j, j);
+        len += snprintf(manifest + len, sizeof(manifest) - len, "</parts></image><signature>%0256d</signature></manifest>", 0);
+        snprintf(config, sizeof(config), "<nc version=\"4.4\" enabled=\"true\"><hypervisor type=\"kvm\" capability=\"hw\"/>"
+                 "<backing><work>/var/lib/eucalyptus/instances/work</work><cache size=\"10240\">/var/lib/eucalyptus/instances/cache</cache></backing>"
+                 "<network mode=\"EDGE\"><bridge>br0</bridge><public>eth0</public><dhcp>/usr/sbin/dhcpd</dhcp></network>"
+                 "<limits><cores>16</cores><memoryMB>65536</memoryMB><diskGB>1024</diskGB></limits></nc>");
+
+        struct {
+            const char *name;
+            const char *xml;
+            const char *xpath;
+        } bench[] = {
+            {"manifest, first element", manifest, "manifest/version"},
+            {"manifest, signature at the end", manifest, "manifest/signature"},
+            {"manifest, missing element", manifest, "manifest/image/kernel"},
+            {"config, nested element", config, "nc/limits/memoryMB"},
+        };
+
+        for (int j = 0; j < (sizeof(bench) / sizeof(bench[0])); j++) {
+            char *cont = NULL;
+            long long t_start = time_usec();
+            for (int k = 0; k < XPATH_BENCH_ITERATIONS; k++) {
+                cont = xpath_content(bench[j].xml, bench[j].xpath);
+                EUCA_FREE(cont);
+            }
+            double ns = (time_usec() - t_start) * 1000.0 / XPATH_BENCH_ITERATIONS;
+            printf("\t%-32s %6zu bytes: %8.1f ns per lookup, %6.1f ns per KB\n", bench[j].name, strlen(bench[j].xml), ns, ns * 1024.0 / strlen(bench[j].xml));
+        }
+    }
+
     {
         printf("testing euca_execlp_log\n");
         printf("spawning %d competing threads that will write to %s\n", COMPETITIVE_PARTICIPANTS, TEST_LOG);
@@ -127,6 +127,18 @@ typedef unsigned char boolean;         //!< @todo move this somewhere more globa
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! Privileged operation latency as seen through the rootwrap broker
+typedef struct rootwrap_broker_stats_t {
+    long long requests;                //!< commands run by a broker
+    long long fallbacks;               //!< commands that had to exec euca_rootwrap directly
+    long long failures;                //!< broker transport errors
+    long long spawn_failures;          //!< brokers that did not start
+    int running;                       //!< brokers currently started
+    boolean disabled;                  //!< set once a broker reported it cannot run as root
+    long long total_usec;              //!< sum of broker round trip times
+    long long max_usec;                //!< slowest broker round trip
+} rootwrap_broker_stats;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXPORTED VARIABLES                             |
@@ -153,6 +165,8 @@ int killwait(pid_t pid);
 int check_process(pid_t pid, char *search);
 char *system_output(char *shell_command);
 char *getConfString(char configFiles[][EUCA_MAX_PATH], int numFiles, char *key);
+boolean getConfLong(char configFiles[][EUCA_MAX_PATH], int numFiles, char *key, long *pVal);
+boolean getConfBool(char configFiles[][EUCA_MAX_PATH], int numFiles, char *key, boolean * pVal);
 int get_conf_var(const char *path, const char *name, char **value);
 void free_char_list(char **value);
 char **from_var_to_char_list(const char *v);
@@ -188,6 +202,10 @@ int euca_execlp(int *pStatus, const char *file, ...);
 int euca_execlp_redirect(int *pStatus, const char *stdin_path, const char *stdout_path, boolean stdout_append, const char *stderr_path, boolean stderr_append, const char *file, ...);
 int euca_run_workflow_parser(const char *line, void *data);
 int euca_execlp_log(int *pStatus, int (*custom_parser) (const char *line, void *data), void *parser_data, const char *file, ...);
+int euca_rootwrap_broker_init(const char *rootwrap_path, int max_brokers);
+void euca_rootwrap_broker_shutdown(void);
+int euca_rootwrap_broker_exec(char **argv, boolean capture, int *pStatus, char **output);
+void euca_rootwrap_broker_get_stats(rootwrap_broker_stats * stats);
 char *get_username(void);
 int euca_nanosleep(unsigned long long nsec);
 void euca_srand(void);
@@ -0,0 +1,250 @@
+// -*- mode: C; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+// vim: set softtabstop=4 shiftwidth=4 tabstop=4 expandtab:
+
+/*************************************************************************
+ * Copyright 2009-2012 Eucalyptus Systems, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ *
+ * Please contact Eucalyptus Systems, Inc., 6755 Hollister Ave., Goleta
+ * CA 93117, USA or visit http://www.eucalyptus.com/licenses/ if you need
+ * additional information or have any questions.
+ *
+ * This file may incorporate work covered under the following copyright
+ * and permission notice:
+ *
+ *   Software License Agreement (BSD License)
+ *
+ *   Copyright (c) 2008, Regents of the University of California
+ *   All rights reserved.
+ *
+ *   Redistribution and use of this software in source and binary forms,
+ *   with or without modification, are permitted provided that the
+ *   following conditions are met:
+ *
+ *     Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *     Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *   BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE. USERS OF THIS SOFTWARE ACKNOWLEDGE
+ *   THE POSSIBLE PRESENCE OF OTHER OPEN SOURCE LICENSED MATERIAL,
+ *   COPYRIGHTED MATERIAL OR PATENTED MATERIAL IN THIS SOFTWARE,
+ *   AND IF ANY SUCH MATERIAL IS DISCOVERED THE PARTY DISCOVERING
+ *   IT MAY INFORM DR. RICH WOLSKI AT THE UNIVERSITY OF CALIFORNIA,
+ *   SANTA BARBARA WHO WILL THEN ASCERTAIN THE MOST APPROPRIATE REMEDY,
+ *   WHICH IN THE REGENTS' DISCRETION MAY INCLUDE, WITHOUT LIMITATION,
+ *   REPLACEMENT OF THE CODE SO IDENTIFIED, LICENSING OF THE CODE SO
+ *   IDENTIFIED, OR WITHDRAWAL OF THE CODE CAPABILITY TO THE EXTENT
+ *   NEEDED TO COMPLY WITH ANY SUCH LICENSES OR RIGHTS.
+ ************************************************************************/
+
+//!
+//! @file util/stats/counter_sensor.c
+//! Sensor reporting a set of named counters maintained by the component
+//!
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  INCLUDES                                  |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+#include "counter_sensor.h"
+#include "sensor_common.h"
+#include <eucalyptus.h>
+#include <euca_string.h>
+#include <string.h>
+#include <log.h>
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  DEFINES                                   |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                  TYPEDEFS                                  |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                ENUMERATIONS                                |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                 STRUCTURES                                 |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                             EXTERNAL VARIABLES                             |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+/* Should preferably be handled in header file */
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                              GLOBAL VARIABLES                              |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                              STATIC VARIABLES                              |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+static counter_sensor_t internal_counter_sensor;
+static char interval_tag[SENSOR_TAG_MAX];
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                              STATIC PROTOTYPES                             |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+#ifdef _UNIT_TEST
+static int test_counter_sensor();
+
+#endif
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                                   MACROS                                   |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------*\
+ |                                                                            |
+ |                               IMPLEMENTATION                               |
+ |                                                                            |
+\*----------------------------------------------------------------------------*/
+
+//! Entry point for the counters sensor. Gets the current counter values
+//! from the component and wraps them in a sensor event.
+json_object *counter_sensor_call() {
+    json_object *counters;
+    json_object *event_json;
+    json_object *tags;
+
+    if (internal_counter_sensor.counters_callback == NULL) {
+        LOGERROR("Counter sensor invoked before initialization\n");
+        return NULL;
+    }
+
+    if ((counters = internal_counter_sensor.counters_callback()) == NULL) {
+        LOGERROR("Failed getting the component counters\n");
+        return NULL;
+    }
+
+    tags = build_tag_set(1, interval_tag);
+    event_json = build_sensor_output(counter_sensor.sensor_name, COUNTER_SENSOR_DESCRIPTION, time(NULL), internal_counter_sensor.event_ttl, tags, counters);
+
+    if (event_json == NULL) {
+        json_object_put(counters);
+        LOGERROR("Failed in counters output generation.");
+        return NULL;
+    }
+
+    return event_json;
+}
+
+//! Idempotently initialize the counter sensor structures. Not threadsafe.
+//! The counters_call callback returns a new json object mapping counter names to values.
+int initialize_counter_sensor(const char *service_name, int interval, int event_ttl, json_object *(*counters_call)()) {
+    if (service_name == NULL ||
+        event_ttl < 0 ||
+        counters_call == NULL) {
+        LOGERROR("Invalid initialization values for counter sensor. Cannot initialize\n");
+        return EUCA_ERROR;
+    }
+
+    LOGINFO("Initializing counter sensor for component %s\n", service_name);
+    euca_strncpy(counter_sensor.config_name, COUNTER_SENSOR_NAME, SENSOR_NAME_MAX);
+    snprintf(counter_sensor.sensor_name, SENSOR_NAME_MAX, COUNTER_SENSOR_NAME_FORMAT, service_name);
+    counter_sensor.enabled = 0;
+    counter_sensor.sensor_function = counter_sensor_call;
+    counter_sensor.state_toggle_callback = NULL;
+
+    euca_strncpy(internal_counter_sensor.service_name, service_name, SENSOR_NAME_MAX);
+    internal_counter_sensor.counters_callback = counters_call;
+    internal_counter_sensor.event_ttl = event_ttl;
+    snprintf(interval_tag, SENSOR_TAG_MAX, SENSOR_INTERVAL_PERIOD_TAG_FORMAT, interval);
+
+    return EUCA_OK;
+}
+
+int teardown_counter_sensor() {
+    bzero(internal_counter_sensor.service_name, SENSOR_NAME_MAX);
+    internal_counter_sensor.counters_callback = NULL;
+    return EUCA_OK;
+}
+
+#ifdef _UNIT_TEST
+
+json_object *counters_test() {
+    json_object *counters = json_object_new_object();
+    json_object_object_add(counters, "hits", json_object_new_int64(42));
+    json_object_object_add(counters, "misses", json_object_new_int64(7));
+    return counters;
+}
+
+int test_counter_sensor() {
+    int test_ttl = 60;
+    initialize_counter_sensor("cc", test_ttl, test_ttl, counters_test);
+    json_object *event = counter_sensor_call();
+    if (event == NULL) {
+        return 1;
+    }
+    LOGINFO("Result map: %s\n", json_object_to_json_string_ext(event, JSON_C_TO_STRING_PRETTY));
+    json_object_put(event);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int count, success, failure;
+    count = 0;
+    success = 0;
+    failure = 0;
+
+    if(test_counter_sensor() == 0) {
+        LOGINFO("Success!\n");
+        success++;
+    } else {
+        LOGINFO("Failed\n");
+        failure++;
+    }
+    count++;
+
+    LOGINFO("Tests: %d, Success: %d, Failure: %d\n", count, success, failure);
+    return 0;
+}
+#endif
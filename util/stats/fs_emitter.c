@@ -66,7 +66,11 @@
 //!
 //! @file util/stats/fs_emitter.c
 //! Implementation of event emitter the writes json to the filesystem with
-//!  each sensor event in a unique file identified by the sensor name
+//!  each sensor event in a unique file identified by the sensor name.
+//!
+//! Alternatively (STATS_FILESYSTEM_OUTPUT_MODE="ndjson") events are buffered
+//!  as compact newline-delimited json and appended once per sensor pass to a
+//!  single size-rotated log that is opened, owned and permissioned only once.
 //!
 
 /*----------------------------------------------------------------------------*\
@@ -75,6 +79,7 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+#define _GNU_SOURCE                    // fallocate
 #include "fs_emitter.h"
 #include "sensor_common.h"
 #include <eucalyptus.h>
@@ -83,12 +88,17 @@
 #include <diskutil.h>
 #include <log.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <json/json.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <grp.h>
+#include <pwd.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <config.h>
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -139,6 +149,15 @@ static struct group *euca_stats_group;
 const static int file_flags = O_CREAT | O_WRONLY;
 static char euca_stats_path[EUCA_MAX_PATH];
 
+static int ndjson_mode = FALSE;          //!< set when events go to the ndjson log
+static int ndjson_fd = -1;               //!< open descriptor of the ndjson log
+static off_t ndjson_size = 0;            //!< current size of the ndjson log
+static long ndjson_max_bytes = NDJSON_DEFAULT_MAX_BYTES;
+static char ndjson_path[EUCA_MAX_PATH];
+static char *ndjson_buf = NULL;          //!< events pending for the next flush
+static size_t ndjson_buf_len = 0;
+static size_t ndjson_buf_size = 0;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                              STATIC PROTOTYPES                             |
@@ -152,6 +171,12 @@ static char *expand_data_path(const char *path);
 static int set_stats_output_path(const char *euca_home);
 static char *get_stats_output_path();
 static void euca_chrreplace(char *haystack, char target, char replacement);
+static int ndjson_open(void);
+static void ndjson_close(void);
+static int ndjson_rotate(void);
+static int ndjson_buffer_event(json_object *event);
+static int ndjson_write_all(const char *buf, size_t len);
+static void read_output_config(void);
 
 #ifdef _UNIT_TEST
 static char *test_home; //home dir for tests
@@ -160,6 +185,8 @@ static int test_get_temp_output_name();
 static int test_get_output_name();
 static int test_write_event_to_file();
 static int test_get_set_stats_path();
+static int test_ndjson_emitter();
+static int test_ndjson_config();
 #endif
 
 /*----------------------------------------------------------------------------*\
@@ -174,6 +201,20 @@ static int test_get_set_stats_path();
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! Reads the output mode and the ndjson rotation threshold from the configuration
+static void read_output_config(void) {
+    long max_bytes = 0;
+    char *mode = configFileValue(OUTPUT_MODE_CONFIG_NAME);
+
+    ndjson_mode = (mode != NULL && strcmp(mode, OUTPUT_MODE_NDJSON) == 0);
+    EUCA_FREE(mode);
+
+    ndjson_max_bytes = NDJSON_DEFAULT_MAX_BYTES;
+    if(configFileValueLong(OUTPUT_MAX_BYTES_CONFIG_NAME, &max_bytes) && max_bytes > 0) {
+        ndjson_max_bytes = (max_bytes < NDJSON_MIN_MAX_BYTES) ? NDJSON_MIN_MAX_BYTES : max_bytes;
+    }
+}
+
 int init_emitter(const char *euca_home) {
     //check for proper group
     LOGDEBUG("Initializing fs emitter\n");
@@ -204,22 +245,206 @@ int init_emitter(const char *euca_home) {
         }
     }
 
+    read_output_config();
+    if(ndjson_mode) {
+        if(ndjson_open() != EUCA_OK) {
+            LOGERROR("Cannot open ndjson output for fs emitter\n");
+            return EUCA_ERROR;
+        }
+    }
+
     LOGINFO("FS emitter initialization complete\n");
     return EUCA_OK;
 }
 
 //!
-//! Synchronously offer an event to the emitter. Emits the event at this time, no batching/queues
-//! 
+//! Offer an event to the emitter. In the default mode the event is written out
+//! synchronously. In ndjson mode it is buffered until the next emitter_flush()
+//!
 //! @param json document to emit
 //! @returns 0 on success, error code != 0 on failure
 int emitter_offer_event(json_object *event) {
     if(event == NULL) {
         return EUCA_ERROR;
     }
+    if(ndjson_mode) {
+        return ndjson_buffer_event(event);
+    }
     return write_event_to_file(event);
 }
 
+//!
+//! Write out any buffered events with a single append, rotating the log
+//! first if the append would take it past the size limit. A no-op in the
+//! default file-per-sensor mode.
+//!
+//! @returns 0 on success, error code != 0 on failure
+int emitter_flush(void) {
+    int result = EUCA_OK;
+
+    if(!ndjson_mode || ndjson_buf_len == 0) {
+        return EUCA_OK;
+    }
+
+    if(ndjson_fd < 0 && ndjson_open() != EUCA_OK) {
+        LOGERROR("Dropping %ld bytes of sensor events, ndjson output %s not open\n", (long)ndjson_buf_len, ndjson_path);
+        ndjson_buf_len = 0;
+        return EUCA_IO_ERROR;
+    }
+
+    if(ndjson_size > 0 && (ndjson_size + (off_t)ndjson_buf_len) > ndjson_max_bytes) {
+        if(ndjson_rotate() != EUCA_OK) {
+            LOGWARN("Failed to rotate %s, continuing to append\n", ndjson_path);
+        }
+    }
+
+    if(ndjson_fd < 0 || ndjson_write_all(ndjson_buf, ndjson_buf_len) != EUCA_OK) {
+        LOGERROR("Error appending %ld bytes of sensor events to %s\n", (long)ndjson_buf_len, ndjson_path);
+        ndjson_close();
+        result = EUCA_IO_ERROR;
+    } else {
+        ndjson_size += ndjson_buf_len;
+    }
+    ndjson_buf_len = 0;
+    return result;
+}
+
+//! Open (creating if needed) the ndjson log for appending and give it the
+//! output ownership and permissions. Space up to the rotation limit is
+//! reserved without changing the file size so readers never see padding.
+static int ndjson_open(void) {
+    struct stat st = { 0 };
+    struct passwd *pw = NULL;
+    uid_t uid = -1;
+
+    if(ndjson_path[0] == '\0') {
+        char *path = expand_data_path(NDJSON_FILENAME);
+        if(path == NULL) {
+            return EUCA_ERROR;
+        }
+        euca_strncpy(ndjson_path, path, EUCA_MAX_PATH);
+        EUCA_FREE(path);
+    }
+
+    if((ndjson_fd = open(ndjson_path, O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC, OUTPUT_DATA_PERM)) < 0) {
+        LOGERROR("Cannot open %s: %s\n", ndjson_path, strerror(errno));
+        return EUCA_IO_ERROR;
+    }
+
+    if(fstat(ndjson_fd, &st) != 0) {
+        LOGERROR("Cannot stat %s: %s\n", ndjson_path, strerror(errno));
+        ndjson_close();
+        return EUCA_IO_ERROR;
+    }
+    ndjson_size = st.st_size;
+
+    if(geteuid() == 0 && (pw = getpwnam(DATA_OUTPUT_USER)) != NULL) {
+        uid = pw->pw_uid;
+    }
+    if((uid != (uid_t)-1 && st.st_uid != uid) || (euca_stats_group != NULL && st.st_gid != euca_stats_group->gr_gid)) {
+        if(fchown(ndjson_fd, uid, (euca_stats_group != NULL) ? euca_stats_group->gr_gid : (gid_t)-1) != 0) {
+            // not privileged enough to do it directly, take the slow path once
+            if(diskutil_ch(ndjson_path, DATA_OUTPUT_USER, DATA_OUTPUT_GROUP, OUTPUT_DATA_PERM) != EUCA_OK) {
+                LOGERROR("Error setting ownership info on sensor data file %s\n", ndjson_path);
+                ndjson_close();
+                return EUCA_PERMISSION_ERROR;
+            }
+        }
+    }
+    if((st.st_mode & 0777) != OUTPUT_DATA_PERM && fchmod(ndjson_fd, OUTPUT_DATA_PERM) != 0) {
+        LOGWARN("Could not set permissions on %s: %s\n", ndjson_path, strerror(errno));
+    }
+
+#ifdef FALLOC_FL_KEEP_SIZE
+    if(fallocate(ndjson_fd, FALLOC_FL_KEEP_SIZE, 0, ndjson_max_bytes) != 0) {
+        LOGTRACE("Could not preallocate %s: %s\n", ndjson_path, strerror(errno));
+    }
+#endif /* FALLOC_FL_KEEP_SIZE */
+
+    LOGDEBUG("Opened ndjson sensor output %s (%ld bytes)\n", ndjson_path, (long)ndjson_size);
+    return EUCA_OK;
+}
+
+//! Close the ndjson log, if open
+static void ndjson_close(void) {
+    if(ndjson_fd >= 0) {
+        close(ndjson_fd);
+        ndjson_fd = -1;
+    }
+}
+
+//! Shift <log>.N-1 to <log>.N, ..., <log> to <log>.1 and open a fresh log
+static int ndjson_rotate(void) {
+    char from[EUCA_MAX_PATH] = "";
+    char to[EUCA_MAX_PATH] = "";
+    int i = 0;
+
+    ndjson_close();
+    for(i = NDJSON_ROTATE_COUNT; i > 0; i--) {
+        if(i == 1) {
+            euca_strncpy(from, ndjson_path, EUCA_MAX_PATH);
+        } else {
+            snprintf(from, EUCA_MAX_PATH, "%s.%d", ndjson_path, i - 1);
+        }
+        snprintf(to, EUCA_MAX_PATH, "%s.%d", ndjson_path, i);
+        if(rename(from, to) != 0 && errno != ENOENT) {
+            LOGWARN("Could not rotate %s to %s: %s\n", from, to, strerror(errno));
+        }
+    }
+    return ndjson_open();
+}
+
+//! Append the compact form of the event and a newline to the pending buffer
+static int ndjson_buffer_event(json_object *event) {
+    const char *json_string = json_object_to_json_string_ext(event, JSON_C_TO_STRING_PLAIN);
+    size_t len = 0;
+    char *new_buf = NULL;
+
+    if(json_string == NULL) {
+        LOGERROR("Error getting json string for sensor event\n");
+        return EUCA_ERROR;
+    }
+
+    len = strlen(json_string);
+    if((ndjson_buf_len + len + 1) > ndjson_buf_size) {
+        size_t new_size = (ndjson_buf_size == 0) ? 4096 : ndjson_buf_size;
+        while(new_size < (ndjson_buf_len + len + 1))
+            new_size *= 2;
+        if((new_buf = EUCA_REALLOC(ndjson_buf, new_size, sizeof(char))) == NULL) {
+            LOGERROR("Out of memory buffering sensor event\n");
+            return EUCA_MEMORY_ERROR;
+        }
+        ndjson_buf = new_buf;
+        ndjson_buf_size = new_size;
+    }
+
+    memcpy(ndjson_buf + ndjson_buf_len, json_string, len);
+    ndjson_buf_len += len;
+    ndjson_buf[ndjson_buf_len++] = '\n';
+
+    if(ndjson_buf_len >= NDJSON_BUFFER_FLUSH_BYTES) {
+        return emitter_flush();
+    }
+    return EUCA_OK;
+}
+
+//! Write the whole buffer, retrying on short writes and EINTR
+static int ndjson_write_all(const char *buf, size_t len) {
+    ssize_t rc = 0;
+
+    while(len > 0) {
+        if((rc = write(ndjson_fd, buf, len)) < 0) {
+            if(errno == EINTR)
+                continue;
+            LOGERROR("Write to %s failed: %s\n", ndjson_path, strerror(errno));
+            return EUCA_IO_ERROR;
+        }
+        buf += rc;
+        len -= rc;
+    }
+    return EUCA_OK;
+}
+
 //! Replace the 'replace' char with the 'find' char in the string. Simple
 static void euca_chrreplace(char *haystack, char target, char replacement) {
     if(haystack == NULL) {
@@ -579,6 +804,130 @@ static int test_write_event_to_file_highload() {
     }
 }
 
+static int test_ndjson_emitter() {
+    LOGINFO("\n-------------Testing ndjson emitter mode----------------\n");
+    const char * test_json = "{\"sensor\":\"mysensor.name\",\"test\":\"value\", \"timestamp\": 123456 }";
+    json_object *test_event = json_tokener_parse(test_json);
+    struct stat st = { 0 };
+    char rotated[EUCA_MAX_PATH] = "";
+    char *contents = NULL;
+    int i = 0;
+    int lines = 0;
+    int result = EUCA_OK;
+
+    if(test_event == NULL) {
+        LOGERROR("Got null json\n");
+        return EUCA_ERROR;
+    }
+
+    ndjson_mode = TRUE;
+    ndjson_max_bytes = 4096;
+    if(ndjson_open() != EUCA_OK) {
+        LOGERROR("Could not open ndjson output\n");
+        result = EUCA_ERROR;
+        goto cleanup;
+    }
+    if(ftruncate(ndjson_fd, 0) != 0) {
+        LOGERROR("Could not truncate %s: %s\n", ndjson_path, strerror(errno));
+        result = EUCA_ERROR;
+        goto cleanup;
+    }
+    ndjson_size = 0;
+
+    for(i = 0; i < 3; i++) {
+        if(emitter_offer_event(test_event) != EUCA_OK) {
+            result = EUCA_ERROR;
+            goto cleanup;
+        }
+    }
+    if(stat(ndjson_path, &st) != 0 || st.st_size != 0) {
+        LOGERROR("Events written before flush\n");
+        result = EUCA_ERROR;
+        goto cleanup;
+    }
+    if(emitter_flush() != EUCA_OK || (contents = file2str(ndjson_path)) == NULL) {
+        LOGERROR("Flush failed\n");
+        result = EUCA_ERROR;
+        goto cleanup;
+    }
+    for(i = 0; contents[i]; i++) {
+        if(contents[i] == '\n')
+            lines++;
+    }
+    LOGINFO("ndjson contents: %s", contents);
+    if(lines != 3 || strncmp(contents, "{\"sensor\":\"mysensor.name\",", 26) != 0) {
+        LOGERROR("Unexpected ndjson contents, %d lines\n", lines);
+        result = EUCA_ERROR;
+        goto cleanup;
+    }
+
+    //Push it past the limit and check that it rotates
+    for(i = 0; i < 100; i++) {
+        emitter_offer_event(test_event);
+        emitter_flush();
+    }
+    snprintf(rotated, EUCA_MAX_PATH, "%s.1", ndjson_path);
+    if(stat(rotated, &st) != 0 || stat(ndjson_path, &st) != 0 || st.st_size > ndjson_max_bytes) {
+        LOGERROR("ndjson output did not rotate as expected\n");
+        result = EUCA_ERROR;
+    }
+
+cleanup:
+    EUCA_FREE(contents);
+    json_object_put(test_event);
+    ndjson_close();
+    ndjson_mode = FALSE;
+    return result;
+}
+
+//! Enables ndjson mode through the configuration file, as a deployment would
+static int test_ndjson_config() {
+    LOGINFO("\n-------------Testing ndjson mode configuration----------------\n");
+    static configEntry keys_restart[] = { {"placeholderkey", "placeholderdefault"}, {NULL, NULL} };
+    static configEntry keys_no_restart[] = {
+        {OUTPUT_MODE_CONFIG_NAME, OUTPUT_MODE_CONFIG_DEFAULT},
+        {OUTPUT_MAX_BYTES_CONFIG_NAME, OUTPUT_MAX_BYTES_CONFIG_DEFAULT},
+        {NULL, NULL},
+    };
+    char config_files[1][EUCA_MAX_PATH] = { "" };
+    int result = EUCA_OK;
+
+    snprintf(config_files[0], EUCA_MAX_PATH, "%s/test_fs_emitter.conf", get_stats_output_path());
+    configInitValues(keys_restart, keys_no_restart);
+
+    //Defaults: file-per-sensor output
+    if(str2file("", config_files[0], O_CREAT | O_TRUNC | O_WRONLY, 0600, FALSE) != EUCA_OK) {
+        LOGERROR("Could not write %s\n", config_files[0]);
+        return EUCA_ERROR;
+    }
+    readConfigFile(config_files, 1);
+    read_output_config();
+    if(ndjson_mode || ndjson_max_bytes != NDJSON_DEFAULT_MAX_BYTES) {
+        LOGERROR("Unexpected defaults: ndjson_mode=%d max_bytes=%ld\n", ndjson_mode, ndjson_max_bytes);
+        result = EUCA_ERROR;
+        goto cleanup;
+    }
+
+    if(str2file(OUTPUT_MODE_CONFIG_NAME "=\"" OUTPUT_MODE_NDJSON "\"\n" OUTPUT_MAX_BYTES_CONFIG_NAME "=\"131072\"\n", config_files[0],
+                O_CREAT | O_TRUNC | O_WRONLY, 0600, FALSE) != EUCA_OK) {
+        LOGERROR("Could not write %s\n", config_files[0]);
+        result = EUCA_ERROR;
+        goto cleanup;
+    }
+    readConfigFile(config_files, 1);
+    read_output_config();
+    if(!ndjson_mode || ndjson_max_bytes != 131072) {
+        LOGERROR("ndjson mode not enabled by configuration: ndjson_mode=%d max_bytes=%ld\n", ndjson_mode, ndjson_max_bytes);
+        result = EUCA_ERROR;
+    }
+
+cleanup:
+    unlink(config_files[0]);
+    ndjson_mode = FALSE;
+    ndjson_max_bytes = NDJSON_DEFAULT_MAX_BYTES;
+    return result;
+}
+
 const char * test_output_path = "unit_test_output";
 
 int main(int argc, char** argv) {
@@ -611,6 +960,10 @@ int main(int argc, char** argv) {
     ++test_count && (test_write_event_to_file() == EUCA_OK) ? success_count++ : failure_count++;    
     LOGINFO("Unit tests completed: %d total, %d success, %d failures\n", test_count, success_count, failure_count);
 
+    ++test_count && (test_ndjson_emitter() == EUCA_OK) ? success_count++ : failure_count++;
+
+    ++test_count && (test_ndjson_config() == EUCA_OK) ? success_count++ : failure_count++;
+
     //Test performance and lots of data
     //++test_count && (test_write_event_to_file_highload() == EUCA_OK) ? success_count++ : failure_count++;    
     LOGINFO("Unit tests completed: %d total, %d success, %d failures\n", test_count, success_count, failure_count);
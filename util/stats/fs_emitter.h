@@ -100,6 +100,24 @@
 #define DATA_DIR_PERM 0755
 #define OUTPUT_DATA_PERM 0640
 
+//! Selects how events are written: "files" (one file per sensor, default) or "ndjson"
+#define OUTPUT_MODE_CONFIG_NAME "STATS_FILESYSTEM_OUTPUT_MODE"
+#define OUTPUT_MODE_FILES "files"
+#define OUTPUT_MODE_NDJSON "ndjson"
+#define OUTPUT_MODE_CONFIG_DEFAULT OUTPUT_MODE_FILES
+
+//! Rotation threshold in bytes for the ndjson event log
+#define OUTPUT_MAX_BYTES_CONFIG_NAME "STATS_FILESYSTEM_OUTPUT_MAX_BYTES"
+#define OUTPUT_MAX_BYTES_CONFIG_DEFAULT "8388608" //!< NDJSON_DEFAULT_MAX_BYTES
+
+//! Name of the ndjson event log within the stats output directory
+#define NDJSON_FILENAME "events.ndjson"
+#define NDJSON_DEFAULT_MAX_BYTES (8 * 1024 * 1024)
+#define NDJSON_MIN_MAX_BYTES (64 * 1024)
+#define NDJSON_ROTATE_COUNT 3
+//! Buffered events are written out early once this many bytes are pending
+#define NDJSON_BUFFER_FLUSH_BYTES (64 * 1024)
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  TYPEDEFS                                  |
@@ -132,6 +150,7 @@
 
 int init_emitter();
 int emitter_offer_event(json_object *event);
+int emitter_flush(void);
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -79,6 +79,7 @@
 \*----------------------------------------------------------------------------*/
 #include <json/json.h>
 #include <sensor_common.h>
+#include <message_stats.h>
 
 /*----------------------------------------------------------------------------*\
  |                                                                            |
@@ -114,7 +115,7 @@
 \*----------------------------------------------------------------------------*/
 
 //! Idempotently initialize the message sensor structures. Not threadsafe.
-int initialize_message_sensor(const char *current_component_name, int interval, int ttl, json_object **(*stats_state_get_fn)(), void (*stats_state_set_fn)());
+int initialize_message_sensor(const char *current_component_name, int interval, int ttl, message_stats_table *(*stats_table_get_fn)());
 
 //! Teardown the sensor and remove any accumulated data. This is destructive
 int teardown_message_sensor();
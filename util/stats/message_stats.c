@@ -80,6 +80,7 @@
 #include <log.h>
 #include <ipc.h>
 #include <json/json.h>
+#include <euca_string.h>
 #include <math.h>
 
 /*----------------------------------------------------------------------------*\
@@ -127,28 +128,28 @@
 \*----------------------------------------------------------------------------*/
 
 /*
-Stats map is json mapping. Each message is named and has an associated nested map containing the
-useful stats. The stats tracked are: count, success_count, failed_count, mean, min, max all in milliseconds of duration. 
+The stats state is a fixed binary table (message_stats_table) with one slot per
+message type. The CC keeps it in a shared memory region used by all of its
+processes, the NC in process memory. Request handlers update the counters with
+atomic operations; the json representation is only built when the message
+sensor runs. Each message is named and has an associated nested map containing
+the useful stats. The stats reported are: count, success_count, failure_count,
+mean, min, max and the p50, p95, p99 and p999 latency percentiles, all in
+milliseconds of duration. Percentiles come from a log-bucketed histogram kept
+per message type; histograms are plain bucket counters, so updates from all CC
+processes or NC threads sharing the table merge naturally.
 Example:
 {
-  "describeResources": { "min": 10, "max"; 20, "mean":12.3},
-  "describeSensors": { "min": 10, "max"; 40, "mean":24.3},
-  "runInstance": { "min": 15, "max"; 20, "mean":33.3},
-  "attachVolume": { "min": 35, "max"; 100, "mean":76.3}
+  "enabled": true,
+  "describeResources": { "count": 3, "success_count": 3, "failure_count": 0, "min": 10, "max": 20, "mean": 12.3,
+                         "p50": 10, "p95": 20, "p99": 20, "p999": 20 },
+  "runInstance": { "count": 1, "success_count": 1, "failure_count": 0, "min": 15, "max": 15, "mean": 15.0,
+                   "p50": 15, "p95": 15, "p99": 15, "p999": 15 }
 }
 */
 
-/*
-Uses a map as input to the update and fetch systems. This is entirely due to
-the memory model of the CC and how it must share memory between processes.
-
-The stats system assumes that the actual stats state is shared memory managed
-externally (or not, as in the case of the NC), and is provided directly to these
-methods as a json string.
- */
-
 #ifdef _UNIT_TEST
-json_object *message_stats_map;
+message_stats_table message_stats_map;
 #endif
 
 /*----------------------------------------------------------------------------*\
@@ -156,18 +157,22 @@ json_object *message_stats_map;
  |                              STATIC PROTOTYPES                             |
  |                                                                            |
 \*----------------------------------------------------------------------------*/
-static double calculate_moving_mean(double current_mean, int current_count, long new_value);
 
-//! Constructs a new json object for the message statistics, but not for any specific message, no name used
-static json_object *initialize_new_message_map();
+//! Finds, or assigns, the slot for the given message type
+static message_stats_entry *get_message_entry(message_stats_table *stats_table, const char *message_name);
 
-//! Zero the stats for a single message entry.
-static void reset_message_stat(json_object *msg_entry);
+//! Atomically lowers (or raises) a value if the new value is smaller (or larger)
+static void update_min(volatile long *current, long value);
+static void update_max(volatile long *current, long value);
+
+//! Percentile of the histogram, never larger than the recorded maximum
+static long percentile_clamp(const unsigned int *histogram, long total, double quantile, long max_ms);
 
 #ifdef _UNIT_TEST
-static int test_moving_average();
-static int test_init_message_map();
+static int test_histogram();
 static int test_update_message_stats();
+static int test_get_message_stats_json();
+static int test_claimed_slot();
 #endif
 
 /*----------------------------------------------------------------------------*\
@@ -182,323 +187,371 @@ static int test_update_message_stats();
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
-//! Calculate a cumulative moving averaged using the standard method
-static double calculate_moving_mean(double current_mean, int current_count, long new_value) {
-    return current_mean + ( ((double)new_value - current_mean ) / (current_count + 1) );
+//! Returns the slot used for the named message type, assigning a free one if the
+//! type was not seen before. Slots are never released, so lookups are lock-free.
+//! A slot that stays claimed, e.g. because the process assigning it died while
+//! the table sits in shared memory, is only waited on for MSG_SLOT_CLAIM_SPINS
+//! and then skipped, as if it held another message type.
+//! @returns the entry or NULL if no slot is, or can be made, ready for the type
+static message_stats_entry *get_message_entry(message_stats_table *stats_table, const char *message_name) {
+    u32 h = 5381;
+    int i, idx, spins;
+    const char *c;
+    message_stats_entry *entry;
+
+    for(c = message_name; *c != '\0'; c++) {
+        h = ((h << 5) + h) + (unsigned char)(*c);
+    }
+
+    for(i = 0; i < MSG_STATS_MAX_MESSAGES; i++) {
+        idx = (h + i) % MSG_STATS_MAX_MESSAGES;
+        entry = &(stats_table->messages[idx]);
+
+        if(entry->state == MSG_SLOT_FREE &&
+           __sync_bool_compare_and_swap(&(entry->state), MSG_SLOT_FREE, MSG_SLOT_CLAIMED)) {
+            euca_strncpy(entry->name, message_name, MSG_STATS_NAME_LEN);
+            entry->min_ms = MSG_MIN_INIT;
+            entry->max_ms = MSG_MAX_INIT;
+            __sync_synchronize();
+            entry->state = MSG_SLOT_READY;
+            return entry;
+        }
+
+        //Another updater may be assigning this slot right now
+        for(spins = 0; entry->state == MSG_SLOT_CLAIMED && spins < MSG_SLOT_CLAIM_SPINS; spins++) {
+            __sync_synchronize();
+        }
+        if(entry->state != MSG_SLOT_READY) {
+            continue;
+        }
+
+        if(!strncmp(entry->name, message_name, MSG_STATS_NAME_LEN - 1)) {
+            return entry;
+        }
+    }
+    return NULL;
 }
 
-//! Returns a new message map for the named message type
-//! If cached_map != NULL, reads in that value and initializes the structure with that state.
-//! This is necessary for the CC's memory model.
-static json_object *initialize_new_message_map() {
-    json_object *default_fields = json_object_new_object();
-    json_object_object_add(default_fields, MSG_COUNT_KEY, json_object_new_int(MSG_COUNT_INIT));
-    json_object_object_add(default_fields, MSG_OK_COUNT_KEY, json_object_new_int(MSG_COUNT_INIT));
-    json_object_object_add(default_fields, MSG_FAIL_COUNT_KEY, json_object_new_int(MSG_COUNT_INIT));
-    json_object_object_add(default_fields, MSG_MEAN_KEY, json_object_new_double(MSG_MEAN_INIT));
-    json_object_object_add(default_fields, MSG_MIN_KEY, json_object_new_int(MSG_MIN_INIT)); //Use -1 since it is invalid measure
-    json_object_object_add(default_fields, MSG_MAX_KEY, json_object_new_int(MSG_MAX_INIT));
-    return default_fields;
+static void update_min(volatile long *current, long value) {
+    long cur = *current;
+    while((cur == MSG_MIN_INIT || value < cur)) {
+        long prev = __sync_val_compare_and_swap(current, cur, value);
+        if(prev == cur) {
+            break;
+        }
+        cur = prev;
+    }
 }
 
-//! Resets the counters for the given message entry. Expects that the json object passed
-//! is the map of values for a single message entry. Modifies the entry in-place
-static void reset_message_stat(json_object *msg_entry) {
-    if(msg_entry == NULL || json_object_is_type(msg_entry, json_type_object)) {
-        return;
+static void update_max(volatile long *current, long value) {
+    long cur = *current;
+    while((cur == MSG_MAX_INIT || value > cur)) {
+        long prev = __sync_val_compare_and_swap(current, cur, value);
+        if(prev == cur) {
+            break;
+        }
+        cur = prev;
     }
+}
 
-    json_object_object_del(msg_entry, MSG_MEAN_KEY);
-    json_object_object_del(msg_entry, MSG_MIN_KEY);
-    json_object_object_del(msg_entry, MSG_MAX_KEY);
-    json_object_object_del(msg_entry, MSG_COUNT_KEY);
-    json_object_object_del(msg_entry, MSG_OK_COUNT_KEY);
-    json_object_object_del(msg_entry, MSG_FAIL_COUNT_KEY);
+//! Maps a duration to its histogram bucket
+int message_stats_hist_index(long timing_ms) {
+    int msb;
+    unsigned int v;
 
-    json_object_object_add(msg_entry, MSG_COUNT_KEY, json_object_new_int(MSG_COUNT_INIT));
-    json_object_object_add(msg_entry, MSG_OK_COUNT_KEY, json_object_new_int(MSG_COUNT_INIT));
-    json_object_object_add(msg_entry, MSG_FAIL_COUNT_KEY, json_object_new_int(MSG_COUNT_INIT));
-    json_object_object_add(msg_entry, MSG_MEAN_KEY, json_object_new_double(MSG_MEAN_INIT));
-    json_object_object_add(msg_entry, MSG_MIN_KEY, json_object_new_int(MSG_MIN_INIT)); //Use -1 since it is invalid measure
-    json_object_object_add(msg_entry, MSG_MAX_KEY, json_object_new_int(MSG_MAX_INIT));
+    if(timing_ms <= 0) {
+        return 0;
+    }
+    v = (timing_ms > 0x7FFFFFFFL) ? 0x7FFFFFFFU : (unsigned int)timing_ms;
+    if(v < MSG_HIST_LINEAR_MAX) {
+        return v;
+    }
 
+    msb = 31 - __builtin_clz(v);
+    return MSG_HIST_LINEAR_MAX + (msb - (MSG_HIST_SUB_BITS + 1)) * MSG_HIST_SUB_COUNT +
+           ((v >> (msb - MSG_HIST_SUB_BITS)) & (MSG_HIST_SUB_COUNT - 1));
 }
 
-//! Idempotently enable stats
-void enable_stats(json_object *stats_state) {
-    json_object *enabled_bool = NULL;
-    json_object_object_get_ex(stats_state, STATS_ENABLED_KEY, &enabled_bool);
-    if(enabled_bool == NULL || 
-       ( !json_object_is_type(enabled_bool, json_type_boolean) || 
-         json_object_get_boolean(enabled_bool) != TRUE) ) {
-
-        if(enabled_bool != NULL) {
-            json_object_object_del(stats_state, STATS_ENABLED_KEY);
+//! Returns the highest duration counted in the given histogram bucket
+long message_stats_hist_value(int index) {
+    int msb, shift, sub;
+
+    if(index < MSG_HIST_LINEAR_MAX) {
+        return index;
+    }
+
+    msb = (index - MSG_HIST_LINEAR_MAX) / MSG_HIST_SUB_COUNT + (MSG_HIST_SUB_BITS + 1);
+    sub = (index - MSG_HIST_LINEAR_MAX) % MSG_HIST_SUB_COUNT;
+    shift = msb - MSG_HIST_SUB_BITS;
+    return ((((long)(MSG_HIST_SUB_COUNT + sub)) << shift) + (1L << shift) - 1);
+}
+
+//! Computes a percentile from a histogram holding total data points
+//! @param quantile - between 0 and 1, e.g. 0.99 for p99
+//! @returns the upper bound of the bucket holding the percentile, or MSG_MIN_INIT if empty
+long message_stats_percentile(const unsigned int *histogram, long total, double quantile) {
+    int i;
+    long rank, seen = 0;
+
+    if(histogram == NULL || total <= 0) {
+        return MSG_MIN_INIT;
+    }
+
+    rank = (long)ceil(quantile * total);
+    if(rank < 1) {
+        rank = 1;
+    }
+    for(i = 0; i < MSG_HIST_BUCKETS; i++) {
+        seen += histogram[i];
+        if(seen >= rank) {
+            return message_stats_hist_value(i);
         }
+    }
+    return message_stats_hist_value(MSG_HIST_BUCKETS - 1);
+}
+
+static long percentile_clamp(const unsigned int *histogram, long total, double quantile, long max_ms) {
+    long value = message_stats_percentile(histogram, total, quantile);
+    if(max_ms != MSG_MAX_INIT && value > max_ms) {
+        return max_ms;
+    }
+    return value;
+}
 
-        json_object_object_add(stats_state, STATS_ENABLED_KEY, json_object_new_boolean(TRUE));
-    }    
+//! Idempotently enable stats
+void enable_stats(message_stats_table *stats_table) {
+    if(stats_table != NULL) {
+        stats_table->enabled = TRUE;
+        __sync_synchronize();
+    }
 }
 
-int is_enabled(json_object *stats_state) {
-    json_object *enabled_bool = NULL;
-    json_object_object_get_ex(stats_state, STATS_ENABLED_KEY, &enabled_bool);
-    if(enabled_bool != NULL && json_object_is_type(enabled_bool, json_type_boolean)) {
-        return json_object_get_boolean(enabled_bool);
+int is_enabled(message_stats_table *stats_table) {
+    if(stats_table != NULL) {
+        return stats_table->enabled;
     } else {
         return FALSE;
     }
 }
 
 //! Idempotently disable stats
-void disable_stats(json_object *stats_state) {
-    json_object *enabled_bool = NULL;
-    json_object_object_get_ex(stats_state, STATS_ENABLED_KEY, &enabled_bool);
-    if(enabled_bool == NULL || 
-       (!json_object_is_type(enabled_bool, json_type_boolean) || json_object_get_boolean(enabled_bool) == TRUE)) {
-
-        if(enabled_bool != NULL) {
-            json_object_object_del(stats_state, STATS_ENABLED_KEY);
-        }
-
-        json_object_object_add(stats_state, STATS_ENABLED_KEY, json_object_new_boolean(FALSE));
-    }        
+void disable_stats(message_stats_table *stats_table) {
+    if(stats_table != NULL) {
+        stats_table->enabled = FALSE;
+        __sync_synchronize();
+    }
 }
 
-//! Must ensure that this is called serially the first time. Once the mutex is initialized it is protected by locks
-//! @param stats_state - the current state, if any. Will be reset and set enabled. Does not empty memory, just resets counters
-int initialize_message_stats(json_object **stats_state) {
-    if(stats_state == NULL) {
+//! Must ensure that this is called serially the first time, before any update
+//! @param stats_table - the table to clear. All message types are forgotten and stats are enabled
+int initialize_message_stats(message_stats_table *stats_table) {
+    if(stats_table == NULL) {
         LOGFATAL("Cannot initialize a NULL address pointer for stats\n");
         return EUCA_INVALID_ERROR;
     }
 
-    return reset_message_stats(stats_state);
+    bzero(stats_table, sizeof(message_stats_table));
+    enable_stats(stats_table);
+    return EUCA_OK;
 }
 
 //! Add a new data point to the message's stats
-int update_message_stats(json_object *stats_state, const char *message_name, int timing_ms, int failed) {
+int update_message_stats(message_stats_table *stats_table, const char *message_name, long timing_ms, int failed) {
+    message_stats_entry *entry = NULL;
+
     if(message_name == NULL) {
         return EUCA_ERROR;
     }
 
-    if(stats_state == NULL || !is_enabled(stats_state) ) {
+    if(stats_table == NULL || !is_enabled(stats_table) ) {
         //Stats are disabled, return ok
         return EUCA_OK;
     }
 
-    json_object *msg = NULL;
-    json_object_object_get_ex(stats_state, message_name, &msg);
-    json_object *min_obj, *max_obj, *mean_obj, *count_obj, *ok_obj, *fail_obj;
-    int min_val, max_val, count_val, ok_count, fail_count;
-    double mean_val;
-
-    if(msg == NULL) {
-        //Not found. Add it.
-        msg = initialize_new_message_map();
-        if(msg == NULL) {
-            LOGERROR("Failed to add message type %s to the message stats map", message_name);
-            return EUCA_ERROR;
-        }  else {
-            json_object_object_add(stats_state, message_name, msg);
+    if((entry = get_message_entry(stats_table, message_name)) == NULL) {
+        if(__sync_fetch_and_add(&(stats_table->dropped), 1) == 0) {
+            LOGERROR("Failed to add message type %s to the message stats table: table full or slot stuck being assigned\n", message_name);
         }
-    }
-
-    //Update the data
-    json_object_object_get_ex(msg, MSG_MEAN_KEY, &mean_obj);
-    if(mean_obj == NULL) {
-        LOGERROR("Null in stats object found, cannot continue update.\n");
-        return EUCA_ERROR;
-    }
-    mean_val = json_object_get_int(mean_obj);
-
-    json_object_object_get_ex(msg, MSG_MIN_KEY, &min_obj);
-    if(mean_obj == NULL) {
-        LOGERROR("Null in stats object found, cannot continue update.\n");
-        return EUCA_ERROR;
-    }
-    min_val = json_object_get_int(min_obj);
-
-    json_object_object_get_ex(msg, MSG_MAX_KEY, &max_obj);
-    if(max_obj == NULL) {
-        LOGERROR("Null in stats object found, cannot continue update.\n");
-        return EUCA_ERROR;
-    }
-    max_val = json_object_get_int(max_obj);
-
-    json_object_object_get_ex(msg, MSG_COUNT_KEY, &count_obj);
-    if(count_obj == NULL) {
-        LOGERROR("Null in stats object found, cannot continue update.\n");
         return EUCA_ERROR;
     }
-    count_val = json_object_get_int(count_obj);
-
-    json_object_object_get_ex(msg, MSG_OK_COUNT_KEY, &ok_obj);
-    if(ok_obj == NULL) {
-        LOGERROR("Null in stats object found, cannot continue update.\n");
-        return EUCA_ERROR;
-    }
-    ok_count = json_object_get_int(ok_obj);
-
-    json_object_object_get_ex(msg, MSG_COUNT_KEY, &fail_obj);
-    if(fail_obj == NULL) {
-        LOGERROR("Null in stats object found, cannot continue update.\n");
-        return EUCA_ERROR;
-    }
-    fail_count = json_object_get_int(fail_obj);
-
-    mean_val = (int)trunc(calculate_moving_mean((double)mean_val, count_val, timing_ms));
-    json_object_object_del(msg, MSG_MEAN_KEY);
-
-    json_object_object_add(msg, MSG_MEAN_KEY, json_object_new_int(mean_val));
-    
-    if(min_val == MSG_MIN_INIT || timing_ms < min_val) {
-        json_object_object_del(msg, MSG_MIN_KEY);
-        json_object_object_add(msg, MSG_MIN_KEY, json_object_new_int(timing_ms));
-    }
-    
-    if(max_val == MSG_MAX_INIT || timing_ms > max_val) {
-        json_object_object_del(msg, MSG_MAX_KEY);
-        json_object_object_add(msg, MSG_MAX_KEY, json_object_new_int(timing_ms));
-    }
-    
-    json_object_object_del(msg, MSG_COUNT_KEY);
-    json_object_object_add(msg, MSG_COUNT_KEY, json_object_new_int(++count_val));
 
+    __sync_fetch_and_add(&(entry->count), 1);
     if(failed == 0) {
-        json_object_object_del(msg, MSG_OK_COUNT_KEY);
-        json_object_object_add(msg, MSG_OK_COUNT_KEY, json_object_new_int(++ok_count));
+        __sync_fetch_and_add(&(entry->ok_count), 1);
     } else {
-        json_object_object_del(msg, MSG_FAIL_COUNT_KEY);
-        json_object_object_add(msg, MSG_FAIL_COUNT_KEY, json_object_new_int(++fail_count));
+        __sync_fetch_and_add(&(entry->fail_count), 1);
     }
+    __sync_fetch_and_add(&(entry->sum_ms), timing_ms);
+    update_min(&(entry->min_ms), timing_ms);
+    update_max(&(entry->max_ms), timing_ms);
+    __sync_fetch_and_add(&(entry->histogram[message_stats_hist_index(timing_ms)]), 1);
 
     return EUCA_OK;
 }
 
-//! Iterate through and reset all message metrics for next interval
-//! Removes all current data and stats from memory
-int reset_message_stats(json_object **stats_state) {
-    if(stats_state == NULL) {
+//! Reset all message metrics for next interval. Message types keep their slots.
+int reset_message_stats(message_stats_table *stats_table) {
+    json_object *drained = NULL;
+
+    if(stats_table == NULL) {
         LOGERROR("Cannot reset message stats on null pointer\n");
         return EUCA_INVALID_ERROR;
     }
 
-    if(*stats_state != NULL) {
-        //In future versions of json-c (0.12 for sure), this returns an int to determine if count decremented.
-        //The CentOS version is old (0.10), but when available use the return value to ensure all refs are released
-        json_object_object_foreach(*stats_state, key, value) {
-            if(strcmp(key, STATS_ENABLED_KEY) != 0 && json_object_is_type(value, json_type_object)) {
-                reset_message_stat(value);
-            }
-        }
-    } else {
-        LOGTRACE("Reseting message stats to a new json object\n");
-        *stats_state = json_object_new_object();
-        enable_stats(*stats_state);
+    drained = get_message_stats_json(stats_table, TRUE);
+    if(drained != NULL) {
+        json_object_put(drained);
     }
     return EUCA_OK;
 }
 
-//! Entry point for the message stats sensor. Gets the stats data from
-//! the message maps and sends it to the emitter.
-json_object *get_message_stats_json(const char *message_stats_string) {
-    //Stringify and re-parse to create completely separate copy
-    if(message_stats_string != NULL) {
-        return json_tokener_parse(message_stats_string);
-    } else {
+//! Builds the json representation of the message stats. If reset is set, each
+//! counter is atomically exchanged with its initial value while being read, so
+//! no data point is lost or counted twice across intervals.
+json_object *get_message_stats_json(message_stats_table *stats_table, int reset) {
+    int i, j;
+    long count, ok_count, fail_count, sum_ms, min_ms, max_ms, hist_total;
+    unsigned int histogram[MSG_HIST_BUCKETS];
+    message_stats_entry *entry = NULL;
+    json_object *stats_json = NULL;
+    json_object *msg = NULL;
+
+    if(stats_table == NULL) {
         return NULL;
     }
-}
 
+    stats_json = json_object_new_object();
+    json_object_object_add(stats_json, STATS_ENABLED_KEY, json_object_new_boolean(is_enabled(stats_table)));
+    for(i = 0; i < MSG_STATS_MAX_MESSAGES; i++) {
+        entry = &(stats_table->messages[i]);
+        if(entry->state != MSG_SLOT_READY) {
+            continue;
+        }
 
-#ifdef _UNIT_TEST
-static int test_moving_average() {
-    LOGINFO("Testing moving average calculation\n");
-    double cma = 0.0;
-    int count = 0;
-    double result;
-    result = calculate_moving_mean(cma, count, 1); 
-    if(result != 1.0) {
-        LOGERROR("Wrong answer %f\n", result);
-        return 1;
-    }
-    
-    cma = 1.0;
-    count = 1;    
-    result = calculate_moving_mean(cma, count, 2);
-    if(result != 1.5) {
-        LOGERROR("Wrong answer %f\n", result);
-        return 1;
-    }
+        if(reset) {
+            count = __sync_lock_test_and_set(&(entry->count), MSG_COUNT_INIT);
+            ok_count = __sync_lock_test_and_set(&(entry->ok_count), MSG_COUNT_INIT);
+            fail_count = __sync_lock_test_and_set(&(entry->fail_count), MSG_COUNT_INIT);
+            sum_ms = __sync_lock_test_and_set(&(entry->sum_ms), 0);
+            min_ms = __sync_lock_test_and_set(&(entry->min_ms), MSG_MIN_INIT);
+            max_ms = __sync_lock_test_and_set(&(entry->max_ms), MSG_MAX_INIT);
+            for(j = 0; j < MSG_HIST_BUCKETS; j++) {
+                histogram[j] = __sync_lock_test_and_set(&(entry->histogram[j]), 0);
+            }
+        } else {
+            count = entry->count;
+            ok_count = entry->ok_count;
+            fail_count = entry->fail_count;
+            sum_ms = entry->sum_ms;
+            min_ms = entry->min_ms;
+            max_ms = entry->max_ms;
+            for(j = 0; j < MSG_HIST_BUCKETS; j++) {
+                histogram[j] = entry->histogram[j];
+            }
+        }
 
-    return 0;
-}
+        //The histogram is drained independently from count, use its own total
+        for(j = 0, hist_total = 0; j < MSG_HIST_BUCKETS; j++) {
+            hist_total += histogram[j];
+        }
 
-static int test_init_message_map() {
-    json_object *map = initialize_new_message_map();
-    if(map != NULL) {
-        LOGINFO("Built: %s\n", json_object_to_json_string_ext(map, JSON_C_TO_STRING_PRETTY));
-        return 0;
-    }
-    return 1;
+        msg = json_object_new_object();
+        json_object_object_add(msg, MSG_COUNT_KEY, json_object_new_int64(count));
+        json_object_object_add(msg, MSG_OK_COUNT_KEY, json_object_new_int64(ok_count));
+        json_object_object_add(msg, MSG_FAIL_COUNT_KEY, json_object_new_int64(fail_count));
+        json_object_object_add(msg, MSG_MEAN_KEY, json_object_new_double((count > 0) ? ((double)sum_ms / count) : MSG_MEAN_INIT));
+        json_object_object_add(msg, MSG_MIN_KEY, json_object_new_int64(min_ms));
+        json_object_object_add(msg, MSG_MAX_KEY, json_object_new_int64(max_ms));
+        json_object_object_add(msg, MSG_P50_KEY, json_object_new_int64(percentile_clamp(histogram, hist_total, 0.50, max_ms)));
+        json_object_object_add(msg, MSG_P95_KEY, json_object_new_int64(percentile_clamp(histogram, hist_total, 0.95, max_ms)));
+        json_object_object_add(msg, MSG_P99_KEY, json_object_new_int64(percentile_clamp(histogram, hist_total, 0.99, max_ms)));
+        json_object_object_add(msg, MSG_P999_KEY, json_object_new_int64(percentile_clamp(histogram, hist_total, 0.999, max_ms)));
+        json_object_object_add(stats_json, entry->name, msg);
+    }
+
+    return stats_json;
 }
 
-static int test_update_message_stats() {
-    LOGINFO("Testing update message stats\n");
-    if(initialize_message_stats(&message_stats_map) != 0) {
-        LOGERROR("Failed to initialize the structures\n");
-        return 1;
+
+#ifdef _UNIT_TEST
+static int test_histogram() {
+    int i;
+    long v, p;
+    unsigned int histogram[MSG_HIST_BUCKETS];
+
+    LOGINFO("Testing latency histogram buckets\n");
+    //Every value must fall in a bucket whose upper bound is within 12.5%
+    for(v = 0; v < 1000000; v = (v < 100) ? v + 1 : v + 97) {
+        i = message_stats_hist_index(v);
+        if(i < 0 || i >= MSG_HIST_BUCKETS || message_stats_hist_value(i) < v ||
+           message_stats_hist_value(i) > v + v / MSG_HIST_SUB_COUNT) {
+            LOGERROR("Bad bucket %d for %ld\n", i, v);
+            return 1;
+        }
     }
-    
-    if(update_message_stats(message_stats_map, "runInstance", 100, 0) != 0) {
-        LOGERROR("Error updating stats\n");
+    if(message_stats_hist_index(0x7FFFFFFFL) != MSG_HIST_BUCKETS - 1) {
+        LOGERROR("Largest value does not map to the last bucket\n");
         return 1;
     }
 
-    if(update_message_stats(message_stats_map, "runInstance", 125, 0) != 0) {
-        LOGERROR("Error updating stats\n");
-        return 1;
+    bzero(histogram, sizeof(histogram));
+    for(v = 1; v <= 1000; v++) {
+        histogram[message_stats_hist_index(v)]++;
     }
-
-    if(update_message_stats(message_stats_map, "runInstance", 75, 0) != 0) {
-        LOGERROR("Error updating stats\n");
+    p = message_stats_percentile(histogram, 1000, 0.50);
+    if(p < 500 || p > 500 + 500 / MSG_HIST_SUB_COUNT) {
+        LOGERROR("Wrong p50 %ld\n", p);
         return 1;
     }
-
-    if(update_message_stats(message_stats_map, "runInstance", 50, 0) != 0) {
-        LOGERROR("Error updating stats\n");
+    p = message_stats_percentile(histogram, 1000, 0.99);
+    if(p < 990 || p > 990 + 990 / MSG_HIST_SUB_COUNT) {
+        LOGERROR("Wrong p99 %ld\n", p);
         return 1;
     }
+    return 0;
+}
 
-    if(update_message_stats(message_stats_map, "describeInstances", 50, 0) != 0) {
-        LOGERROR("Error updating stats\n");
+static int test_update_message_stats() {
+    LOGINFO("Testing update message stats\n");
+    if(initialize_message_stats(&message_stats_map) != 0) {
+        LOGERROR("Failed to initialize the structures\n");
         return 1;
     }
-
-    if(update_message_stats(message_stats_map, "terminateInstance", 50, 0) != 0) {
+    
+    if(update_message_stats(&message_stats_map, "runInstance", 100, 0) != 0 ||
+       update_message_stats(&message_stats_map, "runInstance", 125, 0) != 0 ||
+       update_message_stats(&message_stats_map, "runInstance", 75, 1) != 0 ||
+       update_message_stats(&message_stats_map, "runInstance", 50, 0) != 0 ||
+       update_message_stats(&message_stats_map, "describeInstances", 50, 0) != 0 ||
+       update_message_stats(&message_stats_map, "terminateInstance", 50, 0) != 0) {
         LOGERROR("Error updating stats\n");
         return 1;
     }
     
     //Verify
+    json_object *stats = get_message_stats_json(&message_stats_map, FALSE);
     json_object * inst = NULL;
-    json_object_object_get_ex(message_stats_map, "runInstance", &inst);
-    LOGINFO("Message stats: \n%s\n", json_object_to_json_string_ext(message_stats_map, JSON_C_TO_STRING_PRETTY));
-    json_object *msg_count, *msg_max, *msg_min, *msg_mean;
+    json_object_object_get_ex(stats, "runInstance", &inst);
+    LOGINFO("Message stats: \n%s\n", json_object_to_json_string_ext(stats, JSON_C_TO_STRING_PRETTY));
+    json_object *msg_count, *msg_max, *msg_min, *msg_mean, *msg_fail;
     msg_count = NULL;
     msg_max = NULL;
     msg_min = NULL;
     msg_mean = NULL;
+    msg_fail = NULL;
     json_object_object_get_ex(inst, MSG_COUNT_KEY, &msg_count);
     json_object_object_get_ex(inst, MSG_MAX_KEY, &msg_max);
     json_object_object_get_ex(inst, MSG_MIN_KEY, &msg_min);
     json_object_object_get_ex(inst, MSG_MEAN_KEY, &msg_mean);
-    if(inst != NULL && 
+    json_object_object_get_ex(inst, MSG_FAIL_COUNT_KEY, &msg_fail);
+    int ok = (inst != NULL && 
        json_object_get_int(msg_count) == 4 &&
+       json_object_get_int(msg_fail) == 1 &&
        json_object_get_int(msg_max) == 125 &&
        json_object_get_double(msg_mean) == ((100.0+125.0+75.0+50.0)/4.0) && 
-       json_object_get_int(msg_min) == 50) {
+       json_object_get_int(msg_min) == 50);
+    json_object_put(stats);
+    if(ok) {
         LOGINFO("test passes\n");
         return 0;
     } else {
@@ -508,28 +561,64 @@ static int test_update_message_stats() {
 }
 
 static int test_get_message_stats_json() {
-    LOGINFO("Testing update message stats\n");
+    LOGINFO("Testing draining message stats\n");
     if(initialize_message_stats(&message_stats_map) != 0) {
         LOGERROR("Failed to initialize the structures\n");
         return 1;
     }
     
-    if(update_message_stats(message_stats_map, "runInstance", 100, 0) != 0) {
+    if(update_message_stats(&message_stats_map, "runInstance", 100, 0) != 0) {
         LOGERROR("Error updating stats\n");
         return 1;
     }
-    
-    LOGINFO("Got intermediate result: %s\n", json_object_to_json_string_ext(message_stats_map, JSON_C_TO_STRING_PRETTY));
 
-    if(update_message_stats(message_stats_map, "runInstance", 125, 0) != 0) {
+    json_object *first = get_message_stats_json(&message_stats_map, TRUE);
+    LOGINFO("Drained result: %s\n", json_object_to_json_string_ext(first, JSON_C_TO_STRING_PRETTY));
+
+    if(update_message_stats(&message_stats_map, "runInstance", 125, 0) != 0) {
         LOGERROR("Error updating stats\n");
         return 1;
     }
 
-    LOGINFO("Post-update result: %s\n", json_object_to_json_string_ext(message_stats_map, JSON_C_TO_STRING_PRETTY));
+    json_object *second = get_message_stats_json(&message_stats_map, TRUE);
+    LOGINFO("Post-update result: %s\n", json_object_to_json_string_ext(second, JSON_C_TO_STRING_PRETTY));
 
-    LOGINFO("Internal state result: %s\n", json_object_to_json_string_ext(message_stats_map, JSON_C_TO_STRING_PRETTY));
-    
+    json_object *inst = NULL, *msg_count = NULL, *msg_min = NULL;
+    json_object_object_get_ex(second, "runInstance", &inst);
+    json_object_object_get_ex(inst, MSG_COUNT_KEY, &msg_count);
+    json_object_object_get_ex(inst, MSG_MIN_KEY, &msg_min);
+    int ok = (json_object_get_int(msg_count) == 1 && json_object_get_int(msg_min) == 125);
+    json_object_put(first);
+    json_object_put(second);
+    return (ok ? 0 : 1);
+}
+
+static int test_claimed_slot() {
+    int i;
+
+    LOGINFO("Testing update of a slot left claimed\n");
+    if(initialize_message_stats(&message_stats_map) != 0) {
+        LOGERROR("Failed to initialize the structures\n");
+        return 1;
+    }
+
+    //As if the updaters assigning all slots but the last one had died
+    for(i = 0; i < MSG_STATS_MAX_MESSAGES - 1; i++) {
+        message_stats_map.messages[i].state = MSG_SLOT_CLAIMED;
+    }
+
+    if(update_message_stats(&message_stats_map, "runInstance", 100, 0) != 0 || message_stats_map.dropped != 0 ||
+       strcmp(message_stats_map.messages[MSG_STATS_MAX_MESSAGES - 1].name, "runInstance")) {
+        LOGERROR("Update did not skip past the claimed slots\n");
+        return 1;
+    }
+
+    //Once every other slot is claimed too, the update can only be dropped
+    message_stats_map.messages[MSG_STATS_MAX_MESSAGES - 1].state = MSG_SLOT_CLAIMED;
+    if(update_message_stats(&message_stats_map, "describeInstances", 100, 0) == 0 || message_stats_map.dropped != 1) {
+        LOGERROR("Update with only claimed slots was not dropped\n");
+        return 1;
+    }
     return 0;
 }
 
@@ -539,7 +628,7 @@ int main(int argc, char** argv) {
     success = 0;
     failure = 0;
 
-    if(test_moving_average() == 0) {
+    if(test_histogram() == 0) {
         LOGINFO("Success!\n");
         success++;
     } else {
@@ -548,7 +637,7 @@ int main(int argc, char** argv) {
     }
     count++;
 
-    if(test_init_message_map() == 0) {
+    if(test_update_message_stats() == 0) {
         LOGINFO("Success!\n");
         success++;
     } else {
@@ -557,7 +646,7 @@ int main(int argc, char** argv) {
     }
     count++;
 
-    if(test_update_message_stats() == 0) {
+    if(test_get_message_stats_json() == 0) {
         LOGINFO("Success!\n");
         success++;
     } else {
@@ -566,7 +655,7 @@ int main(int argc, char** argv) {
     }
     count++;
 
-    if(test_get_message_stats_json() == 0) {
+    if(test_claimed_slot() == 0) {
         LOGINFO("Success!\n");
         success++;
     } else {
@@ -91,6 +91,10 @@
 #define MSG_COUNT_KEY "count"
 #define MSG_OK_COUNT_KEY "success_count"
 #define MSG_FAIL_COUNT_KEY "failure_count"
+#define MSG_P50_KEY "p50"
+#define MSG_P95_KEY "p95"
+#define MSG_P99_KEY "p99"
+#define MSG_P999_KEY "p999"
 #define STATS_ENABLED_KEY "enabled" //tracks state of the stats system, if disabled, stats aren't collected
 
 #define MSG_MEAN_INIT 0
@@ -98,6 +102,24 @@
 #define MSG_MAX_INIT -1
 #define MSG_COUNT_INIT 0
 
+#define MSG_STATS_MAX_MESSAGES 128 //!< Number of distinct message types that can be tracked
+#define MSG_STATS_NAME_LEN 64 //!< Maximum length of a message type name
+
+#define MSG_SLOT_FREE 0 //!< Slot is not used
+#define MSG_SLOT_CLAIMED 1 //!< Slot is being assigned to a message type
+#define MSG_SLOT_READY 2 //!< Slot is assigned to the message type in its name
+#define MSG_SLOT_CLAIM_SPINS 65536 //!< How long to wait for a slot being assigned before dropping the update
+
+//! @{
+//! @name Log-bucketed latency histogram. Values below MSG_HIST_LINEAR_MAX ms are
+//! counted exactly; above that each power of two is split in MSG_HIST_SUB_COUNT
+//! buckets, so reported percentiles are within 12.5% of the recorded value.
+#define MSG_HIST_SUB_BITS 3
+#define MSG_HIST_SUB_COUNT (1 << MSG_HIST_SUB_BITS)
+#define MSG_HIST_LINEAR_MAX (2 * MSG_HIST_SUB_COUNT)
+#define MSG_HIST_BUCKETS (MSG_HIST_LINEAR_MAX + (31 - (MSG_HIST_SUB_BITS + 1)) * MSG_HIST_SUB_COUNT)
+//! @}
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                                  TYPEDEFS                                  |
@@ -116,6 +138,27 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
+//! Counters of a single message type. All fields are updated with atomic operations.
+typedef struct message_stats_entry_t {
+    volatile int state; //!< One of MSG_SLOT_FREE, MSG_SLOT_CLAIMED or MSG_SLOT_READY
+    char name[MSG_STATS_NAME_LEN]; //!< Message type name, valid once state is MSG_SLOT_READY
+    volatile long count; //!< Number of messages handled
+    volatile long ok_count; //!< Number of successful messages
+    volatile long fail_count; //!< Number of failed messages
+    volatile long sum_ms; //!< Sum of the handling times, in milliseconds
+    volatile long min_ms; //!< Shortest handling time or MSG_MIN_INIT
+    volatile long max_ms; //!< Longest handling time or MSG_MAX_INIT
+    volatile unsigned int histogram[MSG_HIST_BUCKETS]; //!< Handling time distribution, see message_stats_hist_index()
+} message_stats_entry;
+
+//! Fixed binary layout of the message statistics. Safe to place in shared memory:
+//! updates are lock-free and the structure contains no pointers.
+typedef struct message_stats_table_t {
+    volatile int enabled; //!< Stats are only collected when set
+    volatile long dropped; //!< Updates dropped because all slots are in use or a slot stayed claimed
+    message_stats_entry messages[MSG_STATS_MAX_MESSAGES];
+} message_stats_table;
+
 /*----------------------------------------------------------------------------*\
  |                                                                            |
  |                             EXPORTED VARIABLES                             |
@@ -128,26 +171,32 @@
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 
-//! Update stats for the message
+//! Update stats for the message. Lock-free, may be called concurrently from
+//! several threads or processes sharing the table.
 //! failed = 1 indicates the message was an error/failure
 //! failed = 0 indicates the message was a successful operation 
-int update_message_stats(json_object *stats_state, const char *message_name, int timing_ms, int failed);
+int update_message_stats(message_stats_table *stats_table, const char *message_name, long timing_ms, int failed);
 
-//Iterate through and reset all message metrics for next interval
-int reset_message_stats(json_object **stats_state);
+//! Reset all message metrics for next interval
+int reset_message_stats(message_stats_table *stats_table);
 
-//! Idempotently initialize the message sensor structures. Not threadsafe.
-int initialize_message_stats(json_object **stats_state);
+//! Initialize the message stats table: clears all message types and enables collection. Not threadsafe.
+int initialize_message_stats(message_stats_table *stats_table);
 
 //! Get the full set of current message stats as a json object.
-//! Output will be a new allocated structure independent of any state internal
-//! to the stats tracking
-//! @returns json object for give state string, or NULL if error or no string given
-json_object *get_message_stats_json(const char *message_stats_string);
-
-void enable_stats(json_object *stats_state);
-int is_enabled(json_object *stats_state);
-void disable_stats(json_object *stats_state);
+//! Output will be a new allocated structure independent of the table.
+//! If reset is set, the counters are atomically drained as they are read.
+//! @returns json object for the given table, or NULL on error
+json_object *get_message_stats_json(message_stats_table *stats_table, int reset);
+
+//! Histogram helpers. Histograms of the same layout are merged by adding their buckets
+int message_stats_hist_index(long timing_ms);
+long message_stats_hist_value(int index);
+long message_stats_percentile(const unsigned int *histogram, long total, double quantile);
+
+void enable_stats(message_stats_table *stats_table);
+int is_enabled(message_stats_table *stats_table);
+void disable_stats(message_stats_table *stats_table);
 
 
 /*----------------------------------------------------------------------------*\
@@ -86,6 +86,7 @@
 #include "message_sensor.h"
 #include "message_stats.h"
 #include "service_sensor.h"
+#include "counter_sensor.h"
 #include "fs_emitter.h"
 
 /*----------------------------------------------------------------------------*\
@@ -130,9 +131,12 @@ extern struct internal_sensor service_state_sensor; //from service_sensor.h
  |                                                                            |
 \*----------------------------------------------------------------------------*/
 #ifdef _UNIT_TEST
-json_object *test_msg_stats; //Stats obj for testing
+message_stats_table test_msg_stats; //Stats table for testing
 configEntry configEntryKeysRestart[] = { { "placeholderkey", "placeholderdefault" } }; //Not used but must have something here, cannot be zero
-configEntry configEntryKeysNoRestart[] = { {SENSOR_LIST_CONF_PARAM_NAME, SENSOR_LIST_CONF_PARAM_DEFAULT} };
+configEntry configEntryKeysNoRestart[] = { {SENSOR_LIST_CONF_PARAM_NAME, SENSOR_LIST_CONF_PARAM_DEFAULT},
+                                           {OUTPUT_MODE_CONFIG_NAME, OUTPUT_MODE_CONFIG_DEFAULT},
+                                           {OUTPUT_MAX_BYTES_CONFIG_NAME, OUTPUT_MAX_BYTES_CONFIG_DEFAULT},
+                                           {NULL, NULL} };
 #endif
 
 /*----------------------------------------------------------------------------*\
@@ -162,7 +166,7 @@ static int test_sensor_registration();
 static int test_stats_run(const char *config_file);
 static char *testing_service_state_call();
 static char *testing_service_state_call();
-static json_object **test_get_msg_stats();
+static message_stats_table *test_get_msg_stats();
 #endif
 
 /*----------------------------------------------------------------------------*\
@@ -289,6 +293,12 @@ int internal_sensor_pass(int return_on_fail) {
     }
     
  cleanup:
+    //Write out whatever the emitter batched during this pass
+    if(emitter_flush() != EUCA_OK) {
+        LOGERROR("Error flushing emitted sensor events\n");
+        ret = EUCA_ERROR;
+    }
+
     if(release_lock_fn != NULL) {
         release_lock_fn();
         LOGTRACE("Released lock for stats during sensor pass\n");
@@ -330,6 +340,14 @@ static int register_sensor_set() {
         LOGERROR("Error registering service state sensor\n");
     }
 
+    // only components that keep counters initialize this one
+    if(strlen(counter_sensor.config_name) > 0) {
+        LOGDEBUG("Registering counter sensor\n");
+        if(result += register_sensor(&counter_sensor) > 0) {
+            LOGERROR("Error registering counter sensor\n");
+        }
+    }
+
     return result;
 }
 
@@ -557,14 +575,10 @@ int flush_sensor_registry() {
 
 //! ***********UNIT TESTS ****************
 #ifdef _UNIT_TEST
-static json_object **test_get_msg_stats() {
+static message_stats_table *test_get_msg_stats() {
     return &test_msg_stats;
 }
 
-static void test_set_msg_stats() {
-    return;
-}
-
 void print_header(const char* name) {
     LOGINFO("\n\n***** Running test %s *****\n", name);
 }
@@ -612,7 +626,7 @@ static int test_stats_run(const char *config_file_path) {
     LOGDEBUG("Done with config file checks\n");
 
     flush_sensor_registry(); //just to be sure from other tests
-    initialize_message_sensor("testservice", 60, 60, test_get_msg_stats, test_set_msg_stats);
+    initialize_message_sensor("testservice", 60, 60, test_get_msg_stats);
     initialize_service_state_sensor("testservice", 60, 60, state_call, check_call);
 
     if(init_stats(test_home, "testservice", test_lock, test_unlock) != EUCA_OK) {
@@ -623,9 +637,9 @@ static int test_stats_run(const char *config_file_path) {
 
     LOGINFO("Setting some message stats and doing an internal run\n");
     //populate some stats for the message stats
-    update_message_stats(test_msg_stats, "fakemessage", 500, 0);
-    update_message_stats(test_msg_stats, "fakemessageDescribe", 250, 0);
-    update_message_stats(test_msg_stats, "fakemessageRun", 200, 0);
+    update_message_stats(&test_msg_stats, "fakemessage", 500, 0);
+    update_message_stats(&test_msg_stats, "fakemessageDescribe", 250, 0);
+    update_message_stats(&test_msg_stats, "fakemessageRun", 200, 0);
 
     int ret = internal_sensor_pass(TRUE);
     flush_sensor_registry();